@@ -0,0 +1,446 @@
+"""Command a fleet of primary mirror controllers in parallel.
+
+Each controller gets its own asyncio connection. A fleet command is sent to
+every node before any reply is waited for, and requests on one connection are
+pipelined: a request registers for the reply keys it expects before it is
+sent, so any number can be in flight and replies are matched to them in
+order. Messages nobody is waiting for (MovePreempted, Saturated, FanStalled,
+pushed metrics, late replies) are kept as the node's events. A rejected
+command never completes, so apply_map() fails that node instead.
+
+Every reply is timed from its request being sent. For moves and homing that is
+the time to MoveComplete or HomingComplete, so latency_report() gives the
+per-node command latency and completion time side by side.
+
+For moves that have to start together, sync_clocks() runs the ClockSync
+exchange with every node (see include/clock_sync.h) and apply_map(...,
+execute_at=T) has each node hold its move until fleet time T. Fleet time is
+the host's clock, wall time in us unless another clock is given. A node
+drops a schedule that has no command by T and reports ScheduleExpired.
+clock_report() lists each node's fitted offset, skew and residual.
+
+Usage:
+    python pmc_fleet.py --simulate 20 --time-scale 0.05
+    python pmc_fleet.py --simulate 20 --sync --jitter 0.002
+    python pmc_fleet.py --nodes 192.168.121.177:4500 192.168.121.178:4500 --home
+"""
+
+import argparse
+import asyncio
+import collections
+import json
+import random
+import statistics
+import sys
+import time
+
+HANDSHAKE_REQUEST = 0xDEAD
+HANDSHAKE_REPLY = 0xBEEF
+ABSOLUTE = 0
+RELATIVE = 1
+
+NodeResult = collections.namedtuple('NodeResult', ['ok', 'latency_s', 'reply', 'error'])
+
+
+class FleetResult(dict):
+    """NodeResult per node name."""
+
+    @property
+    def ok(self):
+        return all(result.ok for result in self.values())
+
+    def failed(self):
+        return sorted(name for name, result in self.items() if not result.ok)
+
+
+def unwrap(message):
+    """Strips single-key wrappers such as {"PMCMessage": {...}} off a reply."""
+    while isinstance(message, dict) and len(message) == 1:
+        (value,) = message.values()
+        if not isinstance(value, dict):
+            break
+        message = value
+    return message
+
+
+class MirrorNode:
+    def __init__(self, name, host, port):
+        self.name = name
+        self.host = host
+        self.port = port
+        self.reader = None
+        self.writer = None
+        self.read_task = None
+        self.waiters = collections.defaultdict(collections.deque)  # reply key -> (future, sent, op)
+        self.latencies = collections.defaultdict(list)  # op -> seconds
+        self.events = []  # (monotonic time, message)
+        self.homing_required = None
+        self.min_rtt_us = None
+        self.clock_stats = {}
+
+    async def connect(self, timeout=5.0):
+        self.reader, self.writer = await asyncio.wait_for(asyncio.open_connection(self.host, self.port), timeout)
+        self.read_task = asyncio.ensure_future(self._read_loop())
+        reply = await asyncio.wait_for(self.request({'Handshake': HANDSHAKE_REQUEST}, {'Handshake': 'handshake'})
+                                       ['Handshake'], timeout)
+        if reply.get('Handshake') != HANDSHAKE_REPLY:
+            raise ConnectionError('Bad handshake reply %r' % reply)
+        self.homing_required = reply.get('HomingRequired')
+        return reply
+
+    async def close(self):
+        if self.writer is not None:
+            self.writer.close()
+        if self.read_task is not None:
+            self.read_task.cancel()
+            try:
+                await self.read_task
+            except asyncio.CancelledError:
+                pass
+
+    def request(self, fields, replies):
+        """Sends one PMCMessage without waiting. replies maps each reply key to
+        expect to the name its latency is recorded under. Returns a future per key."""
+        if self.writer is None or self.writer.is_closing():
+            raise ConnectionError('%s is not connected' % self.name)
+        loop = asyncio.get_running_loop()
+        sent = time.monotonic()
+        futures = {}
+        for key, op in replies.items():
+            futures[key] = loop.create_future()
+            self.waiters[key].append((futures[key], sent, op))
+        self.writer.write(json.dumps({'PMCMessage': fields}).encode('utf-8'))
+        return futures
+
+    def forget(self, key, future):
+        """Drops a reply that is never going to come, e.g. MoveReleased for a refused ExecuteAt."""
+        queue = self.waiters.get(key, ())
+        for entry in list(queue):
+            if entry[0] is future:
+                queue.remove(entry)
+                future.cancel()
+
+    def _dispatch(self, message):
+        now = time.monotonic()
+        matched = False
+        for key in message:
+            queue = self.waiters.get(key)
+            if not queue:
+                continue
+            # A request that timed out still owns its reply, so later requests stay in step
+            future, sent, op = queue.popleft()
+            if not future.done():
+                self.latencies[op].append(now - sent)
+                future.set_result(message)
+                matched = True
+        # A preempted move never completes, the move that replaced it does
+        if 'MovePreempted' in message and len(self.waiters.get('MoveComplete', ())) > 1:
+            future, _, _ = self.waiters['MoveComplete'].popleft()
+            if not future.done():
+                future.set_result(message)
+        # Neither does a rejected command. It is the newest one, any move still
+        # running ahead of it completes as usual.
+        if message.get('CommandRejected') and self.waiters.get('MoveComplete'):
+            future, _, _ = self.waiters['MoveComplete'].pop()
+            if not future.done():
+                future.set_result(message)
+        if not matched:
+            self.events.append((now, message))
+
+    async def _read_loop(self):
+        decoder = json.JSONDecoder()
+        buffer = ''
+        try:
+            while True:
+                data = await self.reader.read(4096)
+                if not data:
+                    break
+                buffer += data.decode('utf-8', errors='replace')
+                while True:
+                    start = buffer.find('{')
+                    if start < 0:
+                        buffer = ''
+                        break
+                    try:
+                        message, end = decoder.raw_decode(buffer, start)
+                    except json.JSONDecodeError:
+                        buffer = buffer[start:]
+                        break
+                    buffer = buffer[end:]
+                    self._dispatch(unwrap(message))
+        finally:
+            for queue in self.waiters.values():
+                while queue:
+                    future, _, _ = queue.popleft()
+                    if not future.done():
+                        future.set_exception(ConnectionError('%s disconnected' % self.name))
+
+
+def wall_clock_us():
+    return time.time_ns() // 1000
+
+
+class Fleet:
+    def __init__(self, nodes, clock=wall_clock_us):
+        self.nodes = {node.name: node for node in nodes}
+        self.clock = clock
+
+    def subset(self, names):
+        return Fleet([self.nodes[name] for name in names], self.clock)
+
+    @classmethod
+    def from_addresses(cls, addresses, default_port=4500):
+        """Nodes from "host" or "host:port" strings, named after the address."""
+        nodes = []
+        for address in addresses:
+            host, _, port = address.partition(':')
+            nodes.append(MirrorNode(address, host, int(port) if port else default_port))
+        return cls(nodes)
+
+    async def _each(self, action, timeout):
+        """Runs action(node) on every node at once, one node failing doesn't hold up the rest."""
+
+        async def run(node):
+            started = time.monotonic()
+            try:
+                reply = await asyncio.wait_for(action(node), timeout)
+                return NodeResult(True, time.monotonic() - started, reply, None)
+            except (asyncio.TimeoutError, ConnectionError, OSError, ValueError) as err:
+                return NodeResult(False, time.monotonic() - started, None, repr(err) if str(err) == '' else str(err))
+
+        names = list(self.nodes)
+        results = await asyncio.gather(*(run(self.nodes[name]) for name in names))
+        return FleetResult(zip(names, results))
+
+    async def connect(self, timeout=5.0):
+        return await self._each(lambda node: node.connect(timeout), timeout)
+
+    async def close(self):
+        await asyncio.gather(*(node.close() for node in self.nodes.values()))
+
+    async def broadcast(self, fields, reply_key, op=None, timeout=5.0):
+        """Sends the same message to every node and waits for reply_key from each."""
+
+        async def action(node):
+            return await node.request(fields, {reply_key: op or reply_key})[reply_key]
+
+        return await self._each(action, timeout)
+
+    async def enable(self, enabled=True, timeout=5.0):
+        return await self.broadcast({'EnableSteppers': enabled}, 'SteppersEnabled', 'enable', timeout)
+
+    async def stop(self, timeout=5.0):
+        return await self.broadcast({'Stop': 0}, 'Stopped', 'stop', timeout)
+
+    async def status(self, timeout=5.0):
+        return await self.broadcast({'GetStatus': 0}, 'HomingRequired', 'status', timeout)
+
+    async def positions(self, timeout=5.0):
+        return await self.broadcast({'GetPositions': 0}, 'APosition', 'positions', timeout)
+
+    async def home(self, speed, fast=False, timeout=120.0):
+        """Homes every node, finishing when the last HomingComplete is in."""
+        command = 'FindHomeFast' if fast else 'FindHome'
+
+        async def action(node):
+            futures = node.request({command: speed}, {command: 'home_ack', 'HomingComplete': 'home'})
+            await futures[command]
+            return await futures['HomingComplete']
+
+        return await self._each(action, timeout)
+
+    async def sync_clocks(self, rounds=8, interval_s=0.02, timeout=5.0):
+        """ClockSync exchanges with every node. Each sample is stamped with the fleet
+        time plus half the node's smallest round trip so far, its best estimate of the
+        one-way delay. The reply is the node's fit after the last round."""
+
+        async def action(node):
+            reply = None
+            for _ in range(rounds):
+                path_delay = node.min_rtt_us // 2 if node.min_rtt_us is not None else 0
+                sent = self.clock()
+                reply = await node.request({'ClockSync': sent + path_delay}, {'ClockSync': 'clock_sync'})['ClockSync']
+                rtt = self.clock() - sent
+                node.min_rtt_us = rtt if node.min_rtt_us is None else min(node.min_rtt_us, rtt)
+                await asyncio.sleep(interval_s)
+            node.clock_stats = dict(reply, MinRtt_us=node.min_rtt_us)
+            return node.clock_stats
+
+        return await self._each(action, timeout + rounds * interval_s)
+
+    async def apply_map(self, poses, relative=False, execute_at=None, timeout=60.0):
+        """Moves each node in poses (name -> (tip_urad, tilt_urad, focus), relative moves
+        may leave focus out) and waits for them all to arrive. Nodes not in poses are left
+        alone. With execute_at (fleet time, us) the nodes hold their moves until then,
+        the reply includes the node's ReleaseError_us."""
+
+        async def action(node):
+            pose = poses[node.name]
+            if len(pose) < 3 and not relative:
+                raise ValueError('Absolute moves need tip, tilt and focus')
+            # A mode change drops a pending schedule, so the mode goes first
+            fields = {'MoveType': RELATIVE if relative else ABSOLUTE}
+            replies = {'MoveComplete': 'move'}
+            if execute_at is not None:
+                # Then the schedule, it holds the command that follows it
+                fields['ExecuteAt'] = execute_at
+                replies = {'ExecuteAt': 'schedule', 'MoveReleased': 'release', 'MoveComplete': 'move'}
+            fields.update({'SetTip': pose[0], 'SetTilt': pose[1]})
+            if len(pose) > 2:
+                fields['SetFocus'] = pose[2]
+            futures = node.request(fields, replies)
+            reply = {}
+            if execute_at is not None:
+                scheduled = await futures['ExecuteAt']
+                if scheduled.get('ExecuteAt') != '$OK^':
+                    # Not held, so the move runs as soon as it arrives
+                    node.forget('MoveReleased', futures['MoveReleased'])
+                    raise ValueError('ExecuteAt refused: %s' % scheduled.get('ExecuteAt'))
+                reply.update(await futures['MoveReleased'])
+                if reply.get('ScheduleExpired'):
+                    # The command wasn't there by the release time, it runs unscheduled if at all
+                    node.forget('MoveComplete', futures['MoveComplete'])
+                    raise ValueError('ExecuteAt expired before the command arrived')
+            reply.update(await futures['MoveComplete'])
+            if 'MovePreempted' in reply:
+                raise ValueError('Preempted by a later move')
+            if reply.get('CommandRejected'):
+                raise ValueError('Command rejected, out of range')
+            return reply
+
+        return await self.subset(poses)._each(action, timeout)
+
+    def events(self):
+        """Unsolicited messages from every node, oldest first, as (time, node name, message)."""
+        merged = [(t, name, message) for name, node in self.nodes.items() for t, message in node.events]
+        return sorted(merged, key=lambda event: event[0])
+
+    def clock_report(self):
+        """Rows of (node, offset_us, skew_ppm, residual_us, samples, min_rtt_us) from the last sync."""
+        rows = []
+        for name, node in self.nodes.items():
+            stats = node.clock_stats
+            if stats:
+                rows.append((name, stats['ClockOffset_us'], stats['ClockSkew_ppm'], stats['ClockResidual_us'],
+                             stats['ClockSamples'], stats['MinRtt_us']))
+        return rows
+
+    def latency_report(self):
+        """Rows of (node, op, count, min, median, p95, max) with times in ms."""
+        rows = []
+        for name, node in self.nodes.items():
+            for op, samples in sorted(node.latencies.items()):
+                ordered = sorted(samples)
+                p95 = ordered[min(len(ordered) - 1, int(0.95 * len(ordered)))]
+                rows.append((name, op, len(ordered), 1e3 * ordered[0], 1e3 * statistics.median(ordered),
+                             1e3 * p95, 1e3 * ordered[-1]))
+        return rows
+
+
+def print_result(label, result):
+    worst = max((r.latency_s for r in result.values()), default=0.0)
+    print('%-10s %d/%d ok, slowest %.1f ms' % (label, len(result) - len(result.failed()), len(result), 1e3 * worst))
+    for name in result.failed():
+        print('    %s: %s' % (name, result[name].error))
+
+
+def print_latency_report(fleet):
+    print('%-22s %-10s %5s %9s %9s %9s %9s' % ('node', 'op', 'n', 'min_ms', 'med_ms', 'p95_ms', 'max_ms'))
+    for row in fleet.latency_report():
+        print('%-22s %-10s %5d %9.2f %9.2f %9.2f %9.2f' % row)
+
+
+def print_clock_report(fleet):
+    print('%-22s %14s %9s %11s %7s %10s' % ('node', 'offset_us', 'skew_ppm', 'residual_us', 'samples', 'min_rtt_us'))
+    for row in fleet.clock_report():
+        print('%-22s %14.0f %9.2f %11.1f %7d %10d' % row)
+
+
+async def exercise(fleet, args, simulators=()):
+    """Connects, optionally homes, then steps through random tip/tilt maps and back to zero.
+    With sync, the maps are released at a common time and the spread is checked."""
+    results = [('connect', await fleet.connect(args.timeout))]
+    fleet = fleet.subset([name for name, result in results[0][1].items() if result.ok])
+    results.append(('enable', await fleet.enable(True, args.timeout)))
+    if args.home:
+        results.append(('home', await fleet.home(args.home_speed, timeout=args.move_timeout)))
+    if args.sync:
+        results.append(('sync', await fleet.sync_clocks(args.sync_rounds, timeout=args.timeout)))
+    rng = random.Random(args.seed)
+    spreads = []
+    for step in range(args.maps):
+        poses = {name: (rng.uniform(-args.span, args.span), rng.uniform(-args.span, args.span), 0.0)
+                 for name in fleet.nodes}
+        execute_at = fleet.clock() + int(args.lead * 1e6) if args.sync else None
+        result = await fleet.apply_map(poses, execute_at=execute_at, timeout=args.move_timeout)
+        results.append(('map %d' % step, result))
+        if execute_at is not None:
+            errors = [r.reply['ReleaseError_us'] for r in result.values() if r.ok]
+            print('map %d released, local error %.0f..%.0f us' % (step, min(errors, default=0), max(errors, default=0)))
+            released = [sim.release_true_us for sim in simulators if sim.name in fleet.nodes]
+            if released:
+                spreads.append(max(released) - min(released))
+                print('map %d true release spread %d us' % (step, spreads[-1]))
+    results.append(('zero', await fleet.apply_map({name: (0.0, 0.0, 0.0) for name in fleet.nodes},
+                                                  timeout=args.move_timeout)))
+    results.append(('status', await fleet.status(args.timeout)))
+    for label, result in results:
+        print_result(label, result)
+    print_latency_report(fleet)
+    if args.sync:
+        print_clock_report(fleet)
+    for t, name, message in fleet.events():
+        print('event %s: %s' % (name, json.dumps(message)))
+    await fleet.close()
+    if spreads and max(spreads) > args.max_spread:
+        print('Release spread over %d us' % args.max_spread)
+        return False
+    return all(result.ok for _, result in results)
+
+
+async def run(args):
+    simulators = []
+    if args.simulate:
+        import pmc_simulator
+        # The host keeps true time, the simulated controllers' clocks are offset and skewed from it
+        clock = pmc_simulator.VirtualClock()
+        simulators, ports = await pmc_simulator.start_simulators(args.simulate, clock=clock,
+                                                                 time_scale=args.time_scale,
+                                                                 reply_delay_s=args.reply_delay, jitter_s=args.jitter)
+        fleet = Fleet([MirrorNode(sim.name, '127.0.0.1', port) for sim, port in zip(simulators, ports)], clock.now_us)
+    else:
+        fleet = Fleet.from_addresses(args.nodes, args.port)
+    try:
+        return await exercise(fleet, args, simulators)
+    finally:
+        for simulator in simulators:
+            await simulator.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument('--nodes', nargs='+', help='Controller addresses, host or host:port')
+    target.add_argument('--simulate', type=int, help='Run against this many local simulated controllers')
+    parser.add_argument('--port', type=int, default=4500, help='Port for addresses without one')
+    parser.add_argument('--home', action='store_true', help='Home every node first')
+    parser.add_argument('--home-speed', type=float, default=100.0)
+    parser.add_argument('--maps', type=int, default=3, help='Random tip/tilt maps to step through')
+    parser.add_argument('--span', type=float, default=500.0, help='Largest tip/tilt in the maps, urad')
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--sync', action='store_true', help='Sync clocks and release each map at a common time')
+    parser.add_argument('--sync-rounds', type=int, default=8)
+    parser.add_argument('--lead', type=float, default=0.5, help='How far ahead scheduled maps are released, s')
+    parser.add_argument('--max-spread', type=int, default=1000,
+                        help='Largest simulated release spread that passes, us')
+    parser.add_argument('--timeout', type=float, default=5.0, help='Reply timeout, s')
+    parser.add_argument('--move-timeout', type=float, default=120.0, help='Move and homing timeout, s')
+    parser.add_argument('--time-scale', type=float, default=0.05, help='Simulated motion time multiplier')
+    parser.add_argument('--reply-delay', type=float, default=0.0, help='Simulated reply delay, s')
+    parser.add_argument('--jitter', type=float, default=0.0, help='Simulated random extra reply delay, s')
+    args = parser.parse_args()
+    return 0 if asyncio.run(run(args)) else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,403 @@
+"""Simulated primary mirror controllers for exercising host software without hardware.
+
+Each simulated controller listens on its own TCP port and speaks the same
+protocol as the firmware: {"PMCMessage": {...}} commands in, JSON replies out,
+with the keys handled in the order they appear in a message. Only the motion
+side is modelled:
+
+- Handshake(0xDEAD), EnableSteppers, MoveType (0 absolute, 1 relative),
+  SetTip/SetTilt (urad), SetFocus, Stop, GetStatus, GetPositions, FindHome,
+  FindHomeFast, ClockSync and ExecuteAt. Anything else is ignored.
+- As on the firmware, an absolute move starts once SetTip, SetTilt and
+  SetFocus have all been received, and a relative move starts on any of them.
+- Targets go through the same linear kinematics as include/mirror_kinematics.h.
+  A move takes as long as the actuator with the furthest to go needs at the
+  default speed and acceleration, then MoveComplete is sent.
+- A new target during a move preempts it (MovePreempted), as on the firmware.
+- Homing takes a fixed time, then HomingComplete is sent.
+- ClockSync and ExecuteAt work as in include/clock_sync.h. All the
+  controllers in a process share one VirtualClock for true time, and each
+  has its own local clock running from a random offset at a random skew. A
+  scheduled move is released on the first control tick at or after its
+  local release time, and the true time of that tick is kept in
+  release_true_us so tests can see how closely a fleet started together.
+
+Workspace limits, TRACK/JOG modes, traces and parameters are not modelled.
+time_scale shortens every move and homing run, so a fleet test doesn't have
+to wait for the real motion. It doesn't affect the clocks.
+
+Usage:
+    python pmc_simulator.py --count 20 --base-port 4500 --time-scale 0.05
+"""
+
+import argparse
+import asyncio
+import collections
+import json
+import math
+import random
+import sys
+import time
+
+MICRON_PER_STEP = 3.175 / 16
+STEPS_PER_MM = 1000.0 / MICRON_PER_STEP
+STROKE_BOTTOM_STEPS = -0.5 * int(12700.0 / MICRON_PER_STEP)
+TIP_GAIN = (281.3 * STEPS_PER_MM, -140.6 * STEPS_PER_MM, -140.6 * STEPS_PER_MM)
+TILT_GAIN = (0.0, 243.6 * STEPS_PER_MM, -243.6 * STEPS_PER_MM)
+RAD_PER_URAD = 1e-6
+
+STEPPER_MAX_SPEED = 2400.0
+STEPPER_MAX_ACCEL = 2000.0
+HOMING_TIME_S = 20.0
+HANDSHAKE_REQUEST = 0xDEAD
+HANDSHAKE_REPLY = 0xBEEF
+TICK_US = 100  # UPDATE_PRD_US
+
+CLOCK_SYNC_WINDOW = 16
+CLOCK_SYNC_MIN_SAMPLES = 4
+CLOCK_SYNC_SKEW_SPAN_US = 10000000
+CLOCK_SYNC_MAX_SKEW = 200e-6
+CLOCK_SYNC_MAX_AGE_US = 300000000
+SCHEDULE_MAX_LEAD_US = 60000000
+MAX_CLOCK_OFFSET_US = 3600000000
+MAX_CLOCK_SKEW_PPM = 50.0
+
+ABSOLUTE = 0
+RELATIVE = 1
+
+
+def pose_to_steps(tip_rad, tilt_rad, focus):
+    """Actuator step targets for a pose (MirrorStates::getMotorStepTargets, no saturation)."""
+    tan_tip = math.tan(tip_rad)
+    tan_tilt = math.tan(tilt_rad) / math.cos(tip_rad)
+    return [STEPS_PER_MM * focus + TIP_GAIN[ii] * tan_tip + TILT_GAIN[ii] * tan_tilt for ii in range(3)]
+
+
+def move_duration(distance, speed=STEPPER_MAX_SPEED, accel=STEPPER_MAX_ACCEL):
+    """Rest to rest time over distance steps with a trapezoidal profile."""
+    distance = abs(distance)
+    if distance < speed * speed / accel:
+        return 2.0 * math.sqrt(distance / accel)
+    return distance / speed + speed / accel
+
+
+class VirtualClock:
+    """True time in us, shared by the host and every simulated controller."""
+
+    def __init__(self, epoch_us=None):
+        self.epoch_us = time.time_ns() // 1000 if epoch_us is None else epoch_us
+        self.start = time.monotonic()
+
+    def now_us(self):
+        return self.epoch_us + int((time.monotonic() - self.start) * 1e6)
+
+    def seconds_until(self, true_us):
+        return max((true_us - self.now_us()) * 1e-6, 0.0)
+
+
+class ClockSync:
+    """Same fit as include/clock_sync.h: a line through (host, local - host)
+    over the last CLOCK_SYNC_WINDOW samples."""
+
+    def __init__(self):
+        self.samples = collections.deque(maxlen=CLOCK_SYNC_WINDOW)
+        self.intercept = 0.0
+        self.slope = 0.0
+        self.residual = 0.0
+
+    def add_sample(self, host_us, local_us):
+        if self.samples and local_us - self.samples[-1][1] >= CLOCK_SYNC_MAX_AGE_US:
+            self.samples.clear()
+        self.samples.append((host_us, local_us))
+        host_ref, local_ref = host_us, local_us
+        x = [h - host_ref for h, _ in self.samples]
+        y = [(l - local_ref) - dx for (_, l), dx in zip(self.samples, x)]
+        n = len(x)
+        sx, sy = sum(x), sum(y)
+        sxx = sum(v * v for v in x)
+        sxy = sum(a * b for a, b in zip(x, y))
+        denom = n * sxx - sx * sx
+        fit_skew = host_ref - min(h for h, _ in self.samples) >= CLOCK_SYNC_SKEW_SPAN_US and denom > 0
+        self.slope = (n * sxy - sx * sy) / denom if fit_skew else 0.0
+        self.slope = min(max(self.slope, -CLOCK_SYNC_MAX_SKEW), CLOCK_SYNC_MAX_SKEW)
+        self.intercept = (sy - self.slope * sx) / n
+        self.residual = math.sqrt(sum((b - self.intercept - self.slope * a) ** 2 for a, b in zip(x, y)) / n)
+
+    def is_synced(self, local_now_us):
+        return (len(self.samples) >= CLOCK_SYNC_MIN_SAMPLES
+                and local_now_us - self.samples[-1][1] < CLOCK_SYNC_MAX_AGE_US)
+
+    def to_local(self, host_us):
+        host_ref, local_ref = self.samples[-1]
+        dx = host_us - host_ref
+        return local_ref + round(dx + self.intercept + self.slope * dx)
+
+    def offset_us(self):
+        host_ref, local_ref = self.samples[-1] if self.samples else (0, 0)
+        return local_ref - host_ref + self.intercept
+
+
+class SimulatedController:
+    def __init__(self, name, clock=None, time_scale=1.0, reply_delay_s=0.0, jitter_s=0.0, seed=None):
+        self.name = name
+        self.time_scale = time_scale
+        self.reply_delay_s = reply_delay_s
+        self.jitter_s = jitter_s
+        self.rng = random.Random(seed)
+        self.clock = clock if clock is not None else VirtualClock()
+        self.local_offset_us = self.rng.randint(0, MAX_CLOCK_OFFSET_US)
+        self.skew_ppm = self.rng.uniform(-MAX_CLOCK_SKEW_PPM, MAX_CLOCK_SKEW_PPM)
+        self.tick_phase_us = self.rng.randrange(TICK_US)
+        self.clock_sync = ClockSync()
+        self.release_at_local = None
+        self.release_task = None
+        self.release_true_us = None
+        self.enabled = False
+        self.homing_required = True
+        self.mode = ABSOLUTE
+        self.pose = [0.0, 0.0, 0.0]  # tip (rad), tilt (rad), focus
+        self.shadow = [0.0, 0.0, 0.0]  # Commanded pose, latched once a whole command is in
+        self.updated = [False, False, False]
+        self.positions = [0.0, 0.0, 0.0]
+        self.move = None  # (start positions, end positions, start time, duration)
+        self.task = None
+        self.writer = None
+        self.server = None
+
+    async def start(self, host, port):
+        self.server = await asyncio.start_server(self._serve, host, port)
+        return self.server.sockets[0].getsockname()[1]
+
+    def local_us(self, true_us=None):
+        """This controller's clock at a true time (now by default)."""
+        true_us = self.clock.now_us() if true_us is None else true_us
+        elapsed = true_us - self.clock.epoch_us
+        return self.local_offset_us + round(elapsed * (1.0 + self.skew_ppm * 1e-6))
+
+    def true_us(self, local_us):
+        return self.clock.epoch_us + round((local_us - self.local_offset_us) / (1.0 + self.skew_ppm * 1e-6))
+
+    async def close(self):
+        for task in (self.task, self.release_task):
+            if task is not None:
+                task.cancel()
+        if self.server is not None:
+            self.server.close()
+            await self.server.wait_closed()
+
+    async def _serve(self, reader, writer):
+        # The firmware talks to one client at a time, a new connection takes over
+        self.writer = writer
+        decoder = json.JSONDecoder()
+        buffer = ''
+        try:
+            while True:
+                data = await reader.read(4096)
+                if not data:
+                    break
+                buffer += data.decode('utf-8', errors='replace')
+                while True:
+                    start = buffer.find('{')
+                    if start < 0:
+                        buffer = ''
+                        break
+                    try:
+                        message, end = decoder.raw_decode(buffer, start)
+                    except json.JSONDecodeError:
+                        buffer = buffer[start:]
+                        break
+                    buffer = buffer[end:]
+                    await self._handle(message.get('PMCMessage', {}))
+        except (ConnectionError, asyncio.CancelledError):
+            pass
+        finally:
+            if self.writer is writer:
+                self.writer = None
+            writer.close()
+
+    async def _send(self, **fields):
+        if self.writer is None:
+            return
+        delay = self.reply_delay_s + self.rng.uniform(0.0, self.jitter_s)
+        if delay > 0.0:
+            await asyncio.sleep(delay)
+        if self.writer is not None:
+            self.writer.write(json.dumps({'PMCMessage': fields}).encode('utf-8'))
+            await self.writer.drain()
+
+    async def _handle(self, message):
+        for key, value in message.items():
+            if key == 'Handshake':
+                if value == HANDSHAKE_REQUEST:
+                    await self._send(Handshake=HANDSHAKE_REPLY, HomingRequired=self.homing_required)
+            elif key == 'EnableSteppers':
+                self.enabled = bool(value)
+                await self._send(SteppersEnabled=self.enabled)
+            elif key == 'MoveType':
+                # A schedule armed in the old mode is dropped, as setControlMode() does
+                if int(value) != self.mode:
+                    self.release_at_local = None
+                self.mode = int(value)
+            elif key in ('SetTip', 'SetTilt', 'SetFocus'):
+                if not self.enabled:
+                    continue
+                axis = ('SetTip', 'SetTilt', 'SetFocus').index(key)
+                value = float(value) * (RAD_PER_URAD if axis < 2 else 1.0)
+                self.shadow[axis] = self.shadow[axis] + value if self.mode == RELATIVE else value
+                self.updated[axis] = True
+            elif key in ('FindHome', 'FindHomeFast'):
+                self._start_homing()
+                if key == 'FindHome':
+                    await self._send(FindHome='$OK^')
+                else:
+                    await self._send(FindHomeFast='$OK^', SeededHoming=False)
+            elif key == 'ClockSync':
+                self.clock_sync.add_sample(int(value), self.local_us())
+                await self._send(ClockSync=value, ClockOffset_us=self.clock_sync.offset_us(),
+                                 ClockSkew_ppm=self.clock_sync.slope * 1e6,
+                                 ClockResidual_us=self.clock_sync.residual,
+                                 ClockSamples=len(self.clock_sync.samples))
+            elif key == 'ExecuteAt':
+                status, lead_us = self._schedule(int(value))
+                await self._send(ExecuteAt=status, ExecuteIn_us=lead_us)
+            elif key == 'Stop':
+                self._halt()
+                self.release_at_local = None
+                if self.release_task is not None:
+                    self.release_task.cancel()
+                await self._send(Stopped='$OK^')
+            elif key == 'GetStatus':
+                moving = self.task is not None and not self.task.done()
+                await self._send(**{'ARunning?': moving, 'BRunning?': moving, 'CRunning?': moving,
+                                    'HomingRequired': self.homing_required,
+                                    'ClockSynced': self.clock_sync.is_synced(self.local_us()),
+                                    'ClockOffset_us': self.clock_sync.offset_us(),
+                                    'ClockSkew_ppm': self.clock_sync.slope * 1e6})
+            elif key == 'GetPositions':
+                positions = self._current_positions()
+                await self._send(APosition=positions[0], BPosition=positions[1], CPosition=positions[2])
+        # checkForNewCommand(): absolute moves need all three axes, relative any one
+        if any(self.updated) if self.mode == RELATIVE else all(self.updated):
+            self.updated = [False, False, False]
+            if self.release_at_local is not None:
+                release_at, self.release_at_local = self.release_at_local, None
+                self.release_task = asyncio.ensure_future(self._release(list(self.shadow), release_at))
+            else:
+                await self._start_move(list(self.shadow))
+
+    def _schedule(self, host_us):
+        now = self.local_us()
+        if not self.clock_sync.is_synced(now):
+            return 'NotSynced', 0
+        release_at = self.clock_sync.to_local(host_us)
+        lead_us = release_at - now
+        if lead_us < 0:
+            return 'TooLate', lead_us
+        if lead_us > SCHEDULE_MAX_LEAD_US:
+            return 'TooFar', lead_us
+        self.release_at_local = release_at
+        return '$OK^', lead_us
+
+    async def _release(self, target, release_at):
+        # First control tick at or after the local release time
+        due = self.true_us(release_at)
+        tick = due + (self.tick_phase_us - due) % TICK_US
+        while self.local_us(tick) < release_at:
+            tick += TICK_US
+        await asyncio.sleep(self.clock.seconds_until(tick))
+        self.release_true_us = tick
+        await self._start_move(target)
+        await self._send(MoveReleased=True, ReleaseError_us=self.local_us(tick) - release_at)
+
+    def _current_positions(self):
+        if self.move is None:
+            return [round(p) for p in self.positions]
+        start, end, started, duration = self.move
+        fraction = min((time.monotonic() - started) / duration, 1.0) if duration > 0.0 else 1.0
+        return [round(s + (e - s) * fraction) for s, e in zip(start, end)]
+
+    def _halt(self):
+        if self.task is not None and not self.task.done():
+            self.positions = [float(p) for p in self._current_positions()]
+            self.task.cancel()
+        self.move = None
+
+    async def _start_move(self, target):
+        if self.task is not None and not self.task.done():
+            abandoned = self.pose
+            self._halt()
+            await self._send(MovePreempted=True, AbandonedTip=abandoned[0] / RAD_PER_URAD,
+                             AbandonedTilt=abandoned[1] / RAD_PER_URAD, AbandonedFocus=abandoned[2])
+        self.pose = target
+        self.shadow = list(target)
+        end = pose_to_steps(*target)
+        duration = max(move_duration(e - s) for s, e in zip(self.positions, end)) * self.time_scale
+        self.move = (list(self.positions), end, time.monotonic(), duration)
+        self.task = asyncio.ensure_future(self._finish_move(end, duration))
+
+    async def _finish_move(self, end, duration):
+        await asyncio.sleep(duration)
+        self.positions = end
+        self.move = None
+        await self._send(MoveComplete=True)
+
+    def _start_homing(self):
+        self._halt()
+        end = [STROKE_BOTTOM_STEPS] * 3
+        duration = HOMING_TIME_S * self.time_scale
+        self.move = (list(self.positions), end, time.monotonic(), duration)
+        self.task = asyncio.ensure_future(self._finish_homing(end, duration))
+
+    async def _finish_homing(self, end, duration):
+        await asyncio.sleep(duration)
+        self.positions = end
+        self.pose = [0.0, 0.0, STROKE_BOTTOM_STEPS / STEPS_PER_MM]
+        self.shadow = list(self.pose)
+        self.move = None
+        self.homing_required = False
+        homing_ms = int(duration * 1000)
+        await self._send(HomingComplete=True, AHomingTime_ms=homing_ms, BHomingTime_ms=homing_ms,
+                         CHomingTime_ms=homing_ms)
+
+
+async def start_simulators(count, host='127.0.0.1', base_port=0, **kwargs):
+    """Starts count controllers. Returns them with their ports (base_port 0 picks free ports)."""
+    clock = kwargs.pop('clock', None) or VirtualClock()
+    controllers = []
+    ports = []
+    for ii in range(count):
+        controller = SimulatedController('pmc%02d' % ii, clock=clock, seed=ii, **kwargs)
+        ports.append(await controller.start(host, base_port + ii if base_port else 0))
+        controllers.append(controller)
+    return controllers, ports
+
+
+async def run(args):
+    controllers, ports = await start_simulators(args.count, args.host, args.base_port, time_scale=args.time_scale,
+                                                reply_delay_s=args.reply_delay, jitter_s=args.jitter)
+    print('%d simulated controllers on %s ports %s' % (len(ports), args.host, ', '.join(str(p) for p in ports)))
+    try:
+        await asyncio.Event().wait()
+    finally:
+        for controller in controllers:
+            await controller.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--count', type=int, default=1)
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--base-port', type=int, default=4500)
+    parser.add_argument('--time-scale', type=float, default=1.0, help='Motion time multiplier')
+    parser.add_argument('--reply-delay', type=float, default=0.0, help='Fixed reply delay, s')
+    parser.add_argument('--jitter', type=float, default=0.0, help='Random extra reply delay up to this, s')
+    args = parser.parse_args()
+    try:
+        asyncio.run(run(args))
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,195 @@
+"""Decode control tick traces dumped by the primary mirror controller.
+
+The controller answers DumpTrace with a series of replies carrying
+TraceChunk, TraceChunks and TraceData (base64 of a slice of the binary
+dump). The dump is a 24 byte header followed by 40 byte records, oldest
+first, all little endian (see include/trace_recorder.h).
+
+Usage:
+    python trace_decoder.py --host 192.168.121.177 --port 4500 -o trace.csv
+    python trace_decoder.py --log replies.txt -o trace.npy
+    python trace_decoder.py --bin trace.bin -o trace.csv
+"""
+
+import argparse
+import base64
+import csv
+import json
+import socket
+import struct
+import sys
+import zlib
+
+TRACE_MAGIC = 0x31435254  # "TRC1"
+TRACE_FORMAT_VERSION = 1
+TRACE_NO_TRIGGER = 0xFFFFFFFF
+HEADER_FORMAT = '<IHHIIHBBI'
+RECORD_FORMAT = '<I3i3i3hHHBB'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+MOVE_STATES = ['IDLE', 'NEW_MOVE_CMD', 'MOVE_IN_PROGRESS', 'MOVE_COMPLETE', 'LIMIT_SW_DETECT', 'HOMING_IS_ACTIVE',
+               'MICROSTEP_CHANGE', 'TRACKING', 'FINAL_APPROACH']
+TRIGGER_SOURCES = {0: 'none', 1: 'limit_switch', 2: 'move_interrupted', 4: 'command'}
+
+COLUMNS = ['tick', 'time_s',
+           'a_pos', 'b_pos', 'c_pos',
+           'a_target', 'b_target', 'c_target',
+           'a_speed', 'b_speed', 'c_speed',
+           'isr_us', 'move_state',
+           'a_homing', 'b_homing', 'c_homing',
+           'a_switch', 'b_switch', 'c_switch',
+           'a_switch_raw', 'b_switch_raw', 'c_switch_raw']
+
+
+def decode_dump(data):
+    """Returns (header dict, list of row tuples in COLUMNS order)."""
+    if len(data) < HEADER_SIZE:
+        raise ValueError('Dump is shorter than its header')
+    (magic, version, record_size, num_records, trigger_index,
+     tick_period_us, trigger_source, _, crc) = struct.unpack_from(HEADER_FORMAT, data)
+    if magic != TRACE_MAGIC:
+        raise ValueError('Not a trace dump (magic 0x%08X)' % magic)
+    if version != TRACE_FORMAT_VERSION or record_size != RECORD_SIZE:
+        raise ValueError('Unsupported trace format v%d, %d byte records' % (version, record_size))
+    body = data[HEADER_SIZE:HEADER_SIZE + num_records * RECORD_SIZE]
+    if len(body) != num_records * RECORD_SIZE:
+        raise ValueError('Dump is truncated: %d of %d records' % (len(body) // RECORD_SIZE, num_records))
+    if zlib.crc32(body) != crc:
+        raise ValueError('Trace CRC mismatch')
+
+    header = {
+        'num_records': num_records,
+        'trigger_index': None if trigger_index == TRACE_NO_TRIGGER else trigger_index,
+        'trigger_source': TRIGGER_SOURCES.get(trigger_source, trigger_source),
+        'tick_period_us': tick_period_us,
+    }
+    rows = []
+    t0 = None
+    for fields in struct.iter_unpack(RECORD_FORMAT, body):
+        tick = fields[0]
+        if t0 is None:
+            t0 = tick
+        homing, move_state, switches = fields[11], fields[12], fields[13]
+        rows.append((tick, ((tick - t0) & 0xFFFFFFFF) * tick_period_us * 1e-6)
+                    + fields[1:11]
+                    + (move_state,)
+                    + tuple((homing >> (3 * ii)) & 0x7 for ii in range(3))
+                    + tuple((switches >> ii) & 1 for ii in range(3))
+                    + tuple((switches >> (ii + 4)) & 1 for ii in range(3)))
+    return header, rows
+
+
+def iter_json_objects(text):
+    decoder = json.JSONDecoder()
+    idx = 0
+    while True:
+        start = text.find('{', idx)
+        if start < 0:
+            return
+        try:
+            obj, idx = decoder.raw_decode(text, start)
+        except json.JSONDecodeError:
+            idx = start + 1
+            continue
+        yield obj
+
+
+def find_chunk(obj):
+    """Finds a TraceChunk reply anywhere inside a decoded message."""
+    if isinstance(obj, dict):
+        if 'TraceChunk' in obj and 'TraceData' in obj:
+            return obj
+        for value in obj.values():
+            found = find_chunk(value)
+            if found is not None:
+                return found
+    return None
+
+
+def assemble_chunks(text):
+    chunks = {}
+    total = None
+    for obj in iter_json_objects(text):
+        chunk = find_chunk(obj)
+        if chunk is None:
+            continue
+        total = chunk['TraceChunks']
+        chunks[chunk['TraceChunk']] = base64.b64decode(chunk['TraceData'])
+    if total is None:
+        raise ValueError('No trace chunks found')
+    missing = [ii for ii in range(total) if ii not in chunks]
+    if missing:
+        raise ValueError('Missing %d of %d chunks (first %d)' % (len(missing), total, missing[0]))
+    return b''.join(chunks[ii] for ii in range(total))
+
+
+def fetch_dump(host, port, timeout=10.0):
+    """Asks the controller for its trace and collects the replies."""
+    client = socket.create_connection((host, port), timeout=timeout)
+    try:
+        client.send(b'{"PMCMessage":{"DumpTrace": 0}}')
+        received = ''
+        while True:
+            data = client.recv(4096)
+            if not data:
+                break
+            received += data.decode('utf-8', errors='replace')
+            try:
+                return assemble_chunks(received)
+            except ValueError:
+                continue
+    finally:
+        client.close()
+    return assemble_chunks(received)
+
+
+def write_csv(path, header, rows):
+    with open(path, 'w', newline='') as f:
+        f.write('# trigger_index=%s trigger_source=%s tick_period_us=%d\n'
+                % (header['trigger_index'], header['trigger_source'], header['tick_period_us']))
+        writer = csv.writer(f)
+        writer.writerow(COLUMNS)
+        writer.writerows(rows)
+
+
+def write_npy(path, header, rows):
+    import numpy as np
+    dtype = [(name, 'f8' if name == 'time_s' else 'i8') for name in COLUMNS]
+    np.save(path, np.array(rows, dtype=dtype))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument('--host', help='Controller address, sends DumpTrace')
+    source.add_argument('--log', help='Text file of captured DumpTrace replies')
+    source.add_argument('--bin', help='Raw binary dump')
+    parser.add_argument('--port', type=int, default=4500)
+    parser.add_argument('--save-bin', help='Also write the raw binary dump here')
+    parser.add_argument('-o', '--output', required=True, help='Output file, .csv or .npy')
+    args = parser.parse_args()
+
+    if args.host:
+        data = fetch_dump(args.host, args.port)
+    elif args.log:
+        with open(args.log) as f:
+            data = assemble_chunks(f.read())
+    else:
+        with open(args.bin, 'rb') as f:
+            data = f.read()
+    if args.save_bin:
+        with open(args.save_bin, 'wb') as f:
+            f.write(data)
+
+    header, rows = decode_dump(data)
+    if args.output.endswith('.npy'):
+        write_npy(args.output, header, rows)
+    else:
+        write_csv(args.output, header, rows)
+    print('%d records, trigger %s at index %s' % (header['num_records'], header['trigger_source'], header['trigger_index']))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,74 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Per-axis state of the three actuators, as one block
+@file axis_state.h
+
+Each field is an array indexed by motor (PMC::MOTOR_A..C), so the control tick
+walks one field for all three axes at a time and the whole block is a couple of
+cache lines. The controller owns the only live copy. It's plain data, so
+telemetry and persistence take a consistent snapshot by copying it with
+interrupts off.
+
+The position, target, speed and running fields are published from the stepper
+core at the end of every control tick. Everything else is the tick's own state.
+*/
+
+#ifndef AXIS_STATE_H
+#define AXIS_STATE_H
+
+#include <cstdint>
+#include <type_traits>
+
+constexpr uint8_t NUM_AXES = 3;
+
+struct AxisState
+{
+    // Published by the control tick, in reference microsteps
+    int32_t position[NUM_AXES];
+    int32_t target[NUM_AXES];
+    float speed[NUM_AXES]; // Driver steps/s
+    bool running[NUM_AXES];
+    uint32_t sequence; // Bumped on every publish, tells a fresh snapshot from a stale one
+
+    // Latest command, after projection onto the workspace
+    int32_t cmdSteps[NUM_AXES];
+
+    // Where motion outside a StepperCore move (blends, tracking, homing, the
+    // step generator) is taking each axis, in driver steps, and how fast
+    int32_t driveTarget[NUM_AXES];
+    float driveSpeed[NUM_AXES];
+    float stepRemainder[NUM_AXES]; // Part of a step velocity driving still owes
+
+    // Homing sequence, each axis runs its own copy
+    uint8_t homingState[NUM_AXES];
+    uint32_t homingStart_ms[NUM_AXES];
+    uint32_t homingPauseStart_ms[NUM_AXES];
+    uint32_t homingTime_ms[NUM_AXES];
+    int32_t homingRapidTarget[NUM_AXES]; // Seeded homing only, just above the endstop
+
+    // Debounced limit switches
+    bool limitFound[NUM_AXES];
+    uint8_t switchLevel[NUM_AXES];
+    uint32_t switchEdgesHandled[NUM_AXES];
+    uint32_t switchBounces[NUM_AXES];
+
+    void reset()
+    {
+        *this = AxisState();
+    }
+};
+static_assert(std::is_trivially_copyable<AxisState>::value, "AxisState snapshots are plain copies");
+
+#endif
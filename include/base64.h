@@ -0,0 +1,51 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Base64 encoding (RFC 4648) for sending binary blocks in JSON messages
+@file base64.h
+*/
+
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <cstdint>
+#include <cstddef>
+
+constexpr size_t base64EncodedLength(size_t len)
+{
+    return 4 * ((len + 2) / 3);
+}
+
+// Writes base64EncodedLength(len) characters plus a terminator to out
+inline size_t base64Encode(const uint8_t *in, size_t len, char *out)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t nn = 0;
+    for (size_t ii = 0; ii < len; ii += 3)
+    {
+        uint32_t word = (uint32_t)in[ii] << 16;
+        if (ii + 1 < len)
+            word |= (uint32_t)in[ii + 1] << 8;
+        if (ii + 2 < len)
+            word |= in[ii + 2];
+        out[nn++] = alphabet[(word >> 18) & 0x3F];
+        out[nn++] = alphabet[(word >> 12) & 0x3F];
+        out[nn++] = (ii + 1 < len) ? alphabet[(word >> 6) & 0x3F] : '=';
+        out[nn++] = (ii + 2 < len) ? alphabet[word & 0x3F] : '=';
+    }
+    out[nn] = '\0';
+    return nn;
+}
+
+#endif
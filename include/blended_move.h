@@ -0,0 +1,260 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Continuous-velocity transition to a new target
+@file blended_move.h
+
+Used when a command preempts a move in flight. Instead of jumping straight to
+the new move's speeds, each axis follows an acceleration-limited ramp from its
+current position and velocity to rest at the new target (stopping and coming
+back first if it is heading the wrong way or can't stop in time). The ramps are
+stretched to a common duration so all axes arrive together.
+
+The ramps are then smoothed with a moving average over a window of control
+ticks. Averaging an acceleration-limited profile over a window of W seconds
+bounds the jerk to 2 * accel / W, keeps speed and acceleration within their
+limits, and still ends exactly on the target, W seconds later. The window's
+history carries over when a blend is preempted again, so velocity and
+acceleration stay continuous across any number of retargets.
+
+Positions are in steps, the output is whole steps per control tick.
+*/
+
+#ifndef BLENDED_MOVE_H
+#define BLENDED_MOVE_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+constexpr uint8_t BLEND_AXES = 3;
+constexpr uint16_t BLEND_MAX_WINDOW_TICKS = 256;
+
+// Smoothing window that keeps jerk under maxJerk, in control ticks
+inline uint16_t blendWindowTicks(double maxAccel, double maxJerk, uint32_t period_us)
+{
+    double window = std::ceil(2.0 * maxAccel / (maxJerk * period_us * 1e-6));
+    return (uint16_t)std::min(std::max(window, 1.0), (double)BLEND_MAX_WINDOW_TICKS);
+}
+
+// Constant-acceleration segments from (p0, v0) to rest at the target
+class AxisRamp
+{
+public:
+    AxisRamp() : numSegments(0), startPos(0.0), startVel(0.0), target(0.0) {}
+
+    void plan(double p0, double v0, double targetPos, double cruise, double accel)
+    {
+        numSegments = 0;
+        startPos = p0;
+        startVel = v0;
+        target = targetPos;
+        double p = p0, v = v0;
+
+        // Heading away from the target, or too fast to stop before it: stop first
+        double dist = target - p;
+        if ((v != 0.0 && (dist == 0.0 || (v > 0.0) != (dist > 0.0))) || (v * v / (2 * accel) > std::fabs(dist)))
+        {
+            double dir = (v > 0.0) ? 1.0 : -1.0;
+            addSegment(std::fabs(v) / accel, -dir * accel);
+            p += dir * v * v / (2 * accel);
+            v = 0.0;
+            dist = target - p;
+        }
+        double dir = (dist >= 0.0) ? 1.0 : -1.0;
+        double u = std::fabs(v); // Speed towards the target
+        dist = std::fabs(dist);
+        if (u > cruise)
+        {
+            addSegment((u - cruise) / accel, -dir * accel);
+            dist -= (u * u - cruise * cruise) / (2 * accel);
+            u = cruise;
+        }
+        double peak = std::min(cruise, std::sqrt(std::max(accel * dist + 0.5 * u * u, 0.0)));
+        peak = std::max(peak, u);
+        addSegment((peak - u) / accel, dir * accel);
+        double cruiseDist = dist - (peak * peak - u * u) / (2 * accel) - peak * peak / (2 * accel);
+        if (peak > 0.0 && cruiseDist > 0.0)
+            addSegment(cruiseDist / peak, 0.0);
+        addSegment(peak / accel, -dir * accel);
+    }
+
+    double getDuration() const
+    {
+        double duration = 0.0;
+        for (uint8_t ii = 0; ii < numSegments; ii++)
+            duration += segments[ii].duration;
+        return duration;
+    }
+
+    void sample(double t, double *pos, double *vel) const
+    {
+        double p = startPos, v = startVel;
+        for (uint8_t ii = 0; ii < numSegments; ii++)
+        {
+            double dt = std::min(t, segments[ii].duration);
+            p += v * dt + 0.5 * segments[ii].accel * dt * dt;
+            v += segments[ii].accel * dt;
+            t -= dt;
+            if (t <= 0.0)
+            {
+                *pos = p;
+                *vel = v;
+                return;
+            }
+        }
+        *pos = target;
+        *vel = 0.0;
+    }
+
+private:
+    void addSegment(double duration, double accel)
+    {
+        if (duration > 0.0)
+            segments[numSegments++] = {duration, accel};
+    }
+
+    struct Segment
+    {
+        double duration;
+        double accel;
+    };
+    Segment segments[4];
+    uint8_t numSegments;
+    double startPos;
+    double startVel;
+    double target;
+};
+
+class BlendedMove
+{
+public:
+    BlendedMove() : window(1), head(0), tick(0), rampTicks(0), period_s(0.0)
+    {
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            sum[ii] = 0.0;
+            output[ii] = 0;
+            targets[ii] = 0;
+        }
+    }
+
+    // Starts from steady motion that isn't smoothed yet: position in steps,
+    // velocity in steps/s. The smoothing window's history is filled in as if
+    // that velocity had been held for a whole window.
+    void start(const int32_t *position, const double *velocity, const int32_t *target,
+               double maxSpeed, double maxAccel, uint16_t windowTicks, uint32_t period_us)
+    {
+        window = std::min(std::max(windowTicks, (uint16_t)1), BLEND_MAX_WINDOW_TICKS);
+        period_s = period_us * 1e-6;
+        head = 0;
+        double rampStart[BLEND_AXES];
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            // The average lags the ramp by half a window
+            double lead = velocity[ii] * period_s * (window - 1) / 2.0;
+            rampStart[ii] = position[ii] + lead;
+            sum[ii] = 0.0;
+            for (uint16_t jj = 0; jj < window; jj++)
+            {
+                history[ii][jj] = rampStart[ii] - velocity[ii] * period_s * (window - 1 - jj);
+                sum[ii] += history[ii][jj];
+            }
+            output[ii] = position[ii];
+        }
+        planRamps(rampStart, velocity, target, maxSpeed, maxAccel);
+    }
+
+    // New target from wherever the blend is now
+    void retarget(const int32_t *target, double maxSpeed, double maxAccel)
+    {
+        double pos[BLEND_AXES], vel[BLEND_AXES];
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+            ramps[ii].sample(tick * period_s, &pos[ii], &vel[ii]);
+        planRamps(pos, vel, target, maxSpeed, maxAccel);
+    }
+
+    bool isDone() const { return tick >= rampTicks + window - 1; }
+    uint32_t getTotalTicks() const { return rampTicks + window - 1; }
+    uint16_t getWindow() const { return window; }
+    int32_t getPosition(uint8_t axis) const { return output[axis]; }
+    double getSmoothedPosition(uint8_t axis) const { return isDone() ? targets[axis] : sum[axis] / window; }
+
+    // Whole steps for the next tick
+    void next(int32_t *steps)
+    {
+        if (isDone())
+        {
+            for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+                steps[ii] = 0;
+            return;
+        }
+        tick++;
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            double pos, vel;
+            ramps[ii].sample(tick * period_s, &pos, &vel);
+            sum[ii] += pos - history[ii][head];
+            history[ii][head] = pos;
+            int32_t newOutput = isDone() ? targets[ii] : (int32_t)std::lround(sum[ii] / window);
+            steps[ii] = newOutput - output[ii];
+            output[ii] = newOutput;
+        }
+        head = (head + 1) % window;
+    }
+
+private:
+    void planRamps(const double *pos, const double *vel, const int32_t *target, double maxSpeed, double maxAccel)
+    {
+        double duration = 0.0;
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            targets[ii] = target[ii];
+            ramps[ii].plan(pos[ii], vel[ii], target[ii], maxSpeed, maxAccel);
+            duration = std::max(duration, ramps[ii].getDuration());
+        }
+        // Slow the faster axes down so everything arrives together
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            if (ramps[ii].getDuration() >= duration)
+                continue;
+            double lo = 0.0, hi = maxSpeed;
+            for (uint8_t iter = 0; iter < 40; iter++)
+            {
+                double mid = 0.5 * (lo + hi);
+                ramps[ii].plan(pos[ii], vel[ii], target[ii], mid, maxAccel);
+                if (ramps[ii].getDuration() > duration)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            ramps[ii].plan(pos[ii], vel[ii], target[ii], hi, maxAccel);
+        }
+        tick = 0;
+        rampTicks = (uint32_t)std::ceil(duration / period_s);
+    }
+
+    AxisRamp ramps[BLEND_AXES];
+    double history[BLEND_AXES][BLEND_MAX_WINDOW_TICKS];
+    double sum[BLEND_AXES];
+    int32_t output[BLEND_AXES];
+    int32_t targets[BLEND_AXES];
+    uint16_t window;
+    uint16_t head;
+    uint32_t tick;
+    uint32_t rampTicks;
+    double period_s;
+};
+
+#endif
@@ -0,0 +1,166 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Host to controller clock mapping for scheduled (ExecuteAt) moves
+@file clock_sync.h
+
+The host sends ClockSync messages stamped with the host time (us) it expects
+them to arrive at, i.e. its send time plus its estimate of the one-way delay.
+Each one is paired with the local clock when it's handled, and a straight
+line fitted through the last CLOCK_SYNC_WINDOW pairs gives the offset and
+skew of the local clock against the host's. The skew is only fitted once the
+samples span CLOCK_SYNC_SKEW_SPAN_US; over a quick burst of syncs the delay
+jitter swamps it and the offset alone is more accurate. ExecuteAt times are
+converted to the local clock with that line and the control tick releases the
+move once its local time comes up, so every controller synced to the same
+host starts together, to within the fit error plus a tick.
+
+LocalClock extends the wrapping 32 bit micros() to 64 bits. It has to see
+the counter at least once per wrap (71 minutes); the control tick reads it
+on every pass.
+*/
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+constexpr uint8_t CLOCK_SYNC_WINDOW = 16;
+constexpr uint8_t CLOCK_SYNC_MIN_SAMPLES = 4;
+constexpr int64_t CLOCK_SYNC_SKEW_SPAN_US = 10000000; // Samples have to cover this to fit the skew
+constexpr double CLOCK_SYNC_MAX_SKEW = 200e-6;        // Well past any crystal, anything more is noise
+constexpr uint64_t CLOCK_SYNC_MAX_AGE_US = 300000000ull; // Not synced once the newest sample is this old
+constexpr int64_t SCHEDULE_MAX_LEAD_US = 60000000;       // ExecuteAt further ahead than this is refused
+
+enum SCHEDULE_STATUS
+{
+    SCHEDULE_OK,
+    SCHEDULE_NOT_SYNCED,
+    SCHEDULE_TOO_LATE,
+    SCHEDULE_TOO_FAR
+};
+
+class LocalClock
+{
+public:
+    LocalClock() : last(0), high(0) {}
+
+    uint64_t extend(uint32_t now_us)
+    {
+        if (now_us < last)
+            high += 1ull << 32;
+        last = now_us;
+        return high | now_us;
+    }
+
+private:
+    uint32_t last;
+    uint64_t high;
+};
+
+class ClockSync
+{
+public:
+    ClockSync() { reset(); }
+
+    void reset()
+    {
+        count = 0;
+        head = 0;
+        intercept = 0.0;
+        slope = 0.0;
+        residual = 0.0;
+        hostRef = 0;
+        localRef = 0;
+    }
+
+    // host_us: host time the sample was expected to arrive, local_us: when it did
+    void addSample(int64_t host_us, uint64_t local_us)
+    {
+        // After a long gap (or a missed micros() wrap) the old samples don't fit any more
+        if (count > 0 && local_us - localRef >= CLOCK_SYNC_MAX_AGE_US)
+            reset();
+        hostTime[head] = host_us;
+        localTime[head] = local_us;
+        head = (head + 1) % CLOCK_SYNC_WINDOW;
+        if (count < CLOCK_SYNC_WINDOW)
+            count++;
+        hostRef = host_us;
+        localRef = local_us;
+        fit();
+    }
+
+    bool isSynced(uint64_t localNow_us) const
+    {
+        return count >= CLOCK_SYNC_MIN_SAMPLES && localNow_us - localRef < CLOCK_SYNC_MAX_AGE_US;
+    }
+
+    // Local clock reading at host time host_us
+    uint64_t toLocal(int64_t host_us) const
+    {
+        double dx = (double)(host_us - hostRef);
+        return localRef + (int64_t)std::llround(dx + intercept + slope * dx);
+    }
+
+    // Local minus host time at the newest sample, from the fit
+    double getOffset_us() const { return (double)localRef - (double)hostRef + intercept; }
+    double getSkew_ppm() const { return slope * 1e6; }
+    double getResidual_us() const { return residual; }
+    uint8_t getSampleCount() const { return count; }
+
+private:
+    // Least squares line through (host, local - host), relative to the newest
+    // sample so the doubles only ever hold small numbers
+    void fit()
+    {
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        double x[CLOCK_SYNC_WINDOW], y[CLOCK_SYNC_WINDOW];
+        int64_t oldest = hostRef;
+        for (uint8_t ii = 0; ii < count; ii++)
+        {
+            oldest = std::min(oldest, hostTime[ii]);
+            x[ii] = (double)(hostTime[ii] - hostRef);
+            y[ii] = (double)(int64_t)(localTime[ii] - localRef) - x[ii];
+            sx += x[ii];
+            sy += y[ii];
+            sxx += x[ii] * x[ii];
+            sxy += x[ii] * y[ii];
+        }
+        double denom = count * sxx - sx * sx;
+        slope = (hostRef - oldest >= CLOCK_SYNC_SKEW_SPAN_US && denom > 0.0) ? (count * sxy - sx * sy) / denom : 0.0;
+        slope = std::min(std::max(slope, -CLOCK_SYNC_MAX_SKEW), CLOCK_SYNC_MAX_SKEW);
+        intercept = (sy - slope * sx) / count;
+        double sumSq = 0.0;
+        for (uint8_t ii = 0; ii < count; ii++)
+        {
+            double r = y[ii] - (intercept + slope * x[ii]);
+            sumSq += r * r;
+        }
+        residual = std::sqrt(sumSq / count);
+    }
+
+    int64_t hostTime[CLOCK_SYNC_WINDOW];
+    uint64_t localTime[CLOCK_SYNC_WINDOW];
+    uint8_t count;
+    uint8_t head;
+    double intercept;
+    double slope;
+    double residual;
+    int64_t hostRef;
+    uint64_t localRef;
+};
+
+#endif
@@ -0,0 +1,182 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Persistent parameter table
+@file config_store.h
+
+Typed parameters with defaults and limits, stored in non-volatile memory
+as a CRC-checked block tagged with a schema version and a parameter count.
+
+Parameters are only ever appended to a table, so a block written by older
+firmware still loads: the parameters it has are kept and new ones take
+their defaults. The schema version is bumped when an existing parameter
+changes meaning, and the migration hook converts the stored values.
+*/
+
+#ifndef CONFIG_STORE_H
+#define CONFIG_STORE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include "nv_storage.h"
+#include "position_record.h"
+
+constexpr uint32_t CONFIG_STORE_MAGIC = 0x47464E43; // "CNFG"
+constexpr uint16_t CONFIG_STORE_MAX_PARAMS = 24;
+
+enum PARAM_TYPE
+{
+    PARAM_TYPE_DOUBLE,
+    PARAM_TYPE_UINT,
+};
+
+enum PARAM_APPLY
+{
+    PARAM_APPLY_LIVE,      // Takes effect immediately
+    PARAM_APPLY_ON_REBOOT, // Stored now, used from the next boot
+};
+
+enum PARAM_STATUS
+{
+    PARAM_OK,
+    PARAM_UNKNOWN,
+    PARAM_OUT_OF_RANGE,
+};
+
+struct ParamDef
+{
+    const char *name;
+    uint8_t type;
+    uint8_t apply;
+    double defaultValue;
+    double minValue;
+    double maxValue;
+};
+
+struct ConfigHeader
+{
+    uint32_t magic;
+    uint16_t schemaVersion;
+    uint16_t count;
+    uint32_t crc; // Covers the header up to here and the values that follow
+};
+
+// Converts values stored under an older schema, in place
+typedef void (*ConfigMigration)(uint16_t fromVersion, double *values, uint16_t count);
+
+class ConfigStore
+{
+public:
+    ConfigStore(NvStorage &storage, uint32_t regionStart, uint32_t regionSize,
+                const ParamDef *table, uint16_t numParams, uint16_t schemaVersion,
+                ConfigMigration migrate = nullptr)
+        : storage(storage), regionStart(regionStart), regionSize(regionSize),
+          table(table), numParams(numParams), schemaVersion(schemaVersion), migrate(migrate)
+    {
+        restoreDefaults();
+    }
+
+    static constexpr uint32_t requiredSize(uint16_t numParams)
+    {
+        return sizeof(ConfigHeader) + numParams * sizeof(double);
+    }
+
+    // Returns false if nothing valid was stored and the defaults are in use
+    bool load()
+    {
+        restoreDefaults();
+        ConfigHeader header;
+        storage.get(regionStart, header);
+        if (header.magic != CONFIG_STORE_MAGIC || header.count > CONFIG_STORE_MAX_PARAMS ||
+            requiredSize(header.count) > regionSize || header.schemaVersion > schemaVersion)
+            return false;
+
+        double stored[CONFIG_STORE_MAX_PARAMS];
+        storage.read(regionStart + sizeof(ConfigHeader), stored, header.count * sizeof(double));
+        if (header.crc != computeCrc(header, stored))
+            return false;
+
+        if (header.schemaVersion < schemaVersion && migrate != nullptr)
+            migrate(header.schemaVersion, stored, header.count);
+        // Parameters this block doesn't know about keep their defaults,
+        // and anything outside the current limits is dropped
+        for (uint16_t id = 0; id < numParams && id < header.count; id++)
+        {
+            if (isInRange(id, stored[id]))
+                values[id] = stored[id];
+        }
+        return true;
+    }
+
+    // Returns false if the table doesn't fit in the region
+    bool save()
+    {
+        if (numParams > CONFIG_STORE_MAX_PARAMS || requiredSize(numParams) > regionSize)
+            return false;
+        ConfigHeader header;
+        header.magic = CONFIG_STORE_MAGIC;
+        header.schemaVersion = schemaVersion;
+        header.count = numParams;
+        header.crc = computeCrc(header, values);
+        // A reset between the two writes leaves a CRC mismatch, which loads as defaults
+        storage.write(regionStart + sizeof(ConfigHeader), values, numParams * sizeof(double));
+        storage.put(regionStart, header);
+        return true;
+    }
+
+    void restoreDefaults()
+    {
+        for (uint16_t id = 0; id < numParams; id++)
+            values[id] = table[id].defaultValue;
+    }
+
+    uint8_t set(uint16_t id, double value)
+    {
+        if (id >= numParams)
+            return PARAM_UNKNOWN;
+        if (table[id].type == PARAM_TYPE_UINT)
+            value = std::round(value);
+        if (!isInRange(id, value))
+            return PARAM_OUT_OF_RANGE;
+        values[id] = value;
+        return PARAM_OK;
+    }
+
+    double get(uint16_t id) const { return (id < numParams) ? values[id] : 0.0; }
+    const ParamDef *getDef(uint16_t id) const { return (id < numParams) ? &table[id] : nullptr; }
+    uint16_t getNumParams() const { return numParams; }
+
+private:
+    bool isInRange(uint16_t id, double value) const
+    {
+        return (value >= table[id].minValue) && (value <= table[id].maxValue);
+    }
+    uint32_t computeCrc(const ConfigHeader &header, const double *data) const
+    {
+        uint32_t crc = crc32(&header, offsetof(ConfigHeader, crc));
+        return crc32(data, header.count * sizeof(double), crc);
+    }
+
+    NvStorage &storage;
+    uint32_t regionStart;
+    uint32_t regionSize;
+    const ParamDef *table;
+    uint16_t numParams;
+    uint16_t schemaVersion;
+    ConfigMigration migrate;
+    double values[CONFIG_STORE_MAX_PARAMS];
+};
+
+#endif
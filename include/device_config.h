@@ -41,13 +41,20 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 #define C_LIMIT_SW_PIN 11
 
 #define STEP_ENABLE_PIN 8 
-#define FAN_CONTROL 0     // Unconfirmed
+#define FAN_CONTROL 0     // Unconfirmed, PWM to the fans (SpinEnable on the shield)
+#define FAN_TACH_PIN 1    // Unconfirmed, open-drain fan status (SpinDir on the shield)
+#define FAN_PWM_FREQ_HZ 25000   // PC fan PWM input
+#define FAN_STARTUP_DUTY 100    // Percent, fans run flat out unless told otherwise
 
 #define LED_PIN 13
 
+// Analog joystick for JOG mode, button active low
 #define SW 37
 #define VRx 38
 #define VRy 39
+#define JOYSTICK_SAMPLE_PERIOD_US 10000 // Sampled from loop(), read by the control tick while jogging
+#define JOG_FINE_RATE_URAD_S 20.0       // Full deflection rates, tunable with SetParam
+#define JOG_COARSE_RATE_URAD_S 500.0
 
 //Determine Network values
 #define MAC { 0x00, 0x50, 0xB6, 0xEA, 0x8F, 0x44 }
@@ -58,20 +65,80 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 #define SUBNET  0,0,0,0
 #define PORT    4500
 
+#define CONTROL_TICK_IRQ_PRIORITY 64 // Below the step generator's PIT (32), so it can preempt the tick
 #define UPDATE_PRD_US 100 // TODO: Set this according to the stepper speed, so that it's not interrupting more often than it needs to.
-#define TERM_UPDATE_PRD_SEC 0.2
-constexpr uint32_t TERM_UPDATE_COUNT = TERM_UPDATE_PRD_SEC / (UPDATE_PRD_US * 1e-6);
+#define DASHBOARD_REFRESH_MS 200        // Terminal dashboard snapshot period
+#define DASHBOARD_RENDER_BUDGET_US 1000 // Fields left over when a pass runs past this wait for the next loop()
 #define MIRROR_RADIUS 281880  // Radius of mirror actuator positions in um 
-#define STEPPER_MAX_SPEED 2400.0
+#define STEPPER_MAX_SPEED 2400.0 // Defaults, tunable at runtime with SetParam
 #define STEPPER_MAX_ACCEL 2000.0
-
+#define STEPPER_MAX_JERK 200000.0 // Only used to blend a preempted move into the new one
+#define LIMIT_SW_DEBOUNCE_US 500 // Switch level must be stable this long before it's acted on
+
+// Coordinated moves emit their step pulses from a PIT-driven generator instead of
+// one step per axis per control tick (homing still steps from the tick). Off until
+// the pulse spacing has been checked on a scope with the control tick running.
+#define ENABLE_STEP_GENERATOR 0
+#define STEP_GEN_BASE_HZ 200000 // Generator time base, steps up to half this per axis
+
+#define STEP_PULSE_NS 2000 // DRV8825 needs the step pin high for 1.9 us
+
+// Runtime microstep resolution (MicrostepMode). Needs the shield's MODE0-2 jumpers
+// replaced by wires to these pins, shared by all three drivers. Without it the
+// drivers stay at the jumpered 1/16 (MICROSTEP_DIVIDER).
+#define ENABLE_MICROSTEP_CONTROL 0
+#define MICROSTEP_M0_PIN 24 // Unconfirmed
+#define MICROSTEP_M1_PIN 25 // Unconfirmed
+#define MICROSTEP_M2_PIN 26 // Unconfirmed
+
+// Position storage backend
+#define NV_STORAGE_EEPROM 0   // Teensy flash-emulated EEPROM
+#define NV_STORAGE_SPI_FRAM 1 // MB85RS-family FRAM on SPI
+#define NV_STORAGE_I2C_FRAM 2 // MB85RC-family FRAM on Wire
+#define NV_STORAGE_BACKEND NV_STORAGE_EEPROM
+#define FRAM_CS_PIN 36        // Unconfirmed
+#define FRAM_I2C_ADDR 0x50    // Unconfirmed
+#define FRAM_SIZE_BYTES 32768 // Unconfirmed
+
+// Addresses below are offsets into whichever backend is selected
 constexpr uint32_t EEPROM_ADDR_START = 0;
-constexpr uint32_t EEPROM_ADDR_STEPPER_A_POS = (EEPROM_ADDR_START + 0);
-constexpr uint32_t EEPROM_ADDR_STEPPER_B_POS = (EEPROM_ADDR_STEPPER_A_POS + sizeof(uint32_t));
-constexpr uint32_t EEPROM_ADDR_STEPPER_C_POS = (EEPROM_ADDR_STEPPER_B_POS + sizeof(uint32_t));
-constexpr uint32_t EEPROM_ADDR_IS_HOMED = (EEPROM_ADDR_STEPPER_C_POS + sizeof(uint32_t));
-constexpr uint32_t EEPROM_ADDR_RESET_NOTIFIER = (EEPROM_ADDR_IS_HOMED + sizeof(uint32_t));
+// Position records are journaled round-robin across this region to spread flash wear
+constexpr uint32_t EEPROM_ADDR_POSITION_JOURNAL = (EEPROM_ADDR_START + 0);
+constexpr uint32_t EEPROM_POSITION_JOURNAL_SIZE = 1024;
+// Motion parameter table (GetParam/SetParam)
+constexpr uint32_t EEPROM_ADDR_CONFIG = (EEPROM_ADDR_POSITION_JOURNAL + EEPROM_POSITION_JOURNAL_SIZE);
+constexpr uint32_t EEPROM_CONFIG_SIZE = 256;
+
+// In-motion position checkpoints (committed from loop(), never from the control ISR).
+// On a wear-free backend (FRAM) every step change is checkpointed instead.
+#define CHECKPOINT_INTERVAL_MS 1000  // Checkpoint at least this often while moving
+#define CHECKPOINT_STEP_DELTA 400    // ...or once any axis is this many steps from the last record
+#define CHECKPOINT_MIN_PERIOD_MS 250 // but never more often than this, to limit flash wear
+// The flash-emulated EEPROM writes with interrupts disabled, so each in-motion
+// checkpoint there stops the control tick for the write: roughly 0.4 ms per
+// changed byte, tens of ms when a sector has to be erased. That's a hitch in
+// the move the error bound doesn't cover. Off, a reset mid-move on that backend
+// leaves only the start-of-run record, so full homing is needed. Compare
+// TickGapMax_us and JournalWriteMax_us on the bench before turning it on.
+#define ENABLE_STALLING_MOTION_CHECKPOINTS 0
 
 #define ENABLE_TERMINAL_UPDATES 1
 
+// Time budgets for the stages of loop() (see LoopWatchdog). The hardware watchdog
+// is only fed by a pass that met all of them, and an overrun is counted and sent
+// as a LoopOverrun message. The slow stages write EEPROM/flash.
+#define LOOP_BUDGET_US 100000
+#define LOOP_CLIENTS_BUDGET_US 10000
+#define LOOP_CLIENT_DATA_BUDGET_US 50000 // SetParam saves the config
+#define LOOP_SERVICES_BUDGET_US 50000    // Position journal writes
+#define LOOP_NOTIFICATIONS_BUDGET_US 20000
+#define METRICS_PUSH_PERIOD_S 0 // Unsolicited GetMetrics replies, 0 = only on request (see MetricsPeriod)
+
+// Control tick trace (ArmTrace/TriggerTrace/DumpTrace), 40 bytes per record
+#define ENABLE_CONTROL_TRACE 1
+#define TRACE_BUFFER_RECORDS 4096        // 0.4 s at UPDATE_PRD_US = 100, kept in DMAMEM
+#define TRACE_POST_TRIGGER_RECORDS 1024  // Records kept after the trigger, the rest lead up to it
+#define TRACE_DEFAULT_TRIGGERS 0x07      // TRACE_TRIGGER_ALL, armed at boot
+#define TRACE_DUMP_CHUNK_BYTES 192       // Binary bytes per DumpTrace reply (256 base64 characters)
+
 #endif
\ No newline at end of file
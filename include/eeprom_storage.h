@@ -0,0 +1,34 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief NvStorage backend for the Teensy's flash-emulated EEPROM
+@file eeprom_storage.h
+*/
+
+#ifndef EEPROM_STORAGE_H
+#define EEPROM_STORAGE_H
+
+#include "nv_storage.h"
+
+class EepromStorage : public NvStorage
+{
+public:
+    void read(uint32_t addr, void *data, uint32_t length) override;
+    void write(uint32_t addr, const void *data, uint32_t length) override;
+    uint32_t size() const override;
+    // The Teensy 4 programs and erases its flash with interrupts disabled
+    bool stallsInterrupts() const override { return true; }
+};
+
+#endif
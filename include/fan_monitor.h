@@ -0,0 +1,125 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Fan tachometer speed and stall detection
+@file fan_monitor.h
+
+The fans' open-drain tach output interrupts on each falling edge. The pin
+ISR only counts the edge (like the limit switch ISRs), everything else runs
+from loop(): the speed is the edge count over a fixed window, and a fan that
+is driven hard enough to spin but hasn't produced an edge for
+FAN_STALL_TIMEOUT_MS is stalled. Starting the fan from off gets FAN_SPINUP_MS
+before it can be called stalled.
+
+Times in loop() are accumulated from differences, so millis() wrapping
+around doesn't matter.
+*/
+
+#ifndef FAN_MONITOR_H
+#define FAN_MONITOR_H
+
+#include <cstdint>
+
+constexpr uint8_t FAN_TACH_PULSES_PER_REV = 2;
+constexpr uint32_t FAN_TACH_MIN_PERIOD_US = 500;  // Closer edges are noise (30000 rpm)
+constexpr uint32_t FAN_RPM_WINDOW_MS = 1000;
+constexpr uint32_t FAN_STALL_TIMEOUT_MS = 2000;
+constexpr uint32_t FAN_SPINUP_MS = 3000;
+constexpr uint8_t FAN_STALL_MIN_DUTY_PERCENT = 30; // PC fans may legitimately stop below this
+
+class FanMonitor
+{
+public:
+    FanMonitor()
+        : edgeCount(0), lastEdge_us(0), duty(0), rpm(0), stalled(false), stallCount(0), lastCount(0),
+          lastUpdate_ms(0), updated(false), quiet_ms(0), running_ms(0), windowEdges(0), window_ms(0) {}
+
+    // From the tach pin interrupt
+    void recordEdge(uint32_t now_us)
+    {
+        if (edgeCount != 0 && now_us - lastEdge_us < FAN_TACH_MIN_PERIOD_US)
+            return;
+        lastEdge_us = now_us;
+        edgeCount = edgeCount + 1;
+    }
+
+    void setDuty(uint8_t percent)
+    {
+        if (percent > 0 && duty == 0)
+            running_ms = 0;
+        if (percent < FAN_STALL_MIN_DUTY_PERCENT)
+            stalled = false;
+        duty = percent;
+    }
+
+    // From loop(). Returns true when the fan has just stalled.
+    bool update(uint32_t now_ms)
+    {
+        uint32_t count = edgeCount;
+        uint32_t elapsed_ms = updated ? now_ms - lastUpdate_ms : 0;
+        lastUpdate_ms = now_ms;
+        updated = true;
+
+        uint32_t edges = count - lastCount;
+        lastCount = count;
+        quiet_ms = (edges != 0) ? 0 : saturatingAdd(quiet_ms, elapsed_ms);
+        running_ms = (duty > 0) ? saturatingAdd(running_ms, elapsed_ms) : 0;
+
+        windowEdges += edges;
+        window_ms += elapsed_ms;
+        if (window_ms >= FAN_RPM_WINDOW_MS)
+        {
+            rpm = (uint32_t)((uint64_t)windowEdges * 60000 / (FAN_TACH_PULSES_PER_REV * window_ms));
+            windowEdges = 0;
+            window_ms = 0;
+        }
+        if (quiet_ms >= FAN_STALL_TIMEOUT_MS)
+            rpm = 0;
+
+        bool stalledNow = duty >= FAN_STALL_MIN_DUTY_PERCENT && running_ms >= FAN_SPINUP_MS &&
+                          quiet_ms >= FAN_STALL_TIMEOUT_MS;
+        bool newStall = stalledNow && !stalled;
+        stalled = stalledNow;
+        if (newStall)
+            stallCount++;
+        return newStall;
+    }
+
+    uint8_t getDuty() const { return duty; }
+    uint32_t getRpm() const { return rpm; }
+    bool isStalled() const { return stalled; }
+    uint32_t getStallCount() const { return stallCount; }
+
+private:
+    static uint32_t saturatingAdd(uint32_t a, uint32_t b)
+    {
+        return (a > UINT32_MAX - b) ? UINT32_MAX : a + b;
+    }
+
+    volatile uint32_t edgeCount;
+    volatile uint32_t lastEdge_us;
+    uint8_t duty;
+    uint32_t rpm;
+    bool stalled;
+    uint32_t stallCount;
+    uint32_t lastCount;
+    uint32_t lastUpdate_ms;
+    bool updated;
+    uint32_t quiet_ms;
+    uint32_t running_ms;
+    uint32_t windowEdges;
+    uint32_t window_ms;
+};
+
+#endif
@@ -0,0 +1,62 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief NvStorage backends for external FRAM (Fujitsu MB85RS SPI / MB85RC I2C)
+@file fram_storage.h
+
+FRAM is byte-writable with no erase cycle and effectively unlimited
+endurance, so these backends report isWearFree().
+*/
+
+#ifndef FRAM_STORAGE_H
+#define FRAM_STORAGE_H
+
+#include "nv_storage.h"
+#include <SPI.h>
+#include <Wire.h>
+
+class SpiFramStorage : public NvStorage
+{
+public:
+    SpiFramStorage(SPIClass &spi, uint8_t csPin, uint32_t size);
+    bool begin() override;
+    void read(uint32_t addr, void *data, uint32_t length) override;
+    void write(uint32_t addr, const void *data, uint32_t length) override;
+    uint32_t size() const override { return framSize; }
+    bool isWearFree() const override { return true; }
+
+private:
+    void sendCommand(uint8_t opcode, uint32_t addr);
+    SPIClass &spi;
+    uint8_t csPin;
+    uint32_t framSize;
+};
+
+class I2cFramStorage : public NvStorage
+{
+public:
+    I2cFramStorage(TwoWire &wire, uint8_t i2cAddr, uint32_t size);
+    bool begin() override;
+    void read(uint32_t addr, void *data, uint32_t length) override;
+    void write(uint32_t addr, const void *data, uint32_t length) override;
+    uint32_t size() const override { return framSize; }
+    bool isWearFree() const override { return true; }
+
+private:
+    TwoWire &wire;
+    uint8_t i2cAddr;
+    uint32_t framSize;
+};
+
+#endif
@@ -0,0 +1,145 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Analog joystick to tip/tilt rates for JOG mode
+@file joystick_jog.h
+
+In JOG mode the control tick samples the joystick every
+JOYSTICK_SAMPLE_PERIOD_US and feeds the rates from here into the same rate
+integration and followers as TRACK mode, so the mirror moves at a continuous
+velocity rather than through a series of point-to-point moves.
+
+Each ADC channel is low pass filtered, then a deadband around the center is
+removed and the rest scaled to +/-1 of full deflection. X drives tip and Y
+tilt, at the fine or coarse rate for full deflection. Pressing the button
+toggles between the two. Jog always starts at the fine rate.
+
+Samples come from a JoystickSource: the shield's pins on the target, or a
+ScriptedJoystick in the native tests. The shield's ADC is read from loop(),
+the control tick only picks up the latest sample.
+*/
+
+#ifndef JOYSTICK_JOG_H
+#define JOYSTICK_JOG_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+constexpr uint16_t JOYSTICK_ADC_MAX = 1023;         // 10 bit analogRead()
+constexpr double JOYSTICK_DEADBAND_COUNTS = 40.0;   // Covers the resting offset of the stick
+constexpr double JOYSTICK_FILTER_TAU_S = 0.03;      // ADC low pass time constant
+constexpr uint8_t JOYSTICK_BUTTON_DEBOUNCE_SAMPLES = 3;
+
+struct JoystickSample
+{
+    uint16_t x;
+    uint16_t y;
+    bool pressed;
+};
+
+class JoystickSource
+{
+public:
+    virtual ~JoystickSource() {}
+    virtual JoystickSample read(uint32_t now_us) = 0;
+};
+
+// Plays back a list of samples, each held until the next one's time comes up
+class ScriptedJoystick : public JoystickSource
+{
+public:
+    struct Keyframe
+    {
+        uint32_t time_us;
+        JoystickSample sample;
+    };
+
+    ScriptedJoystick(const Keyframe *script, uint16_t length) : script(script), length(length) {}
+
+    JoystickSample read(uint32_t now_us) override
+    {
+        JoystickSample sample{JOYSTICK_ADC_MAX / 2, JOYSTICK_ADC_MAX / 2, false};
+        for (uint16_t ii = 0; ii < length && script[ii].time_us <= now_us; ii++)
+            sample = script[ii].sample;
+        return sample;
+    }
+
+private:
+    const Keyframe *script;
+    uint16_t length;
+};
+
+class JoystickJog
+{
+public:
+    JoystickJog() { reset(); }
+
+    void reset()
+    {
+        filteredX = filteredY = JOYSTICK_ADC_MAX / 2.0;
+        tipRate = tiltRate = 0.0;
+        buttonLevel = false;
+        buttonCount = 0;
+        coarse = false;
+    }
+
+    // Rates are in rad/s at full deflection, dt is the time since the last sample
+    void update(const JoystickSample &sample, double dt, double fineRate, double coarseRate)
+    {
+        double alpha = dt / (JOYSTICK_FILTER_TAU_S + dt);
+        filteredX += alpha * (sample.x - filteredX);
+        filteredY += alpha * (sample.y - filteredY);
+
+        // Toggles once per press, after the level has been steady for a few samples
+        if (sample.pressed == buttonLevel)
+            buttonCount = 0;
+        else if (++buttonCount >= JOYSTICK_BUTTON_DEBOUNCE_SAMPLES)
+        {
+            buttonLevel = sample.pressed;
+            buttonCount = 0;
+            if (buttonLevel)
+                coarse = !coarse;
+        }
+
+        double rate = coarse ? coarseRate : fineRate;
+        tipRate = rate * deflection(filteredX);
+        tiltRate = rate * deflection(filteredY);
+    }
+
+    double getTipRate() const { return tipRate; }
+    double getTiltRate() const { return tiltRate; }
+    bool isCoarse() const { return coarse; }
+
+private:
+    static double deflection(double counts)
+    {
+        constexpr double center = JOYSTICK_ADC_MAX / 2.0;
+        double offset = counts - center;
+        if (std::fabs(offset) <= JOYSTICK_DEADBAND_COUNTS)
+            return 0.0;
+        double scaled = (std::fabs(offset) - JOYSTICK_DEADBAND_COUNTS) / (center - JOYSTICK_DEADBAND_COUNTS);
+        return std::copysign(std::min(scaled, 1.0), offset);
+    }
+
+    double filteredX;
+    double filteredY;
+    double tipRate;
+    double tiltRate;
+    bool buttonLevel;
+    uint8_t buttonCount;
+    bool coarse;
+};
+
+#endif
@@ -0,0 +1,152 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Per-stage time budgets for loop(), in front of the hardware watchdog
+@file loop_watchdog.h
+
+loop() is split into stages that run back to back. Each stage ends with
+endStage(), which times it from the end of the one before. endLoop() checks
+the stages and the whole pass against their budgets. It returns true only if
+every budget was met, and only then does loop() feed the hardware watchdog.
+A loop that stays stuck (or keeps overrunning) therefore starves the watchdog,
+where before it was fed regardless.
+
+An overrun is counted once per pass, against the stage furthest over its
+budget. takeReport() hands the overruns since the last report to loop() at
+most once every LOOP_OVERRUN_REPORT_MS, so a slow network doesn't turn into a
+flood of events.
+
+Times are micros() differences, so wrapping doesn't matter.
+*/
+
+#ifndef LOOP_WATCHDOG_H
+#define LOOP_WATCHDOG_H
+
+#include <cstdint>
+
+constexpr uint32_t LOOP_OVERRUN_REPORT_MS = 1000;
+
+enum LOOP_STAGE
+{
+    LOOP_STAGE_CLIENTS,       // checkForNewClients, stopDisconnectedClients
+    LOOP_STAGE_CLIENT_DATA,   // processClientData, including the command handlers
+    LOOP_STAGE_SERVICES,      // Position journal, fan, dashboard, trace dump, metrics push
+    LOOP_STAGE_NOTIFICATIONS, // Messages for the notifier flags
+    NUM_LOOP_STAGES
+};
+
+static const char *const LoopStageNames[NUM_LOOP_STAGES]{"Clients", "ClientData", "Services", "Notifications"};
+
+// Overruns since the last report. stage is NUM_LOOP_STAGES when only the whole pass was over.
+struct LoopOverrunReport
+{
+    uint32_t overruns;
+    uint8_t stage;
+    uint32_t duration_us;
+    uint32_t budget_us;
+};
+
+class LoopWatchdog
+{
+public:
+    LoopWatchdog(const uint32_t *stageBudgets_us, uint32_t loopBudget_us)
+        : loopBudget_us(loopBudget_us), loopStart_us(0), stageStart_us(0), loop_us(0), overruns(0),
+          reportOverruns(0), lastReport_ms(0), reported(false), worst{0, NUM_LOOP_STAGES, 0, 0}
+    {
+        for (uint8_t ii = 0; ii < NUM_LOOP_STAGES; ii++)
+        {
+            this->stageBudgets_us[ii] = stageBudgets_us[ii];
+            stage_us[ii] = 0;
+        }
+    }
+
+    void beginLoop(uint32_t now_us)
+    {
+        loopStart_us = stageStart_us = now_us;
+        for (uint8_t ii = 0; ii < NUM_LOOP_STAGES; ii++)
+            stage_us[ii] = 0;
+    }
+
+    void endStage(uint8_t stage, uint32_t now_us)
+    {
+        stage_us[stage] += now_us - stageStart_us;
+        stageStart_us = now_us;
+    }
+
+    // Returns true if the pass met every budget, i.e. the watchdog can be fed
+    bool endLoop(uint32_t now_us)
+    {
+        loop_us = now_us - loopStart_us;
+        LoopOverrunReport over{1, NUM_LOOP_STAGES, 0, 0};
+        uint32_t worstExcess = 0;
+        for (uint8_t ii = 0; ii < NUM_LOOP_STAGES; ii++)
+        {
+            if (stage_us[ii] > stageBudgets_us[ii] && stage_us[ii] - stageBudgets_us[ii] > worstExcess)
+            {
+                worstExcess = stage_us[ii] - stageBudgets_us[ii];
+                over.stage = ii;
+                over.duration_us = stage_us[ii];
+                over.budget_us = stageBudgets_us[ii];
+            }
+        }
+        if (worstExcess == 0 && loop_us > loopBudget_us)
+        {
+            worstExcess = loop_us - loopBudget_us;
+            over.duration_us = loop_us;
+            over.budget_us = loopBudget_us;
+        }
+        if (worstExcess == 0)
+            return true;
+
+        overruns++;
+        // The longest overrun since the last report is the one reported
+        if (reportOverruns == 0 || over.duration_us - over.budget_us > worst.duration_us - worst.budget_us)
+            worst = over;
+        reportOverruns++;
+        return false;
+    }
+
+    // From loop(), after endLoop(). True if there are overruns to report.
+    bool takeReport(uint32_t now_ms, LoopOverrunReport *report)
+    {
+        if (reportOverruns == 0 || (reported && now_ms - lastReport_ms < LOOP_OVERRUN_REPORT_MS))
+            return false;
+        *report = worst;
+        report->overruns = reportOverruns;
+        reportOverruns = 0;
+        lastReport_ms = now_ms;
+        reported = true;
+        return true;
+    }
+
+    // Of the last pass
+    uint32_t getStage_us(uint8_t stage) const { return stage_us[stage]; }
+    uint32_t getLoop_us() const { return loop_us; }
+    uint32_t getOverruns() const { return overruns; }
+
+private:
+    uint32_t stageBudgets_us[NUM_LOOP_STAGES];
+    uint32_t loopBudget_us;
+    uint32_t loopStart_us;
+    uint32_t stageStart_us;
+    uint32_t stage_us[NUM_LOOP_STAGES];
+    uint32_t loop_us;
+    uint32_t overruns;
+    uint32_t reportOverruns;
+    uint32_t lastReport_ms;
+    bool reported;
+    LoopOverrunReport worst;
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Runtime metrics registry
+@file metrics.h
+
+Fixed table of named counters and gauges. Values are 32-bit atomics, so
+the control ISR, pin ISRs and loop() can all update them without locking
+(LDREX/STREX on the Cortex-M7) and nothing is allocated at runtime.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <cstdint>
+#include <atomic>
+
+constexpr uint16_t METRICS_MAX_METRICS = 32;
+
+enum METRIC_KIND
+{
+    METRIC_COUNTER, // Only ever incremented
+    METRIC_GAUGE,   // Set, or raised to a high-water mark
+};
+
+struct MetricDef
+{
+    const char *name;
+    METRIC_KIND kind;
+};
+
+class MetricsRegistry
+{
+public:
+    MetricsRegistry(const MetricDef *table, uint16_t numMetrics)
+        : table(table), numMetrics(numMetrics < METRICS_MAX_METRICS ? numMetrics : METRICS_MAX_METRICS)
+    {
+        for (uint16_t id = 0; id < METRICS_MAX_METRICS; id++)
+            values[id].store(0, std::memory_order_relaxed);
+    }
+
+    void increment(uint16_t id, uint32_t count = 1)
+    {
+        if (id < numMetrics)
+            values[id].fetch_add(count, std::memory_order_relaxed);
+    }
+
+    void set(uint16_t id, uint32_t value)
+    {
+        if (id < numMetrics)
+            values[id].store(value, std::memory_order_relaxed);
+    }
+
+    // Raises a gauge to value if it is higher than what's there
+    void updateMax(uint16_t id, uint32_t value)
+    {
+        if (id >= numMetrics)
+            return;
+        uint32_t current = values[id].load(std::memory_order_relaxed);
+        while (value > current && !values[id].compare_exchange_weak(current, value, std::memory_order_relaxed))
+            ;
+    }
+
+    uint32_t get(uint16_t id) const
+    {
+        return (id < numMetrics) ? values[id].load(std::memory_order_relaxed) : 0;
+    }
+
+    const MetricDef *getDef(uint16_t id) const
+    {
+        return (id < numMetrics) ? &table[id] : nullptr;
+    }
+
+    uint16_t getNumMetrics() const { return numMetrics; }
+
+private:
+    const MetricDef *table;
+    uint16_t numMetrics;
+    std::atomic<uint32_t> values[METRICS_MAX_METRICS];
+};
+
+#endif
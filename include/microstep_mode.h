@@ -0,0 +1,93 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Runtime DRV8825 microstep resolution
+@file microstep_mode.h
+
+Everything above the drivers (kinematics, workspace limits, homing distances,
+the position journal) counts in reference microsteps, 1/MICROSTEP_DIVIDER of a
+full step. The drivers can run coarser than that for fast slews, where each
+driver step covers getScale() reference microsteps. The step counters and
+targets given to the drivers are in driver steps, and are converted here.
+
+A driver can always switch to a finer mode. Switching to a coarser mode is only
+exact from a position on the coarser grid: the DRV8825 indexer advances to the
+next valid state of the new mode on its first step, so from anywhere else the
+step count and the rotor would disagree.
+*/
+
+#ifndef MICROSTEP_MODE_H
+#define MICROSTEP_MODE_H
+
+#include <cstdint>
+#include "mirror_kinematics.h"
+
+constexpr uint8_t MICROSTEP_REFERENCE_SHIFT = 4; // log2(MICROSTEP_DIVIDER)
+static_assert((1 << MICROSTEP_REFERENCE_SHIFT) == MICROSTEP_DIVIDER, "Reference shift doesn't match MICROSTEP_DIVIDER");
+
+class MicrostepMode
+{
+public:
+    MicrostepMode() : shift(0) {}
+
+    // Full step (1) up to the reference resolution, powers of two only.
+    // 1/32 is finer than the reference microstep and can't be represented.
+    static bool isValidDivider(uint32_t divider)
+    {
+        return divider >= 1 && divider <= (1u << MICROSTEP_REFERENCE_SHIFT) && (divider & (divider - 1)) == 0;
+    }
+
+    bool setDivider(uint32_t divider)
+    {
+        if (!isValidDivider(divider))
+            return false;
+        uint8_t log2Divider = 0;
+        while ((1u << log2Divider) < divider)
+            log2Divider++;
+        shift = MICROSTEP_REFERENCE_SHIFT - log2Divider;
+        return true;
+    }
+
+    uint32_t getDivider() const { return 1u << (MICROSTEP_REFERENCE_SHIFT - shift); }
+    // Reference microsteps per driver step
+    int32_t getScale() const { return 1 << shift; }
+    uint8_t getScaleShift() const { return shift; }
+    void setScaleShift(uint8_t scaleShift) { shift = (scaleShift > MICROSTEP_REFERENCE_SHIFT) ? 0 : scaleShift; }
+
+    // DRV8825 MODE2..MODE0 levels (bit 0 is MODE0): full step is 000, 1/2 is 001, ... 1/16 is 100
+    uint8_t getModeBits() const { return MICROSTEP_REFERENCE_SHIFT - shift; }
+
+    int32_t toReference(int32_t driverSteps) const { return driverSteps * getScale(); }
+
+    // Nearest driver step, ties away from zero
+    int32_t toDriver(int32_t referenceSteps) const
+    {
+        int32_t scale = getScale();
+        int32_t half = scale / 2;
+        return (referenceSteps >= 0) ? (referenceSteps + half) / scale : -((-referenceSteps + half) / scale);
+    }
+
+    // Driver steps in this mode for a count made in another
+    int32_t rescale(int32_t driverSteps, const MicrostepMode &from) const
+    {
+        return toDriver(from.toReference(driverSteps));
+    }
+
+    bool isAligned(int32_t referenceSteps) const { return (referenceSteps & (getScale() - 1)) == 0; }
+
+private:
+    uint8_t shift;
+};
+
+#endif
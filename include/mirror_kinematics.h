@@ -0,0 +1,347 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief LFAST prototype Primary Mirror kinematics
+@file mirror_kinematics.h
+
+Conversions between tip/tilt/focus and actuator step positions, see
+doc/PrimaryMirrorMath.mlx for the derivation. Kept free of Arduino and
+LFAST_Device dependencies so it can be built for the native test target.
+*/
+
+#ifndef MIRROR_KINEMATICS_H
+#define MIRROR_KINEMATICS_H
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+// Nothing to mask on the native build
+inline void noInterrupts() {}
+inline void interrupts() {}
+#endif
+
+constexpr double MICROSTEP_DIVIDER = 16;
+constexpr double MICROSTEP_RATIO = 1.0 / MICROSTEP_DIVIDER;
+
+constexpr double MIRROR_RADIUS_MICRONS = 281880.0;          // Radius of mirror actuator positions in um
+constexpr double MICRON_PER_STEP = 3.175 * MICROSTEP_RATIO; // conversion factor of stepper motor steps to vertical movement in um
+constexpr double STEPS_PER_MICRON = 1.0 / MICRON_PER_STEP;
+constexpr double STEPS_PER_MM = STEPS_PER_MICRON*1000;
+constexpr double MM_PER_STEP = 1.0/STEPS_PER_MM;
+
+constexpr double STROKE_MICRON = 12700.0;
+constexpr double MAX_STROKE_MICRON = (0.5 * STROKE_MICRON);
+constexpr double MIN_STROKE_MICRON = (-0.5 * STROKE_MICRON);
+constexpr double STROKE_STEPS = (uint32_t)(STROKE_MICRON / MICRON_PER_STEP); // 4000*MICROSTEP_DIVIDER
+constexpr double STROKE_BOTTOM_STEPS = (-0.5*STROKE_STEPS);
+constexpr double STROKE_TOP_STEPS = (0.5*STROKE_STEPS);
+constexpr double STROKE_BOTTOM_MICRON = STROKE_BOTTOM_STEPS * MICRON_PER_STEP;
+
+
+constexpr double URAD_PER_RAD = 1000000.0;
+constexpr double RAD_PER_URAD = 1.0/URAD_PER_RAD;
+
+// Mirror coeffs assume millimeters!!
+constexpr double MIRROR_MATH_COEFF_0 = 281.3;
+constexpr double MIRROR_MATH_COEFF_1 = -140.6;
+constexpr double MIRROR_MATH_COEFF_2 = 243.6;
+
+// Reachable workspace: the stroke box in step space
+constexpr double WORKSPACE_ULIM_STEPS = (int32_t)(STROKE_STEPS / 2);
+constexpr double WORKSPACE_LLIM_STEPS = -1 * WORKSPACE_ULIM_STEPS;
+// Per-actuator step offsets for a unit tan(tip), unit tan(tilt)/cos(tip) and unit focus
+constexpr double WORKSPACE_TIP_GAIN[3]{MIRROR_MATH_COEFF_0 * STEPS_PER_MM,
+                                       MIRROR_MATH_COEFF_1 * STEPS_PER_MM,
+                                       MIRROR_MATH_COEFF_1 * STEPS_PER_MM};
+constexpr double WORKSPACE_TILT_GAIN[3]{0.0,
+                                        MIRROR_MATH_COEFF_2 * STEPS_PER_MM,
+                                        -1 * MIRROR_MATH_COEFF_2 * STEPS_PER_MM};
+constexpr double WORKSPACE_FOCUS_GAIN = STEPS_PER_MM;
+
+namespace LFAST
+{
+    namespace PMC
+    {
+        enum ControlMode
+        {
+            STOP = 0,
+            RELATIVE = 1,
+            ABSOLUTE = 2,
+            TRACK = 3, // Targets are rates, integrated by the control tick
+            JOG = 4,   // Tip/tilt rates from the joystick, targets are ignored
+        };
+
+        enum UNIT_TYPES
+        {
+            ENGINEERING = 0,
+            STEPS_PER_SEC = 1
+        };
+
+        enum AXIS
+        {
+            TIP = 0,
+            TILT = 1,
+            FOCUS = 2
+        };
+
+        enum DIRECTION
+        {
+            REVERSE = -1,
+            FORWARD = 1
+        };
+
+        enum MOTOR_ID
+        {
+            MOTOR_A = 0,
+            MOTOR_B = 1,
+            MOTOR_C = 2
+        };
+
+        enum SATURATION_POLICY
+        {
+            PRESERVE_TIP_TILT = 0, // Keep tip/tilt, slide focus into range (scale tip/tilt only if it can't fit)
+            PRESERVE_FOCUS = 1,    // Keep focus, scale tip/tilt back towards zero
+            REJECT_COMMAND = 2     // Don't move, keep the last reachable command
+        };
+
+        enum SATURATION_STATUS
+        {
+            IN_RANGE = 0,
+            SATURATED = 1,
+            REJECTED = 2
+        };
+
+    }
+};
+
+class MotorStates
+{
+public:
+    MotorStates(int32_t A, int32_t B, int32_t C) : A_steps(A), B_steps(B), C_steps(C) {}
+
+    MotorStates &operator=(MotorStates const &other)
+    {
+        noInterrupts();
+        A_steps = other.A_steps;
+        B_steps = other.B_steps;
+        C_steps = other.C_steps;
+        interrupts();
+        return *this;
+    }
+
+    int32_t A_steps;
+    int32_t B_steps;
+    int32_t C_steps;
+
+    // Inverse of MirrorStates::getMotorPosnCommands. The three actuator heights
+    // define the mirror plane z = focus + x*tan(tip) + y*tan(tilt)/cos(tip),
+    // so its slopes and offset can be solved for directly.
+    void getTipTiltFocusFeedback(double *tip, double *tilt, double *focus) const
+    {
+        constexpr double c[3]{MIRROR_MATH_COEFF_0, MIRROR_MATH_COEFF_1, MIRROR_MATH_COEFF_2};
+        double zA = (double)A_steps * MM_PER_STEP;
+        double zB = (double)B_steps * MM_PER_STEP;
+        double zC = (double)C_steps * MM_PER_STEP;
+
+        double tanAlpha = (zA - 0.5 * (zB + zC)) / (c[0] - c[1]);
+        double tanBetaOverCosAlpha = (zB - zC) / (2 * c[2]);
+        double tipAngle_rad = std::atan(tanAlpha);
+
+        *tip = tipAngle_rad;
+        *tilt = std::atan(tanBetaOverCosAlpha * std::cos(tipAngle_rad));
+        *focus = zA - c[0] * tanAlpha;
+    }
+};
+
+// Actuator demand for a commanded pose, split into the tip/tilt part
+// (which differs per actuator) and the focus part (common to all three).
+struct ActuatorDemand
+{
+    double tipTiltSteps[3];
+    double focusSteps;
+    double tipTiltScale;
+
+    int32_t getSteps(uint8_t motor) const
+    {
+        return (int32_t)getExactSteps(motor);
+    }
+    double getExactSteps(uint8_t motor) const
+    {
+        return focusSteps + tipTiltScale * tipTiltSteps[motor];
+    }
+};
+
+class MirrorWorkspace
+{
+public:
+    static void computeDemand(double tanTip, double tanTiltOverCosTip, double focus, ActuatorDemand *demand)
+    {
+        for (uint8_t ii = 0; ii < 3; ii++)
+            demand->tipTiltSteps[ii] = WORKSPACE_TIP_GAIN[ii] * tanTip + WORKSPACE_TILT_GAIN[ii] * tanTiltOverCosTip;
+        demand->focusSteps = WORKSPACE_FOCUS_GAIN * focus;
+        demand->tipTiltScale = 1.0;
+    }
+
+    static bool isReachable(const ActuatorDemand &demand)
+    {
+        bool reachable = true;
+        for (uint8_t ii = 0; ii < 3; ii++)
+        {
+            double steps = demand.focusSteps + demand.tipTiltScale * demand.tipTiltSteps[ii];
+            reachable &= (steps >= WORKSPACE_LLIM_STEPS) && (steps <= WORKSPACE_ULIM_STEPS);
+        }
+        return reachable;
+    }
+
+    // Batched check, returns the number of unreachable demands.
+    static uint32_t checkReachable(const ActuatorDemand *demands, bool *reachable, uint32_t count)
+    {
+        uint32_t numUnreachable = 0;
+        for (uint32_t ii = 0; ii < count; ii++)
+        {
+            reachable[ii] = isReachable(demands[ii]);
+            if (!reachable[ii])
+                numUnreachable++;
+        }
+        return numUnreachable;
+    }
+
+    // Projects the demand onto the reachable workspace according to the policy.
+    static uint8_t project(ActuatorDemand *demand, uint8_t policy)
+    {
+        if (isReachable(*demand))
+            return LFAST::PMC::IN_RANGE;
+        if (policy == LFAST::PMC::REJECT_COMMAND)
+            return LFAST::PMC::REJECTED;
+
+        double tipTiltMin = std::min({demand->tipTiltSteps[0], demand->tipTiltSteps[1], demand->tipTiltSteps[2]});
+        double tipTiltMax = std::max({demand->tipTiltSteps[0], demand->tipTiltSteps[1], demand->tipTiltSteps[2]});
+        double scale = 1.0;
+        if (policy == LFAST::PMC::PRESERVE_FOCUS)
+        {
+            demand->focusSteps = std::min(std::max(demand->focusSteps, WORKSPACE_LLIM_STEPS), WORKSPACE_ULIM_STEPS);
+            for (uint8_t ii = 0; ii < 3; ii++)
+            {
+                double tt = demand->tipTiltSteps[ii];
+                if (tt > 0.0)
+                    scale = std::min(scale, (WORKSPACE_ULIM_STEPS - demand->focusSteps) / tt);
+                else if (tt < 0.0)
+                    scale = std::min(scale, (WORKSPACE_LLIM_STEPS - demand->focusSteps) / tt);
+            }
+        }
+        else
+        {
+            // Tip/tilt can only be kept if its spread across the actuators fits in the stroke
+            double tipTiltSpan = tipTiltMax - tipTiltMin;
+            constexpr double strokeSpan = WORKSPACE_ULIM_STEPS - WORKSPACE_LLIM_STEPS;
+            if (tipTiltSpan > strokeSpan)
+                scale = strokeSpan / tipTiltSpan;
+            demand->focusSteps = std::min(std::max(demand->focusSteps, WORKSPACE_LLIM_STEPS - scale * tipTiltMin),
+                                          WORKSPACE_ULIM_STEPS - scale * tipTiltMax);
+        }
+        demand->tipTiltScale = std::max(scale, 0.0);
+        return LFAST::PMC::SATURATED;
+    }
+};
+
+class MirrorStates
+{
+private:
+
+public:
+    MirrorStates &operator=(MirrorStates const &other)
+    {
+        noInterrupts();
+        TIP_POS_RAD = other.TIP_POS_RAD;
+        TILT_POS_RAD = other.TILT_POS_RAD;
+        FOCUS_POS_MM = other.FOCUS_POS_MM;
+        interrupts();
+        return *this;
+    }
+
+    volatile double TIP_POS_RAD;
+    volatile double TILT_POS_RAD;
+    volatile double FOCUS_POS_MM;
+
+    uint8_t getMotorPosnCommands(int32_t *a_steps, int32_t *b_steps, int32_t *c_steps,
+                                 uint8_t policy = LFAST::PMC::PRESERVE_TIP_TILT,
+                                 MirrorStates *projected = nullptr) const
+    {
+        double tanAlpha = std::tan(TIP_POS_RAD);
+        double cosAlpha = std::cos(TIP_POS_RAD);
+        double tanBeta = std::tan(TILT_POS_RAD);
+        double gamma = FOCUS_POS_MM;
+
+        ActuatorDemand demand;
+        MirrorWorkspace::computeDemand(tanAlpha, tanBeta / cosAlpha, gamma, &demand);
+        uint8_t saturationStatus = MirrorWorkspace::project(&demand, policy);
+        if (saturationStatus == LFAST::PMC::REJECTED)
+            return saturationStatus;
+
+        *a_steps = demand.getSteps(LFAST::PMC::MOTOR_A);
+        *b_steps = demand.getSteps(LFAST::PMC::MOTOR_B);
+        *c_steps = demand.getSteps(LFAST::PMC::MOTOR_C);
+
+        if (projected != nullptr)
+        {
+            if (saturationStatus == LFAST::PMC::SATURATED)
+            {
+                double projTip = std::atan(demand.tipTiltScale * tanAlpha);
+                projected->TIP_POS_RAD = projTip;
+                projected->TILT_POS_RAD = std::atan(demand.tipTiltScale * (tanBeta / cosAlpha) * std::cos(projTip));
+                projected->FOCUS_POS_MM = demand.focusSteps / WORKSPACE_FOCUS_GAIN;
+            }
+            else
+            {
+                *projected = *this;
+            }
+        }
+        return saturationStatus;
+    }
+    // Unrounded actuator positions, for velocity control. Nothing is written if
+    // the pose is rejected.
+    uint8_t getMotorStepTargets(double *steps, uint8_t policy = LFAST::PMC::PRESERVE_TIP_TILT) const
+    {
+        double cosAlpha = std::cos(TIP_POS_RAD);
+        ActuatorDemand demand;
+        MirrorWorkspace::computeDemand(std::tan(TIP_POS_RAD), std::tan(TILT_POS_RAD) / cosAlpha, FOCUS_POS_MM, &demand);
+        uint8_t saturationStatus = MirrorWorkspace::project(&demand, policy);
+        if (saturationStatus == LFAST::PMC::REJECTED)
+            return saturationStatus;
+        for (uint8_t ii = 0; ii < 3; ii++)
+            steps[ii] = demand.getExactSteps(ii);
+        return saturationStatus;
+    }
+    void resetToZero()
+    {
+        TIP_POS_RAD = 0.0;
+        TILT_POS_RAD = 0.0;
+        FOCUS_POS_MM = 0.0;
+    }
+    // The pose the actuators are at, e.g. after homing or tracking
+    void setFromFeedback(const MotorStates &motors)
+    {
+        double tip, tilt, focus;
+        motors.getTipTiltFocusFeedback(&tip, &tilt, &focus);
+        TIP_POS_RAD = tip;
+        TILT_POS_RAD = tilt;
+        FOCUS_POS_MM = focus;
+    }
+};
+
+#endif
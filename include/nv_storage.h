@@ -0,0 +1,50 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Non-volatile storage interface
+@file nv_storage.h
+
+Byte-addressed read/write interface used by the position journal, so it
+can run on the Teensy EEPROM, an external FRAM or on a simulated memory in
+the native build. The backend is picked with NV_STORAGE_BACKEND in
+device_config.h.
+*/
+
+#ifndef NV_STORAGE_H
+#define NV_STORAGE_H
+
+#include <cstdint>
+
+class NvStorage
+{
+public:
+    virtual ~NvStorage() {}
+    // Returns false if the device doesn't respond
+    virtual bool begin() { return true; }
+    virtual void read(uint32_t addr, void *data, uint32_t length) = 0;
+    virtual void write(uint32_t addr, const void *data, uint32_t length) = 0;
+    virtual uint32_t size() const = 0;
+    // True for memories without erase cycles (FRAM), where writing
+    // often costs nothing and checkpoint rate limits can be dropped
+    virtual bool isWearFree() const { return false; }
+    // True where a write holds off every interrupt, the control tick included
+    virtual bool stallsInterrupts() const { return false; }
+
+    template <typename T>
+    void get(uint32_t addr, T &value) { read(addr, &value, sizeof(T)); }
+    template <typename T>
+    void put(uint32_t addr, const T &value) { write(addr, &value, sizeof(T)); }
+};
+
+#endif
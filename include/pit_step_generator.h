@@ -0,0 +1,51 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief StepGenerator backend on a Teensy periodic interrupt timer
+@file pit_step_generator.h
+
+One IntervalTimer (PIT) channel runs the DDA for all three axes, so their
+pulses share a time base. Only one instance can exist, the timer ISR is static.
+*/
+
+#ifndef PIT_STEP_GENERATOR_H
+#define PIT_STEP_GENERATOR_H
+
+#include <Arduino.h>
+#include "step_generator.h"
+
+class PitStepGenerator : public StepGenerator
+{
+public:
+    PitStepGenerator(const uint8_t *stepPins, const uint8_t *dirPins, uint32_t baseRate_hz);
+    bool begin() override;
+    bool queueSegment(const int32_t *steps, uint32_t duration_us) override;
+    uint8_t getFreeSegments() const override { return core.getFreeSegments(); }
+    bool isIdle() const override { return core.isIdle(); }
+    void stop() override;
+    void getPositions(int32_t *positions) const override;
+    void setPositions(const int32_t *positions) override;
+    uint32_t getMaxStepRate() const override { return core.getMaxStepRate(); }
+
+private:
+    static void timer_ISR();
+    void service();
+    static PitStepGenerator *instance;
+    IntervalTimer timer;
+    DdaStepCore core;
+    uint8_t stepPins[STEP_GEN_AXES];
+    uint8_t dirPins[STEP_GEN_AXES];
+};
+
+#endif
@@ -0,0 +1,280 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Append-only position journal
+@file position_journal.h
+
+Position records are appended round-robin to a ring of slots in a region
+of non-volatile storage, so repeated commits are spread over the whole
+region instead of rewriting the same bytes. A header at the start of the
+region describes the slot layout and is tagged with the storage backend the
+journal was last opened on, so records carried over from another backend can
+be told apart.
+
+Slots hold consecutive sequence numbers from slot 0 up to the newest record,
+so the newest record is found with a binary search. If that invariant
+doesn't hold (blank region, torn write in slot 0, layout change) the slots
+are scanned linearly and the journal is compacted: the newest record is
+moved to slot 0 and every other record is invalidated.
+*/
+
+#ifndef POSITION_JOURNAL_H
+#define POSITION_JOURNAL_H
+
+#include <cstdint>
+#include "nv_storage.h"
+#include "position_record.h"
+
+constexpr uint32_t POSITION_JOURNAL_MAGIC = 0x4A534F50; // "POSJ"
+
+struct PositionJournalHeader
+{
+    uint32_t magic;
+    uint16_t recordVersion;
+    uint16_t slotSize;
+    uint32_t numSlots;
+    uint32_t backend;
+    uint32_t crc;
+
+    uint32_t computeCrc() const
+    {
+        return crc32(this, offsetof(PositionJournalHeader, crc));
+    }
+    bool isValid() const
+    {
+        return (magic == POSITION_JOURNAL_MAGIC) && (crc == computeCrc()) && (numSlots > 0);
+    }
+};
+
+class PositionJournal
+{
+public:
+    static constexpr uint32_t SLOT_SIZE = sizeof(PositionRecord);
+
+    PositionJournal(NvStorage &storage, uint32_t regionStart, uint32_t regionSize, uint32_t backend = 0)
+        : storage(storage), regionStart(regionStart),
+          numSlots((regionSize - sizeof(PositionJournalHeader)) / SLOT_SIZE), backend(backend),
+          head(0), newestSlot(-1), scanSlotReads(0), scanWasLinear(false), backendChanged(false) {}
+
+    // Reads a region's header without opening the journal. Returns false if
+    // there is no journal there.
+    static bool readHeader(NvStorage &storage, uint32_t regionStart, PositionJournalHeader *header)
+    {
+        storage.get(regionStart, *header);
+        return header->isValid();
+    }
+    // Drops the journal in a region, the next begin() there starts a fresh one
+    static void retire(NvStorage &storage, uint32_t regionStart)
+    {
+        storage.put(regionStart, (uint32_t)0);
+    }
+
+    // Locates the newest valid record. Returns false if the journal is empty.
+    bool begin()
+    {
+        scanSlotReads = 0;
+        scanWasLinear = false;
+        backendChanged = false;
+        newestSlot = -1;
+
+        PositionJournalHeader header;
+        storage.get(regionStart, header);
+        if (!header.isValid() || header.recordVersion != POSITION_RECORD_VERSION)
+        {
+            // Nothing usable here, start a fresh journal
+            format();
+            return false;
+        }
+        // Written from another backend, the records are kept but the caller is told
+        backendChanged = (header.backend != backend);
+        if (header.slotSize != SLOT_SIZE || header.numSlots != numSlots)
+        {
+            // Region was resized, carry the newest record over into the new layout
+            PositionRecord record;
+            int32_t slot = linearScan(header.slotSize, header.numSlots, &record);
+            format();
+            if (slot < 0)
+                return false;
+            writeSlot(0, record);
+            setNewest(0, record);
+            return true;
+        }
+        if (backendChanged)
+            writeHeader();
+
+        PositionRecord record;
+        int32_t slot = fastScan(&record);
+        if (slot < 0)
+        {
+            slot = linearScan(SLOT_SIZE, numSlots, &record);
+            if (slot < 0)
+                return false;
+            compact(slot, record);
+            return true;
+        }
+        setNewest(slot, record);
+        return true;
+    }
+
+    bool getNewest(PositionRecord *record) const
+    {
+        if (newestSlot < 0)
+            return false;
+        *record = newest;
+        return true;
+    }
+
+    // Stamps the next sequence number on the record and writes it at the head.
+    void append(PositionRecord &record)
+    {
+        record.sequence = (newestSlot < 0) ? 1 : newest.sequence + 1;
+        record.seal();
+        writeSlot(head, record);
+        setNewest(head, record);
+    }
+
+    uint32_t getNumSlots() const { return numSlots; }
+    uint32_t getHead() const { return head; }
+    // Slots read by the last begin(), and whether it had to fall back to a linear scan
+    uint32_t getScanSlotReads() const { return scanSlotReads; }
+    bool wasLastScanLinear() const { return scanWasLinear; }
+    // True if the last begin() found the journal tagged with another backend
+    bool wasBackendChanged() const { return backendChanged; }
+
+private:
+    uint32_t slotAddr(uint32_t slot, uint32_t slotSize) const
+    {
+        return regionStart + sizeof(PositionJournalHeader) + slot * slotSize;
+    }
+    bool readSlot(uint32_t slot, uint32_t slotSize, PositionRecord *record)
+    {
+        scanSlotReads++;
+        storage.get(slotAddr(slot, slotSize), *record);
+        return record->isValid();
+    }
+    void writeSlot(uint32_t slot, const PositionRecord &record)
+    {
+        storage.put(slotAddr(slot, SLOT_SIZE), record);
+    }
+    void setNewest(uint32_t slot, const PositionRecord &record)
+    {
+        newestSlot = slot;
+        newest = record;
+        head = (slot + 1) % numSlots;
+    }
+
+    // Binary search for the last slot continuing slot 0's sequence. Returns -1
+    // if the ring doesn't look consistent.
+    int32_t fastScan(PositionRecord *record)
+    {
+        PositionRecord first, probe;
+        if (!readSlot(0, SLOT_SIZE, &first))
+            return -1;
+        uint32_t lo = 0, hi = numSlots - 1;
+        *record = first;
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (readSlot(mid, SLOT_SIZE, &probe) && (probe.sequence - first.sequence) == mid)
+            {
+                lo = mid;
+                *record = probe;
+            }
+            else
+                hi = mid - 1;
+        }
+        // The slot after the newest must be blank, torn or from the previous lap
+        uint32_t next = (lo + 1) % numSlots;
+        if (next != 0 && readSlot(next, SLOT_SIZE, &probe) && probe.isNewerThan(*record))
+            return -1;
+        return lo;
+    }
+
+    int32_t linearScan(uint32_t slotSize, uint32_t slots, PositionRecord *record)
+    {
+        scanWasLinear = true;
+        int32_t found = -1;
+        PositionRecord probe;
+        for (uint32_t slot = 0; slot < slots; slot++)
+        {
+            if (slotAddr(slot + 1, slotSize) > storage.size())
+                break;
+            if (readSlot(slot, slotSize, &probe) && (found < 0 || probe.isNewerThan(*record)))
+            {
+                found = slot;
+                *record = probe;
+            }
+        }
+        return found;
+    }
+
+    void compact(uint32_t slot, const PositionRecord &record)
+    {
+        for (uint32_t ii = 1; ii < numSlots; ii++)
+        {
+            if (ii != slot)
+                invalidateSlot(ii);
+        }
+        // Write the new copy before retiring the old one so a reset here loses nothing
+        writeSlot(0, record);
+        if (slot != 0)
+            invalidateSlot(slot);
+        setNewest(0, record);
+    }
+
+    // Flips the CRC of a valid record rather than erasing the slot, it's fewer writes
+    void invalidateSlot(uint32_t slot)
+    {
+        PositionRecord probe;
+        storage.get(slotAddr(slot, SLOT_SIZE), probe);
+        if (probe.isValid())
+            storage.put(slotAddr(slot, SLOT_SIZE) + offsetof(PositionRecord, crc), (uint32_t)~probe.crc);
+    }
+
+    void writeHeader()
+    {
+        PositionJournalHeader header;
+        header.magic = POSITION_JOURNAL_MAGIC;
+        header.recordVersion = POSITION_RECORD_VERSION;
+        header.slotSize = SLOT_SIZE;
+        header.numSlots = numSlots;
+        header.backend = backend;
+        header.crc = header.computeCrc();
+        storage.put(regionStart, header);
+    }
+
+    void format()
+    {
+        writeHeader();
+
+        // Stale records from an older layout must not be picked up later
+        for (uint32_t ii = 0; ii < numSlots; ii++)
+            invalidateSlot(ii);
+        head = 0;
+        newestSlot = -1;
+    }
+
+    NvStorage &storage;
+    uint32_t regionStart;
+    uint32_t numSlots;
+    uint32_t backend;
+    uint32_t head;
+    int32_t newestSlot;
+    PositionRecord newest;
+    uint32_t scanSlotReads;
+    bool scanWasLinear;
+    bool backendChanged;
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Persisted stepper position record
+@file position_record.h
+
+Versioned, CRC-checked record of the three stepper positions. Records carry
+a sequence counter so the newest valid copy can be picked out of several
+slots after a torn write.
+*/
+
+#ifndef POSITION_RECORD_H
+#define POSITION_RECORD_H
+
+#include <cstdint>
+#include <cstddef>
+
+constexpr uint16_t POSITION_RECORD_VERSION = 1;
+
+enum POSITION_RECORD_FLAGS
+{
+    POSITION_FLAG_HOMED = 0x0001,      // Positions are referenced to a completed homing run
+    POSITION_FLAG_STATIONARY = 0x0002, // Committed with no motion in progress (clean shutdown marker)
+    // Microstep scale shift the drivers were stepping at (see microstep_mode.h).
+    // Positions are always in reference microsteps, this only sizes checkpoint errors.
+    POSITION_FLAG_STEP_SCALE_MASK = 0x0F00,
+};
+constexpr uint8_t POSITION_FLAG_STEP_SCALE_SHIFT = 8;
+
+// CRC-32 (IEEE 802.3, reflected)
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    crc = ~crc;
+    for (size_t ii = 0; ii < length; ii++)
+    {
+        crc ^= bytes[ii];
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+struct PositionRecord
+{
+    uint16_t version;
+    uint16_t flags;
+    uint32_t sequence;
+    int32_t position[3];
+    uint32_t crc;
+
+    uint32_t computeCrc() const
+    {
+        return crc32(this, offsetof(PositionRecord, crc));
+    }
+    void seal()
+    {
+        version = POSITION_RECORD_VERSION;
+        crc = computeCrc();
+    }
+    bool isValid() const
+    {
+        return (version == POSITION_RECORD_VERSION) && (crc == computeCrc());
+    }
+    bool hasFlags(uint16_t mask) const
+    {
+        return (flags & mask) == mask;
+    }
+    // Sequence comparison that survives the counter wrapping
+    bool isNewerThan(const PositionRecord &other) const
+    {
+        return (int32_t)(sequence - other.sequence) > 0;
+    }
+};
+
+#endif
@@ -27,8 +27,28 @@ MoveRelative(V, X,Y) – Move each axis with velocity V X,Y units from the curre
 MoveRawAbsolute(V, X,Y) – Move each axis with velocity V to an absolute X,Y position with respect to “home”
 MoveRawRelative(V, X,Y) – Move each axis with velocity V X,Y units from the current position In the above commands,
                           V, X and Y are vectors of length 3. Velocity is in units of steps per second, X,Y are steps.
+MoveType(3) – TRACK mode: SetTip/SetTilt/SetFocus become rates (urad/s, urad/s and SetFocus units per second)
+               that the mirror follows continuously, blending rate changes, until the mode changes.
+MoveType(4) – JOG mode: the joystick drives tip/tilt rates the same way, its button toggles fine/coarse gain.
+              SetTip/SetTilt/SetFocus are ignored until the mode changes.
 Home(V) – Move all actuators to home positions at velocity V
-FanSpeed(S) – Set the fan speed to a percentage S of full scale
+FindHomeFast(V) – Same as Home(V), but first rapid to just above the switches using the positions stored in EEPROM
+MicrostepMode(N) – Step the drivers at 1/N microsteps (1, 2, 4, 8 or 16), applied once the mirror is stationary.
+                   Positions and commands stay in 1/16 microsteps, coarser modes slew faster at the same step rate.
+SaturationPolicy(P) – Select how unreachable commands are handled: 0 = preserve tip/tilt, 1 = preserve focus, 2 = reject
+ArmTrace(M) – Restart the control tick trace, freezing it after a trigger in mask M (see TRACE_TRIGGER)
+TriggerTrace() – Trigger the trace from the client
+DumpTrace() – Freeze the trace and stream it as base64 chunks of the binary dump (client/trace_decoder.py)
+GetMetrics() – Returns all counters and gauges (see PMC_METRIC) in one message
+MetricsPeriod(S) – Push GetMetrics replies every S seconds, 0 to stop
+GetParam(N) – Returns motion parameter N (see PMC_PARAM) with its default and limits
+ParamId(N), SetParam(X) – Sets motion parameter N to X, applies it (live or on reboot) and stores it
+ClockSync(T) – Clock sync sample, T is the host time in us the message is expected to arrive at.
+               Replies with the fitted offset, skew and residual of the local clock (see clock_sync.h).
+ExecuteAt(T) – Hold the motion command that follows in the same message until host time T (us), then
+               release it from the control tick. Needs ClockSync first, replies with the lead time.
+FanSpeed(S) – Set the fan speed to a percentage S of full scale (25 kHz PWM). A fan
+    driven hard enough to turn that stops producing tach pulses raises FanStalled.
 GetStatus() – Returns the status bits for each axis of motion. Bits are Faulted, Home and Moving
 GetPositions() – Returns 3 step counts
 Stop() – Immediately stops all motion
@@ -44,44 +64,92 @@ Stop() – Immediately stops all motion
 #include <cmath>
 #include <algorithm>
 
-#include <MultiStepper.h>
 #include <math_util.h>
 #include "teensy41_device.h"
+#include "device_config.h"
+#include "mirror_kinematics.h"
+#include "position_record.h"
+#include "position_journal.h"
+#include "nv_storage.h"
+#include "config_store.h"
+#include "trace_recorder.h"
+#include "metrics.h"
+#include "step_generator.h"
+#include "microstep_mode.h"
+#include "track_follower.h"
+#include "blended_move.h"
+#include "joystick_jog.h"
+#include "fan_monitor.h"
+#include "clock_sync.h"
+#include "axis_state.h"
+#include "stepper_core.h"
 // Setup functions
 
 #define ENABLE_STEPPER LOW
 #define DISABLE_STEPPER HIGH
 
-constexpr double MICROSTEP_DIVIDER = 16;
-constexpr double MICROSTEP_RATIO = 1.0 / MICROSTEP_DIVIDER;
-
-constexpr double MIRROR_RADIUS_MICRONS = 281880.0;          // Radius of mirror actuator positions in um
-constexpr double MICRON_PER_STEP = 3.175 * MICROSTEP_RATIO; // conversion factor of stepper motor steps to vertical movement in um
-constexpr double STEPS_PER_MICRON = 1.0 / MICRON_PER_STEP;
-constexpr double STEPS_PER_MM = STEPS_PER_MICRON*1000;
-constexpr double MM_PER_STEP = 1.0/STEPS_PER_MM;
-
-constexpr double STROKE_MICRON = 12700.0;
-constexpr double MAX_STROKE_MICRON = (0.5 * STROKE_MICRON);
-constexpr double MIN_STROKE_MICRON = (-0.5 * STROKE_MICRON);
-constexpr double STROKE_STEPS = (uint32_t)(STROKE_MICRON / MICRON_PER_STEP); // 4000*MICROSTEP_DIVIDER
-constexpr double STROKE_BOTTOM_STEPS = (-0.5*STROKE_STEPS);
-constexpr double STROKE_TOP_STEPS = (0.5*STROKE_STEPS);
-constexpr double STROKE_BOTTOM_MICRON = STROKE_BOTTOM_STEPS * MICRON_PER_STEP;
-
-
-constexpr double URAD_PER_RAD = 1000000.0;
-constexpr double RAD_PER_URAD = 1.0/URAD_PER_RAD;
-
-// Mirror coeffs assume millimeters!!
-const double MIRROR_MATH_COEFF_0 = 281.3;
-const double MIRROR_MATH_COEFF_1 = -140.6;
-const double MIRROR_MATH_COEFF_2 = 243.6;
-// Units don't matter for motor math coeffs.
-const double MOTOR_MATH_COEFF_0 = 0.001185025075130589607;
-const double MOTOR_MATH_COEFF_1 = 0.00205252363836930761;
-const double MOTOR_MATH_COEFF_2 = 1.0;
+// Homing sequence timing (each axis runs its own copy of the sequence).
+// Distances and the slow speed ratio are defaults for the parameter table below.
+constexpr uint32_t HOMING_PAUSE_1_MS = 1000;
+constexpr uint32_t HOMING_PAUSE_2_MS = 300;
+constexpr double HOMING_BACKOFF_STEPS = STEPS_PER_MM;
+constexpr double HOMING_SLOW_SPEED_RATIO = 0.1;
+// Seeded homing rapids to this far above the bottom of the stroke before searching for the switch
+constexpr double HOMING_SEED_MARGIN_STEPS = 2 * STEPS_PER_MM;
+
+// Tunable motion parameters, see GetParam/SetParam. Only ever append to this
+// list (ids are stored), and bump PMC_PARAM_SCHEMA_VERSION if one changes meaning.
+enum PMC_PARAM
+{
+    PARAM_STEPPER_MAX_SPEED,        // steps/s
+    PARAM_STEPPER_MAX_ACCEL,        // steps/s^2
+    PARAM_UPDATE_PERIOD_US,         // Control tick period, applied on reboot
+    PARAM_HOMING_BACKOFF_STEPS,     // Distance to back off the switch before the slow approach
+    PARAM_HOMING_SEED_MARGIN_STEPS, // Seeded homing rapids to this far above the bottom of the stroke
+    PARAM_HOMING_SLOW_SPEED_RATIO,  // Slow approach speed as a fraction of the homing speed
+    PARAM_STEPPER_MAX_JERK,         // steps/s^3, bounds the blend when a move is preempted
+    PARAM_JOG_FINE_RATE,            // urad/s at full joystick deflection
+    PARAM_JOG_COARSE_RATE,          // urad/s at full joystick deflection, after a button press
+    NUM_PMC_PARAMS
+};
+constexpr uint16_t PMC_PARAM_SCHEMA_VERSION = 1;
 
+// Runtime metrics, counted since boot. Names are in PmcMetricTable.
+enum PMC_METRIC
+{
+    METRIC_MOVES_COMPLETED,
+    METRIC_MOVES_INTERRUPTED,
+    METRIC_MOVES_RETARGETED,   // Relative commands applied to a move in flight
+    METRIC_LIMIT_HITS,         // Limit switch hits outside of homing
+    METRIC_HOMING_RUNS,        // Completed homing runs
+    METRIC_COMMANDS_SATURATED, // Unreachable commands projected into range
+    METRIC_COMMANDS_REJECTED,  // Unreachable commands rejected by policy
+    METRIC_COMMANDS_DROPPED,   // Commands ignored (steppers disabled, bad handshake)
+    METRIC_POSITION_WRITES,    // Position journal records written
+    METRIC_CONFIG_WRITES,      // Parameter table saves
+    METRIC_MESSAGES_RECEIVED,  // Client messages processed
+    METRIC_CMD_MOTION,         // Commands received, by type
+    METRIC_CMD_HOMING,
+    METRIC_CMD_STOP,
+    METRIC_CMD_QUERY,
+    METRIC_CMD_CONFIG,
+    METRIC_CMD_TRACE,
+    METRIC_CONNECTS, // Client handshakes
+    METRIC_WATCHDOG_WARNINGS,
+    METRIC_FAN_STALLS,
+    METRIC_MOVES_SCHEDULED, // ExecuteAt commands released by the control tick
+    METRIC_SCHEDULES_EXPIRED, // ExecuteAt schedules dropped, no command by the release time
+    METRIC_LOOP_OVERRUNS,   // Passes through loop() over a LoopWatchdog budget (watchdog not fed)
+    METRIC_ISR_MAX_US,  // Gauge: longest control tick
+    METRIC_TICK_GAP_MAX_US, // Gauge: longest time between control tick starts
+    METRIC_JOURNAL_WRITE_MAX_US, // Gauge: longest position record write
+    METRIC_LOOP_MAX_US, // Gauge: longest pass through loop()
+    METRIC_LOOP_CLIENTS_MAX_US, // Gauges: longest of each LOOP_STAGE
+    METRIC_LOOP_CLIENT_DATA_MAX_US,
+    METRIC_LOOP_SERVICES_MAX_US,
+    METRIC_LOOP_NOTIFICATIONS_MAX_US,
+    NUM_PMC_METRICS
+};
 
 // PM Control functions
 enum PRIMARY_MIRROR_ROWS
@@ -101,177 +169,19 @@ enum PRIMARY_MIRROR_ROWS
     STEPPER_A_FB,
     STEPPER_B_FB,
     STEPPER_C_FB,
+    NUM_PRIMARY_MIRROR_ROWS
 };
 
-namespace LFAST
-{
-    namespace PMC
-    {
-        enum ControlMode
-        {
-            STOP = 0,
-            RELATIVE = 1,
-            ABSOLUTE = 2,
-        };
-
-        enum UNIT_TYPES
-        {
-            ENGINEERING = 0,
-            STEPS_PER_SEC = 1
-        };
-
-        enum AXIS
-        {
-            TIP = 0,
-            TILT = 1,
-            FOCUS = 2
-        };
-
-        enum DIRECTION
-        {
-            REVERSE = -1,
-            FORWARD = 1
-        };
-
-        enum MOTOR_ID
-        {
-            MOTOR_A = 0,
-            MOTOR_B = 1,
-            MOTOR_C = 2
-        };
-
-    }
-};
-
-class MotorStates
-{
-private:
-
-    vectorX<double, 3> getMirrorVector(const int32_t *am, const int32_t *bm, const int32_t *cm) const
-    {
-        double A = (double)*am;
-        double B = (double)*bm;
-        double C = (double)*cm;
-        vectorX<double, 3> normalVector;
-
-        constexpr double c[3]{MOTOR_MATH_COEFF_0, MOTOR_MATH_COEFF_1, MOTOR_MATH_COEFF_2};
-        normalVector[0] = (c[0] * (B + C)) - 2 * c[0] * A;
-        normalVector[1] = c[1] * (C - B);
-        normalVector[2] = c[2];
-        normalVector.normalize();
-        return normalVector;
-    }
-
-public:
-    MotorStates(int32_t A, int32_t B, int32_t C) : A_steps(A), B_steps(B), C_steps(C) {}
-
-    MotorStates &operator=(MotorStates const &other)
-    {
-        noInterrupts();
-        A_steps = other.A_steps;
-        B_steps = other.B_steps;
-        C_steps = other.C_steps;
-        interrupts();
-        return *this;
-    }
 
-    int32_t A_steps;
-    int32_t B_steps;
-    int32_t C_steps;
+// void updateControlLoop_ISR();
 
-    void getTipTiltFocusFeedback(double *tip, double *tilt, double *focus)
-    {
-        auto mirrorVector = getMirrorVector(&A_steps, &B_steps, &C_steps);
-        auto norm_XZ = mirrorVector;
-        norm_XZ[1] = 0.0;
-        norm_XZ.normalize();
-        double tipAngle_rad = std::acos(norm_XZ[2]);
-        double tiltAngle_rad = std::acos(mirrorVector[2] * std::cos(tipAngle_rad) - mirrorVector[0] * std::sin(tipAngle_rad));
-        *tip = tipAngle_rad;
-        *tilt = tiltAngle_rad;
-        *focus = 0; // TBD, haven't decided best way to do this part yet
-    }
-};
-class MirrorStates
+// Step/dir pins of the three drivers, for StepperCore (see primary_mirror_ctrl.cpp)
+struct ShieldDriverPins
 {
-private:
-
-public:
-    MirrorStates &operator=(MirrorStates const &other)
-    {
-        noInterrupts();
-        TIP_POS_RAD = other.TIP_POS_RAD;
-        TILT_POS_RAD = other.TILT_POS_RAD;
-        FOCUS_POS_MM = other.FOCUS_POS_MM;
-        interrupts();
-        return *this;
-    }
-
-    volatile double TIP_POS_RAD;
-    volatile double TILT_POS_RAD;
-    volatile double FOCUS_POS_MM;
-
-    bool getMotorPosnCommands(int32_t *a_steps, int32_t *b_steps, int32_t *c_steps) const
-    {
-
-        double tanAlpha = std::tan(TIP_POS_RAD);
-        double cosAlpha = std::cos(TIP_POS_RAD);
-        double tanBeta = std::tan(TILT_POS_RAD);
-        double gamma = FOCUS_POS_MM;
-
-        constexpr double c[3]{MIRROR_MATH_COEFF_0, MIRROR_MATH_COEFF_1, MIRROR_MATH_COEFF_2};
-        double a_distance = gamma + (c[0] * tanAlpha);
-        double b_distance = gamma + (c[1] * tanAlpha + c[2] * tanBeta / cosAlpha);
-        double c_distance = gamma + (c[1] * tanAlpha - c[2] * tanBeta / cosAlpha);
-
-        int32_t a_steps_presat = (int32_t)(a_distance * STEPS_PER_MM);
-        int32_t b_steps_presat = (int32_t)(b_distance * STEPS_PER_MM);
-        int32_t c_steps_presat = (int32_t)(c_distance * STEPS_PER_MM);
-        
-        constexpr int32_t stroke_ulim = STROKE_STEPS / 2;
-        constexpr int32_t stroke_llim = -1 * stroke_ulim;
-        int32_t a_steps_postsat = saturate(a_steps_presat, stroke_llim, stroke_ulim);
-        int32_t b_steps_postsat = saturate(b_steps_presat, stroke_llim, stroke_ulim);
-        int32_t c_steps_postsat = saturate(c_steps_presat, stroke_llim, stroke_ulim);
-
-        int32_t a_diff = a_steps_presat - a_steps_postsat;
-        int32_t b_diff = b_steps_presat - b_steps_postsat;
-        int32_t c_diff = c_steps_presat - c_steps_postsat;
-
-        int32_t max_diff = std::max({a_diff, b_diff, c_diff});
-
-        bool saturationFlag = false;
-        if (std::abs(max_diff) > 0)
-        {
-            *a_steps = a_steps_postsat - max_diff;
-            *b_steps = b_steps_postsat - max_diff;
-            *c_steps = c_steps_postsat - max_diff;
-            saturationFlag = true;
-        }
-        else
-        {
-            *a_steps = a_steps_presat;
-            *b_steps = b_steps_presat;
-            *c_steps = c_steps_presat;
-        }
-        return saturationFlag;
-    }
-    void resetToZero()
-    {
-        TIP_POS_RAD = 0.0;
-        TILT_POS_RAD = 0.0;
-        FOCUS_POS_MM = 0.0;
-    }
-        void resetToHomed()
-    {
-        TIP_POS_RAD = 0.0;
-        TILT_POS_RAD = 0.0;
-        FOCUS_POS_MM = STROKE_BOTTOM_MICRON;
-    }
+    static void setDirections(uint8_t dirBits);
+    static void step(uint8_t stepBits);
 };
 
-// void updateControlLoop_ISR();
-
 class PrimaryMirrorControl : public LFAST_Device
 {
 public:
@@ -279,31 +189,72 @@ public:
 
     virtual ~PrimaryMirrorControl() {}
     void setupPersistentFields() override;
-    void updateStatusFields();
-    void updateCommandFields();
-    void updateFeedbackFields();
+    void serviceDashboard();
+    void serviceTickMessages();
+    void getDashboardStats(uint32_t *maxPass_us, uint32_t *maxField_us, uint32_t *deferredFields);
     void pingMirrorControlStateMachine();
     void copyShadowToActive();
     void setControlMode(uint8_t moveType);
     void setFanSpeed(unsigned int PWR);
+    void serviceFan();
+    void serviceJoystick();
+    void getFanStatus(uint8_t *duty, uint32_t *rpm, bool *stalled);
+    void updateLocalClock(uint32_t now_us) { tickTime_us = localClock.extend(now_us); }
+    uint64_t getLocalTime_us();
+    void addClockSyncSample(int64_t hostTime_us);
+    const ClockSync &getClockSync() { return clockSync; }
+    bool isClockSynced() { return clockSync.isSynced(getLocalTime_us()); }
+    uint8_t scheduleNextCommand(int64_t hostTime_us, int64_t *lead_us);
+    void cancelScheduledCommand() { releaseScheduled = false; }
+    int64_t getLastReleaseError_us() { return lastReleaseError_us; }
     void setTipTarget(double tgt);
     void setTiltTarget(double tgt);
     void setFocusTarget(double tgt);
-    void goHome(volatile double homeSpeed);
+    void setSaturationPolicy(uint8_t policy);
+    bool setMicrostepMode(uint32_t divider);
+    uint32_t getMicrostepDivider() { return slewMicrostepMode.getDivider(); }
+    bool isJogCoarse() { return joystickJog.isCoarse(); }
+    uint8_t getLastSaturationEvent(double *tip, double *tilt, double *focus);
+    void getLastPreemptedTarget(double *tip, double *tilt, double *focus);
+    bool goHome(volatile double homeSpeed, bool seeded = false);
     void stopNow();
     bool getStatus(uint8_t motor);
     double getStepperPosition(uint8_t motor);
+    void getAxisSnapshot(AxisState *snapshot);
 
     void saveStepperPositionsToEeprom();
     void resetPositionsInEeprom();
     void loadCurrentPositionsFromEeprom();
+    void servicePositionJournal();
+    void loadConfiguration();
+    uint8_t setParam(uint16_t id, double value);
+    double getParam(uint16_t id);
+    const ParamDef *getParamDef(uint16_t id);
+    void getCheckpointErrors(uint32_t *maxUncommittedSteps, uint32_t *errorBoundSteps);
+    void publishAxisState();
+    void recordTraceSample(uint32_t isrDuration_us);
+    void armTrace(uint8_t triggerMask);
+    bool triggerTrace();
+    uint32_t beginTraceDump();
+    uint32_t readTraceDump(uint32_t offset, uint8_t *buf, uint32_t len);
+    uint8_t getTraceState();
+    MetricsRegistry &getMetrics() { return metrics; }
+    bool arePositionsTrusted() { return positionsTrusted; }
+    bool isHomingRequired() { return !positionsTrusted; }
     void enableControlInterrupt();
     void setMoveNotifierFlag(volatile bool *flagPtr);
     void setHomingCompleteNotifierFlag(volatile bool *flagPtr);
+    void setSaturationNotifierFlag(volatile bool *flagPtr);
+    void setPreemptNotifierFlag(volatile bool *flagPtr);
+    void setFanStallNotifierFlag(volatile bool *flagPtr);
+    void setReleaseNotifierFlag(volatile bool *flagPtr);
+    void setScheduleExpiredNotifierFlag(volatile bool *flagPtr);
     bool checkForNewCommand();
     bool isHomingInProgress();
+    void getHomingTimes(uint32_t *aTime_ms, uint32_t *bTime_ms, uint32_t *cTime_ms);
 
     void limitSwitchHandler(uint16_t axis);
+    void serviceLimitSwitches();
     void enableSteppers(bool doEnable);
     bool isEnabled() { return steppersEnabled; }
 
@@ -311,29 +262,164 @@ private:
     PrimaryMirrorControl();
     void hardware_setup();
     void enableLimitSwitchInterrupts();
-    void updateStepperCommands();
+    void recordLimitSwitchEdge(uint8_t motor);
+    uint8_t updateStepperCommands();
+    void startBlendedMove(const int32_t *stepperCmdVector);
     bool pingSteppers();
+    bool pingBlendedMove();
+    bool pingStepGenerator();
+    void haltStepGenerator();
+    void haltMotion();
+    bool pingMicrostepChange();
+    bool startFinalApproach();
+    void applyMicrostepMode(const MicrostepMode &mode);
+    int32_t getAxisPosition(uint8_t motor);
+    void setAxisPosition(uint8_t motor, int32_t referenceSteps);
+    bool pingTracking();
+    void pingJoystick();
+    void finishTracking();
     bool pingHomingRoutine();
-    MultiStepper *stepperControl;
+    bool pingAxisHomingRoutine(uint8_t motor, double *velocity);
+    void requestPositionCommit(uint16_t flags);
+    bool waitForMotionRecord();
+    void commitPositionRecord(uint16_t flags, const int32_t *positions);
+    void captureStepperPositions(int32_t *positions);
+    void setupStorage();
+    void captureDashboardSnapshot();
+    double getDashboardValue(uint8_t row);
+    void renderDashboardField(uint8_t row);
+    void applyMotionParams();
+    double getStepSpeedLimit(double period_us);
+    double getCheckpointPolicyErrorSteps(uint8_t stepScaleShift);
+    bool checkpointsInMotion();
+    void startCoordinatedMove(const int32_t *targets);
+    bool runCoordinatedMove();
+    void runAxisVelocities(const double *velocity);
+    void clearDrive();
+    // Everything stepped from the tick goes through the core, which holds the
+    // step counts. The step generator, if there is one, hands its counts back.
+    StepperCore<ShieldDriverPins> stepperCore;
+    AxisState axes;
     MirrorStates CommandStates_Eng;
     MirrorStates ShadowCommandStates_Eng;
+    MirrorStates AppliedCommandStates_Eng;
+    MirrorStates SaturatedCommandStates_Eng;
+    MirrorStates PreemptedCommandStates_Eng; // Target abandoned by the last preemption
     uint8_t controlMode;
+    uint8_t saturationPolicy;
+    uint8_t lastSaturationStatus;
 
     bool steppersEnabled;
     bool focusUpdated;
     bool tipUpdated;
     bool tiltUpdated;
-    int32_t A_cmdSteps;
-    int32_t B_cmdSteps;
-    int32_t C_cmdSteps;
-    bool limitFound_A;
-    bool limitFound_B;
-    bool limitFound_C;
+    // Limit switch debouncing: the pin ISRs only timestamp edges, the control
+    // tick confirms the level in axes once it has been stable. These are
+    // written outside the tick, so they stay out of the axis block.
+    volatile uint32_t limitSwitchEdgeTime_us[NUM_AXES];
+    volatile uint32_t limitSwitchEdgeCount[NUM_AXES];
     double homingSpeedStepsPerSec;
+    bool homingIsSeeded;
+    bool homingCommitPending; // Homing waits for loop() to commit the start-of-run record
+    bool positionsTrusted;
+    bool positionsApproximate;
+    // Position persistence: the control ISR only requests commits, the
+    // journal is written from loop() by servicePositionJournal().
+    NvStorage *positionStorage;
+    bool storageBackendChanged;
+    PositionJournal *positionJournal;
+    ConfigStore *configStore;
+    volatile uint16_t positionRecordFlags; // Flags of the newest requested record
+    volatile int32_t pendingPositions[3];
+    volatile uint16_t pendingRecordFlags;
+    volatile uint32_t commitRequestCount;
+    volatile uint32_t commitServicedCount;
+    uint16_t committedFlags;
+    int32_t committedPositions[3];
+    uint32_t lastCommit_ms;
+    uint32_t lastJournalService_ms;
+    uint32_t maxJournalServiceGap_ms;
+    uint32_t maxUncommittedSteps;
+    uint32_t tickPeriod_us;
+    MetricsRegistry metrics;
+    // Set when coordinated moves are stepped by a StepGenerator (ENABLE_STEP_GENERATOR)
+    StepGenerator *stepGenerator;
+    CoordinatedMove plannedMove;
+    // A command that preempts a move in flight blends into the new target from
+    // the current motion instead (through the step generator when there is one)
+    BlendedMove blendedMove;
+    bool preemptRequested;
+    bool moveIsBlended;
+    int32_t blendSegment[3]; // Taken from the blend but not queued yet
+    bool blendSegmentPending;
+    // Driver step counters and targets are in microstepMode's steps, everything
+    // else in reference microsteps. Point-to-point moves slew at slewMicrostepMode:
+    // the drivers step onto its grid, slew, and finish the last part of a driver
+    // step at the reference resolution, which they stay in at rest.
+    MicrostepMode microstepMode;
+    MicrostepMode slewMicrostepMode;
+    MicrostepMode pendingMicrostepMode;
+    bool microstepAlignStarted;
+    uint8_t restoredStepScaleShift; // Mode the restored position record was stepped at
+    // TRACK mode: loop() sets the rates, the control tick integrates them into
+    // trackPose and each axis follows it in driver steps through runAxisVelocities()
+    struct TrackRates
+    {
+        double tip_rad_s;
+        double tilt_rad_s;
+        double focus_s;
+    };
+    TrackRates trackRates;
+    MirrorStates trackPose;
+    TrackFollower trackFollower[3];
+    bool trackStarted;
+    bool trackHeldAtEdge;
+    // JOG mode feeds trackRates from the joystick every joystickSampleTicks
+    JoystickSource *joystickSource;
+    JoystickJog joystickJog;
+    uint32_t joystickTick;
+    uint32_t lastJoystickSample_us; // loop() samples the shield joystick, see serviceJoystick()
+    uint32_t traceTick;
+
+    // Terminal dashboard: loop() asks for a snapshot, the control tick fills
+    // it in, and loop() redraws only the fields whose values changed.
+    struct DashboardSnapshot
+    {
+        uint8_t moveState;
+        uint8_t controlMode;
+        bool steppersEnabled;
+        AxisState axes;
+        double tipCmd, tiltCmd, focusCmd;
+        double tipEst, tiltEst, focusEst; // Filled in by loop()
+    };
+    DashboardSnapshot dashboardSnapshot;
+    volatile bool dashboardSnapshotRequested;
+    volatile bool dashboardSnapshotReady;
+    bool controlTickRunning;
+    double dashboardValue[NUM_PRIMARY_MIRROR_ROWS];
+    double dashboardRendered[NUM_PRIMARY_MIRROR_ROWS];
+    uint8_t dashboardNextRow;
+    uint32_t dashboardLastRefresh_ms;
+    uint32_t dashboardMaxPass_us;
+    uint32_t dashboardMaxField_us;
+    uint32_t dashboardDeferredFields;
+
+    // Terminal messages can't be formatted from the control tick, so it only
+    // latches what happened and loop() prints it in serviceTickMessages()
+    struct TickMessages
+    {
+        bool stepCommandsSet;
+        int32_t stepCommands[3]; // The newest, older ones are dropped
+        bool moveInterrupted;
+        uint8_t limitSwitches; // One bit per motor
+        uint8_t microstepDivider; // Mode switched to, 0 if none
+    };
+    TickMessages tickMessages;
 
     static void limitSwitch_A_ISR();
     static void limitSwitch_B_ISR();
     static void limitSwitch_C_ISR();
+    static void fanTach_ISR();
 
     typedef enum
     {
@@ -343,22 +429,44 @@ private:
         MOVE_COMPLETE = 3,
         LIMIT_SW_DETECT = 4,
         HOMING_IS_ACTIVE = 5,
+        MICROSTEP_CHANGE = 6,
+        TRACKING = 7,
+        FINAL_APPROACH = 8,
     } MOVE_STATE;
     MOVE_STATE currentMoveState;
 
     typedef enum
     {
         INITIALIZE,
-        HOMING_STEP_1, // Quick move until all endstops are hit
+        HOMING_RAPID,  // Seeded homing only: accel-limited move to just above the endstop
+        HOMING_STEP_1, // Quick move until the endstop is hit
         HOMING_STEP_2, // Short pause
-        HOMING_STEP_3, // Short Move forward until endstops are cleared
+        HOMING_STEP_3, // Short Move forward until the endstop is cleared
         HOMING_STEP_4, // Shorter pause
-        HOMING_STEP_5  // Very slow move backwards until endstops are hit again
-    } HOMING_STATE;
-    HOMING_STATE currentHomingState;
+        HOMING_STEP_5, // Very slow move backwards until the endstop is hit again
+        HOMING_DONE    // Waiting for the other axes
+    } HOMING_STATE; // Kept per axis in axes.homingState
 
     volatile bool *moveNotifierFlagPtr;
     volatile bool *homeNotifierFlagPtr;
+    volatile bool *saturationNotifierFlagPtr;
+    volatile bool *preemptNotifierFlagPtr;
+    volatile bool *fanStallNotifierFlagPtr;
+    volatile bool *releaseNotifierFlagPtr;
+    volatile bool *scheduleExpiredNotifierFlagPtr;
+
+    // Tach edges are counted by fanTach_ISR, speed and stalls worked out in serviceFan()
+    FanMonitor fanMonitor;
+
+    // Scheduled moves: loop() fits the host clock against localClock from
+    // ClockSync samples and converts ExecuteAt times, checkForNewCommand()
+    // holds the next command until the tick time reaches releaseAt_us.
+    LocalClock localClock;
+    ClockSync clockSync;
+    uint64_t tickTime_us;
+    uint64_t releaseAt_us;
+    volatile bool releaseScheduled;
+    int64_t lastReleaseError_us;
 };
 
 #endif
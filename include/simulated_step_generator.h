@@ -0,0 +1,113 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Step generator backend for native tests
+@file simulated_step_generator.h
+
+Runs DdaStepCore on a virtual clock and logs every pin edge, so pulse
+spacing, pulse width and direction setup/hold times can be checked without
+hardware. It covers the DDA only: how long other interrupts hold off the PIT on
+the target has to be measured there.
+*/
+
+#ifndef SIMULATED_STEP_GENERATOR_H
+#define SIMULATED_STEP_GENERATOR_H
+
+#include <vector>
+#include "step_generator.h"
+
+class SimulatedStepGenerator : public StepGenerator
+{
+public:
+    struct Pulse
+    {
+        uint64_t rise_ns;
+        uint64_t fall_ns;
+        bool positive;
+        uint64_t dirSet_ns; // When the direction pin last changed before this pulse
+    };
+
+    explicit SimulatedStepGenerator(uint32_t baseRate_hz)
+        : core(baseRate_hz), baseTicks(0)
+    {
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            dirSet_ns[ii] = 0;
+    }
+
+    bool queueSegment(const int32_t *steps, uint32_t duration_us) override
+    {
+        return core.push(steps, duration_us);
+    }
+    uint8_t getFreeSegments() const override { return core.getFreeSegments(); }
+    bool isIdle() const override { return core.isIdle(); }
+    void stop() override { core.stop(); }
+    void getPositions(int32_t *positions) const override
+    {
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            positions[ii] = core.getPosition(ii);
+    }
+    void setPositions(const int32_t *positions) override
+    {
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            core.setPosition(ii, positions[ii]);
+    }
+    uint32_t getMaxStepRate() const override { return core.getMaxStepRate(); }
+
+    // Runs the base timer for n ticks
+    void advance(uint32_t n)
+    {
+        DdaStepCore::Output out;
+        uint8_t prevDir = dir;
+        for (uint32_t kk = 0; kk < n; kk++)
+        {
+            uint64_t now_ns = getTime_ns();
+            core.tick(out);
+            for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            {
+                uint8_t bit = 1 << ii;
+                if ((out.lower & bit) && !pulses[ii].empty())
+                    pulses[ii].back().fall_ns = now_ns;
+                if (out.raise & bit)
+                    pulses[ii].push_back({now_ns, 0, (dir & bit) != 0, dirSet_ns[ii]});
+            }
+            // Direction is written after the step pins, as the hardware backend does
+            if (out.dirChanged)
+            {
+                for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+                {
+                    if ((out.dir ^ prevDir) & (1 << ii))
+                        dirSet_ns[ii] = now_ns;
+                }
+            }
+            dir = prevDir = out.dir;
+            baseTicks++;
+        }
+    }
+
+    uint64_t getTime_ns() const
+    {
+        return baseTicks * 1000000000ULL / core.getBaseRate();
+    }
+
+    const std::vector<Pulse> &getPulses(uint8_t axis) const { return pulses[axis]; }
+
+private:
+    DdaStepCore core;
+    uint64_t baseTicks;
+    uint8_t dir = 0;
+    uint64_t dirSet_ns[STEP_GEN_AXES];
+    std::vector<Pulse> pulses[STEP_GEN_AXES];
+};
+
+#endif
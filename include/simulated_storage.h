@@ -0,0 +1,163 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief In-memory stand-ins for the non-volatile storage backends
+@file simulated_storage.h
+
+SimulatedEeprom models the wear behaviour of the Teensy 4.x EEPROM emulation (eeprom.c in
+the Teensy core). Each byte address is owned by one flash sector,
+sector = (addr / 4) % FLASH_SECTORS. Every byte write that changes the value
+appends a 2-byte entry to that sector's log. When the log is full the sector
+is erased and its live (non-0xFF) bytes are written back.
+
+SimulatedFram is plain byte-writable memory with no wear, like the
+external FRAM parts.
+
+Used by the native tests to measure flash wear of a storage layout.
+*/
+
+#ifndef SIMULATED_STORAGE_H
+#define SIMULATED_STORAGE_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include "nv_storage.h"
+
+constexpr uint32_t TEENSY41_EEPROM_SIZE = 4284;
+constexpr uint32_t TEENSY41_EEPROM_SECTORS = 63;
+constexpr uint32_t TEENSY41_EEPROM_SECTOR_BYTES = 4096;
+constexpr uint32_t TEENSY41_FLASH_ENDURANCE_CYCLES = 100000; // W25Q64JV erase cycles
+
+class SimulatedEeprom : public NvStorage
+{
+public:
+    SimulatedEeprom(uint32_t size = TEENSY41_EEPROM_SIZE,
+                    uint32_t numSectors = TEENSY41_EEPROM_SECTORS,
+                    uint32_t sectorBytes = TEENSY41_EEPROM_SECTOR_BYTES)
+        : memory(size, 0xFF), sectorEntries(numSectors, 0), sectorErases(numSectors, 0),
+          entriesPerSector(sectorBytes / 2)
+    {
+        resetCounters();
+    }
+
+    void read(uint32_t addr, void *data, uint32_t length) override
+    {
+        bytesRead += length;
+        std::memcpy(data, &memory[addr], length);
+    }
+    void write(uint32_t addr, const void *data, uint32_t length) override
+    {
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        bytesRequested += length;
+        for (uint32_t ii = 0; ii < length; ii++)
+            writeByte(addr + ii, bytes[ii]);
+    }
+    uint32_t size() const override { return memory.size(); }
+
+    // Corrupt a byte without going through the wear model (torn write injection)
+    void poke(uint32_t addr, uint8_t value) { memory[addr] = value; }
+
+    void resetCounters()
+    {
+        bytesRead = 0;
+        bytesRequested = 0;
+        bytesProgrammed = 0;
+        std::fill(sectorErases.begin(), sectorErases.end(), 0);
+    }
+    uint32_t getMaxSectorErases() const
+    {
+        return *std::max_element(sectorErases.begin(), sectorErases.end());
+    }
+    uint32_t getTotalSectorErases() const
+    {
+        uint32_t total = 0;
+        for (auto erases : sectorErases)
+            total += erases;
+        return total;
+    }
+    // Flash bytes programmed (log entries plus compaction rewrites) per byte the caller asked to write
+    double getWriteAmplification() const
+    {
+        return bytesRequested ? (double)bytesProgrammed / (double)bytesRequested : 0.0;
+    }
+
+    uint64_t bytesRead;
+    uint64_t bytesRequested;
+    uint64_t bytesProgrammed;
+
+private:
+    uint32_t sectorOf(uint32_t addr) const { return (addr / 4) % sectorEntries.size(); }
+
+    void writeByte(uint32_t addr, uint8_t value)
+    {
+        if (memory[addr] == value)
+            return;
+        memory[addr] = value;
+        uint32_t sector = sectorOf(addr);
+        if (sectorEntries[sector] >= entriesPerSector)
+        {
+            sectorErases[sector]++;
+            sectorEntries[sector] = 0;
+            for (uint32_t a = sector * 4; a < memory.size(); a += 4 * sectorEntries.size())
+            {
+                for (uint32_t b = a; b < std::min<uint32_t>(a + 4, memory.size()); b++)
+                {
+                    if (memory[b] != 0xFF && b != addr)
+                        appendEntry(sector);
+                }
+            }
+        }
+        appendEntry(sector);
+    }
+    void appendEntry(uint32_t sector)
+    {
+        sectorEntries[sector]++;
+        bytesProgrammed += 2;
+    }
+
+    std::vector<uint8_t> memory;
+    std::vector<uint32_t> sectorEntries;
+    std::vector<uint32_t> sectorErases;
+    uint32_t entriesPerSector;
+};
+
+class SimulatedFram : public NvStorage
+{
+public:
+    SimulatedFram(uint32_t size = 32768) : bytesWritten(0), memory(size, 0x00) {}
+
+    void read(uint32_t addr, void *data, uint32_t length) override
+    {
+        std::memcpy(data, &memory[addr], length);
+    }
+    void write(uint32_t addr, const void *data, uint32_t length) override
+    {
+        bytesWritten += length;
+        std::memcpy(&memory[addr], data, length);
+    }
+    uint32_t size() const override { return memory.size(); }
+    bool isWearFree() const override { return true; }
+
+    // Corrupt a byte (torn write injection)
+    void poke(uint32_t addr, uint8_t value) { memory[addr] = value; }
+
+    uint64_t bytesWritten;
+
+private:
+    std::vector<uint8_t> memory;
+};
+
+#endif
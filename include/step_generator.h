@@ -0,0 +1,348 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Step pulse generation decoupled from the control tick
+@file step_generator.h
+
+The control tick plans motion one segment at a time: how many steps each
+axis takes over the next tick period. A StepGenerator emits those steps
+from its own, faster time base, so the step rate is no longer capped at one
+step per axis per control tick.
+
+DdaStepCore is the hardware-independent part shared by the backends. Every
+base tick it advances a DDA (Bresenham) accumulator per axis over the
+current segment, so all three axes start and finish a segment together and
+their pulses are spread evenly across it. A step pin is raised on one base
+tick and lowered on the next, so the fastest step rate is half the base rate.
+*/
+
+#ifndef STEP_GENERATOR_H
+#define STEP_GENERATOR_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+
+constexpr uint8_t STEP_GEN_AXES = 3;
+constexpr uint8_t STEP_GEN_QUEUE_DEPTH = 4; // Segments, must be a power of 2
+
+class StepGenerator
+{
+public:
+    virtual ~StepGenerator() {}
+    virtual bool begin() { return true; }
+    // Queues steps[axis] signed steps per axis, spread over duration_us.
+    // Fails if the queue is full or a step rate is too high.
+    virtual bool queueSegment(const int32_t *steps, uint32_t duration_us) = 0;
+    virtual uint8_t getFreeSegments() const = 0;
+    virtual bool isIdle() const = 0;
+    // Drops everything queued, the segment in progress stops where it is
+    virtual void stop() = 0;
+    // Steps actually emitted
+    virtual void getPositions(int32_t *positions) const = 0;
+    virtual void setPositions(const int32_t *positions) = 0;
+    virtual uint32_t getMaxStepRate() const = 0;
+};
+
+class DdaStepCore
+{
+public:
+    struct Output
+    {
+        uint8_t lower; // Step pins to bring low (raised on the previous tick)
+        uint8_t raise; // Step pins to bring high
+        uint8_t dir;   // Direction pin levels, bit set for positive
+        bool dirChanged;
+    };
+
+    explicit DdaStepCore(uint32_t baseRate_hz)
+        : baseRate_hz(baseRate_hz), head(0), tail(0)
+    {
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        {
+            position[ii] = 0;
+            accumulator[ii] = 0;
+            current.steps[ii] = 0;
+        }
+        current.ticks = 0;
+        remaining = 0;
+        loaded = false;
+        raised = 0;
+        dirBits = 0;
+    }
+
+    uint32_t getBaseRate() const { return baseRate_hz; }
+    uint32_t getMaxStepRate() const { return baseRate_hz / 2; }
+
+    uint32_t ticksFor(uint32_t duration_us) const
+    {
+        return (uint32_t)(((uint64_t)duration_us * baseRate_hz) / 1000000);
+    }
+
+    // Producer side, called from the control tick
+    bool push(const int32_t *steps, uint32_t duration_us)
+    {
+        uint32_t ticks = ticksFor(duration_us);
+        if (ticks == 0)
+            return false;
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        {
+            if ((uint32_t)std::abs(steps[ii]) * 2 > ticks)
+                return false;
+        }
+        uint8_t h = head.load(std::memory_order_relaxed);
+        if ((uint8_t)(h - tail.load(std::memory_order_acquire)) >= STEP_GEN_QUEUE_DEPTH)
+            return false;
+        Segment &seg = queue[h % STEP_GEN_QUEUE_DEPTH];
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            seg.steps[ii] = steps[ii];
+        seg.ticks = ticks;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint8_t getFreeSegments() const
+    {
+        return STEP_GEN_QUEUE_DEPTH - (uint8_t)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+    }
+
+    bool isIdle() const
+    {
+        return !loaded && head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire) && raised == 0;
+    }
+
+    // Only call while tick() can't run (e.g. with its interrupt masked, as the PIT backend does)
+    void stop()
+    {
+        tail.store(head.load(std::memory_order_relaxed), std::memory_order_release);
+        loaded = false;
+        remaining = 0;
+    }
+
+    // Consumer side, called once per base tick
+    void tick(Output &out)
+    {
+        out.lower = raised;
+        out.raise = 0;
+        out.dirChanged = false;
+        raised = 0;
+
+        if (!loaded)
+        {
+            // Starting from idle: set direction now and step from the next tick,
+            // so the driver's direction setup time is met.
+            out.dirChanged = loadNext();
+            out.dir = dirBits;
+            return;
+        }
+
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        {
+            accumulator[ii] += absSteps[ii];
+            if (accumulator[ii] >= current.ticks)
+            {
+                accumulator[ii] -= current.ticks;
+                out.raise |= (1 << ii);
+                position[ii] += (current.steps[ii] > 0) ? 1 : -1;
+            }
+        }
+        raised = out.raise;
+
+        // The last step of a segment always lands before its final tick,
+        // so the next segment's direction can be set here.
+        if (--remaining == 0)
+            out.dirChanged = loadNext();
+        out.dir = dirBits;
+    }
+
+    int32_t getPosition(uint8_t axis) const { return position[axis]; }
+    void setPosition(uint8_t axis, int32_t pos) { position[axis] = pos; }
+
+private:
+    struct Segment
+    {
+        int32_t steps[STEP_GEN_AXES];
+        uint32_t ticks;
+    };
+
+    bool loadNext()
+    {
+        uint8_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+        {
+            loaded = false;
+            return false;
+        }
+        current = queue[t % STEP_GEN_QUEUE_DEPTH];
+        tail.store(t + 1, std::memory_order_release);
+        remaining = current.ticks;
+        loaded = true;
+        uint8_t newDir = dirBits;
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        {
+            absSteps[ii] = std::abs(current.steps[ii]);
+            // Start half way so pulses sit in the middle of their slots
+            accumulator[ii] = current.ticks / 2;
+            if (current.steps[ii] > 0)
+                newDir |= (1 << ii);
+            else if (current.steps[ii] < 0)
+                newDir &= ~(1 << ii);
+        }
+        bool changed = (newDir != dirBits);
+        dirBits = newDir;
+        return changed;
+    }
+
+    const uint32_t baseRate_hz;
+    Segment queue[STEP_GEN_QUEUE_DEPTH];
+    std::atomic<uint8_t> head;
+    std::atomic<uint8_t> tail;
+    Segment current;
+    uint32_t absSteps[STEP_GEN_AXES];
+    uint32_t accumulator[STEP_GEN_AXES];
+    uint32_t remaining;
+    bool loaded;
+    uint8_t raised;
+    uint8_t dirBits;
+    volatile int32_t position[STEP_GEN_AXES];
+};
+
+// Coordinated move split into control tick segments. The longest axis follows a
+// trapezoidal profile limited by maxSpeed and maxAccel (a triangle if the move is
+// too short to reach maxSpeed), and the others are scaled so all axes ramp and
+// arrive on the same ticks.
+class CoordinatedMove
+{
+public:
+    CoordinatedMove()
+        : longest(0), peakSpeed(0.0), accel(0.0), rampTime_s(0.0), duration_s(0.0), period_s(0.0), totalTicks(0), tick(0)
+    {
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            from[ii] = to[ii] = current[ii] = 0;
+    }
+
+    void start(const int32_t *fromPos, const int32_t *toPos, double maxSpeed, double maxAccel, uint32_t period_us)
+    {
+        longest = 0;
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        {
+            from[ii] = current[ii] = fromPos[ii];
+            to[ii] = toPos[ii];
+            uint32_t dist = (uint32_t)std::abs(to[ii] - from[ii]);
+            if (dist > longest)
+                longest = dist;
+        }
+        period_s = period_us * 1e-6;
+        tick = 0;
+        if (longest == 0 || maxSpeed <= 0.0 || maxAccel <= 0.0)
+        {
+            peakSpeed = accel = rampTime_s = duration_s = 0.0;
+            totalTicks = 0;
+            return;
+        }
+        accel = maxAccel;
+        peakSpeed = std::min(maxSpeed, std::sqrt(longest * maxAccel));
+        rampTime_s = peakSpeed / accel;
+        // Both ramps together cover peakSpeed * rampTime_s
+        duration_s = 2.0 * rampTime_s + (longest - peakSpeed * rampTime_s) / peakSpeed;
+        totalTicks = (uint32_t)std::ceil(duration_s / period_s);
+    }
+
+    bool isDone() const { return tick >= totalTicks; }
+    uint32_t getTotalTicks() const { return totalTicks; }
+
+    // Steps for the next tick
+    void next(int32_t *steps)
+    {
+        if (isDone())
+        {
+            for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+                steps[ii] = 0;
+            return;
+        }
+        tick++;
+        // The last tick lands exactly on the target
+        double fraction = (tick >= totalTicks) ? 1.0 : distanceAt(tick * period_s) / longest;
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        {
+            int32_t pos = from[ii] + (int32_t)std::lround(((int64_t)to[ii] - from[ii]) * fraction);
+            steps[ii] = pos - current[ii];
+            current[ii] = pos;
+        }
+    }
+
+    // Undoes a next() whose segment couldn't be queued
+    void unwind(const int32_t *steps)
+    {
+        tick--;
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            current[ii] -= steps[ii];
+    }
+
+    int32_t getPosition(uint8_t axis) const { return current[axis]; }
+
+    // Steps/s at the end of the planned segments, which keep running until the queue drains
+    double getVelocity(uint8_t axis) const
+    {
+        if (isDone())
+            return 0.0;
+        return (to[axis] - from[axis]) * speedAt(tick * period_s) / longest;
+    }
+
+private:
+    // Along the longest axis
+    double distanceAt(double t_s) const
+    {
+        if (t_s >= duration_s)
+            return longest;
+        if (t_s < rampTime_s)
+            return 0.5 * accel * t_s * t_s;
+        if (t_s < duration_s - rampTime_s)
+            return peakSpeed * (t_s - 0.5 * rampTime_s);
+        double left_s = duration_s - t_s;
+        return longest - 0.5 * accel * left_s * left_s;
+    }
+    double speedAt(double t_s) const
+    {
+        if (t_s >= duration_s)
+            return 0.0;
+        if (t_s < rampTime_s)
+            return accel * t_s;
+        if (t_s < duration_s - rampTime_s)
+            return peakSpeed;
+        return accel * (duration_s - t_s);
+    }
+
+    int32_t from[STEP_GEN_AXES];
+    int32_t to[STEP_GEN_AXES];
+    int32_t current[STEP_GEN_AXES];
+    uint32_t longest;
+    double peakSpeed;
+    double accel;
+    double rampTime_s;
+    double duration_s;
+    double period_s;
+    uint32_t totalTicks;
+    uint32_t tick;
+};
+
+// Fastest planned speed whose rounded per-tick steps the generator can still take
+inline double maxPlannedSpeed(uint32_t maxStepRate, uint32_t period_us)
+{
+    return maxStepRate - 1e6 / period_us;
+}
+
+#endif
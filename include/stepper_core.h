@@ -0,0 +1,247 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Integer-only coordinated stepping from the control tick
+@file stepper_core.h
+
+StepperCore runs coordinated point-to-point moves on three step/dir (DRIVER)
+axes, one call to run() per control tick. Time is counted in ticks, so it
+doesn't read micros() or do any floating point.
+
+Motion planned elsewhere (blends, tracking, homing) goes through stepToward()
+instead, which steps each axis at most once per tick towards a position. Either
+way the core holds the only step counts and is the only thing driving the pins.
+
+The longest axis sets the pace. It takes a step whenever its interval, in
+Q8 fixed-point ticks, has elapsed. The other axes follow it with a Bresenham
+accumulator, so every axis lands on its target on the same step and never
+moves more than one step per tick. The interval comes from a RampTable that is
+looked up by how far the move is from its nearer end. Accelerating from the
+start and decelerating into the target are the same lookup, and a move too
+short to reach full speed turns into a triangle by itself.
+
+The table is built in floating point outside the tick (see RampTable::build)
+and copied in with setRamp(). Entry i covers 2^strideShift steps at their
+average interval, so the time to any entry boundary is exact.
+
+DriverPins is the hardware: static setDirections(bits) and step(bits), with
+bit i set for axis i. Direction bits are set for positive moves.
+*/
+
+#ifndef STEPPER_CORE_H
+#define STEPPER_CORE_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+constexpr uint8_t STEPPER_CORE_AXES = 3;
+constexpr uint16_t RAMP_TABLE_SIZE = 128;
+constexpr uint32_t RAMP_ONE_TICK = 256; // Q8 ticks
+
+class RampTable
+{
+public:
+    RampTable() : cruiseInterval(RAMP_ONE_TICK), strideShift(0)
+    {
+        std::fill(interval, interval + RAMP_TABLE_SIZE, RAMP_ONE_TICK);
+    }
+
+    // maxSpeed in steps/s and accel in steps/s^2, stepped once per period_us tick at most
+    void build(double maxSpeed, double accel, uint32_t period_us)
+    {
+        double ticksPerSec = 1e6 / period_us;
+        double cruise = std::max(RAMP_ONE_TICK * ticksPerSec / maxSpeed, (double)RAMP_ONE_TICK);
+        cruiseInterval = toInterval(cruise);
+
+        // Smallest power of two stride that fits the whole ramp in the table
+        double rampSteps = maxSpeed * maxSpeed / (2.0 * accel);
+        strideShift = 0;
+        while (strideShift < 24 && (double)((uint32_t)RAMP_TABLE_SIZE << strideShift) < rampSteps)
+            strideShift++;
+
+        uint32_t stride = 1u << strideShift;
+        for (uint16_t ii = 0; ii < RAMP_TABLE_SIZE; ii++)
+        {
+            // From rest, step n comes at t = sqrt(2n/a)
+            double t0 = std::sqrt(2.0 * ii * stride / accel);
+            double t1 = std::sqrt(2.0 * (ii + 1) * stride / accel);
+            double ticks = (t1 - t0) / stride * ticksPerSec * RAMP_ONE_TICK;
+            interval[ii] = std::max(toInterval(ticks), cruiseInterval);
+        }
+    }
+
+    // Interval between steps rampStep steps from rest
+    uint32_t lookup(uint32_t rampStep) const
+    {
+        uint32_t index = rampStep >> strideShift;
+        return (index < RAMP_TABLE_SIZE) ? interval[index] : cruiseInterval;
+    }
+
+    uint32_t getCruiseInterval() const { return cruiseInterval; }
+    uint8_t getStrideShift() const { return strideShift; }
+
+private:
+    static uint32_t toInterval(double ticks)
+    {
+        return (uint32_t)std::min(std::llround(ticks), (long long)INT32_MAX);
+    }
+
+    uint32_t interval[RAMP_TABLE_SIZE];
+    uint32_t cruiseInterval;
+    uint8_t strideShift;
+};
+
+template <class DriverPins>
+class StepperCore
+{
+public:
+    StepperCore() : total(0), done(0), interval(0), phase(0), dirBits(0), stepBits(0), moving(false)
+    {
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        {
+            position[ii] = target[ii] = 0;
+            delta[ii] = error[ii] = 0;
+        }
+    }
+
+    void setRamp(const RampTable &table) { ramp = table; }
+
+    // Starts a move to targets from rest. Positions are set with setPosition()
+    // first if the axes have been stepped by anything else.
+    void moveTo(const int32_t *targets)
+    {
+        total = 0;
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        {
+            target[ii] = targets[ii];
+            int32_t dist = target[ii] - position[ii];
+            delta[ii] = (uint32_t)std::abs(dist);
+            total = std::max(total, delta[ii]);
+            if (dist > 0)
+                dirBits |= (1 << ii);
+            else if (dist < 0)
+                dirBits &= ~(1 << ii);
+        }
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+            error[ii] = total / 2;
+        DriverPins::setDirections(dirBits);
+        done = 0;
+        phase = 0;
+        interval = ramp.lookup(0);
+        moving = (total != 0);
+    }
+
+    // Once per control tick. Returns true while the move is running.
+    bool run()
+    {
+        stepBits = 0;
+        if (!moving)
+            return false;
+        phase += RAMP_ONE_TICK;
+        if (phase < interval)
+            return true;
+        phase -= interval;
+
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        {
+            error[ii] += delta[ii];
+            if (error[ii] >= total)
+            {
+                error[ii] -= total;
+                stepBits |= (1 << ii);
+                position[ii] += (dirBits & (1 << ii)) ? 1 : -1;
+            }
+        }
+        DriverPins::step(stepBits);
+
+        if (++done >= total)
+        {
+            moving = false;
+            return false;
+        }
+        interval = ramp.lookup(std::min(done, total - done));
+        return true;
+    }
+
+    // Follow mode: steps each axis at most once towards positions. An axis
+    // that has to reverse only gets its direction set this tick and steps on
+    // the next, so the driver's direction setup time is always met. Ends any
+    // point-to-point move.
+    void stepToward(const int32_t *positions)
+    {
+        moving = false;
+        stepBits = 0;
+        uint8_t dirs = dirBits;
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        {
+            if (positions[ii] > position[ii])
+                dirs |= (1 << ii);
+            else if (positions[ii] < position[ii])
+                dirs &= ~(1 << ii);
+            else
+                continue;
+            if ((dirs ^ dirBits) & (1 << ii))
+                continue;
+            stepBits |= (1 << ii);
+            position[ii] += (dirs & (1 << ii)) ? 1 : -1;
+        }
+        if (dirs != dirBits)
+        {
+            dirBits = dirs;
+            DriverPins::setDirections(dirBits);
+        }
+        if (stepBits)
+            DriverPins::step(stepBits);
+    }
+
+    // Stops dead, wherever the axes are
+    void stop() { moving = false; }
+
+    // Drives the direction pins from the core's copy again, after something
+    // else (a step generator) has had them
+    void syncDirections() { DriverPins::setDirections(dirBits); }
+
+    bool isMoving() const { return moving; }
+    int32_t getPosition(uint8_t axis) const { return position[axis]; }
+    void setPosition(uint8_t axis, int32_t pos) { position[axis] = pos; }
+    int32_t getTarget(uint8_t axis) const { return moving ? target[axis] : position[axis]; }
+    uint8_t getStepBits() const { return stepBits; } // Axes the last run() or stepToward() stepped
+
+    // Steps/s the axis is moving at, for handing the motion over to something else
+    double getVelocity(uint8_t axis, uint32_t period_us) const
+    {
+        if (!moving || delta[axis] == 0)
+            return 0.0;
+        double speed = RAMP_ONE_TICK * 1e6 / ((double)interval * period_us) * delta[axis] / total;
+        return (dirBits & (1 << axis)) ? speed : -speed;
+    }
+
+private:
+    RampTable ramp;
+    int32_t position[STEPPER_CORE_AXES];
+    int32_t target[STEPPER_CORE_AXES];
+    uint32_t delta[STEPPER_CORE_AXES];
+    uint32_t error[STEPPER_CORE_AXES];
+    uint32_t total;    // Steps on the longest axis
+    uint32_t done;     // Steps the longest axis has taken
+    uint32_t interval; // Q8 ticks until its next step
+    uint32_t phase;    // Q8 ticks since its last step
+    uint8_t dirBits;
+    uint8_t stepBits;
+    bool moving;
+};
+
+#endif
@@ -0,0 +1,228 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Control tick trace recorder
+@file trace_recorder.h
+
+Circular buffer of fixed-size records written once per control tick. While
+armed it keeps the most recent records; a trigger whose source is in the
+armed mask lets a set number of further records in and then freezes the
+buffer so the lead-up to and aftermath of the event can be dumped.
+
+The dump is a TraceHeader followed by the records oldest first, all little
+endian. client/trace_decoder.py reads it.
+*/
+
+#ifndef TRACE_RECORDER_H
+#define TRACE_RECORDER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "position_record.h"
+
+constexpr uint32_t TRACE_MAGIC = 0x31435254; // "TRC1"
+constexpr uint16_t TRACE_FORMAT_VERSION = 1;
+constexpr uint32_t TRACE_NO_TRIGGER = 0xFFFFFFFF;
+
+enum TRACE_TRIGGER
+{
+    TRACE_TRIGGER_LIMIT_SWITCH = 0x01,     // Limit switch hit outside of homing
+    TRACE_TRIGGER_MOVE_INTERRUPTED = 0x02, // New command arrived mid-move
+    TRACE_TRIGGER_COMMAND = 0x04,          // TriggerTrace command
+    TRACE_TRIGGER_ALL = 0x07,
+};
+
+enum TRACE_STATE
+{
+    TRACE_IDLE,      // Not recording
+    TRACE_ARMED,     // Recording, waiting for a trigger
+    TRACE_TRIGGERED, // Recording the post-trigger records
+    TRACE_FROZEN,    // Holding a capture for DumpTrace
+};
+
+struct TraceRecord
+{
+    uint32_t tick;
+    int32_t position[3]; // Reference microsteps
+    int32_t target[3];
+    int16_t speed[3]; // Driver steps/s, at whatever microstep mode was active, saturated to the int16_t range
+    uint16_t isrDuration_us;
+    uint16_t homingStates; // 3 bits per axis, A in the low bits
+    uint8_t moveState;
+    uint8_t switchLevels; // Debounced levels in bits 0-2, raw pin levels in bits 4-6
+};
+static_assert(sizeof(TraceRecord) == 40, "Trace record layout is part of the dump format");
+
+struct TraceHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t numRecords;
+    uint32_t triggerIndex; // Record the trigger landed on, TRACE_NO_TRIGGER if none
+    uint16_t tickPeriod_us;
+    uint8_t triggerSource;
+    uint8_t reserved;
+    uint32_t crc; // Over the records
+};
+static_assert(sizeof(TraceHeader) == 24, "Trace header layout is part of the dump format");
+
+template <uint32_t CAPACITY>
+class TraceRecorder
+{
+public:
+    TraceRecorder() : state(TRACE_IDLE), triggerMask(0), postTriggerRecords(0)
+    {
+        clear();
+    }
+
+    // Start a fresh capture. postTrigger is clamped so the trigger record survives.
+    void arm(uint8_t mask, uint32_t postTrigger)
+    {
+        clear();
+        triggerMask = mask;
+        postTriggerRecords = (postTrigger < CAPACITY) ? postTrigger : CAPACITY - 1;
+        state = TRACE_ARMED;
+    }
+
+    void disarm()
+    {
+        state = TRACE_IDLE;
+    }
+
+    // Stop recording and keep whatever is in the buffer
+    void freeze()
+    {
+        if (state != TRACE_IDLE)
+            state = TRACE_FROZEN;
+    }
+
+    bool trigger(uint8_t source)
+    {
+        if (state != TRACE_ARMED || !(triggerMask & source))
+            return false;
+        triggerSource = source;
+        triggerRecorded = recorded;
+        remaining = postTriggerRecords;
+        state = (remaining > 0) ? TRACE_TRIGGERED : TRACE_FROZEN;
+        return true;
+    }
+
+    bool isRecording() const
+    {
+        return (state == TRACE_ARMED) || (state == TRACE_TRIGGERED);
+    }
+
+    void record(const TraceRecord &rec)
+    {
+        if (!isRecording())
+            return;
+        buffer[head] = rec;
+        head = (head + 1) % CAPACITY;
+        if (count < CAPACITY)
+            count++;
+        recorded++;
+        if (state == TRACE_TRIGGERED && --remaining == 0)
+            state = TRACE_FROZEN;
+    }
+
+    // Fills in the dump header for a frozen capture and returns the dump size in bytes
+    uint32_t beginDump(uint16_t tickPeriod_us)
+    {
+        header.magic = TRACE_MAGIC;
+        header.version = TRACE_FORMAT_VERSION;
+        header.recordSize = sizeof(TraceRecord);
+        header.numRecords = count;
+        header.tickPeriod_us = tickPeriod_us;
+        header.reserved = 0;
+        bool hasTrigger = (triggerRecorded != TRACE_NO_TRIGGER);
+        header.triggerIndex = hasTrigger ? triggerRecorded - (recorded - count) : TRACE_NO_TRIGGER;
+        header.triggerSource = hasTrigger ? triggerSource : 0;
+        uint32_t crc = 0;
+        for (uint32_t ii = 0; ii < count; ii++)
+            crc = crc32(&buffer[physicalIndex(ii)], sizeof(TraceRecord), crc);
+        header.crc = crc;
+        return getDumpSize();
+    }
+
+    uint32_t getDumpSize() const
+    {
+        return sizeof(TraceHeader) + count * sizeof(TraceRecord);
+    }
+
+    // Copies up to len bytes of the dump starting at offset, returns the number copied
+    uint32_t readDump(uint32_t offset, uint8_t *out, uint32_t len) const
+    {
+        uint32_t copied = 0;
+        while (copied < len && offset < getDumpSize())
+        {
+            const uint8_t *src;
+            uint32_t available;
+            if (offset < sizeof(TraceHeader))
+            {
+                src = reinterpret_cast<const uint8_t *>(&header) + offset;
+                available = sizeof(TraceHeader) - offset;
+            }
+            else
+            {
+                uint32_t recordOffset = offset - sizeof(TraceHeader);
+                uint32_t within = recordOffset % sizeof(TraceRecord);
+                src = reinterpret_cast<const uint8_t *>(&buffer[physicalIndex(recordOffset / sizeof(TraceRecord))]) + within;
+                available = sizeof(TraceRecord) - within;
+            }
+            uint32_t n = (available < len - copied) ? available : len - copied;
+            memcpy(out + copied, src, n);
+            copied += n;
+            offset += n;
+        }
+        return copied;
+    }
+
+    TRACE_STATE getState() const { return state; }
+    uint8_t getTriggerMask() const { return triggerMask; }
+    uint32_t getCount() const { return count; }
+    static constexpr uint32_t getCapacity() { return CAPACITY; }
+
+private:
+    void clear()
+    {
+        head = 0;
+        count = 0;
+        recorded = 0;
+        remaining = 0;
+        triggerRecorded = TRACE_NO_TRIGGER;
+        triggerSource = 0;
+    }
+
+    // Buffer slot of the ii-th oldest record
+    uint32_t physicalIndex(uint32_t ii) const
+    {
+        return (head + CAPACITY - count + ii) % CAPACITY;
+    }
+
+    TraceRecord buffer[CAPACITY];
+    volatile TRACE_STATE state;
+    uint8_t triggerMask;
+    uint8_t triggerSource;
+    uint32_t postTriggerRecords;
+    uint32_t head;
+    uint32_t count;
+    uint32_t recorded;
+    uint32_t remaining;
+    uint32_t triggerRecorded;
+    TraceHeader header;
+};
+
+#endif
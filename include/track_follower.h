@@ -0,0 +1,79 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief Per-axis velocity follower for TRACK mode
+@file track_follower.h
+
+In TRACK mode the control tick integrates the commanded rates into an
+unrounded demanded position for each actuator, which typically moves by a
+small fraction of a step per tick. The follower turns it into a step rate for
+the velocity drive on the stepper core: the demand's own rate as feedforward, plus a
+proportional correction once the axis is more than half a step off. The step
+rate is slew limited, so a rate change blends in at the acceleration limit
+without the axis stopping.
+*/
+
+#ifndef TRACK_FOLLOWER_H
+#define TRACK_FOLLOWER_H
+
+#include <cmath>
+#include <algorithm>
+
+constexpr double TRACK_POSITION_GAIN = 5.0; // 1/s, position error correction
+constexpr double TRACK_DEADBAND_STEPS = 0.5;
+
+class TrackFollower
+{
+public:
+    TrackFollower() : lastDemand(0.0), velocity(0.0) {}
+
+    void reset(double demand)
+    {
+        lastDemand = demand;
+        velocity = 0.0;
+    }
+
+    // Step rate to run at until the next tick. Positions in steps, dt in seconds.
+    double update(double demand, double actual, double dt, double maxSpeed, double maxAccel)
+    {
+        double error = demand - actual;
+        if (std::fabs(error) < TRACK_DEADBAND_STEPS)
+            error = 0.0;
+        double target = (demand - lastDemand) / dt + TRACK_POSITION_GAIN * error;
+        lastDemand = demand;
+        return slewTo(target, dt, maxSpeed, maxAccel);
+    }
+
+    // Ramps down to a stop at the acceleration limit
+    double stop(double dt, double maxAccel)
+    {
+        return slewTo(0.0, dt, std::fabs(velocity), maxAccel);
+    }
+
+    double getVelocity() const { return velocity; }
+
+private:
+    double slewTo(double target, double dt, double maxSpeed, double maxAccel)
+    {
+        target = std::min(std::max(target, -maxSpeed), maxSpeed);
+        double maxChange = maxAccel * dt;
+        velocity = std::min(std::max(target, velocity - maxChange), velocity + maxChange);
+        return velocity;
+    }
+
+    double lastDemand;
+    double velocity;
+};
+
+#endif
@@ -0,0 +1,41 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief NvStorage backend for the Teensy's flash-emulated EEPROM
+@file eeprom_storage.cpp
+*/
+
+#include "eeprom_storage.h"
+#include <Arduino.h>
+#include <EEPROM.h>
+
+void EepromStorage::read(uint32_t addr, void *data, uint32_t length)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(data);
+    for (uint32_t ii = 0; ii < length; ii++)
+        bytes[ii] = EEPROM.read(addr + ii);
+}
+
+void EepromStorage::write(uint32_t addr, const void *data, uint32_t length)
+{
+    // update() skips bytes that already hold the value, which saves flash wear
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (uint32_t ii = 0; ii < length; ii++)
+        EEPROM.update(addr + ii, bytes[ii]);
+}
+
+uint32_t EepromStorage::size() const
+{
+    return EEPROM.length();
+}
@@ -0,0 +1,136 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief NvStorage backends for external FRAM (Fujitsu MB85RS SPI / MB85RC I2C)
+@file fram_storage.cpp
+*/
+
+#include "fram_storage.h"
+#include <Arduino.h>
+#include <algorithm>
+
+// MB85RS opcodes
+#define FRAM_OP_WREN 0x06
+#define FRAM_OP_READ 0x03
+#define FRAM_OP_WRITE 0x02
+#define FRAM_OP_RDID 0x9F
+#define FRAM_FUJITSU_ID 0x04
+
+#define FRAM_SPI_CLOCK_HZ 20000000
+// Teensy's Wire buffer is 32 bytes, two of which go to the memory address
+#define FRAM_I2C_CHUNK 30
+
+SpiFramStorage::SpiFramStorage(SPIClass &spi, uint8_t csPin, uint32_t size)
+    : spi(spi), csPin(csPin), framSize(size) {}
+
+// Checks the manufacturer ID so a missing part isn't mistaken for blank memory
+bool SpiFramStorage::begin()
+{
+    pinMode(csPin, OUTPUT);
+    digitalWrite(csPin, HIGH);
+    spi.begin();
+
+    spi.beginTransaction(SPISettings(FRAM_SPI_CLOCK_HZ, MSBFIRST, SPI_MODE0));
+    digitalWrite(csPin, LOW);
+    spi.transfer(FRAM_OP_RDID);
+    uint8_t manufacturer = spi.transfer(0);
+    digitalWrite(csPin, HIGH);
+    spi.endTransaction();
+    return manufacturer == FRAM_FUJITSU_ID;
+}
+
+void SpiFramStorage::sendCommand(uint8_t opcode, uint32_t addr)
+{
+    spi.transfer(opcode);
+    // Parts over 64KB take a 3 byte address
+    if (framSize > 0x10000)
+        spi.transfer((addr >> 16) & 0xFF);
+    spi.transfer((addr >> 8) & 0xFF);
+    spi.transfer(addr & 0xFF);
+}
+
+void SpiFramStorage::read(uint32_t addr, void *data, uint32_t length)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(data);
+    spi.beginTransaction(SPISettings(FRAM_SPI_CLOCK_HZ, MSBFIRST, SPI_MODE0));
+    digitalWrite(csPin, LOW);
+    sendCommand(FRAM_OP_READ, addr);
+    for (uint32_t ii = 0; ii < length; ii++)
+        bytes[ii] = spi.transfer(0);
+    digitalWrite(csPin, HIGH);
+    spi.endTransaction();
+}
+
+void SpiFramStorage::write(uint32_t addr, const void *data, uint32_t length)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    spi.beginTransaction(SPISettings(FRAM_SPI_CLOCK_HZ, MSBFIRST, SPI_MODE0));
+    digitalWrite(csPin, LOW);
+    spi.transfer(FRAM_OP_WREN);
+    digitalWrite(csPin, HIGH);
+
+    // No page boundaries or write delay, the whole buffer goes in one burst
+    digitalWrite(csPin, LOW);
+    sendCommand(FRAM_OP_WRITE, addr);
+    for (uint32_t ii = 0; ii < length; ii++)
+        spi.transfer(bytes[ii]);
+    digitalWrite(csPin, HIGH);
+    spi.endTransaction();
+}
+
+I2cFramStorage::I2cFramStorage(TwoWire &wire, uint8_t i2cAddr, uint32_t size)
+    : wire(wire), i2cAddr(i2cAddr), framSize(size) {}
+
+bool I2cFramStorage::begin()
+{
+    wire.begin();
+    wire.beginTransmission(i2cAddr);
+    return wire.endTransmission() == 0;
+}
+
+void I2cFramStorage::read(uint32_t addr, void *data, uint32_t length)
+{
+    uint8_t *bytes = static_cast<uint8_t *>(data);
+    while (length > 0)
+    {
+        uint32_t chunk = std::min<uint32_t>(length, FRAM_I2C_CHUNK);
+        wire.beginTransmission(i2cAddr);
+        wire.write((addr >> 8) & 0xFF);
+        wire.write(addr & 0xFF);
+        wire.endTransmission(false);
+        wire.requestFrom(i2cAddr, (size_t)chunk);
+        for (uint32_t ii = 0; ii < chunk; ii++)
+            bytes[ii] = wire.available() ? wire.read() : 0xFF;
+        bytes += chunk;
+        addr += chunk;
+        length -= chunk;
+    }
+}
+
+void I2cFramStorage::write(uint32_t addr, const void *data, uint32_t length)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    while (length > 0)
+    {
+        uint32_t chunk = std::min<uint32_t>(length, FRAM_I2C_CHUNK);
+        wire.beginTransmission(i2cAddr);
+        wire.write((addr >> 8) & 0xFF);
+        wire.write(addr & 0xFF);
+        wire.write(bytes, chunk);
+        wire.endTransmission();
+        bytes += chunk;
+        addr += chunk;
+        length -= chunk;
+    }
+}
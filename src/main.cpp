@@ -35,8 +35,10 @@ Mirror Control interface.
 
 #include "device_config.h"
 #include "primary_mirror_ctrl.h"
+#include "loop_watchdog.h"
 // Parsing of JSON style command done in network file, for now.
 #include "CrashReport.h"
+#include "base64.h"
 
 /*
 Features:
@@ -52,6 +54,10 @@ Threading
 
 System Recovery
   - Remember positions of stepepr motors in case of ungraceful shutdown. (EEPROM)
+    Done: a CRC-checked position record is restored on boot, homing is skipped if
+    it was committed with the mirror stationary after a homing run.
+    Positions are also checkpointed during moves and homing (see CHECKPOINT_* in
+    device_config.h), so an unplanned reset can still seed a fast homing run.
 
 fanSpeed Control function
 */
@@ -60,6 +66,7 @@ void handshake(unsigned int val);
 void moveType(unsigned int type);
 void velUnits(unsigned int targetUnits);
 void home(double v);
+void homeFast(double v);
 void changeVel(double targetVel);
 void changeTip(double targetTip);
 void changeTilt(double targetTilt);
@@ -69,7 +76,21 @@ void getStatus(double lst);
 void getPositions(double lst);
 void stop(double lst);
 void fanSpeed(unsigned int val);
+void clockSync(double hostTime_us);
+void executeAt(double hostTime_us);
 void enableSteppers(bool en);
+void saturationPolicy(unsigned int policy);
+void microstepMode(unsigned int divider);
+void getParam(unsigned int id);
+void selectParam(unsigned int id);
+void setParam(double value);
+void armTrace(unsigned int mask);
+void triggerTrace(unsigned int val);
+void dumpTrace(unsigned int val);
+void serviceTraceDump();
+void getMetrics(double lst);
+void metricsPeriod(unsigned int seconds);
+void sendMetrics();
 
 LFAST::TcpCommsService *commsService;
 PrimaryMirrorControl *pPmc;
@@ -80,17 +101,39 @@ unsigned int mPort = PORT;
 
 volatile bool moveCompleteFlag = false;
 volatile bool homingCompleteFlag = false;
+volatile bool saturationFlag = false;
+volatile bool preemptFlag = false;
+volatile bool fanStallFlag = false;
+volatile bool releaseFlag = false;
+volatile bool scheduleExpiredFlag = false;
+unsigned int selectedParamId = 0; // Target of the next SetParam
+// DumpTrace streams one chunk per pass through loop()
+bool traceDumpActive = false;
+uint32_t traceDumpOffset = 0;
+uint32_t traceDumpSize = 0;
+uint32_t metricsPushPeriod_ms = METRICS_PUSH_PERIOD_S * 1000;
+uint32_t lastMetricsPush_ms = 0;
 
 #define WATCHDOG_ENABLED 1
 WDT_T4<WDT1> wdt;
 bool wdt_ready = false;
+// Only a pass through loop() within its budgets feeds wdt
+const uint32_t LoopStageBudgets_us[NUM_LOOP_STAGES]{LOOP_CLIENTS_BUDGET_US, LOOP_CLIENT_DATA_BUDGET_US,
+                                                    LOOP_SERVICES_BUDGET_US, LOOP_NOTIFICATIONS_BUDGET_US};
+LoopWatchdog loopWatchdog(LoopStageBudgets_us, LOOP_BUDGET_US);
+const uint16_t LoopStageMaxMetrics[NUM_LOOP_STAGES]{METRIC_LOOP_CLIENTS_MAX_US, METRIC_LOOP_CLIENT_DATA_MAX_US,
+                                                    METRIC_LOOP_SERVICES_MAX_US, METRIC_LOOP_NOTIFICATIONS_MAX_US};
 void watchdogWarning()
 {
+  if (pPmc != nullptr)
+    pPmc->getMetrics().increment(METRIC_WATCHDOG_WARNINGS);
   if (cli != nullptr)
   {
     cli->printDebugMessage("Danger - feed the dog!", LFAST::WARNING);
   }
 }
+// loop() only feeds it on a pass that met its LoopWatchdog budgets, so the
+// board resets after config.timeout of nothing but overruns
 void configureWatchdog()
 {
   if (cli != nullptr)
@@ -133,6 +176,7 @@ void setup()
   commsService->registerMessageHandler<unsigned int>("Handshake", handshake);
   commsService->registerMessageHandler<unsigned int>("MoveType", moveType);
   commsService->registerMessageHandler<double>("FindHome", home);
+  commsService->registerMessageHandler<double>("FindHomeFast", homeFast);
   commsService->registerMessageHandler<double>("SetTip", changeTip);
   commsService->registerMessageHandler<double>("SetTilt", changeTilt);
   commsService->registerMessageHandler<double>("SetFocus", changeFocus);
@@ -140,14 +184,31 @@ void setup()
   commsService->registerMessageHandler<double>("GetPositions", getPositions);
   commsService->registerMessageHandler<double>("Stop", stop);
   commsService->registerMessageHandler<unsigned int>("SetFanSpeed", fanSpeed);
+  commsService->registerMessageHandler<double>("ClockSync", clockSync);
+  commsService->registerMessageHandler<double>("ExecuteAt", executeAt);
   commsService->registerMessageHandler<bool>("EnableSteppers", enableSteppers);
+  commsService->registerMessageHandler<unsigned int>("SaturationPolicy", saturationPolicy);
+  commsService->registerMessageHandler<unsigned int>("MicrostepMode", microstepMode);
+  commsService->registerMessageHandler<unsigned int>("GetParam", getParam);
+  commsService->registerMessageHandler<unsigned int>("ParamId", selectParam);
+  commsService->registerMessageHandler<double>("SetParam", setParam);
+  commsService->registerMessageHandler<unsigned int>("ArmTrace", armTrace);
+  commsService->registerMessageHandler<unsigned int>("TriggerTrace", triggerTrace);
+  commsService->registerMessageHandler<unsigned int>("DumpTrace", dumpTrace);
+  commsService->registerMessageHandler<double>("GetMetrics", getMetrics);
+  commsService->registerMessageHandler<unsigned int>("MetricsPeriod", metricsPeriod);
 
   delay(500);
-  pPmc->resetPositionsInEeprom();
 
   pPmc->setMoveNotifierFlag(&moveCompleteFlag);
   pPmc->setHomingCompleteNotifierFlag(&homingCompleteFlag);
+  pPmc->setSaturationNotifierFlag(&saturationFlag);
+  pPmc->setPreemptNotifierFlag(&preemptFlag);
+  pPmc->setFanStallNotifierFlag(&fanStallFlag);
+  pPmc->setReleaseNotifierFlag(&releaseFlag);
+  pPmc->setScheduleExpiredNotifierFlag(&scheduleExpiredFlag);
 
+  pPmc->loadConfiguration();
   pPmc->loadCurrentPositionsFromEeprom();
   cli->printDebugMessage("Initialization complete");
   // cli->printDebugMessage(DEBUG_CODE_ID_STR);
@@ -166,20 +227,34 @@ void setup()
 
 void loop()
 {
-#if WATCHDOG_ENABLED
-  if (wdt_ready)
-    wdt.feed();
-#endif
+  loopWatchdog.beginLoop(micros());
 
   commsService->checkForNewClients();
+  loopWatchdog.endStage(LOOP_STAGE_CLIENTS, micros());
   if (commsService->checkForNewClientData())
   {
     // cli->printDebugMessage("New data received.");
     commsService->processClientData("PMCMessage");
+    pPmc->getMetrics().increment(METRIC_MESSAGES_RECEIVED);
   }
+  loopWatchdog.endStage(LOOP_STAGE_CLIENT_DATA, micros());
   commsService->stopDisconnectedClients();
+  loopWatchdog.endStage(LOOP_STAGE_CLIENTS, micros());
   // delayMicroseconds(1000);
 
+  pPmc->servicePositionJournal();
+  pPmc->serviceFan();
+  pPmc->serviceJoystick();
+  pPmc->serviceTickMessages();
+  pPmc->serviceDashboard();
+  serviceTraceDump();
+  if (metricsPushPeriod_ms > 0 && (millis() - lastMetricsPush_ms >= metricsPushPeriod_ms))
+  {
+    lastMetricsPush_ms = millis();
+    sendMetrics();
+  }
+  loopWatchdog.endStage(LOOP_STAGE_SERVICES, micros());
+
   if (moveCompleteFlag)
   {
     LFAST::CommsMessage newMsg;
@@ -192,14 +267,107 @@ void loop()
   }
   if (homingCompleteFlag)
   {
+    uint32_t aTime_ms, bTime_ms, cTime_ms;
+    pPmc->getHomingTimes(&aTime_ms, &bTime_ms, &cTime_ms);
     LFAST::CommsMessage newMsg;
     newMsg.addKeyValuePair<bool>("HomingComplete", true);
+    newMsg.addKeyValuePair<unsigned int>("AHomingTime_ms", aTime_ms);
+    newMsg.addKeyValuePair<unsigned int>("BHomingTime_ms", bTime_ms);
+    newMsg.addKeyValuePair<unsigned int>("CHomingTime_ms", cTime_ms);
     commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
 #if ENABLE_TERMINAL_UPDATES
-    cli->printDebugMessage("Homing Complete.");
+    cli->printfDebugMessage("Homing Complete. [A/B/C]: %u, %u, %u ms", aTime_ms, bTime_ms, cTime_ms);
 #endif
     homingCompleteFlag = false;
   }
+  if (saturationFlag)
+  {
+    double tip, tilt, focus;
+    uint8_t status = pPmc->getLastSaturationEvent(&tip, &tilt, &focus);
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<bool>("Saturated", true);
+    newMsg.addKeyValuePair<bool>("CommandRejected", status == LFAST::PMC::REJECTED);
+    newMsg.addKeyValuePair<double>("TipCmd", tip * URAD_PER_RAD);
+    newMsg.addKeyValuePair<double>("TiltCmd", tilt * URAD_PER_RAD);
+    newMsg.addKeyValuePair<double>("FocusCmd", focus);
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+#if ENABLE_TERMINAL_UPDATES
+    cli->printDebugMessage(status == LFAST::PMC::REJECTED ? "Command rejected (out of range)." : "Command saturated.");
+#endif
+    saturationFlag = false;
+  }
+  if (preemptFlag)
+  {
+    double tip, tilt, focus;
+    pPmc->getLastPreemptedTarget(&tip, &tilt, &focus);
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<bool>("MovePreempted", true);
+    newMsg.addKeyValuePair<double>("AbandonedTip", tip * URAD_PER_RAD);
+    newMsg.addKeyValuePair<double>("AbandonedTilt", tilt * URAD_PER_RAD);
+    newMsg.addKeyValuePair<double>("AbandonedFocus", focus);
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+    preemptFlag = false;
+  }
+  if (fanStallFlag)
+  {
+    uint8_t duty;
+    uint32_t rpm;
+    bool stalled;
+    pPmc->getFanStatus(&duty, &rpm, &stalled);
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<bool>("FanStalled", true);
+    newMsg.addKeyValuePair<unsigned int>("FanDuty", duty);
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+#if ENABLE_TERMINAL_UPDATES
+    cli->printDebugMessage("Fan stalled.");
+#endif
+    fanStallFlag = false;
+  }
+  if (releaseFlag)
+  {
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<bool>("MoveReleased", true);
+    newMsg.addKeyValuePair<double>("ReleaseError_us", (double)pPmc->getLastReleaseError_us());
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+    releaseFlag = false;
+  }
+  if (scheduleExpiredFlag)
+  {
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<bool>("MoveReleased", false);
+    newMsg.addKeyValuePair<bool>("ScheduleExpired", true);
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+    scheduleExpiredFlag = false;
+  }
+  LoopOverrunReport overrun;
+  if (loopWatchdog.takeReport(millis(), &overrun))
+  {
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<bool>("LoopOverrun", true);
+    newMsg.addKeyValuePair<std::string>("Stage", overrun.stage < NUM_LOOP_STAGES ? LoopStageNames[overrun.stage] : "Loop");
+    newMsg.addKeyValuePair<unsigned int>("Duration_us", overrun.duration_us);
+    newMsg.addKeyValuePair<unsigned int>("Budget_us", overrun.budget_us);
+    newMsg.addKeyValuePair<unsigned int>("Overruns", overrun.overruns);
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+#if ENABLE_TERMINAL_UPDATES
+    cli->printfDebugMessage("Loop overrun x%u, worst %u/%u us", overrun.overruns, overrun.duration_us,
+                            overrun.budget_us);
+#endif
+  }
+  loopWatchdog.endStage(LOOP_STAGE_NOTIFICATIONS, micros());
+
+  bool withinBudget = loopWatchdog.endLoop(micros());
+  MetricsRegistry &metrics = pPmc->getMetrics();
+  for (uint8_t ii = 0; ii < NUM_LOOP_STAGES; ii++)
+    metrics.updateMax(LoopStageMaxMetrics[ii], loopWatchdog.getStage_us(ii));
+  metrics.updateMax(METRIC_LOOP_MAX_US, loopWatchdog.getLoop_us());
+  if (!withinBudget)
+    metrics.increment(METRIC_LOOP_OVERRUNS);
+#if WATCHDOG_ENABLED
+  // A loop that keeps overrunning starves it, see configureWatchdog()
+  if (wdt_ready && withinBudget)
+    wdt.feed();
+#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -208,19 +376,24 @@ void handshake(unsigned int val)
 {
   if (val == 0xDEAD)
   {
+    pPmc->getMetrics().increment(METRIC_CONNECTS);
     LFAST::CommsMessage newMsg;
     newMsg.addKeyValuePair<unsigned int>("Handshake", 0xBEEF);
+    newMsg.addKeyValuePair<bool>("HomingRequired", pPmc->isHomingRequired());
     commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
     cli->printDebugMessage("Connected to client, starting control ISR.");
     if (!wdt_ready)
       configureWatchdog();
     pPmc->enableControlInterrupt();
   }
+  else
+    pPmc->getMetrics().increment(METRIC_COMMANDS_DROPPED);
   return;
 }
 
 void moveType(unsigned int type)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_MOTION);
   // no_interrupts();
   pPmc->setControlMode(type);
   // interrupts();
@@ -228,62 +401,202 @@ void moveType(unsigned int type)
 
 void home(double v)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_HOMING);
   pPmc->goHome(v);
   LFAST::CommsMessage newMsg;
   newMsg.addKeyValuePair<std::string>("FindHome", "$OK^");
   commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
 }
 
+void homeFast(double v)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_HOMING);
+  bool seeded = pPmc->goHome(v, true);
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<std::string>("FindHomeFast", "$OK^");
+  newMsg.addKeyValuePair<bool>("SeededHoming", seeded);
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
+
 void changeTip(double targetTip)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_MOTION);
   // no_interrupts();
   if (pPmc->isEnabled())
     pPmc->setTipTarget(targetTip);
+  else
+    pPmc->getMetrics().increment(METRIC_COMMANDS_DROPPED);
   // interrupts();
 }
 
 void changeTilt(double targetTilt)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_MOTION);
   // no_interrupts();
   if (pPmc->isEnabled())
     pPmc->setTiltTarget(targetTilt);
+  else
+    pPmc->getMetrics().increment(METRIC_COMMANDS_DROPPED);
   // interrupts();
 }
 
 void changeFocus(double targetFocus)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_MOTION);
   // no_interrupts();
   if (pPmc->isEnabled())
     pPmc->setFocusTarget(targetFocus);
+  else
+    pPmc->getMetrics().increment(METRIC_COMMANDS_DROPPED);
   // interrupts();
 }
 
 void fanSpeed(unsigned int PWR)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
   // no_interrupts();
   pPmc->setFanSpeed(PWR);
   // interrupts();
 }
+// Clock sync sample, see clock_sync.h. Replies with the fit so far.
+void clockSync(double hostTime_us)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
+  pPmc->addClockSyncSample((int64_t)hostTime_us);
+  const ClockSync &sync = pPmc->getClockSync();
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<double>("ClockSync", hostTime_us);
+  newMsg.addKeyValuePair<double>("ClockOffset_us", sync.getOffset_us());
+  newMsg.addKeyValuePair<double>("ClockSkew_ppm", sync.getSkew_ppm());
+  newMsg.addKeyValuePair<double>("ClockResidual_us", sync.getResidual_us());
+  newMsg.addKeyValuePair<unsigned int>("ClockSamples", sync.getSampleCount());
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
+// Holds the motion command that follows in the same message until host time T.
+// Refused commands aren't held, so they run as soon as they arrive.
+void executeAt(double hostTime_us)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_MOTION);
+  int64_t lead_us;
+  uint8_t status = pPmc->scheduleNextCommand((int64_t)hostTime_us, &lead_us);
+  const char *statusStr = (status == SCHEDULE_OK)            ? "$OK^"
+                          : (status == SCHEDULE_NOT_SYNCED) ? "NotSynced"
+                          : (status == SCHEDULE_TOO_LATE)   ? "TooLate"
+                                                            : "TooFar";
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<std::string>("ExecuteAt", statusStr);
+  newMsg.addKeyValuePair<double>("ExecuteIn_us", (double)lead_us);
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
 void enableSteppers(bool en)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
   pPmc->enableSteppers(en);
   LFAST::CommsMessage newMsg;
   newMsg.addKeyValuePair<bool>("SteppersEnabled", en);
   commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
 }
+void saturationPolicy(unsigned int policy)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
+  pPmc->setSaturationPolicy(policy);
+}
+// Sets the slew mode and replies with the one in use. Moves started after this
+// slew in it and still finish at the reference resolution.
+void microstepMode(unsigned int divider)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
+  bool accepted = pPmc->setMicrostepMode(divider);
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<unsigned int>("MicrostepMode", pPmc->getMicrostepDivider());
+  newMsg.addKeyValuePair<std::string>("MicrostepStatus", accepted ? "$OK^" : "Unsupported");
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
+// Reports a motion parameter's value, default, limits and when changes take effect
+void getParam(unsigned int id)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_QUERY);
+  LFAST::CommsMessage newMsg;
+  const ParamDef *def = pPmc->getParamDef(id);
+  newMsg.addKeyValuePair<unsigned int>("ParamId", id);
+  if (def == nullptr)
+  {
+    newMsg.addKeyValuePair<std::string>("ParamStatus", "Unknown");
+  }
+  else
+  {
+    newMsg.addKeyValuePair<std::string>("ParamName", def->name);
+    newMsg.addKeyValuePair<double>("ParamValue", pPmc->getParam(id));
+    newMsg.addKeyValuePair<double>("ParamDefault", def->defaultValue);
+    newMsg.addKeyValuePair<double>("ParamMin", def->minValue);
+    newMsg.addKeyValuePair<double>("ParamMax", def->maxValue);
+    newMsg.addKeyValuePair<bool>("ApplyOnReboot", def->apply == PARAM_APPLY_ON_REBOOT);
+    newMsg.addKeyValuePair<std::string>("ParamStatus", "$OK^");
+  }
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
+// Selects the parameter for SetParam, send it first (e.g. {"ParamId": 0, "SetParam": 1800})
+void selectParam(unsigned int id)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
+  selectedParamId = id;
+}
+void setParam(double value)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
+  uint8_t status = pPmc->setParam(selectedParamId, value);
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<unsigned int>("ParamId", selectedParamId);
+  newMsg.addKeyValuePair<double>("ParamValue", pPmc->getParam(selectedParamId));
+  const char *statusStr = (status == PARAM_OK) ? "$OK^" : (status == PARAM_OUT_OF_RANGE) ? "OutOfRange" : "Unknown";
+  newMsg.addKeyValuePair<std::string>("ParamStatus", statusStr);
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
 // Returns the status bits for each axis of motion. Bits are Faulted, Home and Moving
 void getStatus(double lst)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_QUERY);
+  AxisState axes;
+  pPmc->getAxisSnapshot(&axes);
   LFAST::CommsMessage newMsg;
-  newMsg.addKeyValuePair<bool>("ARunning?", pPmc->getStatus(LFAST::PMC::MOTOR_A));
-  newMsg.addKeyValuePair<bool>("BRunning?", pPmc->getStatus(LFAST::PMC::MOTOR_B));
-  newMsg.addKeyValuePair<bool>("CRunning?", pPmc->getStatus(LFAST::PMC::MOTOR_C));
+  newMsg.addKeyValuePair<bool>("ARunning?", axes.running[LFAST::PMC::MOTOR_A]);
+  newMsg.addKeyValuePair<bool>("BRunning?", axes.running[LFAST::PMC::MOTOR_B]);
+  newMsg.addKeyValuePair<bool>("CRunning?", axes.running[LFAST::PMC::MOTOR_C]);
+  newMsg.addKeyValuePair<bool>("HomingRequired", pPmc->isHomingRequired());
+  newMsg.addKeyValuePair<unsigned int>("MicrostepMode", pPmc->getMicrostepDivider());
+  newMsg.addKeyValuePair<bool>("JogCoarse", pPmc->isJogCoarse());
+  uint8_t fanDuty;
+  uint32_t fanRpm;
+  bool fanStalled;
+  pPmc->getFanStatus(&fanDuty, &fanRpm, &fanStalled);
+  newMsg.addKeyValuePair<unsigned int>("FanDuty", fanDuty);
+  newMsg.addKeyValuePair<unsigned int>("FanRpm", fanRpm);
+  newMsg.addKeyValuePair<bool>("FanStalled", fanStalled);
+  newMsg.addKeyValuePair<bool>("ClockSynced", pPmc->isClockSynced());
+  newMsg.addKeyValuePair<double>("ClockOffset_us", pPmc->getClockSync().getOffset_us());
+  newMsg.addKeyValuePair<double>("ClockSkew_ppm", pPmc->getClockSync().getSkew_ppm());
+  newMsg.addKeyValuePair<unsigned int>("ALimitBounces", axes.switchBounces[LFAST::PMC::MOTOR_A]);
+  newMsg.addKeyValuePair<unsigned int>("BLimitBounces", axes.switchBounces[LFAST::PMC::MOTOR_B]);
+  newMsg.addKeyValuePair<unsigned int>("CLimitBounces", axes.switchBounces[LFAST::PMC::MOTOR_C]);
+  uint32_t uncommittedSteps, errorBoundSteps;
+  pPmc->getCheckpointErrors(&uncommittedSteps, &errorBoundSteps);
+  newMsg.addKeyValuePair<unsigned int>("MaxUncommittedSteps", uncommittedSteps);
+  newMsg.addKeyValuePair<unsigned int>("CheckpointErrorBound", errorBoundSteps);
+  uint32_t dashPass_us, dashField_us, dashDeferred;
+  pPmc->getDashboardStats(&dashPass_us, &dashField_us, &dashDeferred);
+  newMsg.addKeyValuePair<unsigned int>("DashboardMaxPass_us", dashPass_us);
+  newMsg.addKeyValuePair<unsigned int>("DashboardMaxField_us", dashField_us);
+  newMsg.addKeyValuePair<unsigned int>("DashboardDeferredFields", dashDeferred);
   commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
 }
 
 void stop(double lst)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_STOP);
+  noInterrupts();
   pPmc->stopNow();
+  pPmc->cancelScheduledCommand();
+  interrupts();
   LFAST::CommsMessage newMsg;
   newMsg.addKeyValuePair<std::string>("Stopped", "$OK^");
   commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
@@ -292,11 +605,97 @@ void stop(double lst)
 // Returns 3 step counts
 void getPositions(double lst)
 {
+  pPmc->getMetrics().increment(METRIC_CMD_QUERY);
+  // All three from the same control tick
+  AxisState axes;
+  pPmc->getAxisSnapshot(&axes);
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<double>("APosition", axes.position[LFAST::PMC::MOTOR_A]);
+  newMsg.addKeyValuePair<double>("BPosition", axes.position[LFAST::PMC::MOTOR_B]);
+  newMsg.addKeyValuePair<double>("CPosition", axes.position[LFAST::PMC::MOTOR_C]);
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void armTrace(unsigned int mask)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_TRACE);
+  traceDumpActive = false;
+  pPmc->armTrace(mask & TRACE_TRIGGER_ALL);
   LFAST::CommsMessage newMsg;
-  newMsg.addKeyValuePair<double>("APosition", pPmc->getStepperPosition(LFAST::PMC::MOTOR_A));
-  newMsg.addKeyValuePair<double>("BPosition", pPmc->getStepperPosition(LFAST::PMC::MOTOR_B));
-  newMsg.addKeyValuePair<double>("CPosition", pPmc->getStepperPosition(LFAST::PMC::MOTOR_C));
+  newMsg.addKeyValuePair<unsigned int>("TraceState", pPmc->getTraceState());
   commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
+void triggerTrace(unsigned int val)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_TRACE);
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<bool>("TraceTriggered", pPmc->triggerTrace());
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
+
+void dumpTrace(unsigned int val)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_TRACE);
+  traceDumpSize = pPmc->beginTraceDump();
+  traceDumpOffset = 0;
+  traceDumpActive = (traceDumpSize > 0);
+  if (!traceDumpActive)
+  {
+    LFAST::CommsMessage newMsg;
+    newMsg.addKeyValuePair<unsigned int>("TraceChunks", 0);
+    commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+  }
+#if ENABLE_TERMINAL_UPDATES
+  cli->printfDebugMessage("Dumping trace, %u bytes", traceDumpSize);
+#endif
+}
+
+// Sends the next DumpTrace chunk, so a dump never holds up loop() for long
+void serviceTraceDump()
+{
+  if (!traceDumpActive)
+    return;
+  uint8_t chunk[TRACE_DUMP_CHUNK_BYTES];
+  char encoded[base64EncodedLength(TRACE_DUMP_CHUNK_BYTES) + 1];
+  uint32_t numChunks = (traceDumpSize + TRACE_DUMP_CHUNK_BYTES - 1) / TRACE_DUMP_CHUNK_BYTES;
+  uint32_t len = pPmc->readTraceDump(traceDumpOffset, chunk, TRACE_DUMP_CHUNK_BYTES);
+  base64Encode(chunk, len, encoded);
+
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<unsigned int>("TraceChunk", traceDumpOffset / TRACE_DUMP_CHUNK_BYTES);
+  newMsg.addKeyValuePair<unsigned int>("TraceChunks", numChunks);
+  newMsg.addKeyValuePair<std::string>("TraceData", encoded);
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+
+  traceDumpOffset += len;
+  if (len == 0 || traceDumpOffset >= traceDumpSize)
+    traceDumpActive = false;
+}
+
+void getMetrics(double lst)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_QUERY);
+  sendMetrics();
+}
+
+// Pushes GetMetrics replies every S seconds, 0 stops the push
+void metricsPeriod(unsigned int seconds)
+{
+  pPmc->getMetrics().increment(METRIC_CMD_CONFIG);
+  metricsPushPeriod_ms = seconds * 1000;
+  lastMetricsPush_ms = millis();
+}
+
+// All counters and gauges in one message
+void sendMetrics()
+{
+  MetricsRegistry &metrics = pPmc->getMetrics();
+  LFAST::CommsMessage newMsg;
+  newMsg.addKeyValuePair<unsigned int>("Uptime_s", millis() / 1000);
+  for (uint16_t id = 0; id < metrics.getNumMetrics(); id++)
+    newMsg.addKeyValuePair<unsigned int>(metrics.getDef(id)->name, metrics.get(id));
+  commsService->sendMessage(newMsg, LFAST::CommsService::ACTIVE_CONNECTION);
+}
@@ -0,0 +1,116 @@
+/*******************************************************************************
+Copyright 2022
+Steward Observatory Engineering & Technical Services, University of Arizona
+This program is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or any later version.
+This program is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*******************************************************************************/
+
+/**
+@brief StepGenerator backend on a Teensy periodic interrupt timer
+@file pit_step_generator.cpp
+*/
+
+#include "pit_step_generator.h"
+
+// Above the control tick (CONTROL_TICK_IRQ_PRIORITY), which runs with interrupts on
+// so these pulses keep their spacing while it plans
+#define STEP_GEN_IRQ_PRIORITY 32
+
+// The control tick can be preempted by timer_ISR(), so anything beyond the lock-free
+// segment queue masks the PIT interrupt while it touches the DDA state
+static inline void maskStepGenIrq()
+{
+    NVIC_DISABLE_IRQ(IRQ_PIT);
+    asm volatile("dsb\n\tisb"); // Masked before the next access
+}
+static inline void unmaskStepGenIrq()
+{
+    NVIC_ENABLE_IRQ(IRQ_PIT);
+}
+
+PitStepGenerator *PitStepGenerator::instance = nullptr;
+
+PitStepGenerator::PitStepGenerator(const uint8_t *stepPins, const uint8_t *dirPins, uint32_t baseRate_hz)
+    : core(baseRate_hz)
+{
+    for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+    {
+        this->stepPins[ii] = stepPins[ii];
+        this->dirPins[ii] = dirPins[ii];
+    }
+}
+
+bool PitStepGenerator::begin()
+{
+    if (instance != nullptr && instance != this)
+        return false;
+    instance = this;
+    for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+    {
+        pinMode(stepPins[ii], OUTPUT);
+        pinMode(dirPins[ii], OUTPUT);
+        digitalWriteFast(stepPins[ii], LOW);
+    }
+    timer.priority(STEP_GEN_IRQ_PRIORITY);
+    return timer.begin(timer_ISR, 1e6f / core.getBaseRate());
+}
+
+bool PitStepGenerator::queueSegment(const int32_t *steps, uint32_t duration_us)
+{
+    return core.push(steps, duration_us);
+}
+
+void PitStepGenerator::stop()
+{
+    maskStepGenIrq();
+    core.stop();
+    unmaskStepGenIrq();
+}
+
+// All three from the same base tick
+void PitStepGenerator::getPositions(int32_t *positions) const
+{
+    maskStepGenIrq();
+    for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        positions[ii] = core.getPosition(ii);
+    unmaskStepGenIrq();
+}
+
+void PitStepGenerator::setPositions(const int32_t *positions)
+{
+    maskStepGenIrq();
+    for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+        core.setPosition(ii, positions[ii]);
+    unmaskStepGenIrq();
+}
+
+FASTRUN void PitStepGenerator::timer_ISR()
+{
+    instance->service();
+}
+
+FASTRUN void PitStepGenerator::service()
+{
+    DdaStepCore::Output out;
+    core.tick(out);
+    for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+    {
+        uint8_t bit = 1 << ii;
+        if (out.lower & bit)
+            digitalWriteFast(stepPins[ii], LOW);
+        if (out.raise & bit)
+            digitalWriteFast(stepPins[ii], HIGH);
+    }
+    // After the step pins: a new direction is only ever set on a tick with no step
+    if (out.dirChanged)
+    {
+        for (uint8_t ii = 0; ii < STEP_GEN_AXES; ii++)
+            digitalWriteFast(dirPins[ii], (out.dir & (1 << ii)) ? HIGH : LOW);
+    }
+}
@@ -22,7 +22,6 @@ Implementation of Primary Mirror Control Functions.
 
 #include "primary_mirror_ctrl.h"
 #include <Arduino.h>
-#include <EEPROM.h>
 #include <cstring>
 #include <cmath>
 #include <cinttypes>
@@ -32,27 +31,129 @@ Implementation of Primary Mirror Control Functions.
 #include "device_config.h"
 #include "teensy41_device.h"
 #include "TimerOne.h"
+#include "eeprom_storage.h"
+#include "fram_storage.h"
+#if ENABLE_STEP_GENERATOR
+#include "pit_step_generator.h"
+#endif
+
+const uint8_t LimitSwitchPins[3]{A_LIMIT_SW_PIN, B_LIMIT_SW_PIN, C_LIMIT_SW_PIN};
+#if ENABLE_CONTROL_TRACE
+DMAMEM static TraceRecorder<TRACE_BUFFER_RECORDS> ControlTrace;
+#endif
+
+#if ENABLE_STEP_GENERATOR
+const uint8_t StepPins[3]{A_STEP, B_STEP, C_STEP};
+const uint8_t DirPins[3]{A_DIR, B_DIR, C_DIR};
+static PitStepGenerator PitStepBackend(StepPins, DirPins, STEP_GEN_BASE_HZ);
+constexpr double STEPPER_SPEED_LIMIT = STEP_GEN_BASE_HZ / 2;
+#else
+constexpr double STEPPER_SPEED_LIMIT = 10000.0;
+#endif
+
+// DIR high for positive, a STEP_PULSE_NS high pulse per step
+void ShieldDriverPins::setDirections(uint8_t dirBits)
+{
+    digitalWriteFast(A_DIR, (dirBits & 0x1) ? HIGH : LOW);
+    digitalWriteFast(B_DIR, (dirBits & 0x2) ? HIGH : LOW);
+    digitalWriteFast(C_DIR, (dirBits & 0x4) ? HIGH : LOW);
+}
+
+void ShieldDriverPins::step(uint8_t stepBits)
+{
+    if (stepBits & 0x1)
+        digitalWriteFast(A_STEP, HIGH);
+    if (stepBits & 0x2)
+        digitalWriteFast(B_STEP, HIGH);
+    if (stepBits & 0x4)
+        digitalWriteFast(C_STEP, HIGH);
+    delayNanoseconds(STEP_PULSE_NS);
+    digitalWriteFast(A_STEP, LOW);
+    digitalWriteFast(B_STEP, LOW);
+    digitalWriteFast(C_STEP, LOW);
+}
+
+// The shield's joystick header. analogRead() blocks until the conversion is
+// done, so loop() samples into a mailbox and the control tick reads that.
+class AnalogJoystick : public JoystickSource
+{
+public:
+    void sample()
+    {
+        JoystickSample fresh{(uint16_t)analogRead(VRx), (uint16_t)analogRead(VRy), digitalRead(SW) == LOW};
+        noInterrupts();
+        latest = fresh;
+        interrupts();
+    }
+    // Back to a centred stick, so a new jog doesn't start from an old sample
+    void reset()
+    {
+        noInterrupts();
+        latest = {JOYSTICK_ADC_MAX / 2, JOYSTICK_ADC_MAX / 2, false};
+        interrupts();
+    }
+    JoystickSample read(uint32_t now_us) override { return latest; }
 
-#include <MultiStepper.h>
-#include <AccelStepper.h>
+private:
+    JoystickSample latest{JOYSTICK_ADC_MAX / 2, JOYSTICK_ADC_MAX / 2, false};
+};
+static AnalogJoystick ShieldJoystick;
 
-AccelStepper Stepper_A(AccelStepper::DRIVER, A_STEP, A_DIR);
-AccelStepper Stepper_B(AccelStepper::DRIVER, B_STEP, B_DIR);
-AccelStepper Stepper_C(AccelStepper::DRIVER, C_STEP, C_DIR);
-// MultiStepper steppers;
-MultiStepper steppers;
+static const MetricDef PmcMetricTable[NUM_PMC_METRICS] = {
+    {"MovesCompleted", METRIC_COUNTER},
+    {"MovesInterrupted", METRIC_COUNTER},
+    {"MovesRetargeted", METRIC_COUNTER},
+    {"LimitHits", METRIC_COUNTER},
+    {"HomingRuns", METRIC_COUNTER},
+    {"CmdsSaturated", METRIC_COUNTER},
+    {"CmdsRejected", METRIC_COUNTER},
+    {"CmdsDropped", METRIC_COUNTER},
+    {"PositionWrites", METRIC_COUNTER},
+    {"ConfigWrites", METRIC_COUNTER},
+    {"MsgsReceived", METRIC_COUNTER},
+    {"MotionCmds", METRIC_COUNTER},
+    {"HomingCmds", METRIC_COUNTER},
+    {"StopCmds", METRIC_COUNTER},
+    {"QueryCmds", METRIC_COUNTER},
+    {"ConfigCmds", METRIC_COUNTER},
+    {"TraceCmds", METRIC_COUNTER},
+    {"Connects", METRIC_COUNTER},
+    {"WatchdogWarnings", METRIC_COUNTER},
+    {"FanStalls", METRIC_COUNTER},
+    {"ScheduledMoves", METRIC_COUNTER},
+    {"ExpiredSchedules", METRIC_COUNTER},
+    {"LoopOverruns", METRIC_COUNTER},
+    {"IsrMax_us", METRIC_GAUGE},
+    {"TickGapMax_us", METRIC_GAUGE},
+    {"JournalWriteMax_us", METRIC_GAUGE},
+    {"LoopMax_us", METRIC_GAUGE},
+    {"ClientsMax_us", METRIC_GAUGE},
+    {"ClientDataMax_us", METRIC_GAUGE},
+    {"ServicesMax_us", METRIC_GAUGE},
+    {"NotificationsMax_us", METRIC_GAUGE},
+};
+static_assert(NUM_PMC_METRICS <= METRICS_MAX_METRICS, "Too many metrics for the registry");
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////// Motion Control Functions  //////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////
 using namespace LFAST;
 
+// Runs with interrupts on, so the step generator's PIT can preempt it. The switch
+// and tach ISRs sit below it, and loop() masks interrupts around the state it
+// shares with the tick.
 void primaryMirrorControl_ISR()
 {
-    noInterrupts();
-
+    static uint32_t lastTickStart_us = 0;
+    uint32_t tickStart_us = micros();
     PrimaryMirrorControl &pmc = PrimaryMirrorControl::getMirrorController();
+    // Anything that holds the tick off (e.g. an EEPROM write) shows up here
+    if (lastTickStart_us != 0)
+        pmc.getMetrics().updateMax(METRIC_TICK_GAP_MAX_US, tickStart_us - lastTickStart_us);
+    lastTickStart_us = tickStart_us;
+    pmc.updateLocalClock(tickStart_us);
     pmc.copyShadowToActive();
+    pmc.serviceLimitSwitches();
     if (pmc.isEnabled())
     {
         // TOGGLE_DEBUG_PIN();
@@ -60,39 +161,96 @@ void primaryMirrorControl_ISR()
         // delay(1);
         // TOGGLE_DEBUG_PIN();
     }
-    interrupts();
+    pmc.publishAxisState();
+    uint32_t tickDuration_us = micros() - tickStart_us;
+    pmc.getMetrics().updateMax(METRIC_ISR_MAX_US, tickDuration_us);
+#if ENABLE_CONTROL_TRACE
+    pmc.recordTraceSample(tickDuration_us);
+#endif
 }
 
 void PrimaryMirrorControl::limitSwitch_A_ISR()
 {
-    noInterrupts();
-    detachInterrupt(digitalPinToInterrupt(A_LIMIT_SW_PIN));
-    PrimaryMirrorControl &pmc = PrimaryMirrorControl::getMirrorController();
-    pmc.limitSwitchHandler(LFAST::PMC::MOTOR_A);
-    interrupts();
+    PrimaryMirrorControl::getMirrorController().recordLimitSwitchEdge(LFAST::PMC::MOTOR_A);
 }
 void PrimaryMirrorControl::limitSwitch_B_ISR()
 {
-    noInterrupts();
-    detachInterrupt(digitalPinToInterrupt(B_LIMIT_SW_PIN));
-    PrimaryMirrorControl &pmc = PrimaryMirrorControl::getMirrorController();
-    if (pmc.isEnabled())
-        pmc.limitSwitchHandler(LFAST::PMC::MOTOR_B);
-    interrupts();
+    PrimaryMirrorControl::getMirrorController().recordLimitSwitchEdge(LFAST::PMC::MOTOR_B);
 }
 void PrimaryMirrorControl::limitSwitch_C_ISR()
 {
-    noInterrupts();
-    detachInterrupt(digitalPinToInterrupt(C_LIMIT_SW_PIN));
-    PrimaryMirrorControl &pmc = PrimaryMirrorControl::getMirrorController();
-    pmc.limitSwitchHandler(LFAST::PMC::MOTOR_C);
-    interrupts();
+    PrimaryMirrorControl::getMirrorController().recordLimitSwitchEdge(LFAST::PMC::MOTOR_C);
+}
+void PrimaryMirrorControl::fanTach_ISR()
+{
+    PrimaryMirrorControl::getMirrorController().fanMonitor.recordEdge(micros());
 }
 PrimaryMirrorControl::PrimaryMirrorControl()
+    : metrics(PmcMetricTable, NUM_PMC_METRICS)
 {
     controlMode = LFAST::PMC::STOP;
+    saturationPolicy = LFAST::PMC::PRESERVE_TIP_TILT;
+    lastSaturationStatus = LFAST::PMC::IN_RANGE;
+    moveNotifierFlagPtr = nullptr;
+    homeNotifierFlagPtr = nullptr;
+    saturationNotifierFlagPtr = nullptr;
+    preemptNotifierFlagPtr = nullptr;
+    fanStallNotifierFlagPtr = nullptr;
+    releaseNotifierFlagPtr = nullptr;
+    scheduleExpiredNotifierFlagPtr = nullptr;
     currentMoveState = IDLE;
-    currentHomingState = INITIALIZE;
+    axes.reset();
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+        limitSwitchEdgeCount[ii] = 0;
+    homingIsSeeded = false;
+    homingCommitPending = false;
+    positionsTrusted = false;
+    positionsApproximate = false;
+    positionStorage = nullptr;
+    storageBackendChanged = false;
+    positionJournal = nullptr;
+    configStore = nullptr;
+    dashboardSnapshotRequested = false;
+    dashboardSnapshotReady = false;
+    controlTickRunning = false;
+    std::fill(dashboardValue, dashboardValue + NUM_PRIMARY_MIRROR_ROWS, 0.0);
+    std::fill(dashboardRendered, dashboardRendered + NUM_PRIMARY_MIRROR_ROWS, NAN);
+    dashboardNextRow = 0;
+    dashboardLastRefresh_ms = 0;
+    dashboardMaxPass_us = 0;
+    dashboardMaxField_us = 0;
+    dashboardDeferredFields = 0;
+    tickMessages = {};
+    positionRecordFlags = 0;
+    pendingRecordFlags = 0;
+    commitRequestCount = 0;
+    commitServicedCount = 0;
+    committedFlags = 0;
+    std::fill(committedPositions, committedPositions + 3, 0);
+    lastCommit_ms = 0;
+    lastJournalService_ms = 0;
+    maxJournalServiceGap_ms = 0;
+    maxUncommittedSteps = 0;
+    tickPeriod_us = UPDATE_PRD_US;
+    traceTick = 0;
+    armTrace(TRACE_DEFAULT_TRIGGERS);
+    stepGenerator = nullptr;
+    microstepAlignStarted = false;
+    restoredStepScaleShift = 0;
+    trackRates = {0.0, 0.0, 0.0};
+    trackStarted = false;
+    trackHeldAtEdge = false;
+    joystickSource = nullptr;
+    lastJoystickSample_us = 0;
+    joystickTick = 0;
+    preemptRequested = false;
+    moveIsBlended = false;
+    std::fill(blendSegment, blendSegment + 3, 0);
+    blendSegmentPending = false;
+    tickTime_us = 0;
+    releaseAt_us = 0;
+    releaseScheduled = false;
+    lastReleaseError_us = 0;
     hardware_setup();
 }
 
@@ -105,39 +263,91 @@ PrimaryMirrorControl &PrimaryMirrorControl::getMirrorController()
 void PrimaryMirrorControl::hardware_setup()
 {
     // Initialize motors + limit switches
-    Stepper_A.setMaxSpeed(STEPPER_MAX_SPEED);     // Steps per second
-    Stepper_A.setAcceleration(STEPPER_MAX_ACCEL); // Steps per second per second
-
-    Stepper_B.setMaxSpeed(STEPPER_MAX_SPEED);
-    Stepper_B.setAcceleration(STEPPER_MAX_ACCEL);
-
-    Stepper_C.setMaxSpeed(STEPPER_MAX_SPEED);
-    Stepper_C.setAcceleration(STEPPER_MAX_ACCEL);
-
-    steppers.addStepper(Stepper_A);
-    steppers.addStepper(Stepper_B);
-    steppers.addStepper(Stepper_C);
+    for (uint8_t pin : {A_STEP, A_DIR, B_STEP, B_DIR, C_STEP, C_DIR})
+    {
+        pinMode(pin, OUTPUT);
+        digitalWrite(pin, LOW);
+    }
 
     pinMode(STEP_ENABLE_PIN, OUTPUT);
     this->enableSteppers(false);
+#if ENABLE_MICROSTEP_CONTROL
+    pinMode(MICROSTEP_M0_PIN, OUTPUT);
+    pinMode(MICROSTEP_M1_PIN, OUTPUT);
+    pinMode(MICROSTEP_M2_PIN, OUTPUT);
+    applyMicrostepMode(microstepMode);
+#endif
 
     pinMode(A_LIMIT_SW_PIN, INPUT_PULLUP);
     pinMode(B_LIMIT_SW_PIN, INPUT_PULLUP);
     pinMode(C_LIMIT_SW_PIN, INPUT_PULLUP);
 
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+        axes.switchLevel[ii] = digitalRead(LimitSwitchPins[ii]);
+
+    pinMode(SW, INPUT_PULLUP);
+    joystickSource = &ShieldJoystick;
+
+    // Tach edges interrupt on their own pin rather than being polled from the control tick
+    analogWriteFrequency(FAN_CONTROL, FAN_PWM_FREQ_HZ);
+    pinMode(FAN_TACH_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(FAN_TACH_PIN), fanTach_ISR, FALLING);
+    setFanSpeed(FAN_STARTUP_DUTY);
+
     // Global stepper enable pin, high to diable drivers
     enableLimitSwitchInterrupts();
     // Initialize Timer
     Timer1.initialize(UPDATE_PRD_US);
     Timer1.stop();
     Timer1.attachInterrupt(primaryMirrorControl_ISR);
+    NVIC_SET_PRIORITY(IRQ_FLEXPWM1_3, CONTROL_TICK_IRQ_PRIORITY); // TimerOne's FlexPWM channel
+#if ENABLE_STEP_GENERATOR
+    // Stays on the stepper core if the timer can't be had
+    if (PitStepBackend.begin())
+        stepGenerator = &PitStepBackend;
+#endif
 }
 
 void PrimaryMirrorControl::enableLimitSwitchInterrupts()
 {
-    attachInterrupt(digitalPinToInterrupt(A_LIMIT_SW_PIN), limitSwitch_A_ISR, FALLING);
-    attachInterrupt(digitalPinToInterrupt(B_LIMIT_SW_PIN), limitSwitch_B_ISR, FALLING);
-    attachInterrupt(digitalPinToInterrupt(C_LIMIT_SW_PIN), limitSwitch_C_ISR, FALLING);
+    attachInterrupt(digitalPinToInterrupt(A_LIMIT_SW_PIN), limitSwitch_A_ISR, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(B_LIMIT_SW_PIN), limitSwitch_B_ISR, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(C_LIMIT_SW_PIN), limitSwitch_C_ISR, CHANGE);
+}
+
+void PrimaryMirrorControl::recordLimitSwitchEdge(uint8_t motor)
+{
+    limitSwitchEdgeTime_us[motor] = micros();
+    limitSwitchEdgeCount[motor] = limitSwitchEdgeCount[motor] + 1;
+}
+
+// Called from the control tick. Acts on a switch once its level has been
+// stable for LIMIT_SW_DEBOUNCE_US, extra edges in that window count as bounces.
+void PrimaryMirrorControl::serviceLimitSwitches()
+{
+    uint32_t now_us = micros();
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+    {
+        uint32_t edgeCount = limitSwitchEdgeCount[ii];
+        if (edgeCount == axes.switchEdgesHandled[ii])
+            continue;
+        if ((now_us - limitSwitchEdgeTime_us[ii]) < LIMIT_SW_DEBOUNCE_US)
+            continue;
+
+        uint32_t newEdges = edgeCount - axes.switchEdgesHandled[ii];
+        axes.switchEdgesHandled[ii] = edgeCount;
+        uint8_t level = digitalRead(LimitSwitchPins[ii]);
+        if (level == axes.switchLevel[ii])
+        {
+            // Glitch, ended up where it started
+            axes.switchBounces[ii] += newEdges;
+            continue;
+        }
+        axes.switchBounces[ii] += newEdges - 1;
+        axes.switchLevel[ii] = level;
+        if (level == LOW)
+            limitSwitchHandler(ii);
+    }
 }
 
 void PrimaryMirrorControl::setMoveNotifierFlag(volatile bool *flagPtr)
@@ -148,25 +358,65 @@ void PrimaryMirrorControl::setHomingCompleteNotifierFlag(volatile bool *flagPtr)
 {
     homeNotifierFlagPtr = flagPtr;
 }
+void PrimaryMirrorControl::setSaturationNotifierFlag(volatile bool *flagPtr)
+{
+    saturationNotifierFlagPtr = flagPtr;
+}
+void PrimaryMirrorControl::setPreemptNotifierFlag(volatile bool *flagPtr)
+{
+    preemptNotifierFlagPtr = flagPtr;
+}
+void PrimaryMirrorControl::setFanStallNotifierFlag(volatile bool *flagPtr)
+{
+    fanStallNotifierFlagPtr = flagPtr;
+}
+void PrimaryMirrorControl::setReleaseNotifierFlag(volatile bool *flagPtr)
+{
+    releaseNotifierFlagPtr = flagPtr;
+}
+void PrimaryMirrorControl::setScheduleExpiredNotifierFlag(volatile bool *flagPtr)
+{
+    scheduleExpiredNotifierFlagPtr = flagPtr;
+}
 void PrimaryMirrorControl::pingMirrorControlStateMachine()
 {
     // tip/tilt/focus adustment control parsing
     bool moveCompleteFlag = false;
-    static MOVE_STATE prevMoveState = IDLE;
-    static uint32_t counter = 0;
 
     switch (currentMoveState)
     {
     case IDLE:
-        if (checkForNewCommand())
+        if (controlMode == PMC::TRACK || controlMode == PMC::JOG)
         {
-            currentMoveState = NEW_MOVE_CMD;
+            trackStarted = false;
+            currentMoveState = TRACKING;
+        }
+        else if (checkForNewCommand())
+        {
+            // A slew in another mode first steps onto its grid, the command is
+            // started once the drivers have switched
+            pendingMicrostepMode = slewMicrostepMode;
+            microstepAlignStarted = false;
+            currentMoveState = (microstepMode.getScaleShift() != pendingMicrostepMode.getScaleShift()) ? MICROSTEP_CHANGE
+                                                                                                       : NEW_MOVE_CMD;
         }
         break;
     case NEW_MOVE_CMD:
-        enableLimitSwitchInterrupts();
+        if (!waitForMotionRecord())
+            break;
         currentMoveState = MOVE_IN_PROGRESS;
-        updateStepperCommands();
+        {
+            // Rejected from rest there is nothing to run, so no move completes
+            bool fromRest = !preemptRequested;
+            if (updateStepperCommands() == PMC::REJECTED && fromRest)
+            {
+                // Back from the slew mode, if it was switched to for this command
+                applyMicrostepMode(MicrostepMode());
+                saveStepperPositionsToEeprom();
+                currentMoveState = IDLE;
+                break;
+            }
+        }
         // Intentional fall-through
     case MOVE_IN_PROGRESS:
         SET_DEBUG_PIN();
@@ -174,19 +424,34 @@ void PrimaryMirrorControl::pingMirrorControlStateMachine()
         CLEAR_DEBUG_PIN();
         if (moveCompleteFlag)
         {
-            currentMoveState = MOVE_COMPLETE;
+            currentMoveState = startFinalApproach() ? FINAL_APPROACH : MOVE_COMPLETE;
         }
         else
         {
             if (checkForNewCommand())
             {
-                cli->printDebugMessage("Move interrupted.");
+                if (controlMode == PMC::RELATIVE)
+                {
+                    // Same move, new end pose
+                    metrics.increment(METRIC_MOVES_RETARGETED);
+                }
+                else
+                {
+                    tickMessages.moveInterrupted = true;
+                    metrics.increment(METRIC_MOVES_INTERRUPTED);
+#if ENABLE_CONTROL_TRACE
+                    ControlTrace.trigger(TRACE_TRIGGER_MOVE_INTERRUPTED);
+#endif
+                }
+                // Either way the axes blend into the new target from where they are
+                preemptRequested = true;
                 currentMoveState = NEW_MOVE_CMD;
             }
         }
         break;
     case MOVE_COMPLETE:
-        saveStepperPositionsToEeprom();
+        // Positions are committed by stopNow() below
+        metrics.increment(METRIC_MOVES_COMPLETED);
         if (moveNotifierFlagPtr != nullptr)
             *moveNotifierFlagPtr = true;
         currentMoveState = IDLE;
@@ -195,28 +460,42 @@ void PrimaryMirrorControl::pingMirrorControlStateMachine()
         stopNow();
         currentMoveState = IDLE;
         break;
+    case MICROSTEP_CHANGE:
+        if (pingMicrostepChange())
+            currentMoveState = NEW_MOVE_CMD;
+        break;
+    case FINAL_APPROACH:
+        // At most half a slew step, new commands wait for it
+        if (!runCoordinatedMove())
+            currentMoveState = MOVE_COMPLETE;
+        break;
+    case TRACKING:
+        if (pingTracking())
+            currentMoveState = IDLE;
+        break;
     case HOMING_IS_ACTIVE:
-
+        if (homingCommitPending)
+        {
+            if (!waitForMotionRecord())
+                break;
+            homingCommitPending = false;
+        }
         bool homingComplete = pingHomingRoutine();
 
         if (homingComplete)
             currentMoveState = IDLE;
         break;
     }
-    if (counter++ >= TERM_UPDATE_COUNT)
-    {
-        updateFeedbackFields();
-        counter = 0;
-    }
-    if (prevMoveState != currentMoveState)
-    {
-        updateStatusFields();
-        prevMoveState = currentMoveState;
-    }
+    if (dashboardSnapshotRequested)
+        captureDashboardSnapshot();
 }
 
 bool PrimaryMirrorControl::checkForNewCommand()
 {
+    // An ExecuteAt command waits for its release time, so every controller
+    // synced to the same host starts it on the same tick (give or take one)
+    if (releaseScheduled && (int64_t)(tickTime_us - releaseAt_us) < 0)
+        return false;
     bool result = false;
     if (controlMode == PMC::RELATIVE)
     {
@@ -237,9 +516,60 @@ bool PrimaryMirrorControl::checkForNewCommand()
         tipUpdated = false;
         tiltUpdated = false;
         focusUpdated = false;
+        if (releaseScheduled)
+        {
+            releaseScheduled = false;
+            lastReleaseError_us = (int64_t)(tickTime_us - releaseAt_us);
+            metrics.increment(METRIC_MOVES_SCHEDULED);
+            if (releaseNotifierFlagPtr != nullptr)
+                *releaseNotifierFlagPtr = true;
+        }
+    }
+    else if (releaseScheduled)
+    {
+        // Nothing latched by the release time, so the schedule can't be meant
+        // for a command that turns up later
+        releaseScheduled = false;
+        metrics.increment(METRIC_SCHEDULES_EXPIRED);
+        if (scheduleExpiredNotifierFlagPtr != nullptr)
+            *scheduleExpiredNotifierFlagPtr = true;
     }
     return result;
 }
+
+uint64_t PrimaryMirrorControl::getLocalTime_us()
+{
+    noInterrupts();
+    uint64_t now_us = localClock.extend(micros());
+    interrupts();
+    return now_us;
+}
+
+void PrimaryMirrorControl::addClockSyncSample(int64_t hostTime_us)
+{
+    clockSync.addSample(hostTime_us, getLocalTime_us());
+}
+
+// Holds the next motion command until host time hostTime_us. lead_us is how far
+// ahead of the local clock that is.
+uint8_t PrimaryMirrorControl::scheduleNextCommand(int64_t hostTime_us, int64_t *lead_us)
+{
+    uint64_t now_us = getLocalTime_us();
+    *lead_us = 0;
+    if (!clockSync.isSynced(now_us))
+        return SCHEDULE_NOT_SYNCED;
+    uint64_t releaseAt = clockSync.toLocal(hostTime_us);
+    *lead_us = (int64_t)(releaseAt - now_us);
+    if (*lead_us < 0)
+        return SCHEDULE_TOO_LATE;
+    if (*lead_us > SCHEDULE_MAX_LEAD_US)
+        return SCHEDULE_TOO_FAR;
+    noInterrupts();
+    releaseAt_us = releaseAt;
+    releaseScheduled = true;
+    interrupts();
+    return SCHEDULE_OK;
+}
 bool PrimaryMirrorControl::isHomingInProgress()
 {
     return currentMoveState == HOMING_IS_ACTIVE;
@@ -247,6 +577,7 @@ bool PrimaryMirrorControl::isHomingInProgress()
 void PrimaryMirrorControl::enableControlInterrupt()
 {
     Timer1.start();
+    controlTickRunning = true;
 }
 
 // Functions to update necessary control variables
@@ -257,101 +588,265 @@ void PrimaryMirrorControl::copyShadowToActive()
 
 void PrimaryMirrorControl::setControlMode(uint8_t mode)
 {
+    if ((mode == PMC::TRACK || mode == PMC::JOG) && controlMode != mode)
+    {
+        // Tracking starts from rest, rates are sent after the mode
+        noInterrupts();
+        trackRates = {0.0, 0.0, 0.0};
+        joystickJog.reset();
+        joystickTick = 0;
+        interrupts();
+        ShieldJoystick.reset();
+    }
+    // A schedule was armed for a command in the old mode
+    if (controlMode != mode)
+        releaseScheduled = false;
     controlMode = mode;
 }
 
+// In TRACK mode this sets the tip rate in urad/s
 void PrimaryMirrorControl::setTipTarget(double tgt_urad)
 {
-    double tgt_rad_presat;
+    if (controlMode == PMC::JOG)
+    {
+        metrics.increment(METRIC_COMMANDS_DROPPED);
+        return;
+    }
+    if (controlMode == PMC::TRACK)
+    {
+        noInterrupts();
+        trackRates.tip_rad_s = tgt_urad * RAD_PER_URAD;
+        interrupts();
+        return;
+    }
+    noInterrupts();
     if (controlMode == PMC::RELATIVE)
     {
-        if (currentMoveState != MOVE_IN_PROGRESS)
-        {
-            // See comments in setFocusTarget
-            tgt_rad_presat = ShadowCommandStates_Eng.TIP_POS_RAD + (tgt_urad * RAD_PER_URAD);
-            tipUpdated = true;
-        }
-        else
-        {
-            tipUpdated = false;
-        }
+        // See comments in setFocusTarget
+        ShadowCommandStates_Eng.TIP_POS_RAD = ShadowCommandStates_Eng.TIP_POS_RAD + (tgt_urad * RAD_PER_URAD);
     }
     else
     {
-        tgt_rad_presat = (tgt_urad * RAD_PER_URAD);
-        tipUpdated = true;
+        ShadowCommandStates_Eng.TIP_POS_RAD = (tgt_urad * RAD_PER_URAD);
     }
-    // cli->printfDebugMessage("TIP UPDATE: %.8f", tgt_rad_presat * URAD_PER_RAD);
-    // TODO: Add angle saturation to limit command to mechanical range.
-    if (tipUpdated)
-        ShadowCommandStates_Eng.TIP_POS_RAD = tgt_rad_presat;
+    tipUpdated = true;
+    interrupts();
+    // cli->printfDebugMessage("TIP UPDATE: %.8f", ShadowCommandStates_Eng.TIP_POS_RAD * URAD_PER_RAD);
 }
 
+// In TRACK mode this sets the tilt rate in urad/s
 void PrimaryMirrorControl::setTiltTarget(double tgt_urad)
 {
-    double tgt_rad_presat;
+    if (controlMode == PMC::JOG)
+    {
+        metrics.increment(METRIC_COMMANDS_DROPPED);
+        return;
+    }
+    if (controlMode == PMC::TRACK)
+    {
+        noInterrupts();
+        trackRates.tilt_rad_s = tgt_urad * RAD_PER_URAD;
+        interrupts();
+        return;
+    }
+    noInterrupts();
     if (controlMode == PMC::RELATIVE)
     {
-        if (currentMoveState != MOVE_IN_PROGRESS)
-        {
-            tiltUpdated = true;
-            // See comments in setFocusTarget
-            tgt_rad_presat = ShadowCommandStates_Eng.TILT_POS_RAD + (tgt_urad * RAD_PER_URAD);
-        }
-        else
-        {
-            tiltUpdated = false;
-        }
+        // See comments in setFocusTarget
+        ShadowCommandStates_Eng.TILT_POS_RAD = ShadowCommandStates_Eng.TILT_POS_RAD + (tgt_urad * RAD_PER_URAD);
     }
     else
     {
-        tiltUpdated = true;
-        tgt_rad_presat = (tgt_urad * RAD_PER_URAD);
+        ShadowCommandStates_Eng.TILT_POS_RAD = (tgt_urad * RAD_PER_URAD);
     }
-    // cli->printfDebugMessage("TILT UPDATE: %.8f", tgt_rad_presat* URAD_PER_RAD);
-    // TODO: Add angle saturation to limit command to mechanical range.
-    if (tiltUpdated)
-        ShadowCommandStates_Eng.TILT_POS_RAD = tgt_rad_presat;
+    tiltUpdated = true;
+    interrupts();
+    // cli->printfDebugMessage("TILT UPDATE: %.8f", ShadowCommandStates_Eng.TILT_POS_RAD * URAD_PER_RAD);
 }
 
+// In TRACK mode this sets the focus rate, per second
 void PrimaryMirrorControl::setFocusTarget(double tgt_um)
 {
-    double focus_tgt_presat;
+    if (controlMode == PMC::JOG)
+    {
+        metrics.increment(METRIC_COMMANDS_DROPPED);
+        return;
+    }
+    if (controlMode == PMC::TRACK)
+    {
+        noInterrupts();
+        trackRates.focus_s = tgt_um;
+        interrupts();
+        return;
+    }
+    // Relative commands accumulate against the commanded end pose, not the
+    // current position, so a correction sent mid-move retargets the move in
+    // flight. Unreachable results are projected (or rolled back) against the
+    // workspace by updateStepperCommands(). The read-modify-write is atomic
+    // with respect to the tick, which rewrites the shadow pose on saturation.
+    noInterrupts();
     if (controlMode == PMC::RELATIVE)
     {
-        if (currentMoveState != MOVE_IN_PROGRESS)
-        {
-            // In order to process relative commands while one is in progress,
-            // I need to finish getting the motor->tip/tilt/focus transforms correct
-            // So we can see what the current position is before adding to it.
-            // For now, relative commands will only get processed if there is no move in progress.
-            focus_tgt_presat = ShadowCommandStates_Eng.FOCUS_POS_MM + tgt_um;
-            focusUpdated = true;
-        }
-        else
-        {
-            focusUpdated = false;
-        }
+        ShadowCommandStates_Eng.FOCUS_POS_MM = ShadowCommandStates_Eng.FOCUS_POS_MM + tgt_um;
     }
     else
     {
-        focus_tgt_presat = tgt_um;
-        focusUpdated = true;
+        ShadowCommandStates_Eng.FOCUS_POS_MM = tgt_um;
     }
-    if (focusUpdated)
+    focusUpdated = true;
+    interrupts();
+    // cli->printfDebugMessage("TargetFocus = %6.4f", CommandStates_Eng.FOCUS_POS_MM);
+}
+
+void PrimaryMirrorControl::setSaturationPolicy(uint8_t policy)
+{
+    if (policy <= PMC::REJECT_COMMAND)
+        saturationPolicy = policy;
+}
+
+// Requests 1/divider microstepping for point-to-point slews, from the next one
+// on. Final positioning, tracking and homing stay at the reference resolution.
+// Returns false if the mode isn't available.
+bool PrimaryMirrorControl::setMicrostepMode(uint32_t divider)
+{
+    MicrostepMode mode;
+    if (!mode.setDivider(divider))
+        return false;
+#if !ENABLE_MICROSTEP_CONTROL
+    // Jumpered at the reference resolution
+    if (mode.getScaleShift() != 0)
+        return false;
+#endif
+    noInterrupts();
+    slewMicrostepMode = mode;
+    interrupts();
+    return true;
+}
+
+// Runs from the control tick until the drivers are in pendingMicrostepMode.
+// Going coarser from off the coarser grid first steps to the nearest point on
+// it, at the current resolution.
+bool PrimaryMirrorControl::pingMicrostepChange()
+{
+    if (!microstepAlignStarted)
     {
-        // double focus_tgt_post_sat = saturate(focus_tgt_presat, MIN_STROKE_MICRON, MAX_STROKE_MICRON);
-        // ShadowCommandStates_Eng.FOCUS_POS_MM = focus_tgt_post_sat;
-        ShadowCommandStates_Eng.FOCUS_POS_MM = focus_tgt_presat;
+        bool aligned = true;
+        int32_t alignedTargets[3];
+        for (uint8_t ii = 0; ii < 3; ii++)
+        {
+            int32_t position = getAxisPosition(ii);
+            aligned &= pendingMicrostepMode.isAligned(position);
+            alignedTargets[ii] = microstepMode.toDriver(pendingMicrostepMode.toReference(pendingMicrostepMode.toDriver(position)));
+        }
+        if (!aligned)
+        {
+            if (!waitForMotionRecord())
+                return false;
+            startCoordinatedMove(alignedTargets);
+        }
+        microstepAlignStarted = true;
     }
-    // cli->printfDebugMessage("TargetFocus = %6.4f", CommandStates_Eng.FOCUS_POS_MM);
+    if (runCoordinatedMove())
+        return false;
+
+    applyMicrostepMode(pendingMicrostepMode);
+    saveStepperPositionsToEeprom();
+    tickMessages.microstepDivider = microstepMode.getDivider();
+    return true;
+}
+
+// A slew in a coarse mode ends within half a driver step of the command. Switches
+// the drivers back to the reference resolution, which is exact from anywhere,
+// and starts the rest of the way. Returns false if there is nothing left to step.
+bool PrimaryMirrorControl::startFinalApproach()
+{
+    if (microstepMode.getScaleShift() == 0)
+        return false;
+    applyMicrostepMode(MicrostepMode());
+    bool arrived = true;
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+        arrived &= (stepperCore.getPosition(ii) == axes.cmdSteps[ii]);
+    if (arrived)
+        return false;
+    startCoordinatedMove(axes.cmdSteps);
+    return true;
+}
+
+// Switches the drivers and rescales the step counters, which must be on the
+// new mode's grid (or the new mode finer). Call from the control tick or with
+// interrupts disabled.
+void PrimaryMirrorControl::applyMicrostepMode(const MicrostepMode &mode)
+{
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+        stepperCore.setPosition(ii, mode.rescale(stepperCore.getPosition(ii), microstepMode));
+    microstepMode = mode;
+    clearDrive();
+#if ENABLE_MICROSTEP_CONTROL
+    // Holds well over the DRV8825's mode setup time before the next step edge
+    uint8_t modeBits = mode.getModeBits();
+    digitalWrite(MICROSTEP_M0_PIN, (modeBits & 0x1) ? HIGH : LOW);
+    digitalWrite(MICROSTEP_M1_PIN, (modeBits & 0x2) ? HIGH : LOW);
+    digitalWrite(MICROSTEP_M2_PIN, (modeBits & 0x4) ? HIGH : LOW);
+#endif
+}
+
+// Returns the status and resulting command of the last saturated/rejected command
+uint8_t PrimaryMirrorControl::getLastSaturationEvent(double *tip, double *tilt, double *focus)
+{
+    noInterrupts();
+    *tip = SaturatedCommandStates_Eng.TIP_POS_RAD;
+    *tilt = SaturatedCommandStates_Eng.TILT_POS_RAD;
+    *focus = SaturatedCommandStates_Eng.FOCUS_POS_MM;
+    uint8_t status = lastSaturationStatus;
+    interrupts();
+    return status;
+}
+
+// Returns the target of the last move that was preempted by a new command
+void PrimaryMirrorControl::getLastPreemptedTarget(double *tip, double *tilt, double *focus)
+{
+    noInterrupts();
+    *tip = PreemptedCommandStates_Eng.TIP_POS_RAD;
+    *tilt = PreemptedCommandStates_Eng.TILT_POS_RAD;
+    *focus = PreemptedCommandStates_Eng.FOCUS_POS_MM;
+    interrupts();
 }
 
 // Set the fan speed to a percentage S of full scale
-// Fan Pin unknown?
 void PrimaryMirrorControl::setFanSpeed(unsigned int PWR)
 {
-    analogWrite(FAN_CONTROL, PWR);
+    uint8_t duty = (uint8_t)std::min(PWR, 100u);
+    analogWrite(FAN_CONTROL, (duty * 255) / 100);
+    fanMonitor.setDuty(duty);
+}
+
+// Called from loop(). Works out the fan speed from the tach edges counted since
+// the last pass and reports a fan that has stopped turning.
+void PrimaryMirrorControl::serviceFan()
+{
+    if (fanMonitor.update(millis()))
+    {
+        metrics.increment(METRIC_FAN_STALLS);
+        if (fanStallNotifierFlagPtr != nullptr)
+            *fanStallNotifierFlagPtr = true;
+    }
+}
+
+// Called from loop(). Samples the joystick for the control tick while jogging.
+void PrimaryMirrorControl::serviceJoystick()
+{
+    uint32_t now_us = micros();
+    if (controlMode != PMC::JOG || now_us - lastJoystickSample_us < JOYSTICK_SAMPLE_PERIOD_US)
+        return;
+    lastJoystickSample_us = now_us;
+    ShieldJoystick.sample();
+}
+
+void PrimaryMirrorControl::getFanStatus(uint8_t *duty, uint32_t *rpm, bool *stalled)
+{
+    *duty = fanMonitor.getDuty();
+    *rpm = fanMonitor.getRpm();
+    *stalled = fanMonitor.isStalled();
 }
 
 // Immediately stops all motion
@@ -363,273 +858,1054 @@ void PrimaryMirrorControl::stopNow()
     // Stepper_B.stop();
     // Stepper_C.stop();
     currentMoveState = IDLE;
-    currentHomingState = INITIALIZE;
+    std::fill(axes.homingState, axes.homingState + NUM_AXES, INITIALIZE);
     controlMode = PMC::STOP;
 
-    Stepper_A.moveTo(Stepper_A.currentPosition());
-    Stepper_B.moveTo(Stepper_B.currentPosition());
-    Stepper_C.moveTo(Stepper_C.currentPosition());
+    haltMotion();
+    // Also covers a limit switch hit while tracking
+    if (trackStarted)
+        finishTracking();
+    // Stopped mid-slew, back to the resolution the drivers rest in (going finer is exact)
+    applyMicrostepMode(MicrostepMode());
 
     saveStepperPositionsToEeprom();
 }
 
+// Drops whatever is stepping (blend, step generator queue, stepper core) and
+// any preempt in flight, leaving every axis targeted where it stands. Call from
+// the control tick or with interrupts disabled.
+void PrimaryMirrorControl::haltMotion()
+{
+    haltStepGenerator();
+    stepperCore.stop();
+    moveIsBlended = false;
+    blendSegmentPending = false;
+    preemptRequested = false;
+    clearDrive();
+}
+
+// Nothing is driving the axes outside of the core: every target where the axis
+// stands, no speed and no part step owed
+void PrimaryMirrorControl::clearDrive()
+{
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+    {
+        axes.driveTarget[ii] = stepperCore.getPosition(ii);
+        axes.driveSpeed[ii] = 0.0f;
+        axes.stepRemainder[ii] = 0.0f;
+    }
+}
+
 // Move each axis with velocity V to an absolute X,Y position with respect to “home”
 // V, X and Y are vectors of length 3. Velocity is in units of steps per second, X,Y are steps.
 // Velocity input as steps / sec
-void PrimaryMirrorControl::updateStepperCommands()
+// Returns the command's saturation status, a rejected command leaves any move in flight running.
+uint8_t PrimaryMirrorControl::updateStepperCommands()
 {
     // Convert Distance to steps (0.003mm per step??)
-    A_cmdSteps = 0;
-    B_cmdSteps = 0;
-    C_cmdSteps = 0;
-    CommandStates_Eng.getMotorPosnCommands(&A_cmdSteps, &B_cmdSteps, &C_cmdSteps);
+    MirrorStates projectedStates;
+    bool preempting = preemptRequested;
+    preemptRequested = false;
+    int32_t *cmdSteps = axes.cmdSteps;
+    uint8_t saturationStatus = CommandStates_Eng.getMotorPosnCommands(&cmdSteps[PMC::MOTOR_A], &cmdSteps[PMC::MOTOR_B],
+                                                                      &cmdSteps[PMC::MOTOR_C], saturationPolicy,
+                                                                      &projectedStates);
+    if (saturationStatus == PMC::REJECTED)
+    {
+        // Keep running towards the last reachable command, and make sure
+        // subsequent relative commands are applied on top of it.
+        SaturatedCommandStates_Eng = CommandStates_Eng;
+        ShadowCommandStates_Eng = AppliedCommandStates_Eng;
+        CommandStates_Eng = AppliedCommandStates_Eng;
+    }
+    else
+    {
+        if (saturationStatus == PMC::SATURATED)
+        {
+            SaturatedCommandStates_Eng = projectedStates;
+            ShadowCommandStates_Eng = projectedStates;
+            CommandStates_Eng = projectedStates;
+        }
+        if (preempting)
+        {
+            PreemptedCommandStates_Eng = AppliedCommandStates_Eng;
+            if (preemptNotifierFlagPtr != nullptr)
+                *preemptNotifierFlagPtr = true;
+        }
+        AppliedCommandStates_Eng = projectedStates;
 
 #if ENABLE_TERMINAL_UPDATES
-    cli->printfDebugMessage("Step Commands: [A/B/C]: %d, %d, %d", A_cmdSteps, B_cmdSteps, C_cmdSteps);
+        std::copy(cmdSteps, cmdSteps + NUM_AXES, tickMessages.stepCommands);
+        tickMessages.stepCommandsSet = true;
 #endif
-    long stepperCmdVector[3]{A_cmdSteps, B_cmdSteps, C_cmdSteps};
-    steppers.moveTo(stepperCmdVector);
+        // Rounded to the nearest driver step, so a coarse slew ends within
+        // half a driver step of the command
+        int32_t stepperCmdVector[NUM_AXES];
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            stepperCmdVector[ii] = microstepMode.toDriver(cmdSteps[ii]);
+        if (preempting)
+        {
+            startBlendedMove(stepperCmdVector);
+        }
+        else if (stepGenerator == nullptr)
+        {
+            startCoordinatedMove(stepperCmdVector);
+        }
+        else
+        {
+            // Planned from the step counts, which include any segments still queued
+            int32_t from[3];
+            for (uint8_t ii = 0; ii < 3; ii++)
+            {
+                from[ii] = stepperCore.getPosition(ii);
+                axes.driveTarget[ii] = stepperCmdVector[ii];
+            }
+            if (stepGenerator->isIdle())
+                stepGenerator->setPositions(from);
+            plannedMove.start(from, stepperCmdVector, getParam(PARAM_STEPPER_MAX_SPEED),
+                              getParam(PARAM_STEPPER_MAX_ACCEL), tickPeriod_us);
+        }
+    }
 
-    updateCommandFields();
+    if (saturationStatus != PMC::IN_RANGE)
+    {
+        lastSaturationStatus = saturationStatus;
+        metrics.increment(saturationStatus == PMC::REJECTED ? METRIC_COMMANDS_REJECTED : METRIC_COMMANDS_SATURATED);
+        if (saturationNotifierFlagPtr != nullptr)
+            *saturationNotifierFlagPtr = true;
+    }
+    return saturationStatus;
 }
 
 bool PrimaryMirrorControl::pingSteppers()
 {
     bool moveCompleteFlag = false;
 
-    // multistepper run function returns true if any of the motors are still moving
-    if (!steppers.run())
+    if (moveIsBlended)
+        return pingBlendedMove();
+    if (stepGenerator != nullptr)
+        return pingStepGenerator();
+
+    // Returns true while any of the motors are still moving
+    if (!runCoordinatedMove())
     {
         moveCompleteFlag = true;
     }
     return moveCompleteFlag;
 }
-bool PrimaryMirrorControl::pingHomingRoutine()
+
+// Starts a coordinated move to targets, in driver steps, stepped from the tick
+void PrimaryMirrorControl::startCoordinatedMove(const int32_t *targets)
 {
-    static uint32_t waitStartCount = 0;
-    uint32_t waitCounter = 0;
+    stepperCore.moveTo(targets);
+    // Published once the core has arrived
+    clearDrive();
+    std::copy(targets, targets + NUM_AXES, axes.driveTarget);
+}
+
+// Once per tick. Returns true while the move is running.
+bool PrimaryMirrorControl::runCoordinatedMove()
+{
+    return stepperCore.run();
+}
 
-    bool homingComplete = false;
-    static HOMING_STATE prevHomingState = INITIALIZE;
-    switch (currentHomingState)
+// Steps each axis on at its velocity (driver steps/s) for one tick. The part of
+// a step not taken yet is carried over, and the core takes at most one step
+// per tick.
+void PrimaryMirrorControl::runAxisVelocities(const double *velocity)
+{
+    int32_t from[NUM_AXES], to[NUM_AXES];
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
     {
-    case INITIALIZE:
-        limitFound_A = false;
-        limitFound_B = false;
-        limitFound_C = false;
-        Stepper_A.setSpeed(-homingSpeedStepsPerSec);
-        Stepper_B.setSpeed(-homingSpeedStepsPerSec);
-        Stepper_C.setSpeed(-homingSpeedStepsPerSec);
-        currentHomingState = HOMING_STEP_1;
-        updateStatusFields();
-        break;
-    case HOMING_STEP_1:
-        // Quick move until all endstops are hit
-        if (!limitFound_A)
-            Stepper_A.runSpeed();
-        if (!limitFound_B)
-            Stepper_B.runSpeed();
-        if (!limitFound_C)
-            Stepper_C.runSpeed();
-        // delay(1);
-        if (limitFound_A && limitFound_B && limitFound_C)
+        from[ii] = stepperCore.getPosition(ii);
+        axes.stepRemainder[ii] += velocity[ii] * tickPeriod_us * 1e-6;
+        to[ii] = from[ii] + ((axes.stepRemainder[ii] >= 0.5f) ? 1 : (axes.stepRemainder[ii] <= -0.5f) ? -1 : 0);
+        axes.driveTarget[ii] = to[ii];
+        axes.driveSpeed[ii] = velocity[ii];
+    }
+    stepperCore.stepToward(to);
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+    {
+        // A step held back (reversing, or faster than one per tick) isn't owed twice
+        float owed = axes.stepRemainder[ii] - (stepperCore.getPosition(ii) - from[ii]);
+        axes.stepRemainder[ii] = std::min(std::max(owed, -1.0f), 1.0f);
+    }
+}
+
+// Replaces the move in flight with a blend from the axes' current motion into
+// the new target. A blend that is preempted again carries on from its own state.
+void PrimaryMirrorControl::startBlendedMove(const int32_t *stepperCmdVector)
+{
+    double maxSpeed = getParam(PARAM_STEPPER_MAX_SPEED);
+    double maxAccel = getParam(PARAM_STEPPER_MAX_ACCEL);
+    // Stepped from the tick, the blend can't outrun one step per tick
+    if (stepGenerator == nullptr)
+        maxSpeed = std::min(maxSpeed, 1e6 / tickPeriod_us);
+    int32_t to[3];
+    for (uint8_t ii = 0; ii < 3; ii++)
+        to[ii] = stepperCmdVector[ii];
+
+    if (moveIsBlended)
+    {
+        blendedMove.retarget(to, maxSpeed, maxAccel);
+    }
+    else
+    {
+        int32_t from[3];
+        double velocity[3];
+        for (uint8_t ii = 0; ii < 3; ii++)
         {
-            saveStepperPositionsToEeprom();
-            currentHomingState = HOMING_STEP_2;
-            waitStartCount = millis();
-            updateStatusFields();
-        }
-        break;
-    case HOMING_STEP_2:
-        // Short pause
-        waitCounter = millis();
-        if ((waitCounter - waitStartCount) > 1000)
-            currentHomingState = HOMING_STEP_3;
-        break;
-    case HOMING_STEP_3:
-        // Short Move forward until endstops are cleared
-        if (Stepper_A.currentPosition() < (STROKE_BOTTOM_STEPS + STEPS_PER_MM))
+            if (stepGenerator != nullptr)
+            {
+                // The planned positions include the segments still queued
+                from[ii] = plannedMove.getPosition(ii);
+                velocity[ii] = plannedMove.getVelocity(ii);
+            }
+            else
+            {
+                // Zero once the core's move has arrived
+                from[ii] = stepperCore.getPosition(ii);
+                velocity[ii] = stepperCore.getVelocity(ii, tickPeriod_us);
+            }
+        }
+        stepperCore.stop();
+        if (stepGenerator != nullptr)
+            plannedMove.start(from, from, 1.0, 1.0, tickPeriod_us);
+        uint16_t window = blendWindowTicks(maxAccel, getParam(PARAM_STEPPER_MAX_JERK), tickPeriod_us);
+        blendedMove.start(from, velocity, to, maxSpeed, maxAccel, window, tickPeriod_us);
+        moveIsBlended = true;
+    }
+    std::copy(to, to + NUM_AXES, axes.driveTarget);
+}
+
+// Steps the blend out through the step generator, or from the tick through the
+// core: each axis steps towards the blend's position, at most once per tick.
+// Returns true once arrived.
+bool PrimaryMirrorControl::pingBlendedMove()
+{
+    if (stepGenerator != nullptr)
+    {
+        while ((blendSegmentPending || !blendedMove.isDone()) && stepGenerator->getFreeSegments() > 0)
         {
-            Stepper_A.runSpeed();
-            Stepper_B.runSpeed();
-            Stepper_C.runSpeed();
+            if (!blendSegmentPending)
+                blendedMove.next(blendSegment);
+            blendSegmentPending = !stepGenerator->queueSegment(blendSegment, tickPeriod_us);
+            if (blendSegmentPending)
+                break;
+        }
+        for (uint8_t ii = 0; ii < 3; ii++)
+            stepperCore.setPosition(ii, blendedMove.getPosition(ii) - (blendSegmentPending ? blendSegment[ii] : 0));
+        bool arrived = !blendSegmentPending && blendedMove.isDone() && stepGenerator->isIdle();
+        if (arrived)
+            stepperCore.syncDirections();
+        return arrived;
+    }
+
+    int32_t steps[3], positions[3];
+    blendedMove.next(steps);
+    for (uint8_t ii = 0; ii < 3; ii++)
+        positions[ii] = blendedMove.getPosition(ii);
+    stepperCore.stepToward(positions);
+    bool arrived = blendedMove.isDone();
+    for (uint8_t ii = 0; ii < 3; ii++)
+    {
+        arrived &= (stepperCore.getPosition(ii) == positions[ii]);
+        axes.driveSpeed[ii] = steps[ii] * 1e6 / tickPeriod_us;
+    }
+    if (arrived)
+        clearDrive();
+    return arrived;
+}
+// Follows the rates until the mode changes, then ramps every axis down to a
+// stop at the acceleration limit. Returns true once stopped.
+bool PrimaryMirrorControl::pingTracking()
+{
+    bool tracking = (controlMode == PMC::TRACK || controlMode == PMC::JOG);
+    if (!trackStarted)
+    {
+        if (!tracking)
+        {
+            saveStepperPositionsToEeprom();
+            return true;
+        }
+        if (!waitForMotionRecord())
+            return false;
+        trackPose.setFromFeedback(
+            MotorStates(getAxisPosition(PMC::MOTOR_A), getAxisPosition(PMC::MOTOR_B), getAxisPosition(PMC::MOTOR_C)));
+        for (uint8_t ii = 0; ii < 3; ii++)
+            trackFollower[ii].reset(stepperCore.getPosition(ii));
+        clearDrive();
+        trackStarted = true;
+        trackHeldAtEdge = false;
+    }
+
+    double dt = tickPeriod_us * 1e-6;
+    double demand[3];
+    if (tracking)
+    {
+        if (controlMode == PMC::JOG)
+            pingJoystick();
+        bool ratesSet = trackRates.tip_rad_s != 0.0 || trackRates.tilt_rad_s != 0.0 || trackRates.focus_s != 0.0;
+        MirrorStates nextPose;
+        nextPose.TIP_POS_RAD = trackPose.TIP_POS_RAD + trackRates.tip_rad_s * dt;
+        nextPose.TILT_POS_RAD = trackPose.TILT_POS_RAD + trackRates.tilt_rad_s * dt;
+        nextPose.FOCUS_POS_MM = trackPose.FOCUS_POS_MM + trackRates.focus_s * dt;
+        if (ratesSet && nextPose.getMotorStepTargets(demand, PMC::REJECT_COMMAND) == PMC::IN_RANGE)
+        {
+            trackPose = nextPose;
+            trackHeldAtEdge = false;
         }
         else
         {
-            if ((digitalRead(A_LIMIT_SW_PIN)) == HIGH &&
-                (digitalRead(B_LIMIT_SW_PIN)) == HIGH &&
-                (digitalRead(C_LIMIT_SW_PIN)) == HIGH)
+            trackPose.getMotorStepTargets(demand, PMC::PRESERVE_TIP_TILT);
+            if (ratesSet)
             {
-                limitFound_A = false;
-                limitFound_B = false;
-                limitFound_C = false;
-                enableLimitSwitchInterrupts();
-                currentHomingState = HOMING_STEP_4;
-                waitStartCount = millis();
-                updateStatusFields();
+                // Hold at the edge of the workspace until new rates come in
+                trackRates = {0.0, 0.0, 0.0};
+                // The joystick keeps pushing into the edge, report that once
+                if (controlMode != PMC::JOG || !trackHeldAtEdge)
+                {
+                    SaturatedCommandStates_Eng = trackPose;
+                    lastSaturationStatus = PMC::SATURATED;
+                    metrics.increment(METRIC_COMMANDS_SATURATED);
+                    if (saturationNotifierFlagPtr != nullptr)
+                        *saturationNotifierFlagPtr = true;
+                }
+                trackHeldAtEdge = true;
             }
         }
+    }
+
+    double maxSpeed = getParam(PARAM_STEPPER_MAX_SPEED);
+    double maxAccel = getParam(PARAM_STEPPER_MAX_ACCEL);
+    bool moving = false;
+    double velocity[3];
+    for (uint8_t ii = 0; ii < 3; ii++)
+    {
+        velocity[ii] = tracking ? trackFollower[ii].update(demand[ii] / microstepMode.getScale(), stepperCore.getPosition(ii),
+                                                           dt, maxSpeed, maxAccel)
+                                : trackFollower[ii].stop(dt, maxAccel);
+        moving |= (velocity[ii] != 0.0);
+    }
+    runAxisVelocities(velocity);
+    if (tracking || moving)
+        return false;
+
+    finishTracking();
+    saveStepperPositionsToEeprom();
+    return true;
+}
+
+// Samples the joystick every JOYSTICK_SAMPLE_PERIOD_US and turns it into tip/tilt rates
+void PrimaryMirrorControl::pingJoystick()
+{
+    uint32_t sampleTicks = std::max<uint32_t>(JOYSTICK_SAMPLE_PERIOD_US / tickPeriod_us, 1);
+    if (joystickSource != nullptr && joystickTick == 0)
+    {
+        JoystickSample sample = joystickSource->read(micros());
+        joystickJog.update(sample, sampleTicks * tickPeriod_us * 1e-6,
+                           getParam(PARAM_JOG_FINE_RATE) * RAD_PER_URAD, getParam(PARAM_JOG_COARSE_RATE) * RAD_PER_URAD);
+        trackRates = {joystickJog.getTipRate(), joystickJog.getTiltRate(), 0.0};
+    }
+    joystickTick = (joystickTick + 1) % sampleTicks;
+}
+
+// Point-to-point commands carry on from wherever tracking left the mirror
+void PrimaryMirrorControl::finishTracking()
+{
+    MirrorStates stoppedStates;
+    stoppedStates.setFromFeedback(
+        MotorStates(getAxisPosition(PMC::MOTOR_A), getAxisPosition(PMC::MOTOR_B), getAxisPosition(PMC::MOTOR_C)));
+    AppliedCommandStates_Eng = stoppedStates;
+    CommandStates_Eng = stoppedStates;
+    // Unless a command for the new mode has already come in
+    if (!tipUpdated && !tiltUpdated && !focusUpdated)
+        ShadowCommandStates_Eng = stoppedStates;
+    clearDrive();
+    trackStarted = false;
+}
+
+bool PrimaryMirrorControl::pingHomingRoutine()
+{
+    // Each axis runs its own sequence, homing is done when the last one finishes
+    bool homingComplete = true;
+    double velocity[3];
+    for (uint8_t ii = 0; ii < 3; ii++)
+        homingComplete &= pingAxisHomingRoutine(ii, &velocity[ii]);
+    runAxisVelocities(velocity);
+
+    if (homingComplete)
+    {
+        positionsTrusted = true;
+        positionsApproximate = false;
+        metrics.increment(METRIC_HOMING_RUNS);
+        saveStepperPositionsToEeprom();
+        if (homeNotifierFlagPtr != nullptr)
+            *homeNotifierFlagPtr = true;
+        // Relative commands go on top of where homing left the actuators
+        MirrorStates homedStates;
+        homedStates.setFromFeedback(
+            MotorStates(getAxisPosition(PMC::MOTOR_A), getAxisPosition(PMC::MOTOR_B), getAxisPosition(PMC::MOTOR_C)));
+        ShadowCommandStates_Eng = homedStates;
+        CommandStates_Eng = homedStates;
+        AppliedCommandStates_Eng = homedStates;
+        std::fill(axes.homingState, axes.homingState + NUM_AXES, INITIALIZE);
+    }
+    return homingComplete;
+}
+
+// Keeps the step generator's queue topped up from the planned move
+bool PrimaryMirrorControl::pingStepGenerator()
+{
+    int32_t steps[3];
+    while (!plannedMove.isDone() && stepGenerator->getFreeSegments() > 0)
+    {
+        plannedMove.next(steps);
+        if (!stepGenerator->queueSegment(steps, tickPeriod_us))
+        {
+            plannedMove.unwind(steps);
+            break;
+        }
+    }
+    // Step counts follow the plan
+    for (uint8_t ii = 0; ii < 3; ii++)
+    {
+        stepperCore.setPosition(ii, plannedMove.getPosition(ii));
+        axes.driveSpeed[ii] = plannedMove.getVelocity(ii);
+    }
+    bool arrived = plannedMove.isDone() && stepGenerator->isIdle();
+    if (arrived)
+    {
+        // The generator has had the direction pins
+        stepperCore.syncDirections();
+        clearDrive();
+    }
+    return arrived;
+}
+
+// Drops any queued segments and brings the step counts back to the steps actually emitted.
+// Call from the control tick or with interrupts disabled.
+void PrimaryMirrorControl::haltStepGenerator()
+{
+    // When nothing is planned or queued the step counts are already right (and
+    // may have moved since, e.g. homing steps through the core)
+    if (stepGenerator == nullptr || (plannedMove.isDone() && !moveIsBlended && stepGenerator->isIdle()))
+        return;
+    stepGenerator->stop();
+    int32_t emitted[3];
+    stepGenerator->getPositions(emitted);
+    for (uint8_t ii = 0; ii < 3; ii++)
+        stepperCore.setPosition(ii, emitted[ii]);
+    stepperCore.syncDirections();
+    plannedMove.start(emitted, emitted, 1.0, 1.0, tickPeriod_us);
+    moveIsBlended = false;
+    blendSegmentPending = false;
+}
+
+// Accel-limited approach to a target for an axis driven by velocity: the
+// fastest speed that still stops at the target, reached at the acceleration limit
+static double approachVelocity(double velocity, double togo, double dt, double maxSpeed, double maxAccel)
+{
+    double target = std::min(maxSpeed, std::sqrt(2.0 * maxAccel * std::fabs(togo)));
+    target = (togo < 0.0) ? -target : target;
+    double maxChange = maxAccel * dt;
+    return std::min(std::max(target, velocity - maxChange), velocity + maxChange);
+}
+
+// One tick of an axis's homing sequence. Sets the speed the axis runs at until
+// the next tick, in driver steps/s, and returns true once the axis is done.
+bool PrimaryMirrorControl::pingAxisHomingRoutine(uint8_t motor, double *velocity)
+{
+    int32_t position = stepperCore.getPosition(motor);
+    uint32_t now_ms = millis();
+    *velocity = 0.0;
+
+    switch (axes.homingState[motor])
+    {
+    case INITIALIZE:
+        axes.limitFound[motor] = false;
+        axes.homingStart_ms[motor] = now_ms;
+        axes.stepRemainder[motor] = 0.0f;
+        if (homingIsSeeded)
+        {
+            // Positions restored from an in-motion checkpoint may be off by up to the checkpoint error
+            double margin = getParam(PARAM_HOMING_SEED_MARGIN_STEPS) +
+                            (positionsApproximate ? getCheckpointPolicyErrorSteps(restoredStepScaleShift) : 0.0);
+            axes.homingRapidTarget[motor] = STROKE_BOTTOM_STEPS + margin;
+            axes.homingState[motor] = HOMING_RAPID;
+        }
+        else
+        {
+            axes.homingState[motor] = HOMING_STEP_1;
+        }
         break;
-    case HOMING_STEP_4:
-        // Shorter pause
-        waitCounter = millis();
-        if ((waitCounter - waitStartCount) > 300)
+    case HOMING_RAPID:
+        // Accel-limited move to just above the endstop
+        if (axes.limitFound[motor])
+        {
+            // Stored position was off, the switch has already been found.
+            axes.homingPauseStart_ms[motor] = now_ms;
+            axes.homingState[motor] = HOMING_STEP_2;
+        }
+        else if (position == axes.homingRapidTarget[motor])
         {
-            Stepper_A.setSpeed(homingSpeedStepsPerSec * -0.1);
-            Stepper_B.setSpeed(homingSpeedStepsPerSec * -0.1);
-            Stepper_C.setSpeed(homingSpeedStepsPerSec * -0.1);
-            currentHomingState = HOMING_STEP_5;
+            axes.homingState[motor] = HOMING_STEP_1;
         }
+        else
+        {
+            // No faster than the tick can step
+            double maxSpeed = std::min(getParam(PARAM_STEPPER_MAX_SPEED), 1e6 / tickPeriod_us);
+            *velocity = approachVelocity(axes.driveSpeed[motor], axes.homingRapidTarget[motor] - position,
+                                         tickPeriod_us * 1e-6, maxSpeed, getParam(PARAM_STEPPER_MAX_ACCEL));
+        }
+        break;
+    case HOMING_STEP_1:
+        // Quick move until the endstop is hit
+        if (!axes.limitFound[motor])
+            *velocity = -homingSpeedStepsPerSec;
+        else
+        {
+            axes.homingPauseStart_ms[motor] = now_ms;
+            axes.homingState[motor] = HOMING_STEP_2;
+        }
+        break;
+    case HOMING_STEP_2:
+        // Short pause
+        if ((now_ms - axes.homingPauseStart_ms[motor]) > HOMING_PAUSE_1_MS)
+            axes.homingState[motor] = HOMING_STEP_3;
+        break;
+    case HOMING_STEP_3:
+        // Short Move forward until the endstop is cleared
+        if (position < (STROKE_BOTTOM_STEPS + getParam(PARAM_HOMING_BACKOFF_STEPS)))
+        {
+            *velocity = homingSpeedStepsPerSec;
+        }
+        else if (axes.switchLevel[motor] == HIGH)
+        {
+            axes.limitFound[motor] = false;
+            axes.homingPauseStart_ms[motor] = now_ms;
+            axes.homingState[motor] = HOMING_STEP_4;
+        }
+        break;
+    case HOMING_STEP_4:
+        // Shorter pause
+        if ((now_ms - axes.homingPauseStart_ms[motor]) > HOMING_PAUSE_2_MS)
+            axes.homingState[motor] = HOMING_STEP_5;
         break;
     case HOMING_STEP_5:
-        // Very slow move backwards until endstops are hit again
-        if (!limitFound_A)
-            Stepper_A.runSpeed();
-        if (!limitFound_B)
-            Stepper_B.runSpeed();
-        if (!limitFound_C)
-            Stepper_C.runSpeed();
-        // delay(1);
-        if (limitFound_A && limitFound_B && limitFound_C)
+        // Very slow move backwards until the endstop is hit again
+        if (!axes.limitFound[motor])
+            *velocity = -homingSpeedStepsPerSec * getParam(PARAM_HOMING_SLOW_SPEED_RATIO);
+        else
         {
-            enableLimitSwitchInterrupts();
-            saveStepperPositionsToEeprom();
-            if (homeNotifierFlagPtr != nullptr)
-                *homeNotifierFlagPtr = true;
-            ShadowCommandStates_Eng.resetToHomed();
-            CommandStates_Eng.resetToHomed();
-
-            homingComplete = true;
+            axes.homingTime_ms[motor] = now_ms - axes.homingStart_ms[motor];
+            axes.homingState[motor] = HOMING_DONE;
         }
         break;
+    case HOMING_DONE:
+        break;
     }
-    if (prevHomingState != currentHomingState)
-    {
-        updateStatusFields();
-        prevHomingState = currentHomingState;
-    }
+    return axes.homingState[motor] == HOMING_DONE;
+}
 
-    return homingComplete;
+void PrimaryMirrorControl::getHomingTimes(uint32_t *aTime_ms, uint32_t *bTime_ms, uint32_t *cTime_ms)
+{
+    *aTime_ms = axes.homingTime_ms[PMC::MOTOR_A];
+    *bTime_ms = axes.homingTime_ms[PMC::MOTOR_B];
+    *cTime_ms = axes.homingTime_ms[PMC::MOTOR_C];
 }
+
 void PrimaryMirrorControl::enableSteppers(bool doEnable)
 {
     if (doEnable)
     {
         digitalWrite(STEP_ENABLE_PIN, ENABLE_STEPPER);
-        if (cli != nullptr)
-            cli->updatePersistentField(DeviceName, STEPPERS_ENABLED, "True");
     }
     else
     {
+        noInterrupts();
         currentMoveState = IDLE;
         controlMode = PMC::STOP;
+        haltMotion();
+        interrupts();
         digitalWrite(STEP_ENABLE_PIN, DISABLE_STEPPER);
-        if (cli != nullptr)
-            cli->updatePersistentField(DeviceName, STEPPERS_ENABLED, "False");
     }
     if (cli != nullptr)
         steppersEnabled = doEnable;
 }
 // Move all actuators to home positions at velocity V (steps/sec)
-void PrimaryMirrorControl::goHome(volatile double homingSpeed)
+// Seeded homing is only used if the stored positions can be trusted,
+// returns whether it was.
+bool PrimaryMirrorControl::goHome(volatile double homingSpeed, bool seeded)
 {
-
+    homingIsSeeded = seeded && (positionsTrusted || positionsApproximate);
+    if (seeded && !homingIsSeeded)
+        cli->printDebugMessage("Stored positions untrusted, using full homing", LFAST::WARNING);
+    // Homing can't be skipped until this run completes, but a seeded run's
+    // positions stay referenced to the previous one so checkpoints taken
+    // during it can seed the next run.
+    positionsTrusted = false;
+    noInterrupts();
+    // Nothing left over from the last move may keep stepping once homing starts
+    haltMotion();
+    // Homing distances and speeds are in reference microsteps, and the switch is
+    // found at full resolution. Going finer needs no alignment.
+    applyMicrostepMode(MicrostepMode());
+    requestPositionCommit(homingIsSeeded ? POSITION_FLAG_HOMED : 0);
+    homingCommitPending = true;
+    interrupts();
 
     homingSpeedStepsPerSec = (homingSpeed * MIRROR_RADIUS) / (MICRON_PER_STEP);
     currentMoveState = HOMING_IS_ACTIVE;
-    currentHomingState = INITIALIZE;
+    std::fill(axes.homingState, axes.homingState + NUM_AXES, INITIALIZE);
     controlMode = PMC::RELATIVE;
+    return homingIsSeeded;
 }
 void PrimaryMirrorControl::limitSwitchHandler(uint16_t motor)
 {
-    // For de-bounce
-    delayMicroseconds(500);
-    if (motor == LFAST::PMC::MOTOR_A)
-    {
-        if (currentMoveState != HOMING_IS_ACTIVE)
-            attachInterrupt(digitalPinToInterrupt(A_LIMIT_SW_PIN), limitSwitch_A_ISR, FALLING);
-        cli->printDebugMessage("A Limit Switch Detected");
-        Stepper_A.setCurrentPosition(STROKE_BOTTOM_STEPS);
-        limitFound_A = true;
-    }
-    else if (motor == LFAST::PMC::MOTOR_B)
-    {
-        if (currentMoveState != HOMING_IS_ACTIVE)
-            attachInterrupt(digitalPinToInterrupt(B_LIMIT_SW_PIN), limitSwitch_B_ISR, FALLING);
-        cli->printDebugMessage("B Limit Switch Detected");
-        Stepper_B.setCurrentPosition(STROKE_BOTTOM_STEPS);
-        limitFound_B = true;
-    }
-    else if (motor == LFAST::PMC::MOTOR_C)
-    {
-        if (currentMoveState != HOMING_IS_ACTIVE)
-            attachInterrupt(digitalPinToInterrupt(C_LIMIT_SW_PIN), limitSwitch_C_ISR, FALLING);
-        cli->printDebugMessage("C Limit Switch Detected");
-        Stepper_C.setCurrentPosition(STROKE_BOTTOM_STEPS);
-        limitFound_C = true;
-    }
+    if (motor > PMC::MOTOR_C)
+        return;
+
+    tickMessages.limitSwitches |= (1 << motor);
+    // Stop the generator first, so stopNow() doesn't overwrite the reference below
+    haltStepGenerator();
+    setAxisPosition(motor, STROKE_BOTTOM_STEPS);
+    axes.limitFound[motor] = true;
 
     if (currentMoveState != HOMING_IS_ACTIVE)
     {
+        metrics.increment(METRIC_LIMIT_HITS);
+#if ENABLE_CONTROL_TRACE
+        ControlTrace.trigger(TRACE_TRIGGER_LIMIT_SWITCH);
+#endif
         currentMoveState = LIMIT_SW_DETECT;
     }
 }
+// True if the speed is not zero or the axis isn't at its target, as of the last tick
 bool PrimaryMirrorControl::getStatus(uint8_t motor)
 {
-    if (motor == LFAST::PMC::MOTOR_A)
-        return Stepper_A.isRunning(); // Checks to see if the motor is currently running to a target
-    else if (motor == LFAST::PMC::MOTOR_B)
-        return Stepper_B.isRunning(); // true if the speed is not zero or not at the target position
-    else if (motor == LFAST::PMC::MOTOR_C)
-        return Stepper_C.isRunning();
-    else
+    if (motor > LFAST::PMC::MOTOR_C)
         return false;
+    return axes.running[motor];
 }
 
+// In reference microsteps, whatever mode the drivers are in, as of the last tick
 double PrimaryMirrorControl::getStepperPosition(uint8_t motor)
 {
-    if (motor == LFAST::PMC::MOTOR_A)
-        return Stepper_A.currentPosition(); // Checks to see if the motor is currently running to a target
-    else if (motor == LFAST::PMC::MOTOR_B)
-        return Stepper_B.currentPosition(); // true if the speed is not zero or not at the target position
-    else if (motor == LFAST::PMC::MOTOR_C)
-        return Stepper_C.currentPosition();
+    if (motor > LFAST::PMC::MOTOR_C)
+        return 0.0;
+    return axes.position[motor];
+}
+
+// Copies the whole axis block at once, so every field is from the same tick
+void PrimaryMirrorControl::getAxisSnapshot(AxisState *snapshot)
+{
+    noInterrupts();
+    *snapshot = axes;
+    interrupts();
+}
+
+// Called at the end of every control tick (and wherever the step counts are
+// set outside of it, with interrupts disabled)
+void PrimaryMirrorControl::publishAxisState()
+{
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+        axes.position[ii] = getAxisPosition(ii);
+    if (stepperCore.isMoving())
+    {
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            axes.target[ii] = microstepMode.toReference(stepperCore.getTarget(ii));
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            axes.speed[ii] = stepperCore.getVelocity(ii, tickPeriod_us);
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            axes.running[ii] = stepperCore.getTarget(ii) != stepperCore.getPosition(ii);
+    }
     else
+    {
+        // Whatever else is moving the axes
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            axes.target[ii] = microstepMode.toReference(axes.driveTarget[ii]);
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            axes.speed[ii] = axes.driveSpeed[ii];
+        for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+            axes.running[ii] = (axes.driveSpeed[ii] != 0.0f) || (axes.driveTarget[ii] != stepperCore.getPosition(ii));
+    }
+    axes.sequence++;
+}
+
+int32_t PrimaryMirrorControl::getAxisPosition(uint8_t motor)
+{
+    return microstepMode.toReference(stepperCore.getPosition(motor));
+}
+
+void PrimaryMirrorControl::setAxisPosition(uint8_t motor, int32_t referenceSteps)
+{
+    stepperCore.setPosition(motor, microstepMode.toDriver(referenceSteps));
+}
+
+static_assert(EEPROM_POSITION_JOURNAL_SIZE >= sizeof(PositionJournalHeader) + 2 * PositionJournal::SLOT_SIZE,
+              "Position journal region needs room for at least two records");
+#if NV_STORAGE_BACKEND != NV_STORAGE_EEPROM
+static_assert(EEPROM_ADDR_CONFIG + EEPROM_CONFIG_SIZE <= FRAM_SIZE_BYTES,
+              "Position journal and parameters don't fit in the FRAM");
+#endif
+
+// Reads the three positions together so a record never mixes two control ticks
+void PrimaryMirrorControl::captureStepperPositions(int32_t *positions)
+{
+    noInterrupts();
+    std::copy(axes.position, axes.position + NUM_AXES, positions);
+    interrupts();
+}
+
+// Journal writes are too slow for the control ISR, so it only latches the
+// record here. A newer request replaces one that hasn't been written yet.
+// Call from the control tick or with interrupts disabled.
+void PrimaryMirrorControl::requestPositionCommit(uint16_t flags)
+{
+    for (uint8_t ii = 0; ii < 3; ii++)
+        pendingPositions[ii] = getAxisPosition(ii);
+    flags = (flags & ~POSITION_FLAG_STEP_SCALE_MASK) | (microstepMode.getScaleShift() << POSITION_FLAG_STEP_SCALE_SHIFT);
+    pendingRecordFlags = flags;
+    positionRecordFlags = flags;
+    commitRequestCount++;
+}
+
+void PrimaryMirrorControl::commitPositionRecord(uint16_t flags, const int32_t *positions)
+{
+    // Nothing new to say, save the write
+    if (positionJournal == nullptr)
+        return;
+    if (flags == committedFlags && std::equal(positions, positions + 3, committedPositions))
+        return;
+
+    PositionRecord record;
+    record.flags = flags;
+    std::copy(positions, positions + 3, record.position);
+    uint32_t writeStart_us = micros();
+    positionJournal->append(record);
+    metrics.updateMax(METRIC_JOURNAL_WRITE_MAX_US, micros() - writeStart_us);
+    metrics.increment(METRIC_POSITION_WRITES);
+    committedFlags = flags;
+    std::copy(positions, positions + 3, committedPositions);
+    lastCommit_ms = millis();
+}
+
+// Called from loop(). Writes records requested by the control ISR, and
+// checkpoints positions while the mirror is moving or homing.
+void PrimaryMirrorControl::servicePositionJournal()
+{
+    if (positionJournal == nullptr)
+        return;
+    uint32_t now_ms = millis();
+    if (lastJournalService_ms != 0)
+        maxJournalServiceGap_ms = std::max(maxJournalServiceGap_ms, now_ms - lastJournalService_ms);
+    lastJournalService_ms = now_ms;
+
+    int32_t positions[3];
+    noInterrupts();
+    uint32_t requestCount = commitRequestCount;
+    uint16_t flags = pendingRecordFlags;
+    for (uint8_t ii = 0; ii < 3; ii++)
+        positions[ii] = pendingPositions[ii];
+    bool moving = (currentMoveState == MOVE_IN_PROGRESS) || (currentMoveState == HOMING_IS_ACTIVE) ||
+                  (currentMoveState == TRACKING);
+    interrupts();
+
+    if (requestCount != commitServicedCount)
+    {
+        commitPositionRecord(flags, positions);
+        // Requests that arrived during the write are picked up on the next pass
+        commitServicedCount = requestCount;
+        return;
+    }
+    if (!moving)
+        return;
+
+    captureStepperPositions(positions);
+    uint32_t uncommittedSteps = 0;
+    for (uint8_t ii = 0; ii < 3; ii++)
+        uncommittedSteps = std::max(uncommittedSteps, (uint32_t)std::abs(positions[ii] - committedPositions[ii]));
+    maxUncommittedSteps = std::max(maxUncommittedSteps, uncommittedSteps);
+    if (!checkpointsInMotion())
+        return;
+
+    // FRAM has no wear to protect, so write every change
+    bool wearFree = positionStorage->isWearFree();
+    uint32_t minPeriod_ms = wearFree ? 0 : CHECKPOINT_MIN_PERIOD_MS;
+    uint32_t stepDelta = wearFree ? 1 : CHECKPOINT_STEP_DELTA;
+    uint32_t sinceCommit_ms = now_ms - lastCommit_ms;
+    if (sinceCommit_ms < minPeriod_ms)
+        return;
+    if (uncommittedSteps >= stepDelta || sinceCommit_ms >= CHECKPOINT_INTERVAL_MS)
+        commitPositionRecord(positionRecordFlags & ~POSITION_FLAG_STATIONARY, positions);
+}
+
+// Largest distance seen between an axis and its last committed position, and
+// the most it could be: the checkpoint policy plus the worst loop() latency
+// seen so far (UINT32_MAX if nothing is checkpointed while moving).
+void PrimaryMirrorControl::getCheckpointErrors(uint32_t *uncommittedSteps, uint32_t *errorBoundSteps)
+{
+    uint8_t scaleShift = microstepMode.getScaleShift();
+    *uncommittedSteps = maxUncommittedSteps;
+    // No checkpoints while moving, no bound short of the whole move
+    if (!checkpointsInMotion())
+    {
+        *errorBoundSteps = UINT32_MAX;
+        return;
+    }
+    *errorBoundSteps = (uint32_t)std::ceil(getCheckpointPolicyErrorSteps(scaleShift) +
+                                           getParam(PARAM_STEPPER_MAX_SPEED) * microstepMode.getScale() *
+                                               maxJournalServiceGap_ms * 1e-3);
+}
+
+// A backend whose writes hold off every interrupt would stall the control tick
+// mid-move on each checkpoint (see ENABLE_STALLING_MOTION_CHECKPOINTS)
+bool PrimaryMirrorControl::checkpointsInMotion()
+{
+    return ENABLE_STALLING_MOTION_CHECKPOINTS || !positionStorage->stallsInterrupts();
+}
+
+// Furthest an axis can get from its last checkpoint before the next one is
+// due, stepping at the given microstep scale. Time spent waiting on loop() to
+// service the checkpoint comes on top.
+double PrimaryMirrorControl::getCheckpointPolicyErrorSteps(uint8_t stepScaleShift)
+{
+    // FRAM checkpoints every step change
+    if (positionStorage->isWearFree())
         return 0.0;
+    double maxSpeed = getParam(PARAM_STEPPER_MAX_SPEED) * (1 << stepScaleShift);
+    return std::min(maxSpeed * CHECKPOINT_INTERVAL_MS * 1e-3,
+                    std::max((double)CHECKPOINT_STEP_DELTA, maxSpeed * CHECKPOINT_MIN_PERIOD_MS * 1e-3));
 }
 
+// Called at points where the mirror is stationary (move complete, stop, homed),
+// from the control tick or with interrupts disabled.
 void PrimaryMirrorControl::saveStepperPositionsToEeprom()
 {
-    int Aposition = Stepper_A.currentPosition();
-    int Bposition = Stepper_B.currentPosition();
-    int Cposition = Stepper_C.currentPosition();
-    EEPROM.put(EEPROM_ADDR_STEPPER_A_POS, Aposition);
-    EEPROM.put(EEPROM_ADDR_STEPPER_B_POS, Bposition);
-    EEPROM.put(EEPROM_ADDR_STEPPER_C_POS, Cposition);
+    requestPositionCommit(POSITION_FLAG_STATIONARY | (positionsTrusted ? POSITION_FLAG_HOMED : 0));
+}
+
+// Called from the control tick before anything steps. Clears the stationary
+// marker and returns true once loop() has committed that, so a reset mid-move
+// is never mistaken for a clean shutdown.
+bool PrimaryMirrorControl::waitForMotionRecord()
+{
+    if (positionRecordFlags & POSITION_FLAG_STATIONARY)
+        requestPositionCommit(positionRecordFlags & ~POSITION_FLAG_STATIONARY);
+    return commitServicedCount == commitRequestCount;
 }
 
 void PrimaryMirrorControl::resetPositionsInEeprom()
 {
-    EEPROM.put(EEPROM_ADDR_STEPPER_A_POS, 0);
-    EEPROM.put(EEPROM_ADDR_STEPPER_B_POS, 0);
-    EEPROM.put(EEPROM_ADDR_STEPPER_C_POS, 0);
+    positionsTrusted = false;
+    positionsApproximate = false;
+    noInterrupts();
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+        stepperCore.setPosition(ii, 0);
+    clearDrive();
+    requestPositionCommit(0);
+    publishAxisState();
+    interrupts();
     cli->printDebugMessage("Resetting eeprom positions", LFAST::WARNING);
 }
 
+static const ParamDef PmcParamTable[NUM_PMC_PARAMS] = {
+    // name, type, apply, default, min, max
+    {"StepperMaxSpeed", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, STEPPER_MAX_SPEED, 1.0, STEPPER_SPEED_LIMIT},
+    {"StepperMaxAccel", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, STEPPER_MAX_ACCEL, 1.0, 100000.0},
+    {"UpdatePeriod_us", PARAM_TYPE_UINT, PARAM_APPLY_ON_REBOOT, UPDATE_PRD_US, 20, 1000},
+    {"HomingBackoffSteps", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, HOMING_BACKOFF_STEPS, 0.0, 0.25 * STROKE_STEPS},
+    {"HomingSeedMarginSteps", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, HOMING_SEED_MARGIN_STEPS, 0.0, 0.25 * STROKE_STEPS},
+    {"HomingSlowSpeedRatio", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, HOMING_SLOW_SPEED_RATIO, 0.01, 1.0},
+    {"StepperMaxJerk", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, STEPPER_MAX_JERK, 1000.0, 1e9},
+    {"JogFineRate_urad_s", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, JOG_FINE_RATE_URAD_S, 0.1, 5000.0},
+    {"JogCoarseRate_urad_s", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, JOG_COARSE_RATE_URAD_S, 0.1, 5000.0},
+};
+static_assert(NUM_PMC_PARAMS <= CONFIG_STORE_MAX_PARAMS, "Too many parameters for the config store");
+static_assert(ConfigStore::requiredSize(NUM_PMC_PARAMS) <= EEPROM_CONFIG_SIZE, "Parameter table doesn't fit its region");
+
+static EepromStorage EepromBackend;
+#if NV_STORAGE_BACKEND == NV_STORAGE_SPI_FRAM
+static SpiFramStorage FramBackend(SPI, FRAM_CS_PIN, FRAM_SIZE_BYTES);
+#elif NV_STORAGE_BACKEND == NV_STORAGE_I2C_FRAM
+static I2cFramStorage FramBackend(Wire, FRAM_I2C_ADDR, FRAM_SIZE_BYTES);
+#endif
+
+// Picks the backend from NV_STORAGE_BACKEND, falling back to the EEPROM if the FRAM doesn't answer
+// Journal header tag: the backend this build is configured for and the one
+// actually in use, so a journal written during a fallback can be recognised.
+static constexpr uint32_t journalBackendTag(uint32_t activeBackend)
+{
+    return ((uint32_t)NV_STORAGE_BACKEND << 8) | activeBackend;
+}
+
+void PrimaryMirrorControl::setupStorage()
+{
+    positionStorage = &EepromBackend;
+    uint32_t activeBackend = NV_STORAGE_EEPROM;
+#if NV_STORAGE_BACKEND != NV_STORAGE_EEPROM
+    if (FramBackend.begin())
+    {
+        positionStorage = &FramBackend;
+        activeBackend = NV_STORAGE_BACKEND;
+        // A journal left in EEPROM by a fallback boot means the mirror may have
+        // moved since the FRAM record was written
+        PositionJournalHeader header;
+        if (PositionJournal::readHeader(EepromBackend, EEPROM_ADDR_POSITION_JOURNAL, &header) &&
+            header.backend == journalBackendTag(NV_STORAGE_EEPROM))
+        {
+            storageBackendChanged = true;
+            PositionJournal::retire(EepromBackend, EEPROM_ADDR_POSITION_JOURNAL);
+        }
+    }
+    else
+    {
+        // Whatever EEPROM holds predates the FRAM records
+        storageBackendChanged = true;
+        cli->printDebugMessage("FRAM not responding, storing positions in EEPROM", LFAST::WARNING);
+    }
+#endif
+    positionJournal = new PositionJournal(*positionStorage, EEPROM_ADDR_POSITION_JOURNAL, EEPROM_POSITION_JOURNAL_SIZE,
+                                          journalBackendTag(activeBackend));
+    configStore = new ConfigStore(*positionStorage, EEPROM_ADDR_CONFIG, EEPROM_CONFIG_SIZE,
+                                  PmcParamTable, NUM_PMC_PARAMS, PMC_PARAM_SCHEMA_VERSION);
+}
+
 void PrimaryMirrorControl::loadCurrentPositionsFromEeprom()
 {
-    int Aposition = 0;
-    int Bposition = 0;
-    int Cposition = 0;
+    if (positionJournal == nullptr)
+        setupStorage();
 
-    EEPROM.get(EEPROM_ADDR_STEPPER_A_POS, Aposition);
-    EEPROM.get(EEPROM_ADDR_STEPPER_B_POS, Bposition);
-    EEPROM.get(EEPROM_ADDR_STEPPER_C_POS, Cposition);
+    PositionRecord record;
+    bool found = positionJournal->begin() && positionJournal->getNewest(&record);
+    cli->printfDebugMessage("Position journal scan: %u slot reads (%s)", positionJournal->getScanSlotReads(),
+                            positionJournal->wasLastScanLinear() ? "linear scan" : "fast scan");
+    if (!found)
+    {
+        positionsTrusted = false;
+        cli->printDebugMessage("No valid position record in EEPROM, homing required", LFAST::WARNING);
+        return;
+    }
+
+    positionRecordFlags = record.flags;
+    committedFlags = record.flags;
+    restoredStepScaleShift = (record.flags & POSITION_FLAG_STEP_SCALE_MASK) >> POSITION_FLAG_STEP_SCALE_SHIFT;
+    std::copy(record.position, record.position + 3, committedPositions);
+    int32_t Aposition = record.position[PMC::MOTOR_A];
+    int32_t Bposition = record.position[PMC::MOTOR_B];
+    int32_t Cposition = record.position[PMC::MOTOR_C];
+    noInterrupts();
+    setAxisPosition(PMC::MOTOR_A, Aposition);
+    setAxisPosition(PMC::MOTOR_B, Bposition);
+    setAxisPosition(PMC::MOTOR_C, Cposition);
+    publishAxisState();
+    interrupts();
+
+    // Only skip homing if the positions were referenced by a homing run and
+    // the mirror hasn't moved since they were committed.
+    positionsTrusted = record.hasFlags(POSITION_FLAG_HOMED | POSITION_FLAG_STATIONARY);
+    cli->printfDebugMessage("EEPROM Load [A/B/C]: %d, %d, %d (seq %u, %s)", Aposition, Bposition, Cposition,
+                            record.sequence, positionsTrusted ? "trusted" : "homing required");
+    // An in-motion checkpoint is still good enough to seed homing. Without them
+    // the record is from the start of the run, and the mirror could be anywhere.
+    positionsApproximate = !positionsTrusted && record.hasFlags(POSITION_FLAG_HOMED) && checkpointsInMotion();
+
+    // Records from before a storage backend change can't be trusted or used as a
+    // seed, the commit drops the homed flag so a reset before homing still knows
+    if (storageBackendChanged || positionJournal->wasBackendChanged())
+    {
+        positionsTrusted = false;
+        positionsApproximate = false;
+        noInterrupts();
+        saveStepperPositionsToEeprom();
+        interrupts();
+        cli->printDebugMessage("Position storage backend changed, homing required", LFAST::WARNING);
+    }
+    if (positionsApproximate)
+        cli->printfDebugMessage("Restored an in-motion checkpoint, positions may be off by up to %.0f steps",
+                                getCheckpointPolicyErrorSteps(restoredStepScaleShift));
 
-    cli->printfDebugMessage("EEPROM Load [A/B/C]: %d, %d, %d", Aposition, Bposition, Cposition);
-    Stepper_A.setCurrentPosition(Aposition);
-    Stepper_B.setCurrentPosition(Bposition);
-    Stepper_C.setCurrentPosition(Cposition);
+    if (positionsTrusted)
+    {
+        // Resume from the restored pose so relative commands are applied on top of it
+        MirrorStates restoredStates;
+        restoredStates.setFromFeedback(MotorStates(Aposition, Bposition, Cposition));
+        ShadowCommandStates_Eng = restoredStates;
+        CommandStates_Eng = restoredStates;
+        AppliedCommandStates_Eng = restoredStates;
+    }
+}
+
+void PrimaryMirrorControl::loadConfiguration()
+{
+    if (configStore == nullptr)
+        setupStorage();
+
+    if (!configStore->load())
+        cli->printDebugMessage("No valid parameter table stored, using defaults", LFAST::WARNING);
+
+    // Applied here so a new tick period takes effect from boot
+    tickPeriod_us = getParam(PARAM_UPDATE_PERIOD_US);
+    Timer1.setPeriod(tickPeriod_us);
+    applyMotionParams();
+}
+
+// Validates, applies (where that is safe to do live) and stores a parameter
+uint8_t PrimaryMirrorControl::setParam(uint16_t id, double value)
+{
+    if (configStore == nullptr)
+        return PARAM_UNKNOWN;
+
+    // The speed applies live, at the running tick period, and must still hold
+    // at the stored period that the next boot switches to
+    double maxSpeed = (id == PARAM_STEPPER_MAX_SPEED) ? value : getParam(PARAM_STEPPER_MAX_SPEED);
+    double bootPeriod_us = (id == PARAM_UPDATE_PERIOD_US) ? value : getParam(PARAM_UPDATE_PERIOD_US);
+    if (maxSpeed > getStepSpeedLimit(tickPeriod_us) || maxSpeed > getStepSpeedLimit(bootPeriod_us))
+        return PARAM_OUT_OF_RANGE;
+
+    noInterrupts();
+    uint8_t status = configStore->set(id, value);
+    interrupts();
+    if (status != PARAM_OK)
+        return status;
+
+    applyMotionParams();
+    configStore->save();
+    metrics.increment(METRIC_CONFIG_WRITES);
+    cli->printfDebugMessage("%s = %f", configStore->getDef(id)->name, getParam(id));
+    return PARAM_OK;
+}
+
+// The control tick can't step faster than once per tick, the step generator is
+// limited by its own time base
+double PrimaryMirrorControl::getStepSpeedLimit(double period_us)
+{
+    return (stepGenerator != nullptr) ? maxPlannedSpeed(stepGenerator->getMaxStepRate(), period_us) : 1e6 / period_us;
+}
+
+double PrimaryMirrorControl::getParam(uint16_t id)
+{
+    if (configStore == nullptr)
+        return (id < NUM_PMC_PARAMS) ? PmcParamTable[id].defaultValue : 0.0;
+    return configStore->get(id);
+}
+
+const ParamDef *PrimaryMirrorControl::getParamDef(uint16_t id)
+{
+    return (id < NUM_PMC_PARAMS) ? &PmcParamTable[id] : nullptr;
+}
+
+void PrimaryMirrorControl::applyMotionParams()
+{
+    double maxSpeed = getParam(PARAM_STEPPER_MAX_SPEED);
+    double maxAccel = getParam(PARAM_STEPPER_MAX_ACCEL);
+    // Built here, the tick only looks it up
+    RampTable ramp;
+    ramp.build(maxSpeed, maxAccel, tickPeriod_us);
+    noInterrupts();
+    stepperCore.setRamp(ramp);
+    interrupts();
 }
 
 void PrimaryMirrorControl::setupPersistentFields()
@@ -651,93 +1927,290 @@ void PrimaryMirrorControl::setupPersistentFields()
     cli->addPersistentField(this->DeviceName, "[TIP EST]", TIP_FB_ROW);
     cli->addPersistentField(this->DeviceName, "[TILT EST]", TILT_FB_ROW);
     cli->addPersistentField(this->DeviceName, "[FOCUS EST]", FOCUS_FB_ROW);
-    updateStatusFields();
+    // Draw everything on the next pass
+    std::fill(dashboardRendered, dashboardRendered + NUM_PRIMARY_MIRROR_ROWS, NAN);
+}
+
+// Called from the control tick when loop() has asked for a snapshot
+void PrimaryMirrorControl::captureDashboardSnapshot()
+{
+    dashboardSnapshot.moveState = currentMoveState;
+    dashboardSnapshot.controlMode = controlMode;
+    dashboardSnapshot.steppersEnabled = steppersEnabled;
+    dashboardSnapshot.axes = axes;
+    dashboardSnapshot.tipCmd = CommandStates_Eng.TIP_POS_RAD;
+    dashboardSnapshot.tiltCmd = CommandStates_Eng.TILT_POS_RAD;
+    dashboardSnapshot.focusCmd = CommandStates_Eng.FOCUS_POS_MM;
+    dashboardSnapshotRequested = false;
+    dashboardSnapshotReady = true;
 }
 
-void PrimaryMirrorControl::updateStatusFields()
+// Called from loop(). Redraws the fields that changed since they were last
+// drawn, stopping once a pass has used DASHBOARD_RENDER_BUDGET_US.
+void PrimaryMirrorControl::serviceDashboard()
 {
 #if ENABLE_TERMINAL_UPDATES
-    switch (currentMoveState)
+    if (cli == nullptr)
+        return;
+
+    uint32_t now_ms = millis();
+    if (!dashboardSnapshotRequested && (now_ms - dashboardLastRefresh_ms >= DASHBOARD_REFRESH_MS))
     {
-    case IDLE:
-        cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "IDLE");
+        dashboardLastRefresh_ms = now_ms;
+        if (controlTickRunning)
+            dashboardSnapshotRequested = true;
+        else
+        {
+            noInterrupts();
+            publishAxisState();
+            captureDashboardSnapshot();
+            interrupts();
+        }
+    }
+    if (dashboardSnapshotReady)
+    {
+        // The tick won't touch the snapshot again until the next request
+        dashboardSnapshotReady = false;
+        MotorStates(dashboardSnapshot.axes.position[PMC::MOTOR_A], dashboardSnapshot.axes.position[PMC::MOTOR_B],
+                    dashboardSnapshot.axes.position[PMC::MOTOR_C])
+            .getTipTiltFocusFeedback(&dashboardSnapshot.tipEst, &dashboardSnapshot.tiltEst, &dashboardSnapshot.focusEst);
+        for (uint8_t row = 0; row < NUM_PRIMARY_MIRROR_ROWS; row++)
+            dashboardValue[row] = getDashboardValue(row);
+    }
+
+    uint32_t passStart_us = micros();
+    uint32_t deferred = 0;
+    for (uint8_t ii = 0; ii < NUM_PRIMARY_MIRROR_ROWS; ii++)
+    {
+        // Start where the last pass left off so no field is starved
+        uint8_t row = (dashboardNextRow + ii) % NUM_PRIMARY_MIRROR_ROWS;
+        if (dashboardValue[row] == dashboardRendered[row])
+            continue;
+        if (micros() - passStart_us >= DASHBOARD_RENDER_BUDGET_US)
+        {
+            if (deferred++ == 0)
+                dashboardNextRow = row;
+            continue;
+        }
+        uint32_t fieldStart_us = micros();
+        renderDashboardField(row);
+        dashboardRendered[row] = dashboardValue[row];
+        dashboardMaxField_us = std::max(dashboardMaxField_us, micros() - fieldStart_us);
+    }
+    dashboardMaxPass_us = std::max(dashboardMaxPass_us, micros() - passStart_us);
+    dashboardDeferredFields += deferred;
+#endif
+}
+
+// Called from loop(). Prints what the control tick latched since the last call.
+void PrimaryMirrorControl::serviceTickMessages()
+{
+    noInterrupts();
+    TickMessages latched = tickMessages;
+    tickMessages = {};
+    interrupts();
+    if (cli == nullptr)
+        return;
+
+    if (latched.stepCommandsSet)
+        cli->printfDebugMessage("Step Commands: [A/B/C]: %d, %d, %d", latched.stepCommands[PMC::MOTOR_A],
+                                latched.stepCommands[PMC::MOTOR_B], latched.stepCommands[PMC::MOTOR_C]);
+    if (latched.moveInterrupted)
+        cli->printDebugMessage("Move interrupted.");
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+    {
+        if (latched.limitSwitches & (1 << ii))
+            cli->printfDebugMessage("%c Limit Switch Detected", 'A' + ii);
+    }
+    if (latched.microstepDivider != 0)
+        cli->printfDebugMessage("Microstep mode 1/%u", latched.microstepDivider);
+}
+
+// A number that changes whenever the field's text would
+double PrimaryMirrorControl::getDashboardValue(uint8_t row)
+{
+    const DashboardSnapshot &snap = dashboardSnapshot;
+    switch (row)
+    {
+    case CMD_MODE_ROW:
+        return snap.controlMode;
+    case TIP_CMD_ROW:
+        return snap.tipCmd;
+    case TILT_CMD_ROW:
+        return snap.tiltCmd;
+    case FOCUS_CMD_ROW:
+        return snap.focusCmd;
+    case TIP_FB_ROW:
+        return snap.tipEst;
+    case TILT_FB_ROW:
+        return snap.tiltEst;
+    case FOCUS_FB_ROW:
+        return snap.focusEst;
+    case STEPPERS_ENABLED:
+        return snap.steppersEnabled;
+    case MOVE_SM_STATE_ROW:
+        return (snap.moveState << 9) | (snap.axes.homingState[PMC::MOTOR_A] << 6) |
+               (snap.axes.homingState[PMC::MOTOR_B] << 3) | snap.axes.homingState[PMC::MOTOR_C];
+    case STEPPER_A_FB:
+        return snap.axes.position[PMC::MOTOR_A];
+    case STEPPER_B_FB:
+        return snap.axes.position[PMC::MOTOR_B];
+    case STEPPER_C_FB:
+        return snap.axes.position[PMC::MOTOR_C];
+    default:
+        // Blank rows are never drawn
+        return dashboardRendered[row];
+    }
+}
+
+void PrimaryMirrorControl::renderDashboardField(uint8_t row)
+{
+    const DashboardSnapshot &snap = dashboardSnapshot;
+    switch (row)
+    {
+    case CMD_MODE_ROW:
+    {
+        static const char *modeLabels[]{"STOP", "RELATIVE", "ABSOLUTE", "TRACK", "JOG"};
+        if (snap.controlMode <= PMC::JOG)
+            cli->updatePersistentField(DeviceName, CMD_MODE_ROW, modeLabels[snap.controlMode]);
         break;
-    case NEW_MOVE_CMD:
-        cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "NEW_MOVE_CMD");
+    }
+    case TIP_CMD_ROW:
+        cli->updatePersistentField(DeviceName, TIP_CMD_ROW, snap.tipCmd * URAD_PER_RAD, "%.10f urad");
         break;
-    case MOVE_IN_PROGRESS:
-        cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "MOVE_IN_PROGRESS");
+    case TILT_CMD_ROW:
+        cli->updatePersistentField(DeviceName, TILT_CMD_ROW, snap.tiltCmd * URAD_PER_RAD, "%.10f urad");
         break;
-    case MOVE_COMPLETE:
-        cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "MOVE_COMPLETE");
+    case FOCUS_CMD_ROW:
+        cli->updatePersistentField(DeviceName, FOCUS_CMD_ROW, snap.focusCmd, "%.10f um");
         break;
-    case LIMIT_SW_DETECT:
-        cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "LIMIT_SW_DETECT");
+    case TIP_FB_ROW:
+        cli->updatePersistentField(DeviceName, TIP_FB_ROW, snap.tipEst * URAD_PER_RAD, "%.10f urad");
         break;
-    case HOMING_IS_ACTIVE:
-        switch (currentHomingState)
+    case TILT_FB_ROW:
+        cli->updatePersistentField(DeviceName, TILT_FB_ROW, snap.tiltEst * URAD_PER_RAD, "%.10f urad");
+        break;
+    case FOCUS_FB_ROW:
+        cli->updatePersistentField(DeviceName, FOCUS_FB_ROW, snap.focusEst, "%.10f um");
+        break;
+    case STEPPERS_ENABLED:
+        cli->updatePersistentField(DeviceName, STEPPERS_ENABLED, snap.steppersEnabled ? "True" : "False");
+        break;
+    case MOVE_SM_STATE_ROW:
+    {
+        static const char *moveStateLabels[]{"IDLE", "NEW_MOVE_CMD", "MOVE_IN_PROGRESS", "MOVE_COMPLETE",
+                                             "LIMIT_SW_DETECT", "HOMING", "MICROSTEP_CHANGE", "TRACKING",
+                                             "FINAL_APPROACH"};
+        static const char homingStepLabels[]{'I', 'R', '1', '2', '3', '4', '5', 'D'};
+        if (snap.moveState == HOMING_IS_ACTIVE)
         {
-        case INITIALIZE:
-            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "HOMING (INIT)");
-            break;
-        case HOMING_STEP_1:
-            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "HOMING 1 (QUICK REVERSE)");
-            break;
-        case HOMING_STEP_2:
-            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "HOMING 2 (PAUSE)");
-            break;
-        case HOMING_STEP_3:
-            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "HOMING 3 (SHORT FORWARD)");
-            break;
-        case HOMING_STEP_4:
-            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "HOMING 4 (PAUSE)");
-            break;
-        case HOMING_STEP_5:
-            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, "HOMING 5 (SLOW REVERSE)");
-            break;
+            char homingStatus[40];
+            snprintf(homingStatus, sizeof(homingStatus), "HOMING [A:%c B:%c C:%c]",
+                     homingStepLabels[snap.axes.homingState[PMC::MOTOR_A]],
+                     homingStepLabels[snap.axes.homingState[PMC::MOTOR_B]],
+                     homingStepLabels[snap.axes.homingState[PMC::MOTOR_C]]);
+            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, homingStatus);
         }
-
+        else if (snap.moveState <= FINAL_APPROACH)
+            cli->updatePersistentField(DeviceName, MOVE_SM_STATE_ROW, moveStateLabels[snap.moveState]);
         break;
     }
-
-    switch (controlMode)
-    {
-    case PMC::STOP:
-        cli->updatePersistentField(DeviceName, CMD_MODE_ROW, "STOP");
+    case STEPPER_A_FB:
+        cli->updatePersistentField(DeviceName, STEPPER_A_FB, snap.axes.position[PMC::MOTOR_A]);
         break;
-    case PMC::RELATIVE:
-        cli->updatePersistentField(DeviceName, CMD_MODE_ROW, "RELATIVE");
+    case STEPPER_B_FB:
+        cli->updatePersistentField(DeviceName, STEPPER_B_FB, snap.axes.position[PMC::MOTOR_B]);
         break;
-    case PMC::ABSOLUTE:
-        cli->updatePersistentField(DeviceName, CMD_MODE_ROW, "ABSOLUTE");
+    case STEPPER_C_FB:
+        cli->updatePersistentField(DeviceName, STEPPER_C_FB, snap.axes.position[PMC::MOTOR_C]);
         break;
     }
+}
+
+void PrimaryMirrorControl::getDashboardStats(uint32_t *maxPass_us, uint32_t *maxField_us, uint32_t *deferredFields)
+{
+    *maxPass_us = dashboardMaxPass_us;
+    *maxField_us = dashboardMaxField_us;
+    *deferredFields = dashboardDeferredFields;
+}
+
+// Called at the end of every control tick
+void PrimaryMirrorControl::recordTraceSample(uint32_t isrDuration_us)
+{
+#if ENABLE_CONTROL_TRACE
+    uint32_t tick = traceTick++;
+    if (!ControlTrace.isRecording())
+        return;
+    TraceRecord rec;
+    rec.tick = tick;
+    rec.homingStates = 0;
+    rec.switchLevels = 0;
+    // The axis block has just been published for this tick
+    for (uint8_t ii = 0; ii < NUM_AXES; ii++)
+    {
+        rec.position[ii] = axes.position[ii];
+        rec.target[ii] = axes.target[ii];
+        // The step generator can run past what the field holds
+        rec.speed[ii] = (int16_t)std::min(std::max(axes.speed[ii], (float)INT16_MIN), (float)INT16_MAX);
+        rec.homingStates |= axes.homingState[ii] << (3 * ii);
+        rec.switchLevels |= (axes.switchLevel[ii] ? 1 : 0) << ii;
+        rec.switchLevels |= (digitalRead(LimitSwitchPins[ii]) ? 1 : 0) << (ii + 4);
+    }
+    rec.isrDuration_us = (isrDuration_us > UINT16_MAX) ? UINT16_MAX : isrDuration_us;
+    rec.moveState = currentMoveState;
+    ControlTrace.record(rec);
 #endif
 }
 
-void PrimaryMirrorControl::updateCommandFields()
+// Restarts the trace, the buffer is frozen TRACE_POST_TRIGGER_RECORDS ticks after a trigger in the mask
+void PrimaryMirrorControl::armTrace(uint8_t triggerMask)
 {
-#if ENABLE_TERMINAL_UPDATES
-    cli->updatePersistentField(DeviceName, TIP_CMD_ROW, CommandStates_Eng.TIP_POS_RAD * URAD_PER_RAD, "%.10f urad");
-    cli->updatePersistentField(DeviceName, TILT_CMD_ROW, CommandStates_Eng.TILT_POS_RAD * URAD_PER_RAD, "%.10f urad");
-    cli->updatePersistentField(DeviceName, FOCUS_CMD_ROW, CommandStates_Eng.FOCUS_POS_MM, "%.10f um");
+#if ENABLE_CONTROL_TRACE
+    noInterrupts();
+    ControlTrace.arm(triggerMask, TRACE_POST_TRIGGER_RECORDS);
+    interrupts();
 #endif
 }
 
-void PrimaryMirrorControl::updateFeedbackFields()
+bool PrimaryMirrorControl::triggerTrace()
 {
-#if ENABLE_TERMINAL_UPDATES
-    auto aPos = Stepper_A.currentPosition();
-    auto bPos = Stepper_B.currentPosition();
-    auto cPos = Stepper_C.currentPosition();
-    MotorStates motorStates(aPos, bPos, cPos);
-    double tipEst, tiltEst, focusEst;
-    motorStates.getTipTiltFocusFeedback(&tipEst, &tiltEst, &focusEst);
-    cli->updatePersistentField(DeviceName, STEPPER_A_FB, aPos);
-    cli->updatePersistentField(DeviceName, STEPPER_B_FB, bPos);
-    cli->updatePersistentField(DeviceName, STEPPER_C_FB, cPos);
-    cli->updatePersistentField(DeviceName, TIP_FB_ROW, tipEst * URAD_PER_RAD, "%.10f urad");
-    cli->updatePersistentField(DeviceName, TILT_FB_ROW, tiltEst * URAD_PER_RAD, "%.10f urad");
-    // cli->updatePersistentField(DeviceName, FOCUS_FB_ROW, focusEst);
+#if ENABLE_CONTROL_TRACE
+    noInterrupts();
+    bool triggered = ControlTrace.trigger(TRACE_TRIGGER_COMMAND);
+    interrupts();
+    return triggered;
+#else
+    return false;
 #endif
-}
\ No newline at end of file
+}
+
+// Stops recording and prepares the dump, returns its size in bytes (0 if tracing is compiled out)
+uint32_t PrimaryMirrorControl::beginTraceDump()
+{
+#if ENABLE_CONTROL_TRACE
+    noInterrupts();
+    ControlTrace.freeze();
+    interrupts();
+    return ControlTrace.beginDump(tickPeriod_us);
+#else
+    return 0;
+#endif
+}
+
+uint32_t PrimaryMirrorControl::readTraceDump(uint32_t offset, uint8_t *buf, uint32_t len)
+{
+#if ENABLE_CONTROL_TRACE
+    return ControlTrace.readDump(offset, buf, len);
+#else
+    return 0;
+#endif
+}
+
+uint8_t PrimaryMirrorControl::getTraceState()
+{
+#if ENABLE_CONTROL_TRACE
+    return ControlTrace.getState();
+#else
+    return TRACE_IDLE;
+#endif
+}
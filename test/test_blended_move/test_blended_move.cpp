@@ -0,0 +1,192 @@
+#include <unity.h>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <blended_move.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t TICK_US = 1000;
+constexpr double TICK_S = TICK_US * 1e-6;
+constexpr double MAX_SPEED = 2400.0;
+constexpr double MAX_ACCEL = 2000.0;
+constexpr double MAX_JERK = 200000.0;
+constexpr double TOLERANCE = 1.05;
+
+// Checks the smoothed motion tick by tick against the speed, accel and jerk limits
+struct MotionChecker
+{
+    double pos[BLEND_AXES][4];
+    uint32_t samples = 0;
+    double speedLimit;
+    double jerkLimit;
+
+    MotionChecker(const BlendedMove &move, double speedLimit)
+        : speedLimit(speedLimit), jerkLimit(2 * MAX_ACCEL / (move.getWindow() * TICK_S)) {}
+
+    void check(const BlendedMove &move)
+    {
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            for (uint8_t jj = 3; jj > 0; jj--)
+                pos[ii][jj] = pos[ii][jj - 1];
+            pos[ii][0] = move.getSmoothedPosition(ii);
+            if (samples >= 1)
+                TEST_ASSERT_TRUE(std::fabs(pos[ii][0] - pos[ii][1]) / TICK_S <= speedLimit * TOLERANCE);
+            if (samples >= 2)
+                TEST_ASSERT_TRUE(std::fabs(pos[ii][0] - 2 * pos[ii][1] + pos[ii][2]) / (TICK_S * TICK_S) <=
+                                 MAX_ACCEL * TOLERANCE);
+            if (samples >= 3)
+                TEST_ASSERT_TRUE(std::fabs(pos[ii][0] - 3 * pos[ii][1] + 3 * pos[ii][2] - pos[ii][3]) /
+                                     (TICK_S * TICK_S * TICK_S) <=
+                                 jerkLimit * TOLERANCE);
+        }
+        samples++;
+    }
+};
+
+// Runs n ticks (or to the end), keeping track of the whole steps emitted
+static void run(BlendedMove &move, MotionChecker &checker, int32_t *position, uint32_t ticks)
+{
+    for (uint32_t tick = 0; tick < ticks && !move.isDone(); tick++)
+    {
+        int32_t steps[BLEND_AXES];
+        move.next(steps);
+        checker.check(move);
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        {
+            // Smoothed speed stays under a step per tick here
+            TEST_ASSERT_TRUE(std::abs(steps[ii]) <= 3);
+            position[ii] += steps[ii];
+            TEST_ASSERT_EQUAL_INT32(move.getPosition(ii), position[ii]);
+        }
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_window_bounds_jerk(void)
+{
+    TEST_ASSERT_EQUAL_UINT16(200, blendWindowTicks(2000.0, 200000.0, 100));
+    TEST_ASSERT_EQUAL_UINT16(1, blendWindowTicks(2000.0, 1e9, 100));
+    TEST_ASSERT_EQUAL_UINT16(BLEND_MAX_WINDOW_TICKS, blendWindowTicks(100000.0, 1000.0, 100));
+}
+
+void test_reversal_from_full_speed_is_continuous(void)
+{
+    BlendedMove move;
+    int32_t position[BLEND_AXES]{1000, -2000, 0};
+    const double velocity[BLEND_AXES]{MAX_SPEED, -MAX_SPEED, 500.0};
+    const int32_t target[BLEND_AXES]{-3000, 4000, 0};
+    move.start(position, velocity, target, MAX_SPEED, MAX_ACCEL, blendWindowTicks(MAX_ACCEL, MAX_JERK, TICK_US), TICK_US);
+
+    // Picks up where the old move left off, at the speed it was going
+    MotionChecker checker(move, MAX_SPEED);
+    for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        TEST_ASSERT_DOUBLE_WITHIN(1e-6, position[ii], move.getSmoothedPosition(ii));
+    checker.check(move);
+    double before[BLEND_AXES];
+    for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        before[ii] = move.getSmoothedPosition(ii);
+    run(move, checker, position, 1);
+    for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        TEST_ASSERT_DOUBLE_WITHIN(MAX_ACCEL * TICK_S, velocity[ii], (move.getSmoothedPosition(ii) - before[ii]) / TICK_S);
+
+    run(move, checker, position, 100000);
+    TEST_ASSERT_TRUE(move.isDone());
+    for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        TEST_ASSERT_EQUAL_INT32(target[ii], position[ii]);
+}
+
+void test_axes_arrive_together(void)
+{
+    BlendedMove move;
+    int32_t position[BLEND_AXES]{0, 0, 0};
+    const double velocity[BLEND_AXES]{0.0, 0.0, 0.0};
+    const int32_t target[BLEND_AXES]{8000, -800, 0};
+    move.start(position, velocity, target, MAX_SPEED, MAX_ACCEL, blendWindowTicks(MAX_ACCEL, MAX_JERK, TICK_US), TICK_US);
+    MotionChecker checker(move, MAX_SPEED);
+
+    // Rest to rest profiles are symmetric, so every axis is halfway at half time
+    run(move, checker, position, move.getTotalTicks() / 2);
+    TEST_ASSERT_INT32_WITHIN(80, 4000, position[0]);
+    TEST_ASSERT_INT32_WITHIN(8, -400, position[1]);
+    run(move, checker, position, 100000);
+    TEST_ASSERT_EQUAL_INT32(8000, position[0]);
+    TEST_ASSERT_EQUAL_INT32(-800, position[1]);
+    TEST_ASSERT_EQUAL_INT32(0, position[2]);
+}
+
+void test_repeated_retargets_stay_within_limits(void)
+{
+    BlendedMove move;
+    int32_t position[BLEND_AXES]{0, 0, 0};
+    const double velocity[BLEND_AXES]{1200.0, 0.0, -2400.0};
+    int32_t target[BLEND_AXES]{5000, 5000, -5000};
+    move.start(position, velocity, target, MAX_SPEED, MAX_ACCEL, blendWindowTicks(MAX_ACCEL, MAX_JERK, TICK_US), TICK_US);
+    MotionChecker checker(move, MAX_SPEED);
+
+    srand(43);
+    for (uint8_t retarget = 0; retarget < 50; retarget++)
+    {
+        run(move, checker, position, 20 + rand() % 200);
+        for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+            target[ii] = rand() % 20001 - 10000;
+        move.retarget(target, MAX_SPEED, MAX_ACCEL);
+    }
+    run(move, checker, position, 1000000);
+    TEST_ASSERT_TRUE(move.isDone());
+    for (uint8_t ii = 0; ii < BLEND_AXES; ii++)
+        TEST_ASSERT_EQUAL_INT32(target[ii], position[ii]);
+}
+
+void test_faster_than_limit_slows_down_first(void)
+{
+    BlendedMove move;
+    int32_t position[BLEND_AXES]{0, 0, 0};
+    const double velocity[BLEND_AXES]{3000.0, 0.0, 0.0};
+    const int32_t target[BLEND_AXES]{20000, 0, 0};
+    move.start(position, velocity, target, MAX_SPEED, MAX_ACCEL, blendWindowTicks(MAX_ACCEL, MAX_JERK, TICK_US), TICK_US);
+    MotionChecker checker(move, 3000.0);
+    run(move, checker, position, 2000);
+    // Settled at the new limit after (3000 - 2400) / MAX_ACCEL = 0.3 s
+    double before = move.getSmoothedPosition(0);
+    run(move, checker, position, 1);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0, MAX_SPEED, (move.getSmoothedPosition(0) - before) / TICK_S);
+    run(move, checker, position, 100000);
+    TEST_ASSERT_EQUAL_INT32(20000, position[0]);
+    TEST_ASSERT_EQUAL_INT32(0, position[1]);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_window_bounds_jerk);
+    RUN_TEST(test_reversal_from_full_speed_is_continuous);
+    RUN_TEST(test_axes_arrive_together);
+    RUN_TEST(test_repeated_retargets_stay_within_limits);
+    RUN_TEST(test_faster_than_limit_slows_down_first);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
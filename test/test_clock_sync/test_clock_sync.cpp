@@ -0,0 +1,183 @@
+#include <unity.h>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <clock_sync.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr int64_t HOST_EPOCH_US = 1700000000000000ll; // Host clock is wall time
+constexpr uint64_t TICK_US = 100;
+constexpr int64_t SYNC_PERIOD_US = 1000000;
+
+// A controller on the shared virtual clock: its own offset and skew, a ClockSync
+// fit, and a control tick that releases a scheduled move
+struct VirtualController
+{
+    uint64_t localAtZero;
+    double skew_ppm;
+    ClockSync sync;
+    uint64_t releaseAt;
+
+    VirtualController(uint64_t localAtZero, double skew_ppm) : localAtZero(localAtZero), skew_ppm(skew_ppm), releaseAt(0) {}
+
+    uint64_t local(int64_t true_us) const
+    {
+        return localAtZero + (uint64_t)std::llround(true_us * (1.0 + skew_ppm * 1e-6));
+    }
+    int64_t trueTime(uint64_t local_us) const
+    {
+        return (int64_t)std::llround((double)(int64_t)(local_us - localAtZero) / (1.0 + skew_ppm * 1e-6));
+    }
+    // First tick at or after the release time, in true time
+    int64_t releaseTrueTime(int64_t tickPhase_us) const
+    {
+        int64_t due = trueTime(releaseAt);
+        int64_t ticks = (due - tickPhase_us + (int64_t)TICK_US - 1) / (int64_t)TICK_US;
+        int64_t release = tickPhase_us + ticks * (int64_t)TICK_US;
+        while (local(release) < releaseAt)
+            release += TICK_US;
+        return release;
+    }
+};
+
+// Unity's 64 bit asserts aren't enabled in these builds
+static bool within(int64_t delta, int64_t expected, int64_t actual)
+{
+    return std::llabs(actual - expected) <= delta;
+}
+
+static int64_t randomDelay(int64_t min_us, int64_t spread_us)
+{
+    return min_us + rand() % (spread_us + 1);
+}
+
+// Host side of the exchange: stamps each ClockSync with its send time plus half
+// the smallest round trip seen so far. Returns the true time afterwards.
+static int64_t syncRounds(VirtualController &ctrl, int64_t true_us, uint8_t rounds, int64_t minDelay_us,
+                          int64_t spread_us)
+{
+    int64_t minRtt = INT64_MAX;
+    for (uint8_t ii = 0; ii < rounds; ii++)
+    {
+        int64_t out = randomDelay(minDelay_us, spread_us);
+        int64_t back = randomDelay(minDelay_us, spread_us);
+        int64_t pathDelay = (minRtt == INT64_MAX) ? 0 : minRtt / 2;
+        ctrl.sync.addSample(HOST_EPOCH_US + true_us + pathDelay, ctrl.local(true_us + out));
+        minRtt = std::min(minRtt, out + back);
+        true_us += SYNC_PERIOD_US;
+    }
+    return true_us;
+}
+
+void setUp(void)
+{
+    srand(47);
+}
+
+void tearDown(void)
+{
+}
+
+void test_local_clock_extends_past_wrap(void)
+{
+    LocalClock clock;
+    TEST_ASSERT_TRUE(clock.extend(4000000000u) == 4000000000ull);
+    TEST_ASSERT_TRUE(clock.extend(5) == (1ull << 32) + 5);
+    TEST_ASSERT_TRUE(clock.extend(6) == (1ull << 32) + 6);
+    TEST_ASSERT_TRUE(clock.extend(1u << 31) == (1ull << 32) + (1ull << 31));
+    TEST_ASSERT_TRUE(clock.extend(1) == (2ull << 32) + 1);
+}
+
+void test_exact_samples_recover_offset_and_skew(void)
+{
+    VirtualController ctrl{123456789ull, 40.0};
+    TEST_ASSERT_FALSE(ctrl.sync.isSynced(ctrl.local(0)));
+    int64_t now = 0;
+    for (uint8_t ii = 0; ii < CLOCK_SYNC_MIN_SAMPLES; ii++, now += 5 * SYNC_PERIOD_US)
+        ctrl.sync.addSample(HOST_EPOCH_US + now, ctrl.local(now));
+    TEST_ASSERT_TRUE(ctrl.sync.isSynced(ctrl.local(now)));
+    TEST_ASSERT_DOUBLE_WITHIN(0.5, 40.0, ctrl.sync.getSkew_ppm());
+    TEST_ASSERT_TRUE(ctrl.sync.getResidual_us() < 1.0);
+
+    // Ten seconds ahead, the line still lands on the controller's clock
+    int64_t ahead = now + 10 * SYNC_PERIOD_US;
+    TEST_ASSERT_TRUE(within(2, (int64_t)ctrl.local(ahead), (int64_t)ctrl.sync.toLocal(HOST_EPOCH_US + ahead)));
+
+    // Goes stale without fresh samples
+    TEST_ASSERT_FALSE(ctrl.sync.isSynced(ctrl.local(now) + CLOCK_SYNC_MAX_AGE_US));
+}
+
+void test_short_span_fits_offset_only(void)
+{
+    // A burst of samples a few ms apart: the jitter would make up a huge skew
+    VirtualController ctrl{777ull, 30.0};
+    int64_t now = 0;
+    for (uint8_t ii = 0; ii < CLOCK_SYNC_WINDOW; ii++, now += 20000)
+        ctrl.sync.addSample(HOST_EPOCH_US + now, ctrl.local(now + randomDelay(0, 400)));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, ctrl.sync.getSkew_ppm());
+    int64_t ahead = now + SYNC_PERIOD_US;
+    TEST_ASSERT_TRUE(within(250, (int64_t)ctrl.local(ahead), (int64_t)ctrl.sync.toLocal(HOST_EPOCH_US + ahead)));
+}
+
+void test_network_jitter_bounds_the_error(void)
+{
+    VirtualController ctrl{5000000000ull, -25.0};
+    int64_t now = syncRounds(ctrl, 0, 2 * CLOCK_SYNC_WINDOW, 300, 200);
+    TEST_ASSERT_DOUBLE_WITHIN(15.0, -25.0, ctrl.sync.getSkew_ppm());
+    // Half the delay spread either way, the fit averages most of it out
+    int64_t ahead = now + 2 * SYNC_PERIOD_US;
+    TEST_ASSERT_TRUE(within(150, (int64_t)ctrl.local(ahead), (int64_t)ctrl.sync.toLocal(HOST_EPOCH_US + ahead)));
+}
+
+void test_fleet_releases_together(void)
+{
+    // Offsets of hours apart, skews of tens of ppm, control ticks out of phase
+    VirtualController fleet[]{{1000ull, 50.0}, {7200000000ull, -30.0}, {123456789012ull, 0.0},
+                              {42ull, 12.5}, {3600000000ull, -49.0}};
+    constexpr uint8_t N = sizeof(fleet) / sizeof(fleet[0]);
+    int64_t now = 0;
+    for (uint8_t ii = 0; ii < N; ii++)
+        now = std::max(now, syncRounds(fleet[ii], 0, CLOCK_SYNC_WINDOW, 250, 100));
+
+    int64_t executeAt = HOST_EPOCH_US + now + 500000;
+    int64_t first = INT64_MAX, last = INT64_MIN;
+    for (uint8_t ii = 0; ii < N; ii++)
+    {
+        TEST_ASSERT_TRUE(fleet[ii].sync.isSynced(fleet[ii].local(now)));
+        fleet[ii].releaseAt = fleet[ii].sync.toLocal(executeAt);
+        int64_t release = fleet[ii].releaseTrueTime(ii * 17);
+        first = std::min(first, release);
+        last = std::max(last, release);
+    }
+    TEST_ASSERT_TRUE(within(100 + TICK_US, executeAt - HOST_EPOCH_US, first));
+    TEST_ASSERT_TRUE(last - first <= 2 * 100 + (int64_t)TICK_US);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_local_clock_extends_past_wrap);
+    RUN_TEST(test_exact_samples_recover_offset_and_skew);
+    RUN_TEST(test_short_span_fits_offset_only);
+    RUN_TEST(test_network_jitter_bounds_the_error);
+    RUN_TEST(test_fleet_releases_together);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,145 @@
+#include <unity.h>
+#include <cstdint>
+#include <config_store.h>
+#include <simulated_storage.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t CONFIG_START = 1024;
+constexpr uint32_t CONFIG_SIZE = 256;
+
+enum TEST_PARAM
+{
+    SPEED,
+    ACCEL,
+    PERIOD,
+    RATIO, // Added in the "new" firmware
+};
+
+static const ParamDef ParamTable[] = {
+    {"Speed", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, 2400.0, 1.0, 10000.0},
+    {"Accel", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, 2000.0, 1.0, 100000.0},
+    {"Period", PARAM_TYPE_UINT, PARAM_APPLY_ON_REBOOT, 100, 20, 1000},
+    {"Ratio", PARAM_TYPE_DOUBLE, PARAM_APPLY_LIVE, 0.1, 0.01, 1.0},
+};
+constexpr uint16_t NUM_PARAMS = sizeof(ParamTable) / sizeof(ParamTable[0]);
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_blank_storage_loads_defaults(void)
+{
+    SimulatedFram fram;
+    ConfigStore config(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    TEST_ASSERT_FALSE(config.load());
+    for (uint16_t id = 0; id < NUM_PARAMS; id++)
+        TEST_ASSERT_EQUAL_DOUBLE(ParamTable[id].defaultValue, config.get(id));
+}
+
+void test_set_validates_and_round_trips(void)
+{
+    SimulatedFram fram;
+    ConfigStore config(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    TEST_ASSERT_EQUAL_UINT8(PARAM_OK, config.set(SPEED, 1800.0));
+    TEST_ASSERT_EQUAL_UINT8(PARAM_OK, config.set(PERIOD, 49.6)); // Rounded, it's an integer parameter
+    TEST_ASSERT_EQUAL_UINT8(PARAM_OUT_OF_RANGE, config.set(ACCEL, 0.0));
+    TEST_ASSERT_EQUAL_UINT8(PARAM_UNKNOWN, config.set(NUM_PARAMS, 1.0));
+    TEST_ASSERT_EQUAL_DOUBLE(2000.0, config.get(ACCEL));
+    TEST_ASSERT_TRUE(config.save());
+
+    ConfigStore rebooted(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    TEST_ASSERT_TRUE(rebooted.load());
+    TEST_ASSERT_EQUAL_DOUBLE(1800.0, rebooted.get(SPEED));
+    TEST_ASSERT_EQUAL_DOUBLE(50.0, rebooted.get(PERIOD));
+    TEST_ASSERT_EQUAL_DOUBLE(2000.0, rebooted.get(ACCEL));
+}
+
+void test_corrupt_block_loads_defaults(void)
+{
+    SimulatedFram fram;
+    ConfigStore config(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    config.set(SPEED, 1800.0);
+    config.save();
+    fram.poke(CONFIG_START + sizeof(ConfigHeader) + 3, 0xA5);
+
+    ConfigStore rebooted(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    TEST_ASSERT_FALSE(rebooted.load());
+    TEST_ASSERT_EQUAL_DOUBLE(2400.0, rebooted.get(SPEED));
+}
+
+void test_appended_params_take_defaults(void)
+{
+    // Older firmware only knew the first three parameters
+    SimulatedFram fram;
+    ConfigStore oldConfig(fram, CONFIG_START, CONFIG_SIZE, ParamTable, 3, 1);
+    oldConfig.set(ACCEL, 500.0);
+    oldConfig.save();
+
+    ConfigStore newConfig(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    TEST_ASSERT_TRUE(newConfig.load());
+    TEST_ASSERT_EQUAL_DOUBLE(500.0, newConfig.get(ACCEL));
+    TEST_ASSERT_EQUAL_DOUBLE(0.1, newConfig.get(RATIO));
+}
+
+// Schema 2 changed Period from microseconds to tenths of a millisecond
+static void migratePeriod(uint16_t fromVersion, double *values, uint16_t count)
+{
+    if (fromVersion < 2 && count > PERIOD)
+        values[PERIOD] = values[PERIOD] * 10.0;
+}
+
+void test_schema_migration(void)
+{
+    SimulatedFram fram;
+    ConfigStore v1(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 1);
+    v1.set(PERIOD, 50);
+    v1.set(SPEED, 3000.0);
+    v1.save();
+
+    ConfigStore v2(fram, CONFIG_START, CONFIG_SIZE, ParamTable, NUM_PARAMS, 2, migratePeriod);
+    TEST_ASSERT_TRUE(v2.load());
+    TEST_ASSERT_EQUAL_DOUBLE(500.0, v2.get(PERIOD));
+    TEST_ASSERT_EQUAL_DOUBLE(3000.0, v2.get(SPEED));
+
+    // Values the migration pushes out of range fall back to their default
+    v1.set(PERIOD, 200);
+    v1.save();
+    TEST_ASSERT_TRUE(v2.load());
+    TEST_ASSERT_EQUAL_DOUBLE(100.0, v2.get(PERIOD));
+
+    // A block from newer firmware is not understood
+    v2.save();
+    TEST_ASSERT_FALSE(v1.load());
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blank_storage_loads_defaults);
+    RUN_TEST(test_set_validates_and_round_trips);
+    RUN_TEST(test_corrupt_block_loads_defaults);
+    RUN_TEST(test_appended_params_take_defaults);
+    RUN_TEST(test_schema_migration);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,137 @@
+#include <unity.h>
+#include <cstdint>
+#include <fan_monitor.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t LOOP_MS = 10;
+
+// Runs loop() every LOOP_MS with a tach at rpm (0 = stopped), returns the number of new stalls
+static uint32_t run(FanMonitor &fan, uint32_t *now_ms, uint32_t duration_ms, uint32_t rpm)
+{
+    uint32_t stalls = 0;
+    uint32_t edgePeriod_us = rpm ? 60000000 / (rpm * FAN_TACH_PULSES_PER_REV) : 0;
+    uint64_t now_us = (uint64_t)*now_ms * 1000;
+    uint64_t nextEdge_us = now_us;
+    for (uint32_t elapsed = 0; elapsed < duration_ms; elapsed += LOOP_MS)
+    {
+        *now_ms += LOOP_MS;
+        while (rpm && nextEdge_us <= (uint64_t)*now_ms * 1000)
+        {
+            fan.recordEdge((uint32_t)nextEdge_us);
+            nextEdge_us += edgePeriod_us;
+        }
+        stalls += fan.update(*now_ms) ? 1 : 0;
+    }
+    return stalls;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_speed_from_tach_edges(void)
+{
+    FanMonitor fan;
+    uint32_t now_ms = 0;
+    fan.setDuty(100);
+    run(fan, &now_ms, 3000, 1500);
+    TEST_ASSERT_UINT32_WITHIN(60, 1500, fan.getRpm());
+    run(fan, &now_ms, 3000, 2700);
+    TEST_ASSERT_UINT32_WITHIN(60, 2700, fan.getRpm());
+    TEST_ASSERT_FALSE(fan.isStalled());
+}
+
+void test_glitches_between_edges_are_ignored(void)
+{
+    FanMonitor fan;
+    fan.setDuty(100);
+    fan.update(0);
+    // 1200 rpm, each real edge followed by a ringing edge 100 us later
+    for (uint32_t edge = 0; edge < 40; edge++)
+    {
+        fan.recordEdge(edge * 25000);
+        fan.recordEdge(edge * 25000 + 100);
+    }
+    fan.update(1000);
+    TEST_ASSERT_UINT32_WITHIN(60, 1200, fan.getRpm());
+}
+
+void test_stall_raised_once_and_cleared_on_recovery(void)
+{
+    FanMonitor fan;
+    uint32_t now_ms = 0;
+    fan.setDuty(100);
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, 5000, 1800));
+
+    // Stuck: reported once, just after the timeout
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, FAN_STALL_TIMEOUT_MS - 2 * LOOP_MS, 0));
+    TEST_ASSERT_FALSE(fan.isStalled());
+    TEST_ASSERT_EQUAL_UINT32(1, run(fan, &now_ms, 5000, 0));
+    TEST_ASSERT_TRUE(fan.isStalled());
+    TEST_ASSERT_EQUAL_UINT32(0, fan.getRpm());
+
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, 3000, 1800));
+    TEST_ASSERT_FALSE(fan.isStalled());
+    TEST_ASSERT_EQUAL_UINT32(1, run(fan, &now_ms, 5000, 0));
+    TEST_ASSERT_EQUAL_UINT32(2, fan.getStallCount());
+}
+
+void test_spinup_and_low_duty_are_not_stalls(void)
+{
+    FanMonitor fan;
+    uint32_t now_ms = 0;
+    // Off, or driven below the point a fan is expected to turn
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, 10000, 0));
+    fan.setDuty(FAN_STALL_MIN_DUTY_PERCENT - 1);
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, 10000, 0));
+
+    // Switched on from off: nothing until the spin-up time is over
+    fan.setDuty(0);
+    run(fan, &now_ms, 100, 0);
+    fan.setDuty(100);
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, FAN_SPINUP_MS - 2 * LOOP_MS, 0));
+    TEST_ASSERT_EQUAL_UINT32(1, run(fan, &now_ms, 1000, 0));
+}
+
+void test_millis_rollover(void)
+{
+    FanMonitor fan;
+    uint32_t now_ms = UINT32_MAX - 2500;
+    fan.setDuty(100);
+    TEST_ASSERT_EQUAL_UINT32(1, run(fan, &now_ms, 5000, 0));
+    TEST_ASSERT_TRUE(fan.isStalled());
+    TEST_ASSERT_EQUAL_UINT32(0, run(fan, &now_ms, 3000, 1800));
+    TEST_ASSERT_UINT32_WITHIN(60, 1800, fan.getRpm());
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_speed_from_tach_edges);
+    RUN_TEST(test_glitches_between_edges_are_ignored);
+    RUN_TEST(test_stall_raised_once_and_cleared_on_recovery);
+    RUN_TEST(test_spinup_and_low_duty_are_not_stalls);
+    RUN_TEST(test_millis_rollover);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
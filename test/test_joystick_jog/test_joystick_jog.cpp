@@ -0,0 +1,259 @@
+#include <unity.h>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <mirror_kinematics.h>
+#include <track_follower.h>
+#include <joystick_jog.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t TICK_US = 100;
+constexpr double TICK_S = TICK_US * 1e-6;
+constexpr uint32_t SAMPLE_TICKS = 100; // 10 ms joystick sampling
+constexpr double SAMPLE_S = SAMPLE_TICKS * TICK_S;
+constexpr double FINE_RATE = 20.0 * RAD_PER_URAD;
+constexpr double COARSE_RATE = 500.0 * RAD_PER_URAD;
+constexpr double MAX_SPEED = 2400.0;
+constexpr double MAX_ACCEL = 2000.0;
+constexpr uint16_t CENTER = JOYSTICK_ADC_MAX / 2;
+
+static uint16_t noisy(uint16_t counts, int noise)
+{
+    return (uint16_t)std::min(std::max((int)counts + rand() % (2 * noise + 1) - noise, 0), (int)JOYSTICK_ADC_MAX);
+}
+
+// Steps like the control tick's velocity drive (runAxisVelocities()): the fraction of a step not
+// taken yet carries over, at most one step per tick, and a reversal waits a tick for the DIR pin
+struct SimulatedAxis
+{
+    long position = 0;
+    double remainder = 0.0;
+    int direction = 0;
+
+    void run(double velocity, double dt)
+    {
+        remainder += velocity * dt;
+        int want = (remainder >= 0.5) ? 1 : (remainder <= -0.5) ? -1 : 0;
+        if (want != 0 && want == direction)
+        {
+            position += want;
+            remainder -= want;
+        }
+        else if (want != 0)
+            direction = want;
+        remainder = std::min(std::max(remainder, -1.0), 1.0);
+    }
+};
+
+// The JOG path of the control tick: sample, integrate the rates, follow in steps
+struct JogSimulation
+{
+    JoystickSource &source;
+    JoystickJog jog;
+    MirrorStates pose;
+    TrackFollower follower[3];
+    SimulatedAxis axis[3];
+    double demand[3];
+    uint32_t tick = 0;
+    int noise = 0;
+
+    explicit JogSimulation(JoystickSource &source) : source(source)
+    {
+        pose.TIP_POS_RAD = pose.TILT_POS_RAD = pose.FOCUS_POS_MM = 0.0;
+        pose.getMotorStepTargets(demand);
+        for (uint8_t ii = 0; ii < 3; ii++)
+        {
+            axis[ii].position = std::lround(demand[ii]);
+            follower[ii].reset(demand[ii]);
+        }
+    }
+
+    void step()
+    {
+        tick++;
+        if (tick % SAMPLE_TICKS == 0)
+        {
+            JoystickSample sample = source.read(tick * TICK_US);
+            sample.x = noisy(sample.x, noise);
+            sample.y = noisy(sample.y, noise);
+            jog.update(sample, SAMPLE_S, FINE_RATE, COARSE_RATE);
+        }
+        pose.TIP_POS_RAD = pose.TIP_POS_RAD + jog.getTipRate() * TICK_S;
+        pose.TILT_POS_RAD = pose.TILT_POS_RAD + jog.getTiltRate() * TICK_S;
+        TEST_ASSERT_EQUAL_UINT8(LFAST::PMC::IN_RANGE, pose.getMotorStepTargets(demand, LFAST::PMC::REJECT_COMMAND));
+        for (uint8_t ii = 0; ii < 3; ii++)
+        {
+            double prevVelocity = follower[ii].getVelocity();
+            double velocity = follower[ii].update(demand[ii], axis[ii].position, TICK_S, MAX_SPEED, MAX_ACCEL);
+            TEST_ASSERT_TRUE(std::fabs(velocity - prevVelocity) <= MAX_ACCEL * TICK_S + 1e-9);
+            axis[ii].run(velocity, TICK_S);
+        }
+    }
+
+    double now_s() const { return tick * TICK_S; }
+};
+
+void setUp(void)
+{
+    srand(44);
+}
+
+void tearDown(void)
+{
+}
+
+void test_resting_stick_holds_still(void)
+{
+    JoystickJog jog;
+    for (uint16_t ii = 0; ii < 1000; ii++)
+    {
+        JoystickSample sample{noisy(CENTER + 15, 20), noisy(CENTER - 15, 20), false};
+        jog.update(sample, SAMPLE_S, FINE_RATE, COARSE_RATE);
+        TEST_ASSERT_EQUAL_DOUBLE(0.0, jog.getTipRate());
+        TEST_ASSERT_EQUAL_DOUBLE(0.0, jog.getTiltRate());
+    }
+}
+
+void test_deflection_maps_to_rates(void)
+{
+    JoystickJog jog;
+    for (uint16_t ii = 0; ii < 100; ii++)
+        jog.update({JOYSTICK_ADC_MAX, 0, false}, SAMPLE_S, FINE_RATE, COARSE_RATE);
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3 * FINE_RATE, FINE_RATE, jog.getTipRate());
+    TEST_ASSERT_DOUBLE_WITHIN(1e-3 * FINE_RATE, -FINE_RATE, jog.getTiltRate());
+
+    // Halfway between the edge of the deadband and full deflection
+    uint16_t half = (uint16_t)(CENTER + JOYSTICK_DEADBAND_COUNTS + (CENTER - JOYSTICK_DEADBAND_COUNTS) / 2);
+    for (uint16_t ii = 0; ii < 100; ii++)
+        jog.update({half, CENTER, false}, SAMPLE_S, FINE_RATE, COARSE_RATE);
+    TEST_ASSERT_DOUBLE_WITHIN(0.01 * FINE_RATE, 0.5 * FINE_RATE, jog.getTipRate());
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, jog.getTiltRate());
+}
+
+void test_button_toggles_once_per_debounced_press(void)
+{
+    JoystickJog jog;
+    const bool bouncyPress[]{true, false, true, true, false, true, true, true, true, true, true};
+    for (bool pressed : bouncyPress)
+        jog.update({CENTER, CENTER, pressed}, SAMPLE_S, FINE_RATE, COARSE_RATE);
+    TEST_ASSERT_TRUE(jog.isCoarse());
+
+    // Held down: no repeat. Release bounces, then a second press toggles back.
+    for (uint8_t ii = 0; ii < 50; ii++)
+        jog.update({CENTER, CENTER, true}, SAMPLE_S, FINE_RATE, COARSE_RATE);
+    const bool bouncyRelease[]{false, true, false, false, false, false};
+    for (bool pressed : bouncyRelease)
+        jog.update({CENTER, CENTER, pressed}, SAMPLE_S, FINE_RATE, COARSE_RATE);
+    TEST_ASSERT_TRUE(jog.isCoarse());
+    for (uint8_t ii = 0; ii < 5; ii++)
+        jog.update({CENTER, CENTER, true}, SAMPLE_S, FINE_RATE, COARSE_RATE);
+    TEST_ASSERT_FALSE(jog.isCoarse());
+}
+
+void test_scripted_jog_latency_and_smoothness(void)
+{
+    // Coarse gain, push the stick right at 1 s, let go at 3 s
+    const ScriptedJoystick::Keyframe script[]{
+        {0, {CENTER, CENTER, false}},
+        {100000, {CENTER, CENTER, true}},
+        {200000, {CENTER, CENTER, false}},
+        {1000000, {JOYSTICK_ADC_MAX, CENTER, false}},
+        {3000000, {CENTER, CENTER, false}},
+    };
+    ScriptedJoystick stick(script, sizeof(script) / sizeof(script[0]));
+    JogSimulation sim(stick);
+    sim.noise = 8;
+
+    while (sim.now_s() < 1.0)
+        sim.step();
+    TEST_ASSERT_TRUE(sim.jog.isCoarse());
+    long start[3];
+    for (uint8_t ii = 0; ii < 3; ii++)
+        start[ii] = sim.axis[ii].position;
+
+    // Steady speed of the axis that moves most for tip, from the kinematics
+    MirrorStates ahead;
+    ahead.TIP_POS_RAD = COARSE_RATE;
+    ahead.TILT_POS_RAD = ahead.FOCUS_POS_MM = 0.0;
+    double demand[3], origin[3];
+    ahead.getMotorStepTargets(demand);
+    sim.pose.getMotorStepTargets(origin);
+    uint8_t fastest = 0;
+    for (uint8_t ii = 1; ii < 3; ii++)
+    {
+        if (std::fabs(demand[ii] - origin[ii]) > std::fabs(demand[fastest] - origin[fastest]))
+            fastest = ii;
+    }
+    double steadySpeed = demand[fastest] - origin[fastest];
+
+    // Filter settling plus a sample of delay, then the ramp at the acceleration limit
+    double latencyBound = 3 * JOYSTICK_FILTER_TAU_S + SAMPLE_S + std::fabs(steadySpeed) / MAX_ACCEL;
+    double reached_s = 0.0;
+    double minError = INFINITY, maxError = -INFINITY;
+    long steadyStart = 0;
+    while (sim.now_s() < 3.0)
+    {
+        sim.step();
+        double speed = std::fabs(sim.follower[fastest].getVelocity());
+        if (reached_s == 0.0 && speed >= 0.9 * std::fabs(steadySpeed))
+            reached_s = sim.now_s() - 1.0;
+        if (sim.tick == 20000)
+            steadyStart = sim.axis[fastest].position;
+        if (sim.tick > 20000)
+        {
+            double error = sim.demand[fastest] - sim.axis[fastest].position;
+            minError = std::min(minError, error);
+            maxError = std::max(maxError, error);
+        }
+    }
+    TEST_ASSERT_TRUE(reached_s > 0.0 && reached_s <= latencyBound);
+    // Steady jog: steps only land on whole ticks, so the axis alternates between
+    // the step rates either side of the demand. The error swings by the gap between
+    // them over the correction gain, ADC noise adds next to nothing on top.
+    double ticksPerStep = 1.0 / (std::fabs(steadySpeed) * TICK_S);
+    double rateGap = 1.0 / (std::floor(ticksPerStep) * TICK_S) - 1.0 / (std::ceil(ticksPerStep) * TICK_S);
+    TEST_ASSERT_TRUE(maxError - minError <= rateGap / TRACK_POSITION_GAIN + 2.0);
+    TEST_ASSERT_DOUBLE_WITHIN(0.01 * std::fabs(steadySpeed), steadySpeed, sim.axis[fastest].position - steadyStart);
+
+    // Let go: ramps down and holds
+    while (sim.now_s() < 5.0)
+        sim.step();
+    long stopped[3];
+    for (uint8_t ii = 0; ii < 3; ii++)
+    {
+        TEST_ASSERT_EQUAL_DOUBLE(0.0, sim.follower[ii].getVelocity());
+        stopped[ii] = sim.axis[ii].position;
+    }
+    TEST_ASSERT_TRUE(std::labs(stopped[fastest] - start[fastest]) > 0);
+    while (sim.now_s() < 6.0)
+        sim.step();
+    for (uint8_t ii = 0; ii < 3; ii++)
+        TEST_ASSERT_EQUAL_INT32(stopped[ii], sim.axis[ii].position);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_resting_stick_holds_still);
+    RUN_TEST(test_deflection_maps_to_rates);
+    RUN_TEST(test_button_toggles_once_per_debounced_press);
+    RUN_TEST(test_scripted_jog_latency_and_smoothness);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,146 @@
+#include <unity.h>
+#include <cstdint>
+#include <loop_watchdog.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+static const uint32_t Budgets_us[NUM_LOOP_STAGES]{1000, 5000, 5000, 2000};
+constexpr uint32_t LOOP_BUDGET = 10000;
+
+// One pass through loop() with each stage taking stage_us, returns whether the dog was fed
+static bool runPass(LoopWatchdog &dog, uint32_t *now_us, const uint32_t *stage_us)
+{
+    dog.beginLoop(*now_us);
+    for (uint8_t ii = 0; ii < NUM_LOOP_STAGES; ii++)
+    {
+        *now_us += stage_us[ii];
+        dog.endStage(ii, *now_us);
+    }
+    return dog.endLoop(*now_us);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_within_budget_feeds(void)
+{
+    LoopWatchdog dog(Budgets_us, LOOP_BUDGET);
+    uint32_t now_us = 0xFFFFF000; // micros() wraps during the pass
+    const uint32_t stages[NUM_LOOP_STAGES]{1000, 4000, 10, 2000};
+    TEST_ASSERT_TRUE(runPass(dog, &now_us, stages));
+    TEST_ASSERT_EQUAL_UINT32(7010, dog.getLoop_us());
+    TEST_ASSERT_EQUAL_UINT32(4000, dog.getStage_us(LOOP_STAGE_CLIENT_DATA));
+    TEST_ASSERT_EQUAL_UINT32(0, dog.getOverruns());
+    LoopOverrunReport report;
+    TEST_ASSERT_FALSE(dog.takeReport(0, &report));
+}
+
+void test_split_stage_adds_up(void)
+{
+    // Clients is closed on both sides of the client data, like in loop()
+    LoopWatchdog dog(Budgets_us, LOOP_BUDGET);
+    dog.beginLoop(0);
+    dog.endStage(LOOP_STAGE_CLIENTS, 600);
+    dog.endStage(LOOP_STAGE_CLIENT_DATA, 700);
+    dog.endStage(LOOP_STAGE_CLIENTS, 1300);
+    TEST_ASSERT_FALSE(dog.endLoop(1300));
+    TEST_ASSERT_EQUAL_UINT32(1200, dog.getStage_us(LOOP_STAGE_CLIENTS));
+    TEST_ASSERT_EQUAL_UINT32(100, dog.getStage_us(LOOP_STAGE_CLIENT_DATA));
+
+    // Starts over on the next pass
+    dog.beginLoop(2000);
+    dog.endStage(LOOP_STAGE_CLIENTS, 2100);
+    TEST_ASSERT_TRUE(dog.endLoop(2100));
+    TEST_ASSERT_EQUAL_UINT32(100, dog.getStage_us(LOOP_STAGE_CLIENTS));
+}
+
+void test_stage_overrun_starves_and_reports_the_worst(void)
+{
+    LoopWatchdog dog(Budgets_us, LOOP_BUDGET);
+    uint32_t now_us = 0;
+    // Notifications 500 us over, client data 300 us over: notifications is the worst
+    const uint32_t blocked[NUM_LOOP_STAGES]{100, 5300, 100, 2500};
+    TEST_ASSERT_FALSE(runPass(dog, &now_us, blocked));
+    TEST_ASSERT_EQUAL_UINT32(1, dog.getOverruns());
+
+    LoopOverrunReport report;
+    TEST_ASSERT_TRUE(dog.takeReport(1, &report));
+    TEST_ASSERT_EQUAL_UINT32(1, report.overruns);
+    TEST_ASSERT_EQUAL_UINT8(LOOP_STAGE_NOTIFICATIONS, report.stage);
+    TEST_ASSERT_EQUAL_UINT32(2500, report.duration_us);
+    TEST_ASSERT_EQUAL_UINT32(2000, report.budget_us);
+    TEST_ASSERT_FALSE(dog.takeReport(2, &report));
+}
+
+void test_whole_loop_budget(void)
+{
+    // Every stage within its own budget, but not together
+    LoopWatchdog dog(Budgets_us, LOOP_BUDGET);
+    uint32_t now_us = 0;
+    const uint32_t stages[NUM_LOOP_STAGES]{1000, 5000, 5000, 0};
+    TEST_ASSERT_FALSE(runPass(dog, &now_us, stages));
+    LoopOverrunReport report;
+    TEST_ASSERT_TRUE(dog.takeReport(0, &report));
+    TEST_ASSERT_EQUAL_UINT8(NUM_LOOP_STAGES, report.stage);
+    TEST_ASSERT_EQUAL_UINT32(11000, report.duration_us);
+    TEST_ASSERT_EQUAL_UINT32(LOOP_BUDGET, report.budget_us);
+}
+
+void test_reports_are_rate_limited(void)
+{
+    LoopWatchdog dog(Budgets_us, LOOP_BUDGET);
+    uint32_t now_us = 0;
+    uint32_t now_ms = 0xFFFFFF00; // millis() wraps between reports
+    const uint32_t slow[NUM_LOOP_STAGES]{100, 100, 6000, 100};
+    const uint32_t stuck[NUM_LOOP_STAGES]{100, 100, 100, 300000};
+    LoopOverrunReport report;
+
+    TEST_ASSERT_FALSE(runPass(dog, &now_us, slow));
+    TEST_ASSERT_TRUE(dog.takeReport(now_ms, &report));
+
+    // Overruns inside the report period are held and counted into one report
+    uint32_t reports = 0;
+    for (uint16_t ii = 0; ii < 100; ii++)
+    {
+        runPass(dog, &now_us, (ii == 40) ? stuck : slow);
+        now_ms += 10;
+        reports += dog.takeReport(now_ms, &report) ? 1 : 0;
+    }
+    TEST_ASSERT_EQUAL_UINT32(1, reports);
+    TEST_ASSERT_EQUAL_UINT32(100, report.overruns);
+    TEST_ASSERT_EQUAL_UINT8(LOOP_STAGE_NOTIFICATIONS, report.stage);
+    TEST_ASSERT_EQUAL_UINT32(300000, report.duration_us);
+    TEST_ASSERT_EQUAL_UINT32(101, dog.getOverruns());
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_within_budget_feeds);
+    RUN_TEST(test_split_stage_adds_up);
+    RUN_TEST(test_stage_overrun_starves_and_reports_the_worst);
+    RUN_TEST(test_whole_loop_budget);
+    RUN_TEST(test_reports_are_rate_limited);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
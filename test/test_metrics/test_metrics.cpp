@@ -0,0 +1,87 @@
+#include <unity.h>
+#include <cstdint>
+#include <metrics.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+enum TEST_METRIC
+{
+    MOVES,
+    DROPS,
+    ISR_MAX_US,
+    NUM_METRICS
+};
+
+static const MetricDef MetricTable[NUM_METRICS] = {
+    {"Moves", METRIC_COUNTER},
+    {"Drops", METRIC_COUNTER},
+    {"IsrMax_us", METRIC_GAUGE},
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_counters_start_at_zero_and_increment(void)
+{
+    MetricsRegistry metrics(MetricTable, NUM_METRICS);
+    for (uint16_t id = 0; id < NUM_METRICS; id++)
+        TEST_ASSERT_EQUAL_UINT32(0, metrics.get(id));
+    metrics.increment(MOVES);
+    metrics.increment(MOVES);
+    metrics.increment(DROPS, 5);
+    TEST_ASSERT_EQUAL_UINT32(2, metrics.get(MOVES));
+    TEST_ASSERT_EQUAL_UINT32(5, metrics.get(DROPS));
+}
+
+void test_gauge_high_water_mark(void)
+{
+    MetricsRegistry metrics(MetricTable, NUM_METRICS);
+    metrics.updateMax(ISR_MAX_US, 12);
+    metrics.updateMax(ISR_MAX_US, 7);
+    TEST_ASSERT_EQUAL_UINT32(12, metrics.get(ISR_MAX_US));
+    metrics.updateMax(ISR_MAX_US, 30);
+    TEST_ASSERT_EQUAL_UINT32(30, metrics.get(ISR_MAX_US));
+    metrics.set(ISR_MAX_US, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get(ISR_MAX_US));
+}
+
+void test_unknown_ids_are_ignored(void)
+{
+    MetricsRegistry metrics(MetricTable, NUM_METRICS);
+    metrics.increment(NUM_METRICS);
+    metrics.updateMax(NUM_METRICS, 10);
+    TEST_ASSERT_EQUAL_UINT32(0, metrics.get(NUM_METRICS));
+    TEST_ASSERT_NULL(metrics.getDef(NUM_METRICS));
+    TEST_ASSERT_EQUAL_UINT16(NUM_METRICS, metrics.getNumMetrics());
+    TEST_ASSERT_EQUAL_STRING("Drops", metrics.getDef(DROPS)->name);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_counters_start_at_zero_and_increment);
+    RUN_TEST(test_gauge_high_water_mark);
+    RUN_TEST(test_unknown_ids_are_ignored);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,119 @@
+#include <unity.h>
+#include <cstdint>
+#include <cstdlib>
+#include <microstep_mode.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_supported_dividers_and_mode_pins(void)
+{
+    MicrostepMode mode;
+    TEST_ASSERT_EQUAL_UINT32(16, mode.getDivider());
+    TEST_ASSERT_EQUAL_INT32(1, mode.getScale());
+
+    const uint32_t invalid[]{0, 3, 12, 32};
+    for (uint32_t divider : invalid)
+        TEST_ASSERT_FALSE(mode.setDivider(divider));
+    TEST_ASSERT_EQUAL_UINT32(16, mode.getDivider());
+
+    // DRV8825 MODE2..0: 000 full, 001 half, 010 quarter, 011 eighth, 100 sixteenth
+    const uint32_t dividers[]{1, 2, 4, 8, 16};
+    for (uint8_t ii = 0; ii < 5; ii++)
+    {
+        TEST_ASSERT_TRUE(mode.setDivider(dividers[ii]));
+        TEST_ASSERT_EQUAL_UINT32(dividers[ii], mode.getDivider());
+        TEST_ASSERT_EQUAL_INT32((int32_t)(16 / dividers[ii]), mode.getScale());
+        TEST_ASSERT_EQUAL_UINT8(ii, mode.getModeBits());
+    }
+}
+
+void test_conversion_rounds_to_nearest_driver_step(void)
+{
+    MicrostepMode quarter;
+    quarter.setDivider(4); // 4 reference microsteps per driver step
+    TEST_ASSERT_EQUAL_INT32(25, quarter.toDriver(100));
+    TEST_ASSERT_EQUAL_INT32(25, quarter.toDriver(101));
+    TEST_ASSERT_EQUAL_INT32(26, quarter.toDriver(102));
+    TEST_ASSERT_EQUAL_INT32(-25, quarter.toDriver(-101));
+    TEST_ASSERT_EQUAL_INT32(-26, quarter.toDriver(-102));
+    TEST_ASSERT_EQUAL_INT32(-400, quarter.toReference(-100));
+    for (int32_t steps = -1000; steps <= 1000; steps += 7)
+        TEST_ASSERT_EQUAL_INT32(steps, quarter.toDriver(quarter.toReference(steps)));
+
+    TEST_ASSERT_TRUE(quarter.isAligned(-8));
+    TEST_ASSERT_FALSE(quarter.isAligned(-6));
+}
+
+void test_stroke_limits_land_on_every_grid(void)
+{
+    // The limit switch reference and workspace limits are exact in every mode
+    MicrostepMode mode;
+    for (uint32_t divider = 1; divider <= 16; divider *= 2)
+    {
+        mode.setDivider(divider);
+        TEST_ASSERT_TRUE(mode.isAligned((int32_t)STROKE_BOTTOM_STEPS));
+        TEST_ASSERT_TRUE(mode.isAligned((int32_t)WORKSPACE_ULIM_STEPS));
+        TEST_ASSERT_TRUE(mode.isAligned((int32_t)WORKSPACE_LLIM_STEPS));
+    }
+}
+
+void test_coarse_slew_then_fine_approach_keeps_resolution(void)
+{
+    MicrostepMode fine, coarse;
+    coarse.setDivider(1);
+
+    // Fine position off the full step grid, aligned to it before switching
+    int32_t counter = 12345;
+    TEST_ASSERT_FALSE(coarse.isAligned(fine.toReference(counter)));
+    counter = fine.toDriver(coarse.toReference(coarse.toDriver(fine.toReference(counter))));
+    TEST_ASSERT_EQUAL_INT32(12352, counter);
+    counter = coarse.rescale(counter, fine);
+    TEST_ASSERT_EQUAL_INT32(772, counter);
+
+    // Slew: 16x fewer driver steps for the same distance
+    const int32_t command = -30001;
+    int32_t slewSteps = std::abs(coarse.toDriver(command) - counter);
+    TEST_ASSERT_EQUAL_INT32((12352 + 30000) / 16, slewSteps);
+    counter = coarse.toDriver(command);
+    TEST_ASSERT_EQUAL_INT32(-30000, coarse.toReference(counter));
+
+    // Going finer is always exact, and the last reference microstep is reachable
+    counter = fine.rescale(counter, coarse);
+    TEST_ASSERT_EQUAL_INT32(-30000, fine.toReference(counter));
+    counter = fine.toDriver(command);
+    TEST_ASSERT_EQUAL_INT32(command, fine.toReference(counter));
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_supported_dividers_and_mode_pins);
+    RUN_TEST(test_conversion_rounds_to_nearest_driver_step);
+    RUN_TEST(test_stroke_limits_land_on_every_grid);
+    RUN_TEST(test_coarse_slew_then_fine_approach_keeps_resolution);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,88 @@
+"""
+Generates golden_vectors.h for the mirror kinematics tests.
+
+This is an independent implementation of the derivation in
+doc/PrimaryMirrorMath.mlx: the optical axis is rotated by the tip/tilt
+angles to get the tip/tilt vector, the tip/tilt plane through the mirror
+vertex is the plane with that normal, and each actuator offset is the
+distance from the base plane to the tip/tilt plane at the actuator
+coordinates, plus piston (focus). The actuator coordinates are the
+rounded values the firmware uses (MIRROR_MATH_COEFF_*).
+
+Usage: python3 gen_golden_vectors.py > golden_vectors.h
+"""
+import math
+import random
+
+# Actuator coordinates in the base frame [mm]
+MOTOR_XY = [(281.3, 0.0), (-140.6, 243.6), (-140.6, -243.6)]
+
+MICROSTEP_DIVIDER = 16
+MICRON_PER_STEP = 3.175 / MICROSTEP_DIVIDER
+STEPS_PER_MM = 1000.0 / MICRON_PER_STEP
+STROKE_STEPS = int(12700.0 / MICRON_PER_STEP)
+STROKE_ULIM = STROKE_STEPS // 2
+
+
+def rot_x(angle, v):
+    c, s = math.cos(angle), math.sin(angle)
+    return (v[0], c * v[1] - s * v[2], s * v[1] + c * v[2])
+
+
+def rot_y(angle, v):
+    c, s = math.cos(angle), math.sin(angle)
+    return (c * v[0] + s * v[2], v[1], -s * v[0] + c * v[2])
+
+
+def actuator_steps(tip, tilt, focus_mm):
+    # Tip/tilt vector: optical axis (e3) rotated by tilt then tip
+    n = rot_y(-tip, rot_x(tilt, (0.0, 0.0, 1.0)))
+    steps = []
+    for x, y in MOTOR_XY:
+        # Point on the plane n . p = 0 above (x, y), plus piston
+        z = -(n[0] * x + n[1] * y) / n[2] + focus_mm
+        steps.append(int(z * STEPS_PER_MM))  # truncates towards zero like the C cast
+    return steps
+
+
+def main():
+    rng = random.Random(0x1FA57)
+    vectors = []
+    grid = [-0.012, -0.004, 0.0, 0.004, 0.012]
+    for tip in grid:
+        for tilt in grid:
+            for focus in (-2.5, 0.0, 2.5):
+                vectors.append((tip, tilt, focus))
+    while len(vectors) < 200:
+        vectors.append((rng.uniform(-0.02, 0.02), rng.uniform(-0.02, 0.02), rng.uniform(-6.0, 6.0)))
+
+    print("// Generated by gen_golden_vectors.py, do not edit.")
+    print("#ifndef GOLDEN_VECTORS_H")
+    print("#define GOLDEN_VECTORS_H")
+    print("")
+    print("#include <cstdint>")
+    print("")
+    print("struct GoldenVector")
+    print("{")
+    print("    double tip_rad;")
+    print("    double tilt_rad;")
+    print("    double focus_mm;")
+    print("    int32_t steps[3];")
+    print("};")
+    print("")
+    print("const GoldenVector GOLDEN_VECTORS[] = {")
+    count = 0
+    for tip, tilt, focus in vectors:
+        steps = actuator_steps(tip, tilt, focus)
+        if any(abs(s) > STROKE_ULIM for s in steps):
+            continue
+        print("    {%.17g, %.17g, %.17g, {%d, %d, %d}}," % (tip, tilt, focus, steps[0], steps[1], steps[2]))
+        count += 1
+    print("};")
+    print("constexpr uint32_t NUM_GOLDEN_VECTORS = %d;" % count)
+    print("")
+    print("#endif")
+
+
+if __name__ == "__main__":
+    main()
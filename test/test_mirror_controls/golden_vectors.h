@@ -0,0 +1,149 @@
+// Generated by gen_golden_vectors.py, do not edit.
+#ifndef GOLDEN_VECTORS_H
+#define GOLDEN_VECTORS_H
+
+#include <cstdint>
+
+struct GoldenVector
+{
+    double tip_rad;
+    double tilt_rad;
+    double focus_mm;
+    int32_t steps[3];
+};
+
+const GoldenVector GOLDEN_VECTORS[] = {
+    {-0.012, -0.012, -2.5, {-29610, -18828, 10637}},
+    {-0.012, -0.012, 0, {-17011, -6230, 23235}},
+    {-0.012, -0.0040000000000000001, -2.5, {-29610, -9006, 815}},
+    {-0.012, -0.0040000000000000001, 0, {-17011, 3592, 13413}},
+    {-0.012, -0.0040000000000000001, 2.5, {-4413, 16190, 26012}},
+    {-0.012, 0, -2.5, {-29610, -4095, -4095}},
+    {-0.012, 0, 0, {-17011, 8502, 8502}},
+    {-0.012, 0, 2.5, {-4413, 21101, 21101}},
+    {-0.012, 0.0040000000000000001, -2.5, {-29610, 815, -9006}},
+    {-0.012, 0.0040000000000000001, 0, {-17011, 13413, 3592}},
+    {-0.012, 0.0040000000000000001, 2.5, {-4413, 26012, 16190}},
+    {-0.012, 0.012, -2.5, {-29610, 10637, -18828}},
+    {-0.012, 0.012, 0, {-17011, 23235, -6230}},
+    {-0.0040000000000000001, -0.012, -2.5, {-18268, -24496, 4967}},
+    {-0.0040000000000000001, -0.012, 0, {-5670, -11897, 17566}},
+    {-0.0040000000000000001, -0.012, 2.5, {6928, 700, 30164}},
+    {-0.0040000000000000001, -0.0040000000000000001, -2.5, {-18268, -14674, -4853}},
+    {-0.0040000000000000001, -0.0040000000000000001, 0, {-5670, -2076, 7744}},
+    {-0.0040000000000000001, -0.0040000000000000001, 2.5, {6928, 10522, 20343}},
+    {-0.0040000000000000001, 0, -2.5, {-18268, -9764, -9764}},
+    {-0.0040000000000000001, 0, 0, {-5670, 2834, 2834}},
+    {-0.0040000000000000001, 0, 2.5, {6928, 15432, 15432}},
+    {-0.0040000000000000001, 0.0040000000000000001, -2.5, {-18268, -4853, -14674}},
+    {-0.0040000000000000001, 0.0040000000000000001, 0, {-5670, 7744, -2076}},
+    {-0.0040000000000000001, 0.0040000000000000001, 2.5, {6928, 20343, 10522}},
+    {-0.0040000000000000001, 0.012, -2.5, {-18268, 4967, -24496}},
+    {-0.0040000000000000001, 0.012, 0, {-5670, 17566, -11897}},
+    {-0.0040000000000000001, 0.012, 2.5, {6928, 30164, 700}},
+    {0, -0.012, -2.5, {-12598, -27330, 2133}},
+    {0, -0.012, 0, {0, -14731, 14731}},
+    {0, -0.012, 2.5, {12598, -2133, 27330}},
+    {0, -0.0040000000000000001, -2.5, {-12598, -17508, -7688}},
+    {0, -0.0040000000000000001, 0, {0, -4910, 4910}},
+    {0, -0.0040000000000000001, 2.5, {12598, 7688, 17508}},
+    {0, 0, -2.5, {-12598, -12598, -12598}},
+    {0, 0, 0, {0, 0, 0}},
+    {0, 0, 2.5, {12598, 12598, 12598}},
+    {0, 0.0040000000000000001, -2.5, {-12598, -7688, -17508}},
+    {0, 0.0040000000000000001, 0, {0, 4910, -4910}},
+    {0, 0.0040000000000000001, 2.5, {12598, 17508, 7688}},
+    {0, 0.012, -2.5, {-12598, 2133, -27330}},
+    {0, 0.012, 0, {0, 14731, -14731}},
+    {0, 0.012, 2.5, {12598, 27330, -2133}},
+    {0.0040000000000000001, -0.012, -2.5, {-6928, -30164, -700}},
+    {0.0040000000000000001, -0.012, 0, {5670, -17566, 11897}},
+    {0.0040000000000000001, -0.012, 2.5, {18268, -4967, 24496}},
+    {0.0040000000000000001, -0.0040000000000000001, -2.5, {-6928, -20343, -10522}},
+    {0.0040000000000000001, -0.0040000000000000001, 0, {5670, -7744, 2076}},
+    {0.0040000000000000001, -0.0040000000000000001, 2.5, {18268, 4853, 14674}},
+    {0.0040000000000000001, 0, -2.5, {-6928, -15432, -15432}},
+    {0.0040000000000000001, 0, 0, {5670, -2834, -2834}},
+    {0.0040000000000000001, 0, 2.5, {18268, 9764, 9764}},
+    {0.0040000000000000001, 0.0040000000000000001, -2.5, {-6928, -10522, -20343}},
+    {0.0040000000000000001, 0.0040000000000000001, 0, {5670, 2076, -7744}},
+    {0.0040000000000000001, 0.0040000000000000001, 2.5, {18268, 14674, 4853}},
+    {0.0040000000000000001, 0.012, -2.5, {-6928, -700, -30164}},
+    {0.0040000000000000001, 0.012, 0, {5670, 11897, -17566}},
+    {0.0040000000000000001, 0.012, 2.5, {18268, 24496, -4967}},
+    {0.012, -0.012, 0, {17011, -23235, 6230}},
+    {0.012, -0.012, 2.5, {29610, -10637, 18828}},
+    {0.012, -0.0040000000000000001, -2.5, {4413, -26012, -16190}},
+    {0.012, -0.0040000000000000001, 0, {17011, -13413, -3592}},
+    {0.012, -0.0040000000000000001, 2.5, {29610, -815, 9006}},
+    {0.012, 0, -2.5, {4413, -21101, -21101}},
+    {0.012, 0, 0, {17011, -8502, -8502}},
+    {0.012, 0, 2.5, {29610, 4095, 4095}},
+    {0.012, 0.0040000000000000001, -2.5, {4413, -16190, -26012}},
+    {0.012, 0.0040000000000000001, 0, {17011, -3592, -13413}},
+    {0.012, 0.0040000000000000001, 2.5, {29610, 9006, -815}},
+    {0.012, 0.012, 0, {17011, 6230, -23235}},
+    {0.012, 0.012, 2.5, {29610, 18828, -10637}},
+    {0.006420336295062383, -0.0011328616158320266, -3.3784960650515679, {-7924, -22965, -20183}},
+    {-0.0024353520040561079, -0.013683488444199438, -2.3681574628213569, {-15386, -27007, 6590}},
+    {0.0063774763144516383, 0.019089247698610267, 0.63870995618178394, {12259, 22137, -24737}},
+    {-0.014118522120011329, 0.013935715681872487, -1.6234233351598704, {-28196, 18933, -15287}},
+    {-0.01078387735042678, -0.019947727466752396, -0.12966644926258475, {-15940, -17504, 31479}},
+    {-0.0051203627247483757, -0.010010493746435686, 1.6407443448433359, {1009, -393, 24185}},
+    {-0.013880385597199424, -0.018920897276788633, -1.4958996007167826, {-27216, -20935, 25529}},
+    {-0.0070970488329935352, -0.0045638963779600552, -0.56274394854416698, {-12896, -3410, 7795}},
+    {-0.0029156143830924922, 0.0033448765163058176, 0.64559280049472356, {-879, 9425, 1213}},
+    {0.019886209746616073, -0.0044205586906867472, 0.32683476454845728, {29840, -17872, -7017}},
+    {0.0090097521204362714, -0.0082256483402774715, -2.296997563447182, {1196, -28057, -7860}},
+    {0.0089601601229045251, 0.019132742024633092, 1.2230156441020084, {18865, 23305, -23676}},
+    {0.0012159670271382483, 0.014830595921417455, 1.8207988885289943, {10899, 26521, -9893}},
+    {-0.0034867759967098962, 0.010575057899945325, 1.0005750081575115, {99, 20495, -5469}},
+    {3.5680192151527068e-08, -0.004780976466047861, 2.288962242884601, {11534, 5665, 17404}},
+    {-0.0074127846639207642, 0.019978304497775243, -2.114508873099616, {-21164, 19125, -29932}},
+    {0.011372428281390744, -0.0052807981535935473, 0.26334888241590537, {17449, -13214, -247}},
+    {-0.00024224129788317367, 0.0026571863895174935, 3.752376682582593, {18566, 22343, 15819}},
+    {-0.0044360485254078211, -0.0046083239904419135, -0.8458237045369108, {-10550, -6776, 4537}},
+    {6.1940460602486619e-05, -0.00055654009146433384, 4.3122928260651747, {21819, 21004, 22370}},
+    {0.014724485325278602, -0.0069069198588101663, -1.5987579263969929, {12817, -26970, -10010}},
+    {-5.7702993450311352e-05, 0.00086127385063865594, -1.7312895046046144, {-8806, -7626, -9741}},
+    {-0.002847707200759917, -0.011286066283304112, 0.3903133171251465, {-2069, -9870, 17839}},
+    {0.0050887244243808458, -0.0044665361250998577, -3.3094695187604515, {-9463, -25766, -14800}},
+    {-0.00046588983448662968, -0.011852982565509743, -2.2549516920587616, {-12023, -25584, 3517}},
+    {-0.011306014128624371, 0.0093579264463751199, 0.086257866910083081, {-15593, 19934, -3043}},
+    {-0.0039417499785208247, 0.012673387591173656, 2.5720800700738131, {7373, 31313, 195}},
+    {-0.0065737754834992411, -0.010838751739654406, -2.0988019857852795, {-19895, -19225, 7387}},
+    {-0.0087227731336720366, -0.0099853692168594722, -3.7221214486387129, {-31122, -24835, -317}},
+    {0.0069395343662721209, 0.0045652357036801844, -0.90217475211966125, {5291, -3858, -15067}},
+    {-0.014647486680981925, -0.006427422191542723, 0.64981219662954803, {-17490, 5762, 21544}},
+    {-0.0033958152932596665, 0.0025399776833266718, 2.6393868595779288, {8487, 18824, 12588}},
+    {-0.0026930723817247953, -0.015807571118579535, -1.4962264926896678, {-11357, -25038, 13775}},
+    {-0.0078324562273728755, -0.010069528843676135, 1.7564941649500767, {-2251, 2039, 26763}},
+    {0.0088245029608497831, 0.0045547835039871747, 0.41966248624871838, {14624, 1453, -9729}},
+    {-0.0077669110244875175, 0.0041587172909351225, 1.4113863784038934, {-3897, 17721, 7510}},
+    {0.0045822829368471762, 0.011617390208251217, -2.0405940399246645, {-3787, 732, -27792}},
+    {0.0091558958791978021, 0.014314251281002954, -0.77900600863748259, {9053, 7160, -27987}},
+    {0.00036569925647930365, 0.0043427179842931013, 0.92990543166692952, {5204, 9758, -904}},
+    {-0.0036814541343283408, -0.010243090901266573, 2.8868126467489184, {9328, 4581, 29731}},
+    {-0.0092770143046883476, -0.0013128237868710486, 3.1328353089535277, {2636, 20749, 23972}},
+    {0.0041344151940268942, 0.0091882081199500289, 1.8075711465367981, {14969, 17459, -5100}},
+    {-0.0014278764646388914, -0.014308067919515138, -1.7109122072993763, {-10646, -25175, 9955}},
+    {-0.0047938985903048931, 0.0185125644586135, -0.72784783643616269, {-10463, 22457, -22999}},
+    {0.010667071100382119, -0.0020395556541778354, 1.0368405574267499, {20346, -4837, 170}},
+    {0.015040066880177169, -0.0069254842684417471, -0.80902807930567544, {17245, -23236, -6231}},
+    {0.015170642879447031, 0.019242241781022015, 0.64550605922781568, {24760, 16130, -31124}},
+    {-0.0096859068823892357, 0.007133085381033237, -3.5175905336095941, {-31457, -2106, -19620}},
+    {0.0078072191985079399, -0.014165616863165363, 1.3006113237509362, {17621, -16368, 18413}},
+    {-0.0036048995050184246, -0.0088991819530252012, 1.5485493930577334, {2693, -566, 21282}},
+    {-0.013791661053897335, -0.0091298842945611233, -1.1968911138267009, {-25583, -7468, 14950}},
+    {-0.014889228196862763, -0.018081263324765857, -1.4937079886700522, {-28635, -19178, 25224}},
+    {-0.010117998658755366, -0.00091115896515238382, -2.5918869912921854, {-27404, -7010, -4773}},
+    {-0.0072662089413529068, 0.0031040671312438442, -1.9801248452999669, {-20279, -1019, -8640}},
+    {0.00072704582676491949, 0.019698387351674184, 0.70653051542444167, {4591, 27230, -21139}},
+    {0.0068044802755877938, 0.0041935107103886655, 4.2578056903169816, {31102, 21783, 11487}},
+    {-0.010712970873702732, 0.017887517627932992, -2.3707840797750404, {-27134, 17605, -26318}},
+    {-0.0094793984184974676, -0.0022673517208714432, 3.6964053258242959, {5189, 22560, 28127}},
+    {0.00073573737956504626, 0.011849710190598186, -0.55195937545585494, {-1738, 11244, -17850}},
+};
+constexpr uint32_t NUM_GOLDEN_VECTORS = 130;
+
+#endif
@@ -0,0 +1,338 @@
+#include <unity.h>
+#include <cstdint>
+#include <cmath>
+#include <mirror_kinematics.h>
+#include "golden_vectors.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+// Accuracy budgets. Truncating to whole steps costs at most one step
+// (~0.2um) per actuator, which maps to well under a microradian.
+constexpr int32_t GOLDEN_STEP_TOLERANCE = 1;
+constexpr double ROUND_TRIP_ANGLE_TOL_RAD = 1.0e-6;
+constexpr double ROUND_TRIP_FOCUS_TOL_MM = 2.0 * MM_PER_STEP;
+
+// Speed budgets for one forward or inverse kinematics call
+#ifdef ARDUINO
+constexpr uint32_t KINEMATICS_MAX_CYCLES_PER_CALL = 4000;
+#else
+constexpr double KINEMATICS_MAX_NS_PER_CALL = 500.0;
+#endif
+
+constexpr uint32_t NUM_PROPERTY_SAMPLES = 5000;
+constexpr uint32_t NUM_BENCHMARK_CALLS = 10000;
+
+// Small deterministic PRNG so failures are reproducible on every target
+static uint32_t rngState;
+static uint32_t nextRandom()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+static double randomUniform(double lo, double hi)
+{
+    return lo + (hi - lo) * ((double)nextRandom() / 4294967295.0);
+}
+
+static void setPose(MirrorStates *pose, double tip, double tilt, double focus)
+{
+    pose->TIP_POS_RAD = tip;
+    pose->TILT_POS_RAD = tilt;
+    pose->FOCUS_POS_MM = focus;
+}
+
+void setUp(void)
+{
+    rngState = 0x1FA57;
+}
+
+void tearDown(void)
+{
+}
+
+void test_forward_matches_golden_vectors(void)
+{
+    for (uint32_t ii = 0; ii < NUM_GOLDEN_VECTORS; ii++)
+    {
+        const GoldenVector &gv = GOLDEN_VECTORS[ii];
+        MirrorStates pose;
+        setPose(&pose, gv.tip_rad, gv.tilt_rad, gv.focus_mm);
+        int32_t a = 0, b = 0, c = 0;
+        uint8_t status = pose.getMotorPosnCommands(&a, &b, &c);
+        TEST_ASSERT_EQUAL_UINT8(LFAST::PMC::IN_RANGE, status);
+        TEST_ASSERT_INT32_WITHIN(GOLDEN_STEP_TOLERANCE, gv.steps[0], a);
+        TEST_ASSERT_INT32_WITHIN(GOLDEN_STEP_TOLERANCE, gv.steps[1], b);
+        TEST_ASSERT_INT32_WITHIN(GOLDEN_STEP_TOLERANCE, gv.steps[2], c);
+    }
+}
+
+void test_inverse_matches_golden_vectors(void)
+{
+    for (uint32_t ii = 0; ii < NUM_GOLDEN_VECTORS; ii++)
+    {
+        const GoldenVector &gv = GOLDEN_VECTORS[ii];
+        MotorStates motors(gv.steps[0], gv.steps[1], gv.steps[2]);
+        double tip, tilt, focus;
+        motors.getTipTiltFocusFeedback(&tip, &tilt, &focus);
+        TEST_ASSERT_DOUBLE_WITHIN(ROUND_TRIP_ANGLE_TOL_RAD, gv.tip_rad, tip);
+        TEST_ASSERT_DOUBLE_WITHIN(ROUND_TRIP_ANGLE_TOL_RAD, gv.tilt_rad, tilt);
+        TEST_ASSERT_DOUBLE_WITHIN(ROUND_TRIP_FOCUS_TOL_MM, gv.focus_mm, focus);
+    }
+}
+
+// steps -> pose -> steps, sampled uniformly over the whole stroke box
+void test_round_trip_over_workspace(void)
+{
+    for (uint32_t ii = 0; ii < NUM_PROPERTY_SAMPLES; ii++)
+    {
+        int32_t steps[3];
+        for (uint8_t jj = 0; jj < 3; jj++)
+            steps[jj] = (int32_t)randomUniform(WORKSPACE_LLIM_STEPS, WORKSPACE_ULIM_STEPS);
+
+        MotorStates motors(steps[0], steps[1], steps[2]);
+        MirrorStates pose;
+        double tip, tilt, focus;
+        motors.getTipTiltFocusFeedback(&tip, &tilt, &focus);
+        setPose(&pose, tip, tilt, focus);
+
+        int32_t a = 0, b = 0, c = 0;
+        pose.getMotorPosnCommands(&a, &b, &c);
+        TEST_ASSERT_INT32_WITHIN(1, steps[0], a);
+        TEST_ASSERT_INT32_WITHIN(1, steps[1], b);
+        TEST_ASSERT_INT32_WITHIN(1, steps[2], c);
+    }
+}
+
+// pose -> steps -> pose for reachable poses
+void test_pose_round_trip(void)
+{
+    uint32_t numChecked = 0;
+    for (uint32_t ii = 0; ii < NUM_PROPERTY_SAMPLES; ii++)
+    {
+        double tip = randomUniform(-0.03, 0.03);
+        double tilt = randomUniform(-0.03, 0.03);
+        double focus = randomUniform(-6.35, 6.35);
+        ActuatorDemand demand;
+        MirrorWorkspace::computeDemand(std::tan(tip), std::tan(tilt) / std::cos(tip), focus, &demand);
+        if (!MirrorWorkspace::isReachable(demand))
+            continue;
+
+        MirrorStates pose;
+        setPose(&pose, tip, tilt, focus);
+        int32_t a = 0, b = 0, c = 0;
+        TEST_ASSERT_EQUAL_UINT8(LFAST::PMC::IN_RANGE, pose.getMotorPosnCommands(&a, &b, &c));
+
+        double tipFb, tiltFb, focusFb;
+        MotorStates(a, b, c).getTipTiltFocusFeedback(&tipFb, &tiltFb, &focusFb);
+        TEST_ASSERT_DOUBLE_WITHIN(ROUND_TRIP_ANGLE_TOL_RAD, tip, tipFb);
+        TEST_ASSERT_DOUBLE_WITHIN(ROUND_TRIP_ANGLE_TOL_RAD, tilt, tiltFb);
+        TEST_ASSERT_DOUBLE_WITHIN(ROUND_TRIP_FOCUS_TOL_MM, focus, focusFb);
+        numChecked++;
+    }
+    TEST_ASSERT_GREATER_THAN_UINT32(NUM_PROPERTY_SAMPLES / 10, numChecked);
+}
+
+// The unrounded targets TRACK mode follows truncate to the point-to-point commands
+void test_exact_step_targets_match_commands(void)
+{
+    for (uint32_t ii = 0; ii < NUM_PROPERTY_SAMPLES; ii++)
+    {
+        MirrorStates pose;
+        setPose(&pose, randomUniform(-0.05, 0.05), randomUniform(-0.05, 0.05), randomUniform(-8.0, 8.0));
+        for (uint8_t policy = LFAST::PMC::PRESERVE_TIP_TILT; policy <= LFAST::PMC::REJECT_COMMAND; policy++)
+        {
+            int32_t steps[3]{0, 0, 0};
+            double exact[3]{0.0, 0.0, 0.0};
+            uint8_t status = pose.getMotorPosnCommands(&steps[0], &steps[1], &steps[2], policy);
+            TEST_ASSERT_EQUAL_UINT8(status, pose.getMotorStepTargets(exact, policy));
+            if (status == LFAST::PMC::REJECTED)
+                continue;
+            for (uint8_t motor = 0; motor < 3; motor++)
+                TEST_ASSERT_EQUAL_INT32(steps[motor], (int32_t)exact[motor]);
+        }
+    }
+}
+
+// Every saturation policy must either reject or land inside the stroke,
+// and must keep the quantity it promises to keep.
+void test_saturation_policies(void)
+{
+    for (uint32_t ii = 0; ii < NUM_PROPERTY_SAMPLES; ii++)
+    {
+        MirrorStates pose;
+        setPose(&pose, randomUniform(-0.05, 0.05), randomUniform(-0.05, 0.05), randomUniform(-12.0, 12.0));
+
+        for (uint8_t policy = LFAST::PMC::PRESERVE_TIP_TILT; policy <= LFAST::PMC::REJECT_COMMAND; policy++)
+        {
+            int32_t steps[3]{12345, 12345, 12345};
+            MirrorStates projected;
+            uint8_t status = pose.getMotorPosnCommands(&steps[0], &steps[1], &steps[2], policy, &projected);
+            if (status == LFAST::PMC::REJECTED)
+            {
+                TEST_ASSERT_EQUAL_UINT8(LFAST::PMC::REJECT_COMMAND, policy);
+                TEST_ASSERT_EQUAL_INT32(12345, steps[0]);
+                continue;
+            }
+            for (uint8_t jj = 0; jj < 3; jj++)
+            {
+                TEST_ASSERT_TRUE(steps[jj] >= WORKSPACE_LLIM_STEPS);
+                TEST_ASSERT_TRUE(steps[jj] <= WORKSPACE_ULIM_STEPS);
+            }
+            if (status != LFAST::PMC::SATURATED)
+                continue;
+
+            ActuatorDemand requested;
+            MirrorWorkspace::computeDemand(std::tan(pose.TIP_POS_RAD),
+                                           std::tan(pose.TILT_POS_RAD) / std::cos(pose.TIP_POS_RAD),
+                                           pose.FOCUS_POS_MM, &requested);
+            double span = std::max({requested.tipTiltSteps[0], requested.tipTiltSteps[1], requested.tipTiltSteps[2]}) -
+                          std::min({requested.tipTiltSteps[0], requested.tipTiltSteps[1], requested.tipTiltSteps[2]});
+            if (policy == LFAST::PMC::PRESERVE_TIP_TILT && span <= (WORKSPACE_ULIM_STEPS - WORKSPACE_LLIM_STEPS))
+            {
+                TEST_ASSERT_DOUBLE_WITHIN(1.0e-12, pose.TIP_POS_RAD, projected.TIP_POS_RAD);
+                TEST_ASSERT_DOUBLE_WITHIN(1.0e-12, pose.TILT_POS_RAD, projected.TILT_POS_RAD);
+            }
+            if (policy == LFAST::PMC::PRESERVE_FOCUS && std::abs(requested.focusSteps) <= WORKSPACE_ULIM_STEPS)
+            {
+                TEST_ASSERT_DOUBLE_WITHIN(1.0e-12, pose.FOCUS_POS_MM, projected.FOCUS_POS_MM);
+            }
+        }
+    }
+}
+
+// After homing every actuator sits at the bottom of its stroke. A relative
+// command from there that stays in the stroke must not be saturated or rejected.
+void test_relative_command_after_homing_is_in_range(void)
+{
+    int32_t bottom = (int32_t)STROKE_BOTTOM_STEPS;
+    MirrorStates homed;
+    homed.setFromFeedback(MotorStates(bottom, bottom, bottom));
+    TEST_ASSERT_DOUBLE_WITHIN(1.0e-12, 0.0, homed.TIP_POS_RAD);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0e-12, 0.0, homed.TILT_POS_RAD);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0e-9, STROKE_BOTTOM_STEPS * MM_PER_STEP, homed.FOCUS_POS_MM);
+
+    for (uint8_t policy = LFAST::PMC::PRESERVE_TIP_TILT; policy <= LFAST::PMC::REJECT_COMMAND; policy++)
+    {
+        int32_t steps[3];
+        MirrorStates pose = homed;
+        TEST_ASSERT_EQUAL_UINT8(LFAST::PMC::IN_RANGE, pose.getMotorPosnCommands(&steps[0], &steps[1], &steps[2], policy));
+        for (uint8_t jj = 0; jj < 3; jj++)
+            TEST_ASSERT_EQUAL_INT32(bottom, steps[jj]);
+
+        pose.FOCUS_POS_MM = pose.FOCUS_POS_MM + 1.0;
+        TEST_ASSERT_EQUAL_UINT8(LFAST::PMC::IN_RANGE, pose.getMotorPosnCommands(&steps[0], &steps[1], &steps[2], policy));
+        for (uint8_t jj = 0; jj < 3; jj++)
+            TEST_ASSERT_INT32_WITHIN(1, bottom + (int32_t)STEPS_PER_MM, steps[jj]);
+    }
+}
+
+void test_batched_reachability(void)
+{
+    constexpr uint32_t batchSize = 64;
+    ActuatorDemand demands[batchSize];
+    bool reachable[batchSize];
+    uint32_t expectedUnreachable = 0;
+    for (uint32_t ii = 0; ii < batchSize; ii++)
+    {
+        MirrorWorkspace::computeDemand(randomUniform(-0.03, 0.03), randomUniform(-0.03, 0.03),
+                                       randomUniform(-8.0, 8.0), &demands[ii]);
+        if (!MirrorWorkspace::isReachable(demands[ii]))
+            expectedUnreachable++;
+    }
+    TEST_ASSERT_EQUAL_UINT32(expectedUnreachable, MirrorWorkspace::checkReachable(demands, reachable, batchSize));
+    for (uint32_t ii = 0; ii < batchSize; ii++)
+        TEST_ASSERT_EQUAL(MirrorWorkspace::isReachable(demands[ii]), reachable[ii]);
+}
+
+template <typename F>
+static double measureCostPerCall(F func)
+{
+#ifdef ARDUINO
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    uint32_t start = ARM_DWT_CYCCNT;
+    for (uint32_t ii = 0; ii < NUM_BENCHMARK_CALLS; ii++)
+        func(ii);
+    return (double)(ARM_DWT_CYCCNT - start) / NUM_BENCHMARK_CALLS;
+#else
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t ii = 0; ii < NUM_BENCHMARK_CALLS; ii++)
+        func(ii);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / NUM_BENCHMARK_CALLS;
+#endif
+}
+
+static void checkCostBudget(const char *label, double costPerCall)
+{
+    char msg[96];
+#ifdef ARDUINO
+    snprintf(msg, sizeof(msg), "%s: %.1f cycles/call", label, costPerCall);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE_MESSAGE(costPerCall <= KINEMATICS_MAX_CYCLES_PER_CALL, msg);
+#else
+    snprintf(msg, sizeof(msg), "%s: %.1f ns/call", label, costPerCall);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE_MESSAGE(costPerCall <= KINEMATICS_MAX_NS_PER_CALL, msg);
+#endif
+}
+
+void test_benchmark_forward_kinematics(void)
+{
+    volatile int32_t sink = 0;
+    double cost = measureCostPerCall([&](uint32_t ii) {
+        MirrorStates pose;
+        setPose(&pose, 1.0e-6 * (ii % 1000), -1.0e-6 * (ii % 700), 1.0e-3 * (ii % 500));
+        int32_t a = 0, b = 0, c = 0;
+        pose.getMotorPosnCommands(&a, &b, &c);
+        sink = sink + a + b + c;
+    });
+    checkCostBudget("Forward kinematics", cost);
+}
+
+void test_benchmark_inverse_kinematics(void)
+{
+    volatile double sink = 0;
+    double cost = measureCostPerCall([&](uint32_t ii) {
+        double tip, tilt, focus;
+        MotorStates((int32_t)ii, -(int32_t)ii, (int32_t)(ii / 2)).getTipTiltFocusFeedback(&tip, &tilt, &focus);
+        sink = sink + tip + tilt + focus;
+    });
+    checkCostBudget("Inverse kinematics", cost);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_forward_matches_golden_vectors);
+    RUN_TEST(test_inverse_matches_golden_vectors);
+    RUN_TEST(test_round_trip_over_workspace);
+    RUN_TEST(test_pose_round_trip);
+    RUN_TEST(test_exact_step_targets_match_commands);
+    RUN_TEST(test_saturation_policies);
+    RUN_TEST(test_relative_command_after_homing_is_in_range);
+    RUN_TEST(test_batched_reachability);
+    RUN_TEST(test_benchmark_forward_kinematics);
+    RUN_TEST(test_benchmark_inverse_kinematics);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
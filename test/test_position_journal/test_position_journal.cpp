@@ -0,0 +1,326 @@
+#include <unity.h>
+#include <cstdint>
+#include <cstdio>
+#include <position_journal.h>
+#include <simulated_storage.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t JOURNAL_START = 0;
+constexpr uint32_t JOURNAL_SIZE = 1024;
+
+// Endurance benchmark load: a commit clears the stationary marker when a
+// move starts and another one lands the final position.
+constexpr uint32_t BENCHMARK_MOVES = 20000;
+constexpr uint32_t COMMITS_PER_MOVE = 2;
+constexpr double MOVES_PER_HOUR = 120.0;
+constexpr double MIN_JOURNAL_LIFETIME_YEARS = 10.0;
+
+static uint32_t rngState;
+static uint32_t nextRandom()
+{
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState;
+}
+
+static PositionRecord makeRecord(uint16_t flags, int32_t a, int32_t b, int32_t c)
+{
+    PositionRecord record;
+    record.flags = flags;
+    record.position[0] = a;
+    record.position[1] = b;
+    record.position[2] = c;
+    return record;
+}
+
+static void appendMany(PositionJournal &journal, uint32_t count)
+{
+    for (uint32_t ii = 0; ii < count; ii++)
+    {
+        PositionRecord record = makeRecord(POSITION_FLAG_STATIONARY, ii, -(int32_t)ii, 2 * ii);
+        journal.append(record);
+    }
+}
+
+void setUp(void)
+{
+    rngState = 0x1FA57;
+}
+
+void tearDown(void)
+{
+}
+
+void test_blank_region_is_empty(void)
+{
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    PositionRecord record;
+    TEST_ASSERT_FALSE(journal.begin());
+    TEST_ASSERT_FALSE(journal.getNewest(&record));
+
+    // Formatted on the first boot, so the next scan takes the fast path
+    PositionJournal rebooted(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    TEST_ASSERT_FALSE(rebooted.begin());
+}
+
+void test_newest_record_found_after_wrapping(void)
+{
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    journal.begin();
+    uint32_t numSlots = journal.getNumSlots();
+
+    // Every slot count around and past one lap of the ring
+    for (uint32_t count = 1; count <= 3 * numSlots; count++)
+    {
+        PositionRecord record = makeRecord(POSITION_FLAG_HOMED, count, count + 1, count + 2);
+        journal.append(record);
+
+        PositionJournal rebooted(eeprom, JOURNAL_START, JOURNAL_SIZE);
+        PositionRecord newest;
+        TEST_ASSERT_TRUE(rebooted.begin());
+        TEST_ASSERT_TRUE(rebooted.getNewest(&newest));
+        TEST_ASSERT_FALSE(rebooted.wasLastScanLinear());
+        TEST_ASSERT_EQUAL_INT32((int32_t)count, newest.position[0]);
+        TEST_ASSERT_EQUAL_UINT32(count % numSlots, rebooted.getHead());
+    }
+}
+
+void test_fast_scan_is_logarithmic(void)
+{
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    journal.begin();
+    appendMany(journal, journal.getNumSlots() + 7);
+
+    PositionJournal rebooted(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    rebooted.begin();
+    uint32_t log2Slots = 0;
+    while ((1u << log2Slots) < rebooted.getNumSlots())
+        log2Slots++;
+    // First slot, the search itself and the consistency check on the next slot
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(log2Slots + 2, rebooted.getScanSlotReads());
+}
+
+void test_torn_write_falls_back_to_previous_record(void)
+{
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    journal.begin();
+    appendMany(journal, 10);
+    uint32_t tornSlot = journal.getHead();
+    PositionRecord record = makeRecord(POSITION_FLAG_STATIONARY, 1000, 1000, 1000);
+    journal.append(record);
+
+    // Lose the tail of the last record
+    uint32_t tornAddr = JOURNAL_START + sizeof(PositionJournalHeader) + tornSlot * PositionJournal::SLOT_SIZE;
+    eeprom.poke(tornAddr + offsetof(PositionRecord, crc), 0x00);
+    eeprom.poke(tornAddr + offsetof(PositionRecord, crc) + 1, 0x00);
+
+    PositionJournal rebooted(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    PositionRecord newest;
+    TEST_ASSERT_TRUE(rebooted.begin());
+    TEST_ASSERT_TRUE(rebooted.getNewest(&newest));
+    TEST_ASSERT_EQUAL_INT32(9, newest.position[0]);
+    TEST_ASSERT_EQUAL_UINT32(tornSlot, rebooted.getHead());
+}
+
+void test_corrupt_first_slot_is_compacted(void)
+{
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    journal.begin();
+    appendMany(journal, journal.getNumSlots() + 1); // Newest record is in slot 0
+    appendMany(journal, 4);                          // ...now slot 4
+    eeprom.poke(JOURNAL_START + sizeof(PositionJournalHeader), 0x5A);
+
+    PositionJournal rebooted(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    PositionRecord newest;
+    TEST_ASSERT_TRUE(rebooted.begin());
+    TEST_ASSERT_TRUE(rebooted.wasLastScanLinear());
+    TEST_ASSERT_TRUE(rebooted.getNewest(&newest));
+    TEST_ASSERT_EQUAL_INT32(3, newest.position[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, rebooted.getHead());
+
+    // Compaction restored the ring, so the following boot is fast again
+    PositionJournal again(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    TEST_ASSERT_TRUE(again.begin());
+    TEST_ASSERT_FALSE(again.wasLastScanLinear());
+    TEST_ASSERT_TRUE(again.getNewest(&newest));
+    TEST_ASSERT_EQUAL_INT32(3, newest.position[0]);
+}
+
+void test_resized_region_keeps_newest_record(void)
+{
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE);
+    journal.begin();
+    appendMany(journal, 30);
+
+    PositionJournal smaller(eeprom, JOURNAL_START, JOURNAL_SIZE / 4);
+    PositionRecord newest;
+    TEST_ASSERT_TRUE(smaller.begin());
+    TEST_ASSERT_TRUE(smaller.getNewest(&newest));
+    TEST_ASSERT_EQUAL_INT32(29, newest.position[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, smaller.getHead());
+
+    // Records beyond the new region's first slot must not resurface
+    PositionJournal again(eeprom, JOURNAL_START, JOURNAL_SIZE / 4);
+    TEST_ASSERT_TRUE(again.begin());
+    TEST_ASSERT_FALSE(again.wasLastScanLinear());
+    TEST_ASSERT_TRUE(again.getNewest(&newest));
+    TEST_ASSERT_EQUAL_INT32(29, newest.position[0]);
+}
+
+void test_backend_change_is_reported(void)
+{
+    constexpr uint32_t BACKEND_FRAM = 1, BACKEND_FALLBACK = 0x100;
+    SimulatedEeprom eeprom;
+    PositionJournal journal(eeprom, JOURNAL_START, JOURNAL_SIZE, BACKEND_FRAM);
+    journal.begin();
+    appendMany(journal, 10);
+    TEST_ASSERT_FALSE(journal.wasBackendChanged());
+
+    // Opened from another backend the record is kept, but flagged once
+    PositionJournal fallback(eeprom, JOURNAL_START, JOURNAL_SIZE, BACKEND_FALLBACK);
+    PositionRecord newest;
+    TEST_ASSERT_TRUE(fallback.begin());
+    TEST_ASSERT_TRUE(fallback.wasBackendChanged());
+    TEST_ASSERT_TRUE(fallback.getNewest(&newest));
+    TEST_ASSERT_EQUAL_INT32(9, newest.position[0]);
+    TEST_ASSERT_TRUE(fallback.begin());
+    TEST_ASSERT_FALSE(fallback.wasBackendChanged());
+
+    PositionJournalHeader header;
+    TEST_ASSERT_TRUE(PositionJournal::readHeader(eeprom, JOURNAL_START, &header));
+    TEST_ASSERT_EQUAL_UINT32(BACKEND_FALLBACK, header.backend);
+
+    // A retired journal holds nothing
+    PositionJournal::retire(eeprom, JOURNAL_START);
+    TEST_ASSERT_FALSE(PositionJournal::readHeader(eeprom, JOURNAL_START, &header));
+    TEST_ASSERT_FALSE(fallback.begin());
+}
+
+void test_fram_backend_keeps_every_step(void)
+{
+    // On FRAM a checkpoint can go out for every step change
+    SimulatedFram fram;
+    TEST_ASSERT_TRUE(fram.isWearFree());
+    PositionJournal journal(fram, JOURNAL_START, JOURNAL_SIZE);
+    TEST_ASSERT_FALSE(journal.begin());
+    const uint32_t numSteps = 10 * journal.getNumSlots() + 3;
+    for (uint32_t step = 1; step <= numSteps; step++)
+    {
+        PositionRecord record = makeRecord(POSITION_FLAG_HOMED, step, 0, -(int32_t)step);
+        journal.append(record);
+    }
+    // Nothing but the header and the records themselves
+    TEST_ASSERT_EQUAL_UINT32(sizeof(PositionJournalHeader) + numSteps * PositionJournal::SLOT_SIZE, fram.bytesWritten);
+
+    PositionJournal rebooted(fram, JOURNAL_START, JOURNAL_SIZE);
+    PositionRecord newest;
+    TEST_ASSERT_TRUE(rebooted.begin());
+    TEST_ASSERT_TRUE(rebooted.getNewest(&newest));
+    TEST_ASSERT_FALSE(rebooted.wasLastScanLinear());
+    TEST_ASSERT_EQUAL_INT32((int32_t)numSteps, newest.position[0]);
+    TEST_ASSERT_EQUAL_INT32(-(int32_t)numSteps, newest.position[2]);
+}
+
+struct EnduranceResult
+{
+    double writeAmplification;
+    uint32_t maxSectorErases;
+    double lifetimeYears;
+};
+
+// Runs the benchmark load through a layout and projects how long the most
+// worn flash sector lasts at MOVES_PER_HOUR, around the clock.
+template <typename F>
+static EnduranceResult runEndurance(const char *label, SimulatedEeprom &eeprom, F commit)
+{
+    eeprom.resetCounters();
+    int32_t pos[3] = {0, 0, 0};
+    for (uint32_t move = 0; move < BENCHMARK_MOVES; move++)
+    {
+        commit(makeRecord(POSITION_FLAG_HOMED, pos[0], pos[1], pos[2]));
+        for (auto &p : pos)
+            p = (int32_t)(nextRandom() % 20000) - 10000;
+        commit(makeRecord(POSITION_FLAG_HOMED | POSITION_FLAG_STATIONARY, pos[0], pos[1], pos[2]));
+    }
+
+    EnduranceResult result;
+    result.writeAmplification = eeprom.getWriteAmplification();
+    result.maxSectorErases = eeprom.getMaxSectorErases();
+    double erasesPerMove = (double)result.maxSectorErases / BENCHMARK_MOVES;
+    double hours = (erasesPerMove > 0.0) ? TEENSY41_FLASH_ENDURANCE_CYCLES / (erasesPerMove * MOVES_PER_HOUR) : 1.0e9;
+    result.lifetimeYears = hours / (24.0 * 365.0);
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "%s: write amplification %.2f, worst sector %u erases, %.1f years at %.0f moves/hour",
+             label, result.writeAmplification, (unsigned)result.maxSectorErases, result.lifetimeYears, MOVES_PER_HOUR);
+    TEST_MESSAGE(msg);
+    return result;
+}
+
+void test_endurance_benchmark(void)
+{
+    // Original layout: three positions overwritten in place
+    SimulatedEeprom fixedEeprom;
+    EnduranceResult fixed = runEndurance("Fixed words", fixedEeprom, [&](PositionRecord record) {
+        fixedEeprom.put(0, record.position);
+    });
+
+    // Two alternating record slots
+    SimulatedEeprom slotEeprom;
+    uint32_t sequence = 0;
+    EnduranceResult twoSlot = runEndurance("Two slots", slotEeprom, [&](PositionRecord record) {
+        record.sequence = ++sequence;
+        record.seal();
+        slotEeprom.put((sequence & 1) ? 32 : 0, record);
+    });
+
+    SimulatedEeprom journalEeprom;
+    PositionJournal journal(journalEeprom, JOURNAL_START, JOURNAL_SIZE);
+    journal.begin();
+    EnduranceResult journaled = runEndurance("Journal", journalEeprom, [&](PositionRecord record) {
+        journal.append(record);
+    });
+
+    TEST_ASSERT_TRUE(journaled.maxSectorErases < twoSlot.maxSectorErases);
+    TEST_ASSERT_TRUE(journaled.lifetimeYears > fixed.lifetimeYears);
+    TEST_ASSERT_TRUE(journaled.lifetimeYears >= MIN_JOURNAL_LIFETIME_YEARS);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_blank_region_is_empty);
+    RUN_TEST(test_newest_record_found_after_wrapping);
+    RUN_TEST(test_fast_scan_is_logarithmic);
+    RUN_TEST(test_torn_write_falls_back_to_previous_record);
+    RUN_TEST(test_corrupt_first_slot_is_compacted);
+    RUN_TEST(test_resized_region_keeps_newest_record);
+    RUN_TEST(test_backend_change_is_reported);
+    RUN_TEST(test_fram_backend_keeps_every_step);
+    RUN_TEST(test_endurance_benchmark);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,304 @@
+#include <unity.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <simulated_step_generator.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t BASE_RATE_HZ = 200000;
+constexpr uint32_t TICK_US = 100; // Control tick
+constexpr uint32_t BASE_TICKS_PER_SEGMENT = BASE_RATE_HZ / (1000000 / TICK_US);
+constexpr uint64_t BASE_TICK_NS = 1000000000ULL / BASE_RATE_HZ;
+constexpr uint64_t DRV8825_MIN_PULSE_NS = 1900;
+constexpr uint64_t DRV8825_DIR_SETUP_NS = 650;
+
+// Keeps the queue topped up from a planned move, like the control tick does
+static void runMove(SimulatedStepGenerator &gen, CoordinatedMove &move)
+{
+    while (!move.isDone() || !gen.isIdle())
+    {
+        while (!move.isDone() && gen.getFreeSegments() > 0)
+        {
+            int32_t steps[3];
+            move.next(steps);
+            TEST_ASSERT_TRUE(gen.queueSegment(steps, TICK_US));
+        }
+        gen.advance(BASE_TICKS_PER_SEGMENT);
+    }
+}
+
+static void checkPulseTiming(const SimulatedStepGenerator &gen, uint8_t axis)
+{
+    const auto &pulses = gen.getPulses(axis);
+    for (size_t ii = 0; ii < pulses.size(); ii++)
+    {
+        TEST_ASSERT_TRUE(pulses[ii].fall_ns - pulses[ii].rise_ns >= DRV8825_MIN_PULSE_NS);
+        TEST_ASSERT_TRUE(pulses[ii].rise_ns - pulses[ii].dirSet_ns >= DRV8825_DIR_SETUP_NS);
+        if (ii > 0)
+            TEST_ASSERT_TRUE(pulses[ii].rise_ns - pulses[ii - 1].fall_ns >= DRV8825_MIN_PULSE_NS);
+    }
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_sustains_50khz_on_all_axes(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    TEST_ASSERT_TRUE(gen.getMaxStepRate() >= 50000);
+
+    // 5 steps per 100 us tick = 50 kHz, for 10 ms
+    const int32_t steps[3]{5, -5, 5};
+    constexpr uint32_t SEGMENTS = 100;
+    for (uint32_t seg = 0; seg < SEGMENTS; seg++)
+    {
+        if (gen.getFreeSegments() == 0)
+            gen.advance(BASE_TICKS_PER_SEGMENT);
+        TEST_ASSERT_TRUE(gen.queueSegment(steps, TICK_US));
+    }
+    while (!gen.isIdle())
+        gen.advance(1);
+
+    int32_t positions[3];
+    gen.getPositions(positions);
+    TEST_ASSERT_EQUAL_INT32(500, positions[0]);
+    TEST_ASSERT_EQUAL_INT32(-500, positions[1]);
+    TEST_ASSERT_EQUAL_INT32(500, positions[2]);
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        const auto &pulses = gen.getPulses(axis);
+        TEST_ASSERT_EQUAL_UINT32(500, pulses.size());
+        // Evenly spaced at exactly 20 us, including across segment boundaries
+        for (size_t ii = 1; ii < pulses.size(); ii++)
+            TEST_ASSERT_EQUAL_UINT32(20000, (uint32_t)(pulses[ii].rise_ns - pulses[ii - 1].rise_ns));
+        checkPulseTiming(gen, axis);
+    }
+}
+
+void test_axes_start_and_finish_segments_together(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t steps[3]{10, 3, 1};
+    gen.advance(5); // Arbitrary phase
+    TEST_ASSERT_TRUE(gen.queueSegment(steps, TICK_US));
+    gen.advance(1); // Direction setup tick
+    uint64_t start_ns = gen.getTime_ns();
+    gen.advance(BASE_TICKS_PER_SEGMENT);
+    uint64_t end_ns = gen.getTime_ns();
+
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        const auto &pulses = gen.getPulses(axis);
+        TEST_ASSERT_EQUAL_UINT32(std::abs(steps[axis]), pulses.size());
+        for (const auto &pulse : pulses)
+        {
+            TEST_ASSERT_TRUE(pulse.rise_ns >= start_ns);
+            TEST_ASSERT_TRUE(pulse.rise_ns < end_ns);
+        }
+        // Spacing within one base tick of ideal
+        uint64_t ideal_ns = TICK_US * 1000ULL / std::abs(steps[axis]);
+        for (size_t ii = 1; ii < pulses.size(); ii++)
+        {
+            int64_t spacing = pulses[ii].rise_ns - pulses[ii - 1].rise_ns;
+            TEST_ASSERT_TRUE(std::llabs(spacing - (int64_t)ideal_ns) <= (int64_t)BASE_TICK_NS);
+        }
+    }
+}
+
+void test_rejects_segments_above_max_rate(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t tooFast[3]{0, (int32_t)BASE_TICKS_PER_SEGMENT / 2 + 1, 0};
+    const int32_t maxRate[3]{0, -(int32_t)BASE_TICKS_PER_SEGMENT / 2, 0};
+    TEST_ASSERT_FALSE(gen.queueSegment(tooFast, TICK_US));
+    TEST_ASSERT_TRUE(gen.queueSegment(maxRate, TICK_US));
+    while (!gen.isIdle())
+        gen.advance(1);
+    TEST_ASSERT_EQUAL_UINT32(BASE_TICKS_PER_SEGMENT / 2, gen.getPulses(1).size());
+    checkPulseTiming(gen, 1);
+}
+
+void test_queue_full(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t steps[3]{1, 1, 1};
+    for (uint8_t ii = 0; ii < STEP_GEN_QUEUE_DEPTH; ii++)
+        TEST_ASSERT_TRUE(gen.queueSegment(steps, TICK_US));
+    TEST_ASSERT_EQUAL_UINT8(0, gen.getFreeSegments());
+    TEST_ASSERT_FALSE(gen.queueSegment(steps, TICK_US));
+}
+
+void test_direction_reversal_meets_setup_time(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t forward[3]{10, 10, 10};
+    const int32_t reverse[3]{-10, -10, -10};
+    for (uint8_t ii = 0; ii < 6; ii++)
+    {
+        if (gen.getFreeSegments() == 0)
+            gen.advance(BASE_TICKS_PER_SEGMENT);
+        TEST_ASSERT_TRUE(gen.queueSegment((ii / 2) % 2 ? reverse : forward, TICK_US));
+    }
+    while (!gen.isIdle())
+        gen.advance(1);
+    int32_t positions[3];
+    gen.getPositions(positions);
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        TEST_ASSERT_EQUAL_INT32(20, positions[axis]);
+        checkPulseTiming(gen, axis);
+        const auto &pulses = gen.getPulses(axis);
+        TEST_ASSERT_TRUE(pulses[0].positive);
+        TEST_ASSERT_FALSE(pulses[20].positive);
+        TEST_ASSERT_TRUE(pulses[40].positive);
+    }
+}
+
+void test_coordinated_move_arrives_together(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t from[3]{0, 100, -50};
+    const int32_t to[3]{12345, -4000, 777};
+    CoordinatedMove move;
+    move.start(from, to, 60000.0, 6e6, TICK_US);
+    gen.setPositions(from);
+    runMove(gen, move);
+
+    int32_t positions[3];
+    gen.getPositions(positions);
+    uint64_t last_ns = gen.getPulses(0).back().rise_ns;
+    double duration_s = move.getTotalTicks() * TICK_US * 1e-6;
+    for (uint8_t axis = 0; axis < 3; axis++)
+    {
+        uint32_t distance = std::abs(to[axis] - from[axis]);
+        TEST_ASSERT_EQUAL_INT32(to[axis], positions[axis]);
+        TEST_ASSERT_EQUAL_UINT32(distance, gen.getPulses(axis).size());
+        checkPulseTiming(gen, axis);
+        // Every axis takes its last step within the time its last step takes as it
+        // decelerates to rest (plus a tick of rounding): they arrive together.
+        double interval_ns = std::sqrt(2.0 / (6e6 * distance / 12345)) * 1e9;
+        double lag_ns = std::fabs((double)gen.getPulses(axis).back().rise_ns - (double)last_ns);
+        TEST_ASSERT_TRUE(lag_ns <= interval_ns + TICK_US * 1000.0);
+    }
+    // Longest axis cruised at the commanded speed between the two 10 ms ramps,
+    // less the rounding up to whole ticks
+    TEST_ASSERT_DOUBLE_WITHIN(TICK_US * 1e-6, 12345 / 60000.0 + 60000.0 / 6e6, duration_s);
+}
+
+void test_coordinated_move_ramps(void)
+{
+    const int32_t from[3]{0, 0, 0};
+    const int32_t to[3]{20000, -5000, 0};
+    constexpr double SPEED = 40000.0;
+    constexpr double ACCEL = 2e6;
+    CoordinatedMove move;
+    move.start(from, to, SPEED, ACCEL, TICK_US);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)std::ceil((20000 / SPEED + SPEED / ACCEL) / (TICK_US * 1e-6)),
+                             move.getTotalTicks());
+
+    // Starts and ends at rest, the steps per tick change by no more than the
+    // acceleration allows plus rounding, and never exceed maxSpeed plus rounding
+    int32_t steps[3], lastSteps = 0, maxSteps = 0;
+    move.next(steps);
+    TEST_ASSERT_TRUE(steps[0] <= 1);
+    while (!move.isDone())
+    {
+        lastSteps = steps[0];
+        move.next(steps);
+        TEST_ASSERT_TRUE(std::abs(steps[0] - lastSteps) <= (int32_t)std::ceil(ACCEL * TICK_US * TICK_US * 1e-12) + 1);
+        maxSteps = std::max(maxSteps, steps[0]);
+    }
+    TEST_ASSERT_TRUE(steps[0] <= 1);
+    TEST_ASSERT_EQUAL_INT32((int32_t)std::ceil(SPEED * TICK_US * 1e-6), maxSteps);
+    TEST_ASSERT_EQUAL_INT32(20000, move.getPosition(0));
+    TEST_ASSERT_EQUAL_INT32(-5000, move.getPosition(1));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, move.getVelocity(0));
+}
+
+void test_short_move_is_a_triangle(void)
+{
+    const int32_t from[3]{0, 0, 0};
+    const int32_t to[3]{0, 0, -100};
+    CoordinatedMove move;
+    // Would need 2 * 400 steps to reach 40000 steps/s
+    move.start(from, to, 40000.0, 2e6, TICK_US);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)std::ceil(2.0 * std::sqrt(100 / 2e6) / (TICK_US * 1e-6)), move.getTotalTicks());
+    int32_t steps[3];
+    double peak = 0.0;
+    while (!move.isDone())
+    {
+        move.next(steps);
+        peak = std::max(peak, std::fabs(move.getVelocity(2)));
+    }
+    TEST_ASSERT_TRUE(peak <= std::sqrt(100 * 2e6));
+    TEST_ASSERT_EQUAL_INT32(-100, move.getPosition(2));
+}
+
+void test_max_planned_speed_fits_generator(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t from[3]{0, 0, 0};
+    const int32_t to[3]{99999, 33333, -77777};
+    CoordinatedMove move;
+    move.start(from, to, maxPlannedSpeed(gen.getMaxStepRate(), TICK_US), 1e8, TICK_US);
+    gen.setPositions(from);
+    runMove(gen, move); // Asserts every segment is accepted
+    int32_t positions[3];
+    gen.getPositions(positions);
+    TEST_ASSERT_EQUAL_INT32(-77777, positions[2]);
+}
+
+void test_stop_drops_queued_segments(void)
+{
+    SimulatedStepGenerator gen(BASE_RATE_HZ);
+    const int32_t steps[3]{4, 4, 4};
+    for (uint8_t ii = 0; ii < STEP_GEN_QUEUE_DEPTH; ii++)
+        gen.queueSegment(steps, TICK_US);
+    gen.advance(1 + BASE_TICKS_PER_SEGMENT / 2);
+    gen.stop();
+    gen.advance(2 * BASE_TICKS_PER_SEGMENT);
+    TEST_ASSERT_TRUE(gen.isIdle());
+    int32_t positions[3];
+    gen.getPositions(positions);
+    TEST_ASSERT_EQUAL_INT32((int32_t)gen.getPulses(0).size(), positions[0]);
+    TEST_ASSERT_TRUE(positions[0] < 4);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sustains_50khz_on_all_axes);
+    RUN_TEST(test_axes_start_and_finish_segments_together);
+    RUN_TEST(test_rejects_segments_above_max_rate);
+    RUN_TEST(test_queue_full);
+    RUN_TEST(test_direction_reversal_meets_setup_time);
+    RUN_TEST(test_coordinated_move_arrives_together);
+    RUN_TEST(test_coordinated_move_ramps);
+    RUN_TEST(test_short_move_is_a_triangle);
+    RUN_TEST(test_max_planned_speed_fits_generator);
+    RUN_TEST(test_stop_drops_queued_segments);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,372 @@
+#include <unity.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <stepper_core.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <AccelStepper.h>
+#include <MultiStepper.h>
+#else
+#include <chrono>
+#endif
+
+constexpr uint32_t TICK_US = 100;
+constexpr double MAX_SPEED = 2400.0; // Firmware defaults
+constexpr double MAX_ACCEL = 2000.0;
+
+// Speed budgets for one control tick that steps every axis
+#ifdef ARDUINO
+constexpr uint32_t STEPPER_CORE_MAX_CYCLES_PER_TICK = 200;
+#else
+constexpr double STEPPER_CORE_MAX_NS_PER_TICK = 50.0;
+#endif
+constexpr uint32_t NUM_BENCHMARK_CALLS = 100000;
+
+// Records what the core drives onto the pins
+struct RecordingPins
+{
+    static uint8_t dirBits;
+    static uint8_t stepBits;
+    static uint32_t stepCalls;
+    static void setDirections(uint8_t bits) { dirBits = bits; }
+    static void step(uint8_t bits)
+    {
+        stepBits = bits;
+        stepCalls++;
+    }
+    static void reset()
+    {
+        dirBits = stepBits = 0;
+        stepCalls = 0;
+    }
+};
+uint8_t RecordingPins::dirBits;
+uint8_t RecordingPins::stepBits;
+uint32_t RecordingPins::stepCalls;
+
+struct NullPins
+{
+    static void setDirections(uint8_t) {}
+    static void step(uint8_t) {}
+};
+
+static RampTable defaultRamp()
+{
+    RampTable ramp;
+    ramp.build(MAX_SPEED, MAX_ACCEL, TICK_US);
+    return ramp;
+}
+
+// Runs a move to the end, checking no axis ever takes more than one step per
+// tick or strays from the straight line. Returns the ticks it took.
+static uint32_t runMove(StepperCore<RecordingPins> &core, const int32_t *to)
+{
+    int32_t from[STEPPER_CORE_AXES];
+    uint32_t longest = 0;
+    for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+    {
+        from[ii] = core.getPosition(ii);
+        longest = std::max(longest, (uint32_t)std::abs(to[ii] - from[ii]));
+    }
+    core.moveTo(to);
+    uint32_t ticks = 0;
+    uint32_t leadSteps = 0;
+    bool running = core.isMoving();
+    while (running)
+    {
+        int32_t before[STEPPER_CORE_AXES];
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+            before[ii] = core.getPosition(ii);
+        uint32_t calls = RecordingPins::stepCalls;
+        running = core.run();
+        ticks++;
+        TEST_ASSERT_TRUE(ticks < 10000000);
+        if (RecordingPins::stepCalls == calls)
+            continue;
+        leadSteps++;
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        {
+            int32_t moved = core.getPosition(ii) - before[ii];
+            TEST_ASSERT_TRUE(std::abs(moved) <= 1);
+            TEST_ASSERT_EQUAL((RecordingPins::stepBits >> ii) & 1, moved != 0);
+            double ideal = from[ii] + (double)(to[ii] - from[ii]) * leadSteps / longest;
+            TEST_ASSERT_TRUE(std::fabs(core.getPosition(ii) - ideal) <= 1.0);
+        }
+    }
+    return ticks;
+}
+
+void setUp(void)
+{
+    RecordingPins::reset();
+}
+
+void tearDown(void)
+{
+}
+
+void test_ramp_table_reaches_cruise(void)
+{
+    RampTable ramp = defaultRamp();
+    uint32_t cruise = ramp.getCruiseInterval();
+    TEST_ASSERT_EQUAL_UINT32(1067, cruise); // 256 * 10000 ticks/s / 2400 steps/s
+
+    // The whole ramp (1440 steps) fits in the table
+    TEST_ASSERT_TRUE(((uint32_t)RAMP_TABLE_SIZE << ramp.getStrideShift()) >= 1440);
+    TEST_ASSERT_TRUE(((uint32_t)RAMP_TABLE_SIZE << ramp.getStrideShift()) < 2 * 1440);
+
+    // Speeds up monotonically, reaching cruise at the end of the ramp
+    uint32_t last = UINT32_MAX;
+    double elapsed_s = 0.0;
+    uint32_t rampEnd = 0;
+    for (uint32_t step = 0; step < 4000; step++)
+    {
+        uint32_t interval = ramp.lookup(step);
+        TEST_ASSERT_TRUE(interval <= last);
+        TEST_ASSERT_TRUE(interval >= cruise);
+        if (interval > cruise)
+        {
+            elapsed_s += interval * TICK_US * 1e-6 / RAMP_ONE_TICK;
+            rampEnd = step + 1;
+        }
+        last = interval;
+    }
+    TEST_ASSERT_UINT32_WITHIN(1u << ramp.getStrideShift(), 1440, rampEnd);
+    TEST_ASSERT_DOUBLE_WITHIN(0.02, MAX_SPEED / MAX_ACCEL, elapsed_s);
+
+    // Never faster than one step per tick
+    RampTable fast;
+    fast.build(1e6, 1e9, TICK_US);
+    TEST_ASSERT_EQUAL_UINT32(RAMP_ONE_TICK, fast.getCruiseInterval());
+    TEST_ASSERT_EQUAL_UINT32(RAMP_ONE_TICK, fast.lookup(0));
+}
+
+void test_axes_arrive_together(void)
+{
+    StepperCore<RecordingPins> core;
+    core.setRamp(defaultRamp());
+    const int32_t targets[][STEPPER_CORE_AXES]{{1000, -300, 17}, {1000, 1000, 1000}, {-5, 2000, 1999}, {0, 0, 0}};
+    for (auto &to : targets)
+    {
+        runMove(core, to);
+        TEST_ASSERT_FALSE(core.isMoving());
+        for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        {
+            TEST_ASSERT_EQUAL_INT32(to[ii], core.getPosition(ii));
+            TEST_ASSERT_EQUAL_INT32(to[ii], core.getTarget(ii));
+        }
+    }
+    // Back to zero from the last one: A up, B and C down
+    TEST_ASSERT_EQUAL_UINT8(0x1, RecordingPins::dirBits);
+
+    // A move to where it already is doesn't step
+    uint32_t calls = RecordingPins::stepCalls;
+    const int32_t here[STEPPER_CORE_AXES]{0, 0, 0};
+    core.moveTo(here);
+    TEST_ASSERT_FALSE(core.run());
+    TEST_ASSERT_EQUAL_UINT32(calls, RecordingPins::stepCalls);
+}
+
+void test_move_follows_trapezoid(void)
+{
+    StepperCore<RecordingPins> core;
+    core.setRamp(defaultRamp());
+    double rampTime_s = MAX_SPEED / MAX_ACCEL;
+    double rampSteps = MAX_SPEED * rampTime_s / 2;
+
+    // Long move: ramp up, cruise, ramp down
+    const int32_t longMove[STEPPER_CORE_AXES]{5000, 2500, -1000};
+    double expected_s = 2 * rampTime_s + (5000 - 2 * rampSteps) / MAX_SPEED;
+    double taken_s = runMove(core, longMove) * TICK_US * 1e-6;
+    TEST_ASSERT_DOUBLE_WITHIN(0.01 * expected_s, expected_s, taken_s);
+
+    // Too short to reach full speed, so a triangle
+    const int32_t shortMove[STEPPER_CORE_AXES]{5400, 2700, -1000};
+    expected_s = 2 * std::sqrt(400 / MAX_ACCEL);
+    taken_s = runMove(core, shortMove) * TICK_US * 1e-6;
+    TEST_ASSERT_DOUBLE_WITHIN(0.03 * expected_s, expected_s, taken_s);
+}
+
+void test_stop_and_velocity(void)
+{
+    StepperCore<RecordingPins> core;
+    core.setRamp(defaultRamp());
+    const int32_t to[STEPPER_CORE_AXES]{-4000, 2000, 0};
+    core.moveTo(to);
+    TEST_ASSERT_EQUAL_UINT8(0x2, RecordingPins::dirBits & 0x3);
+    for (uint32_t ii = 0; ii < 20000 && core.getPosition(0) > -2000; ii++)
+        core.run();
+
+    // Cruising: full speed on the long axis, half on the other, none on the idle one
+    TEST_ASSERT_DOUBLE_WITHIN(5.0, -MAX_SPEED, core.getVelocity(0, TICK_US));
+    TEST_ASSERT_DOUBLE_WITHIN(5.0, MAX_SPEED / 2, core.getVelocity(1, TICK_US));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, core.getVelocity(2, TICK_US));
+
+    int32_t stoppedAt = core.getPosition(0);
+    core.stop();
+    TEST_ASSERT_FALSE(core.run());
+    TEST_ASSERT_EQUAL_INT32(stoppedAt, core.getPosition(0));
+    TEST_ASSERT_EQUAL_INT32(stoppedAt, core.getTarget(0));
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, core.getVelocity(0, TICK_US));
+}
+
+void test_step_toward_follows_and_reverses(void)
+{
+    StepperCore<RecordingPins> core;
+    core.setRamp(defaultRamp());
+    const int32_t to[STEPPER_CORE_AXES]{100, 50, 0};
+    core.moveTo(to);
+    for (uint8_t ii = 0; ii < 200; ii++)
+        core.run();
+
+    // Taking over mid-move ends it. Axis A carries on, B has to reverse first.
+    const int32_t follow[STEPPER_CORE_AXES]{core.getPosition(0) + 3, core.getPosition(1) - 2, 0};
+    uint8_t dirsBefore = RecordingPins::dirBits;
+    core.stepToward(follow);
+    TEST_ASSERT_FALSE(core.isMoving());
+    TEST_ASSERT_EQUAL_UINT8(0x1, core.getStepBits());
+    TEST_ASSERT_EQUAL_UINT8(dirsBefore & ~0x2, RecordingPins::dirBits);
+
+    // One step per tick from then on, until every axis is there
+    for (uint8_t tick = 0; tick < 2; tick++)
+    {
+        uint32_t calls = RecordingPins::stepCalls;
+        core.stepToward(follow);
+        TEST_ASSERT_EQUAL_UINT32(calls + 1, RecordingPins::stepCalls);
+        TEST_ASSERT_EQUAL_UINT8(0x3, core.getStepBits());
+    }
+    TEST_ASSERT_EQUAL_INT32(follow[0], core.getPosition(0));
+    TEST_ASSERT_EQUAL_INT32(follow[1], core.getPosition(1));
+    uint32_t calls = RecordingPins::stepCalls;
+    core.stepToward(follow);
+    TEST_ASSERT_EQUAL_UINT32(calls, RecordingPins::stepCalls);
+    TEST_ASSERT_EQUAL_UINT8(0, core.getStepBits());
+}
+
+template <typename F>
+static double measureCostPerCall(F func)
+{
+#ifdef ARDUINO
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    uint32_t start = ARM_DWT_CYCCNT;
+    for (uint32_t ii = 0; ii < NUM_BENCHMARK_CALLS; ii++)
+        func();
+    return (double)(ARM_DWT_CYCCNT - start) / NUM_BENCHMARK_CALLS;
+#else
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t ii = 0; ii < NUM_BENCHMARK_CALLS; ii++)
+        func();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / NUM_BENCHMARK_CALLS;
+#endif
+}
+
+// Worst case tick: all three axes step on every call
+static double measureCoreTick()
+{
+    static StepperCore<NullPins> core;
+    RampTable ramp;
+    ramp.build(1e6, 1e9, TICK_US);
+    core.setRamp(ramp);
+    const int32_t to[STEPPER_CORE_AXES]{1000000000, -700000000, 300000000};
+    // Each benchmark starts its own run from zero
+    for (uint8_t ii = 0; ii < STEPPER_CORE_AXES; ii++)
+        core.setPosition(ii, 0);
+    core.moveTo(to);
+    volatile bool sink = false;
+    double cost = measureCostPerCall([&]() { sink = core.run(); });
+    TEST_ASSERT_TRUE(sink);
+    TEST_ASSERT_EQUAL_INT32((int32_t)NUM_BENCHMARK_CALLS, core.getPosition(0));
+    return cost;
+}
+
+void test_benchmark_tick(void)
+{
+    double cost = measureCoreTick();
+    char msg[120];
+#ifdef ARDUINO
+    // The core takes at most one step per axis per control tick, so the step rate is bounded by
+    // the tick period; what matters is how much of the tick it uses
+    snprintf(msg, sizeof(msg), "StepperCore tick: %.1f cycles, %.2f%% of the %lu us tick, %.0f kHz max step rate",
+             cost, 100.0 * cost / (F_CPU_ACTUAL * 1e-6 * TICK_US), (unsigned long)TICK_US, 1e3 / TICK_US);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE_MESSAGE(cost <= STEPPER_CORE_MAX_CYCLES_PER_TICK, msg);
+#else
+    snprintf(msg, sizeof(msg), "StepperCore tick: %.1f ns, %.3f%% of the %lu us tick, %.0f kHz max step rate", cost,
+             100.0 * cost / (TICK_US * 1e3), (unsigned long)TICK_US, 1e3 / TICK_US);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE_MESSAGE(cost <= STEPPER_CORE_MAX_NS_PER_TICK, msg);
+#endif
+}
+
+#ifdef ARDUINO
+// AccelStepper with step functions instead of pins, so nothing is driven
+static void noStep() {}
+#endif
+
+void test_benchmark_against_accelstepper(void)
+{
+#ifdef ARDUINO
+    AccelStepper stepperA(noStep, noStep), stepperB(noStep, noStep), stepperC(noStep, noStep);
+    AccelStepper *axes[]{&stepperA, &stepperB, &stepperC};
+    MultiStepper multi;
+    for (auto stepper : axes)
+    {
+        stepper->setMaxSpeed(1e6);
+        stepper->setAcceleration(1e9);
+        multi.addStepper(*stepper);
+    }
+    long targets[]{1000000000, -700000000, 300000000};
+
+    // What the control tick did for a coordinated move: MultiStepper::run()
+    multi.moveTo(targets);
+    double multiCycles = measureCostPerCall([&]() { multi.run(); });
+    // With acceleration, AccelStepper::run() on every axis
+    for (uint8_t ii = 0; ii < 3; ii++)
+        axes[ii]->moveTo(targets[ii]);
+    double accelCycles = measureCostPerCall([&]() {
+        for (auto stepper : axes)
+            stepper->run();
+    });
+    double coreCycles = measureCoreTick();
+
+    char msg[160];
+    snprintf(msg, sizeof(msg), "Per tick: MultiStepper %.1f, AccelStepper run() x3 %.1f, StepperCore %.1f cycles",
+             multiCycles, accelCycles, coreCycles);
+    TEST_MESSAGE(msg);
+    TEST_ASSERT_TRUE_MESSAGE(coreCycles < multiCycles && coreCycles < accelCycles, msg);
+#else
+    TEST_IGNORE_MESSAGE("AccelStepper only builds for the target");
+#endif
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_ramp_table_reaches_cruise);
+    RUN_TEST(test_axes_arrive_together);
+    RUN_TEST(test_move_follows_trapezoid);
+    RUN_TEST(test_stop_and_velocity);
+    RUN_TEST(test_step_toward_follows_and_reverses);
+    RUN_TEST(test_benchmark_tick);
+    RUN_TEST(test_benchmark_against_accelstepper);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,183 @@
+#include <unity.h>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <trace_recorder.h>
+#include <base64.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr uint32_t CAPACITY = 16;
+
+static TraceRecord makeRecord(uint32_t tick)
+{
+    TraceRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.tick = tick;
+    for (uint8_t ii = 0; ii < 3; ii++)
+    {
+        rec.position[ii] = (int32_t)tick * (ii + 1);
+        rec.target[ii] = -(int32_t)tick;
+        rec.speed[ii] = (int16_t)(100 * ii);
+    }
+    rec.isrDuration_us = 7;
+    rec.moveState = 2;
+    return rec;
+}
+
+static std::vector<uint8_t> readAll(TraceRecorder<CAPACITY> &trace, uint16_t period_us)
+{
+    std::vector<uint8_t> dump(trace.beginDump(period_us));
+    TEST_ASSERT_EQUAL_UINT32(dump.size(), trace.readDump(0, dump.data(), dump.size()));
+    return dump;
+}
+
+static TraceRecord recordAt(const std::vector<uint8_t> &dump, uint32_t index)
+{
+    TraceRecord rec;
+    memcpy(&rec, dump.data() + sizeof(TraceHeader) + index * sizeof(TraceRecord), sizeof(rec));
+    return rec;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_idle_recorder_ignores_records(void)
+{
+    TraceRecorder<CAPACITY> trace;
+    trace.record(makeRecord(1));
+    TEST_ASSERT_EQUAL_UINT32(0, trace.getCount());
+    TEST_ASSERT_FALSE(trace.trigger(TRACE_TRIGGER_COMMAND));
+}
+
+void test_armed_buffer_keeps_newest_records_in_order(void)
+{
+    TraceRecorder<CAPACITY> trace;
+    trace.arm(TRACE_TRIGGER_ALL, 4);
+    for (uint32_t tick = 0; tick < 3 * CAPACITY + 5; tick++)
+        trace.record(makeRecord(tick));
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY, trace.getCount());
+    trace.freeze();
+
+    std::vector<uint8_t> dump = readAll(trace, 100);
+    TraceHeader header;
+    memcpy(&header, dump.data(), sizeof(header));
+    TEST_ASSERT_EQUAL_HEX32(TRACE_MAGIC, header.magic);
+    TEST_ASSERT_EQUAL_UINT32(CAPACITY, header.numRecords);
+    TEST_ASSERT_EQUAL_HEX32(TRACE_NO_TRIGGER, header.triggerIndex);
+    for (uint32_t ii = 0; ii < CAPACITY; ii++)
+        TEST_ASSERT_EQUAL_UINT32(2 * CAPACITY + 5 + ii, recordAt(dump, ii).tick);
+}
+
+void test_trigger_freezes_after_post_trigger_records(void)
+{
+    TraceRecorder<CAPACITY> trace;
+    trace.arm(TRACE_TRIGGER_LIMIT_SWITCH, 5);
+    for (uint32_t tick = 0; tick < 40; tick++)
+    {
+        if (tick == 30)
+        {
+            TEST_ASSERT_FALSE(trace.trigger(TRACE_TRIGGER_MOVE_INTERRUPTED)); // Not in the mask
+            TEST_ASSERT_TRUE(trace.trigger(TRACE_TRIGGER_LIMIT_SWITCH));
+            TEST_ASSERT_FALSE(trace.trigger(TRACE_TRIGGER_LIMIT_SWITCH)); // Already triggered
+        }
+        trace.record(makeRecord(tick));
+    }
+    TEST_ASSERT_EQUAL_INT(TRACE_FROZEN, trace.getState());
+
+    std::vector<uint8_t> dump = readAll(trace, 100);
+    TraceHeader header;
+    memcpy(&header, dump.data(), sizeof(header));
+    TEST_ASSERT_EQUAL_UINT8(TRACE_TRIGGER_LIMIT_SWITCH, header.triggerSource);
+    // Ticks 30-34 came after the trigger, so the buffer ends at 34
+    TEST_ASSERT_EQUAL_UINT32(34, recordAt(dump, CAPACITY - 1).tick);
+    TEST_ASSERT_EQUAL_UINT32(30, recordAt(dump, header.triggerIndex).tick);
+}
+
+void test_chunked_reads_match_single_read(void)
+{
+    TraceRecorder<CAPACITY> trace;
+    trace.arm(TRACE_TRIGGER_COMMAND, 3);
+    for (uint32_t tick = 0; tick < 21; tick++)
+        trace.record(makeRecord(tick));
+    trace.freeze();
+    std::vector<uint8_t> whole = readAll(trace, 250);
+
+    // Chunk size that splits both the header and records
+    std::vector<uint8_t> chunked;
+    uint8_t buf[29];
+    uint32_t offset = 0, len;
+    while ((len = trace.readDump(offset, buf, sizeof(buf))) > 0)
+    {
+        chunked.insert(chunked.end(), buf, buf + len);
+        offset += len;
+    }
+    TEST_ASSERT_EQUAL_UINT32(whole.size(), chunked.size());
+    TEST_ASSERT_EQUAL_MEMORY(whole.data(), chunked.data(), whole.size());
+
+    TraceHeader header;
+    memcpy(&header, whole.data(), sizeof(header));
+    TEST_ASSERT_EQUAL_UINT16(250, header.tickPeriod_us);
+    TEST_ASSERT_EQUAL_HEX32(crc32(whole.data() + sizeof(TraceHeader), whole.size() - sizeof(TraceHeader)), header.crc);
+}
+
+void test_rearm_discards_capture(void)
+{
+    TraceRecorder<CAPACITY> trace;
+    trace.arm(TRACE_TRIGGER_COMMAND, 0);
+    trace.record(makeRecord(1));
+    TEST_ASSERT_TRUE(trace.trigger(TRACE_TRIGGER_COMMAND));
+    TEST_ASSERT_EQUAL_INT(TRACE_FROZEN, trace.getState());
+    trace.record(makeRecord(2));
+    TEST_ASSERT_EQUAL_UINT32(1, trace.getCount());
+
+    trace.arm(TRACE_TRIGGER_COMMAND, 0);
+    TEST_ASSERT_EQUAL_UINT32(0, trace.getCount());
+    TEST_ASSERT_TRUE(trace.isRecording());
+}
+
+void test_base64_rfc4648_vectors(void)
+{
+    const char *inputs[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+    const char *expected[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+    char out[16];
+    for (uint8_t ii = 0; ii < 7; ii++)
+    {
+        size_t len = strlen(inputs[ii]);
+        TEST_ASSERT_EQUAL_UINT32(base64EncodedLength(len), base64Encode((const uint8_t *)inputs[ii], len, out));
+        TEST_ASSERT_EQUAL_STRING(expected[ii], out);
+    }
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_idle_recorder_ignores_records);
+    RUN_TEST(test_armed_buffer_keeps_newest_records_in_order);
+    RUN_TEST(test_trigger_freezes_after_post_trigger_records);
+    RUN_TEST(test_chunked_reads_match_single_read);
+    RUN_TEST(test_rearm_discards_capture);
+    RUN_TEST(test_base64_rfc4648_vectors);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif
@@ -0,0 +1,162 @@
+#include <unity.h>
+#include <cstdint>
+#include <cmath>
+#include <track_follower.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+constexpr double TICK_S = 100e-6;
+constexpr double MAX_SPEED = 2400.0;
+constexpr double MAX_ACCEL = 2000.0;
+// A whole step of quantization, plus the deadband before the correction kicks in
+constexpr double MAX_TRACKING_ERROR = 1.0 + TRACK_DEADBAND_STEPS;
+
+// Steps like the control tick's velocity drive (runAxisVelocities()): the fraction of a step not
+// taken yet carries over, at most one step per tick, and a reversal waits a tick for the DIR pin
+struct SimulatedAxis
+{
+    long position = 0;
+    double remainder = 0.0;
+    int direction = 0;
+
+    void run(double velocity, double dt)
+    {
+        remainder += velocity * dt;
+        int want = (remainder >= 0.5) ? 1 : (remainder <= -0.5) ? -1 : 0;
+        if (want != 0 && want == direction)
+        {
+            position += want;
+            remainder -= want;
+        }
+        else if (want != 0)
+            direction = want;
+        remainder = std::min(std::max(remainder, -1.0), 1.0);
+    }
+};
+
+// Runs the follower against a demand ramping at rate steps/s, returns the worst error after settle_s
+static double runRamp(TrackFollower &follower, SimulatedAxis &axis, double *demand, double *now_s,
+                      double rate, double duration_s, double settle_s)
+{
+    double worstError = 0.0;
+    double start_s = *now_s;
+    uint32_t ticks = (uint32_t)(duration_s / TICK_S);
+    for (uint32_t tick = 0; tick < ticks; tick++)
+    {
+        *now_s += TICK_S;
+        *demand += rate * TICK_S;
+        double prevVelocity = follower.getVelocity();
+        double velocity = follower.update(*demand, axis.position, TICK_S, MAX_SPEED, MAX_ACCEL);
+        TEST_ASSERT_TRUE(std::fabs(velocity - prevVelocity) <= MAX_ACCEL * TICK_S + 1e-9);
+        axis.run(velocity, TICK_S);
+        if (*now_s - start_s > settle_s)
+            worstError = std::max(worstError, std::fabs(*demand - axis.position));
+    }
+    return worstError;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+void test_follows_slow_rate_within_a_step(void)
+{
+    TrackFollower follower;
+    SimulatedAxis axis;
+    double demand = 0.0, now_s = 0.0;
+    follower.reset(demand);
+    // A fraction of a step per tick
+    double worstError = runRamp(follower, axis, &demand, &now_s, 37.3, 20.0, 1.0);
+    TEST_ASSERT_TRUE(worstError <= MAX_TRACKING_ERROR);
+    TEST_ASSERT_DOUBLE_WITHIN(1.0, 37.3 * 20.0, axis.position);
+}
+
+void test_rate_change_blends_without_stopping(void)
+{
+    TrackFollower follower;
+    SimulatedAxis axis;
+    double demand = 0.0, now_s = 0.0;
+    follower.reset(demand);
+    runRamp(follower, axis, &demand, &now_s, 200.0, 2.0, 0.0);
+
+    double minVelocity = follower.getVelocity();
+    uint32_t ticks = (uint32_t)(2.0 / TICK_S);
+    for (uint32_t tick = 0; tick < ticks; tick++)
+    {
+        now_s += TICK_S;
+        demand += 50.0 * TICK_S;
+        double velocity = follower.update(demand, axis.position, TICK_S, MAX_SPEED, MAX_ACCEL);
+        axis.run(velocity, TICK_S);
+        minVelocity = std::min(minVelocity, velocity);
+    }
+    TEST_ASSERT_TRUE(minVelocity > 0.0);
+    // Feedforward plus the correction for up to a step or so of error
+    TEST_ASSERT_DOUBLE_WITHIN(2 * TRACK_POSITION_GAIN, 50.0, follower.getVelocity());
+    TEST_ASSERT_TRUE(runRamp(follower, axis, &demand, &now_s, 50.0, 2.0, 1.0) <= MAX_TRACKING_ERROR);
+}
+
+void test_holds_fractional_demand_without_dithering(void)
+{
+    TrackFollower follower;
+    SimulatedAxis axis;
+    double demand = 0.0, now_s = 0.0;
+    follower.reset(demand);
+    runRamp(follower, axis, &demand, &now_s, 100.0, 0.1234, 0.0);
+    runRamp(follower, axis, &demand, &now_s, 0.0, 2.0, 0.0);
+    long settled = axis.position;
+    TEST_ASSERT_TRUE(runRamp(follower, axis, &demand, &now_s, 0.0, 5.0, 0.0) < TRACK_DEADBAND_STEPS);
+    TEST_ASSERT_EQUAL_INT32(settled, axis.position);
+    TEST_ASSERT_EQUAL_DOUBLE(0.0, follower.getVelocity());
+}
+
+void test_stop_ramps_at_accel_limit(void)
+{
+    TrackFollower follower;
+    SimulatedAxis axis;
+    double demand = 0.0, now_s = 0.0;
+    follower.reset(demand);
+    runRamp(follower, axis, &demand, &now_s, -500.0, 1.0, 0.0);
+    double startVelocity = follower.getVelocity();
+    TEST_ASSERT_DOUBLE_WITHIN(50.0, -500.0, startVelocity);
+
+    uint32_t ticks = 0;
+    while (follower.getVelocity() != 0.0)
+    {
+        double prevVelocity = follower.getVelocity();
+        follower.stop(TICK_S, MAX_ACCEL);
+        TEST_ASSERT_TRUE(std::fabs(follower.getVelocity() - prevVelocity) <= MAX_ACCEL * TICK_S + 1e-9);
+        TEST_ASSERT_TRUE(follower.getVelocity() <= 0.0);
+        ticks++;
+    }
+    TEST_ASSERT_TRUE(ticks * TICK_S <= std::fabs(startVelocity) / MAX_ACCEL + TICK_S);
+}
+
+int runUnityTests(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_follows_slow_rate_within_a_step);
+    RUN_TEST(test_rate_change_blends_without_stopping);
+    RUN_TEST(test_holds_fractional_demand_without_dithering);
+    RUN_TEST(test_stop_ramps_at_accel_limit);
+    return UNITY_END();
+}
+
+#ifdef ARDUINO
+void setup()
+{
+    delay(2000); // Give the serial monitor time to connect
+    runUnityTests();
+}
+void loop() {}
+#else
+int main(int argc, char **argv)
+{
+    return runUnityTests();
+}
+#endif